@@ -0,0 +1,103 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    Per-extent Bloom filters stored inside DataSeries files
+*/
+
+#ifndef DATASERIES_BLOOMFILTER_HPP
+#define DATASERIES_BLOOMFILTER_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <DataSeries/ExtentSeries.hpp>
+#include <DataSeries/GeneralField.hpp>
+
+class DataSeriesSource;
+
+namespace dataseries {
+    /** \brief Set membership with false positives over the values of one field in one extent.
+
+        Values are hashed through a canonical key so that the same number finds the same bits
+        whatever the type of the field or of the value it is looked up with: integral values of
+        any numeric type are keyed as int64, other doubles by their bits, and variable32 and
+        fixedwidth values by their bytes.  Null values are not added, and can't be looked up. */
+    class BloomFilter {
+      public:
+        BloomFilter() : nhashes(0), nvalues(0) { }
+
+        /** An empty filter sized for nvalues distinct values at bits_per_value bits each;
+            10 bits per value gives about 1% false positives. */
+        BloomFilter(uint32_t nvalues, uint32_t bits_per_value);
+
+        /// A filter as returned by getBits(), getNHashes() and getNValues()
+        BloomFilter(const std::string &bits, uint32_t nhashes, uint32_t nvalues = 0)
+            : bits(bits), nhashes(nhashes), nvalues(nvalues) { }
+
+        /** the canonical key of v; empty for a null value */
+        static std::string key(const GeneralValue &v);
+
+        void addKey(const std::string &key) {
+            add(key.data(), key.size());
+        }
+
+        bool mayContainKey(const std::string &key) const {
+            return mayContain(key.data(), key.size());
+        }
+
+        bool mayContain(const GeneralValue &v) const {
+            return v.getType() != ExtentType::ft_unknown && mayContainKey(key(v));
+        }
+
+        void add(const void *key, size_t size);
+        bool mayContain(const void *key, size_t size) const;
+
+        const std::string &getBits() const {
+            return bits;
+        }
+
+        uint32_t getNHashes() const {
+            return nhashes;
+        }
+
+        /// distinct values for filters from compute(), otherwise the number of add() calls
+        uint32_t getNValues() const {
+            return nvalues;
+        }
+
+        typedef std::map<std::string, BloomFilter> ByField;
+
+        /// type of the extents that hold Bloom filters, "DataSeries: BloomFilter"
+        static const ExtentType::Ptr &extentType();
+
+        /** Compute filters of the named fields over all the rows of e, sized by the number of
+            distinct values in each field. */
+        static void compute(const Extent::Ptr &e, const std::vector<std::string> &fields,
+                            uint32_t bits_per_value, ByField &into);
+
+        /** Append the filters for the extent of type type_name at offset in the file to
+            series, which must be of extentType(); starts a new extent in series if it doesn't
+            have one. */
+        static void append(ExtentSeries &series, int64_t offset, const std::string &type_name,
+                           const ByField &filters);
+
+        /** Read all the filters in source, by extent offset.  Returns false if the file
+            doesn't have any.  As with ZoneMap::read(), filters for offsets that the index
+            doesn't list as an extent of the filtered type are ignored. */
+        static bool read(DataSeriesSource &source, std::map<int64_t, ByField> &into);
+
+      private:
+        void addHash(uint64_t hash);
+
+        std::string bits;
+        uint32_t nhashes, nvalues;
+    };
+}
+
+#endif
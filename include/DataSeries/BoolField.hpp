@@ -43,6 +43,52 @@ namespace dataseries { namespace detail {
             bool default_value;
 
             virtual void newExtentType();
+
+            /** Returns a span over this field in every row of the series' current extent.
+
+                Preconditions:
+                - The name of the Field must have been set and the
+                @c ExtentSeries must have an extent. */
+            ColumnSpan<bool> span() const {
+                return span(dataseries.getExtentRef());
+            }
+
+            /** Returns a span over this field in every row of e.
+
+                Preconditions:
+                - The name of the Field must have been set. */
+            ColumnSpan<bool> span(const Extent &e) const {
+                DEBUG_SINVARIANT(e.getTypePtr() == dataseries.getTypePtr());
+                uint32_t stride = e.getTypePtr()->fixedrecordsize();
+                const uint8_t *row0 = e.fixeddata.begin();
+                return ColumnSpan<bool>(row0 + offset, stride, e.fixeddata.size() / stride,
+                                        nullable ? row0 + null_offset : NULL,
+                                        static_cast<uint8_t>(null_bit_mask), default_value,
+                                        bit_mask);
+            }
+
+            /** Sets this field in the nrows rows of the series' current extent starting at
+                first_row to values[0..nrows), or to null for the rows where nulls[i] is
+                non-zero, as SimpleFixedField::setColumn does.
+
+                Preconditions:
+                - The name of the Field must have been set and the rows must exist. */
+            void setColumn(uint32_t first_row, uint32_t nrows, const bool *values,
+                           const uint8_t *nulls = NULL) {
+                Extent &e(dataseries.getExtentRef());
+                size_t stride = e.getTypePtr()->fixedrecordsize();
+                INVARIANT((first_row + static_cast<size_t>(nrows)) * stride <= e.fixeddata.size(),
+                          boost::format("%s: setColumn past the end of the extent") % getName());
+                uint8_t *row_pos = e.fixeddata.begin() + first_row * stride;
+                for (uint32_t i = 0; i < nrows; ++i, row_pos += stride) {
+                    if (nulls != NULL && nulls[i]) {
+                        setNull(e, row_pos, true);
+                    } else {
+                        set(e, row_pos, values[i]);
+                    }
+                }
+            }
+
           protected:
             bool val(const Extent &e, uint8_t *row_pos) const {
                 DEBUG_SINVARIANT(&e != NULL);
@@ -0,0 +1,86 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    One source of extents read by several consumers at once
+*/
+
+#ifndef DATASERIES_BROADCASTBUFFER_HPP
+#define DATASERIES_BROADCASTBUFFER_HPP
+
+#include <deque>
+#include <vector>
+
+#include <Lintel/PThread.hpp>
+
+#include <DataSeries/DataSeriesModule.hpp>
+
+/** \brief Lets several analyses run in parallel over a single read of the same data.
+
+    Each consumer made by newConsumer() returns every extent of the source,
+    in order, so each can head a chain of modules run on a thread of its
+    own.  The extents are shared by all the consumers, so nothing in those
+    chains may modify them.  The source is read once, by whichever
+    consumer first needs the next extent, and an extent is released when
+    the last consumer has read it, so the consumers can be up to
+    max_extent_memory apart.  A consumer that stops reading before the end
+    without being closed or deleted will eventually stop the others.
+*/
+class BroadcastBuffer {
+  public:
+    /** \arg max_extent_memory the most the buffered extents may use; it may
+        be exceeded by one extent. */
+    BroadcastBuffer(DataSeriesModule &source, size_t max_extent_memory = 32*1024*1024);
+    /** all the consumers must have been deleted */
+    ~BroadcastBuffer();
+
+    class Consumer : public DataSeriesModule {
+      public:
+        virtual ~Consumer();
+        virtual Extent::Ptr getSharedExtent();
+        /** stop reading before the end; the other consumers no longer wait
+            for this one, and getSharedExtent() returns NULL. */
+        void close();
+      private:
+        friend class BroadcastBuffer;
+        Consumer(BroadcastBuffer &buffer) : buffer(buffer), position(0) { }
+
+        BroadcastBuffer &buffer;
+        uint64_t position; // of the next extent to return, counting from 0
+    };
+
+    /** A new consumer, allocated with new, e.g. for the head of a
+        SequenceModule.  All of the consumers have to be made before any
+        extent is read. */
+    Consumer *newConsumer();
+
+    /** Calls getAndDeleteShared() on each of modules on a thread of its
+        own, and returns when they are all done.  modules would usually be
+        the tails of chains headed by different consumers. */
+    static void getAndDeleteSharedConcurrently(const std::vector<DataSeriesModule *> &modules);
+
+    /// the most memory the buffered extents used at any one time
+    size_t maxUsedMemory();
+
+  private:
+    Extent::Ptr next(Consumer &consumer);
+    void close(Consumer &consumer);
+    void removeConsumer(Consumer &consumer);
+    /// drop extents every consumer has read; mutex must be held
+    void release();
+
+    DataSeriesModule &source;
+    PThreadMutex mutex;
+    PThreadCond cond;
+    std::deque<Extent::Ptr> buffer;
+    uint64_t first_position; // of buffer.front()
+    std::vector<Consumer *> consumers;
+    size_t cur_used_memory, max_used_memory, max_extent_memory;
+    bool reading, source_done;
+};
+
+#endif
@@ -0,0 +1,179 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    Whole columns of values to append to extents at once
+*/
+
+#ifndef DATASERIES_COLUMNBATCH_HPP
+#define DATASERIES_COLUMNBATCH_HPP
+
+#include <string>
+#include <vector>
+
+#include <boost/utility.hpp>
+
+#include <DataSeries/ExtentField.hpp>
+#include <DataSeries/GeneralField.hpp>
+
+namespace dataseries {
+    /** \brief The values of a batch of records, held a column at a time.
+
+        Each column is a field of the series being written and an array of nrecords values for
+        it, with an optional array of nrecords null flags, non-zero for null, laid out as
+        NullView::gather() writes them.  The arrays are not copied, so they must outlive the
+        batch.  OutputModule::appendColumns() writes a batch, splitting it across extents of
+        its target size; fields of the series that are not in the batch are left zero.
+
+        \code
+        ColumnBatch batch(ids.size());
+        batch.add(id, &ids[0]);
+        batch.add(name, &names[0], &name_nulls[0]);
+        output.appendColumns(batch);
+        \endcode */
+    class ColumnBatch : boost::noncopyable {
+      public:
+        explicit ColumnBatch(uint32_t nrecords) : nrecords(nrecords) { }
+
+        ~ColumnBatch() {
+            for (std::vector<Column *>::iterator i = columns.begin(); i != columns.end(); ++i) {
+                delete *i;
+            }
+        }
+
+        /// number of records in the batch
+        uint32_t size() const { return nrecords; }
+
+        /// add a column of byte, int32, int64 or double values
+        template<typename T> void add(detail::SimpleFixedField<T> &field, const T *values,
+                                      const uint8_t *nulls = NULL) {
+            columns.push_back(new FieldColumn<detail::SimpleFixedField<T>, T>
+                              (field, values, nulls));
+        }
+
+        void add(BoolField &field, const bool *values, const uint8_t *nulls = NULL) {
+            columns.push_back(new FieldColumn<BoolField, bool>(field, values, nulls));
+        }
+
+        void add(Variable32Field &field, const std::string *values, const uint8_t *nulls = NULL) {
+            columns.push_back(new VariableColumn<std::string>(field, values, nulls));
+        }
+
+        void add(Variable32Field &field, const Variable32Ref *values,
+                 const uint8_t *nulls = NULL) {
+            columns.push_back(new VariableColumn<Variable32Ref>(field, values, nulls));
+        }
+
+        /** add a column of values as text, converted as GeneralField::set(const std::string &)
+            does; much slower than the typed columns, for callers that only have text */
+        void add(GeneralField &field, const std::string *values, const uint8_t *nulls = NULL) {
+            columns.push_back(new TextColumn(field, values, nulls));
+        }
+
+        /** Set every column in the nrows records of series' current extent starting at
+            first_row from records [from, from + nrows) of the batch. */
+        void set(ExtentSeries &series, uint32_t first_row, uint32_t from, uint32_t nrows) const {
+            INVARIANT(from + static_cast<size_t>(nrows) <= nrecords,
+                      boost::format("records [%d, %d) are not in a batch of %d")
+                      % from % (from + nrows) % nrecords);
+            for (std::vector<Column *>::const_iterator i = columns.begin();
+                 i != columns.end(); ++i) {
+                (*i)->set(series, first_row, from, nrows);
+            }
+        }
+
+        /// approximate bytes of variable data needed by all the records of the batch
+        size_t variableSize() const {
+            size_t ret = 0;
+            for (std::vector<Column *>::const_iterator i = columns.begin();
+                 i != columns.end(); ++i) {
+                ret += (*i)->variableSize(nrecords);
+            }
+            return ret;
+        }
+
+      private:
+        class Column {
+          public:
+            Column(const uint8_t *nulls) : nulls(nulls) { }
+            virtual ~Column() { }
+            virtual void set(ExtentSeries &series, uint32_t first_row,
+                             uint32_t from, uint32_t nrows) = 0;
+            virtual size_t variableSize(uint32_t) const { return 0; }
+          protected:
+            const uint8_t *nullsFrom(uint32_t from) const {
+                return nulls == NULL ? NULL : nulls + from;
+            }
+            const uint8_t *nulls;
+        };
+
+        template<class FieldT, typename T> class FieldColumn : public Column {
+          public:
+            FieldColumn(FieldT &field, const T *values, const uint8_t *nulls)
+                : Column(nulls), field(field), values(values) { }
+            virtual void set(ExtentSeries &, uint32_t first_row, uint32_t from, uint32_t nrows) {
+                field.setColumn(first_row, nrows, values + from, nullsFrom(from));
+            }
+          protected:
+            FieldT &field;
+            const T *values;
+        };
+
+        template<typename T> class VariableColumn : public FieldColumn<Variable32Field, T> {
+          public:
+            VariableColumn(Variable32Field &field, const T *values, const uint8_t *nulls)
+                : FieldColumn<Variable32Field, T>(field, values, nulls) { }
+            virtual size_t variableSize(uint32_t nrecords) const {
+                size_t ret = 0;
+                for (uint32_t i = 0; i < nrecords; ++i) {
+                    ret += 8 + size(this->values[i]); // length and padding
+                }
+                return ret;
+            }
+          private:
+            static size_t size(const std::string &value) { return value.size(); }
+            static size_t size(const Variable32Ref &value) { return value.size; }
+        };
+
+        class TextColumn : public Column {
+          public:
+            TextColumn(GeneralField &field, const std::string *values, const uint8_t *nulls)
+                : Column(nulls), field(field), values(values) { }
+            virtual void set(ExtentSeries &series, uint32_t first_row, uint32_t from,
+                             uint32_t nrows) {
+                const uint8_t *row0 = series.getExtentRef().fixeddata.begin();
+                size_t stride = series.getTypePtr()->fixedrecordsize();
+                for (uint32_t i = 0; i < nrows; ++i) {
+                    series.setCurPos(row0 + (first_row + i) * stride);
+                    if (nulls != NULL && nulls[from + i]) {
+                        field.setNull();
+                    } else {
+                        field.set(values[from + i]);
+                    }
+                }
+            }
+            virtual size_t variableSize(uint32_t nrecords) const {
+                if (field.getType() != ExtentType::ft_variable32) {
+                    return 0;
+                }
+                size_t ret = 0;
+                for (uint32_t i = 0; i < nrecords; ++i) {
+                    ret += 8 + values[i].size();
+                }
+                return ret;
+            }
+          private:
+            GeneralField &field;
+            const std::string *values;
+        };
+
+        const uint32_t nrecords;
+        std::vector<Column *> columns;
+    };
+}
+
+#endif
@@ -0,0 +1,331 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    Strided views over one column of an extent
+*/
+
+#ifndef DATASERIES_COLUMNSPAN_HPP
+#define DATASERIES_COLUMNSPAN_HPP
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <Lintel/AssertBoost.hpp>
+#include <Lintel/DebugFlag.hpp>
+
+namespace dataseries {
+    /** Rows of an extent that passed a where clause, as row numbers in increasing order. */
+    typedef std::vector<uint32_t> RowSelection;
+
+    /** \brief Random access iterator over the rows of a span; dereferences to Span::operator[] */
+    template<class Span> class SpanIterator {
+      public:
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef typename Span::value_type value_type;
+        typedef int32_t difference_type;
+        typedef const value_type *pointer;
+        typedef value_type reference; // values are computed, so no real reference
+
+        SpanIterator() : span(NULL), row(0) { }
+        SpanIterator(const Span *span, uint32_t row) : span(span), row(row) { }
+
+        value_type operator *() const { return (*span)[row]; }
+        value_type operator [](difference_type n) const { return (*span)[row + n]; }
+        /// row number within the span that this iterator is at
+        uint32_t getRow() const { return row; }
+
+        SpanIterator &operator ++() { ++row; return *this; }
+        SpanIterator operator ++(int) { SpanIterator ret(*this); ++row; return ret; }
+        SpanIterator &operator --() { --row; return *this; }
+        SpanIterator operator --(int) { SpanIterator ret(*this); --row; return ret; }
+        SpanIterator &operator +=(difference_type n) { row += n; return *this; }
+        SpanIterator &operator -=(difference_type n) { row -= n; return *this; }
+        SpanIterator operator +(difference_type n) const { return SpanIterator(span, row + n); }
+        SpanIterator operator -(difference_type n) const { return SpanIterator(span, row - n); }
+        difference_type operator -(const SpanIterator &them) const {
+            DEBUG_SINVARIANT(span == them.span);
+            return static_cast<difference_type>(row) - static_cast<difference_type>(them.row);
+        }
+
+        bool operator ==(const SpanIterator &them) const { return row == them.row; }
+        bool operator !=(const SpanIterator &them) const { return row != them.row; }
+        bool operator <(const SpanIterator &them) const { return row < them.row; }
+        bool operator <=(const SpanIterator &them) const { return row <= them.row; }
+        bool operator >(const SpanIterator &them) const { return row > them.row; }
+        bool operator >=(const SpanIterator &them) const { return row >= them.row; }
+
+      private:
+        const Span *span;
+        uint32_t row;
+    };
+
+    /** \brief View of the null flags of a column across all the rows of an extent.
+
+        The null flag for row i is the mask bit of the byte at base + i * stride.  A view over a
+        non-nullable column has base == NULL and reports every row as not null. */
+    class NullView {
+      public:
+        typedef bool value_type;
+        typedef SpanIterator<NullView> const_iterator;
+
+        NullView() : base(NULL), stride(0), nrows(0), mask(0) { }
+        NullView(const uint8_t *base, uint32_t stride, uint32_t nrows, uint8_t mask)
+            : base(base), stride(stride), nrows(nrows), mask(mask) { }
+
+        uint32_t size() const { return nrows; }
+
+        /// true if the column can have nulls in it
+        bool nullable() const { return base != NULL; }
+
+        bool operator [](uint32_t row) const {
+            DEBUG_SINVARIANT(row < nrows);
+            return base != NULL && (base[row * stride] & mask) != 0;
+        }
+
+        const_iterator begin() const { return const_iterator(this, 0); }
+        const_iterator end() const { return const_iterator(this, nrows); }
+
+        /// number of null rows
+        uint32_t countNulls() const {
+            if (base == NULL) {
+                return 0;
+            }
+            uint32_t ret = 0;
+            const uint8_t *p = base;
+            for (uint32_t i = 0; i < nrows; ++i, p += stride) {
+                ret += (*p & mask) ? 1 : 0;
+            }
+            return ret;
+        }
+
+        /// Store 1 for null rows and 0 for non-null ones into out[0..size())
+        void gather(uint8_t *out) const {
+            if (base == NULL) {
+                memset(out, 0, nrows);
+                return;
+            }
+            const uint8_t *p = base;
+            for (uint32_t i = 0; i < nrows; ++i, p += stride) {
+                out[i] = (*p & mask) ? 1 : 0;
+            }
+        }
+
+      private:
+        const uint8_t *base;
+        uint32_t stride, nrows;
+        uint8_t mask;
+    };
+
+    namespace detail {
+        template<typename T> inline T spanLoad(const uint8_t *p, uint8_t) {
+            return *reinterpret_cast<const T *>(p);
+        }
+
+        template<> inline bool spanLoad<bool>(const uint8_t *p, uint8_t value_mask) {
+            return (*p & value_mask) != 0;
+        }
+    }
+
+    /** \brief Typed view of a fixed-size column across all the rows of an extent.
+
+        The value for row i is at base + i * stride, and if the column is nullable, the null flag
+        for row i is the null_mask bit of the byte at null_base + i * stride.  Since extents are
+        row-major, stride is the fixed record size of the extent type.  Bool columns are bit
+        packed, so for ColumnSpan<bool> value_mask selects the bit within the byte.  A span is only
+        valid while the extent it came from is alive and unmodified.  Spans are obtained from the
+        field accessors, e.g. Int32Field::span(). */
+    template<typename T> class ColumnSpan {
+      public:
+        typedef T value_type;
+        typedef SpanIterator<ColumnSpan> const_iterator;
+
+        ColumnSpan() : base(NULL), null_base(NULL), stride(0), nrows(0), null_mask(0),
+                       value_mask(0), default_value() { }
+
+        ColumnSpan(const uint8_t *base, uint32_t stride, uint32_t nrows,
+                   const uint8_t *null_base, uint8_t null_mask, T default_value,
+                   uint8_t value_mask = 0)
+            : base(base), null_base(null_base), stride(stride), nrows(nrows),
+              null_mask(null_mask), value_mask(value_mask), default_value(default_value) { }
+
+        /// number of rows in the span
+        uint32_t size() const { return nrows; }
+
+        /// distance in bytes between successive values
+        uint32_t getStride() const { return stride; }
+
+        /// true if the column can have nulls in it
+        bool nullable() const { return null_base != NULL; }
+
+        bool isNull(uint32_t row) const {
+            DEBUG_SINVARIANT(row < nrows);
+            return null_base != NULL && (null_base[row * stride] & null_mask) != 0;
+        }
+
+        /// the null flags of this column
+        NullView nulls() const {
+            return NullView(null_base, stride, nrows, null_mask);
+        }
+
+        /// value stored in row, ignoring the null flag
+        T raw(uint32_t row) const {
+            DEBUG_SINVARIANT(row < nrows);
+            return detail::spanLoad<T>(base + row * stride, value_mask);
+        }
+
+        /// value in row, or default_value if row is null; matches Field::val()
+        T operator [](uint32_t row) const {
+            return isNull(row) ? default_value : raw(row);
+        }
+
+        const_iterator begin() const { return const_iterator(this, 0); }
+        const_iterator end() const { return const_iterator(this, nrows); }
+
+        /** Copy the values of every row into out[0..size()), substituting default_value for
+            nulls, so that kernels can run over a dense array. */
+        void gather(T *out) const {
+            const uint8_t *p = base;
+            for (uint32_t i = 0; i < nrows; ++i, p += stride) {
+                out[i] = detail::spanLoad<T>(p, value_mask);
+            }
+            if (null_base != NULL) {
+                const uint8_t *n = null_base;
+                for (uint32_t i = 0; i < nrows; ++i, n += stride) {
+                    if (*n & null_mask) {
+                        out[i] = default_value;
+                    }
+                }
+            }
+        }
+
+        /// Copy the values of the selected rows into out[0..selection.size())
+        void gather(const RowSelection &selection, T *out) const {
+            for (size_t i = 0; i < selection.size(); ++i) {
+                out[i] = (*this)[selection[i]];
+            }
+        }
+
+        /** Resize into and gather either every row or the selected rows into it; not usable
+            for ColumnSpan<bool> since std::vector<bool> is packed. */
+        void gather(std::vector<T> &into, const RowSelection *selection = NULL) const {
+            if (selection == NULL) {
+                into.resize(nrows);
+                if (nrows > 0) {
+                    gather(&into[0]);
+                }
+            } else {
+                into.resize(selection->size());
+                if (!selection->empty()) {
+                    gather(*selection, &into[0]);
+                }
+            }
+        }
+
+      private:
+        const uint8_t *base, *null_base;
+        uint32_t stride, nrows;
+        uint8_t null_mask, value_mask;
+        T default_value;
+    };
+
+    /** \brief Pointer and length of one variable32 value; does not own the bytes. */
+    struct Variable32Ref {
+        Variable32Ref() : data(NULL), size(0) { }
+        Variable32Ref(const uint8_t *data, int32_t size) : data(data), size(size) { }
+
+        bool equal(const std::string &to) const {
+            return to.size() == static_cast<size_t>(size) && memcmp(to.data(), data, size) == 0;
+        }
+
+        std::string str() const {
+            return std::string(reinterpret_cast<const char *>(data), size);
+        }
+
+        const uint8_t *data;
+        int32_t size;
+    };
+
+    /** \brief View of a variable32 column across all the rows of an extent.
+
+        The fixed part of row i at base + i * stride is the offset into the variable data of the
+        4 byte length followed by the value.  Values are returned as Variable32Ref's pointing into
+        the extent, or at default_value for null rows, so the default_value passed in must live
+        as long as the span. */
+    class Variable32Span {
+      public:
+        typedef Variable32Ref value_type;
+        typedef SpanIterator<Variable32Span> const_iterator;
+
+        Variable32Span() : base(NULL), null_base(NULL), vardata(NULL), stride(0), nrows(0),
+                           null_mask(0) { }
+
+        Variable32Span(const uint8_t *base, uint32_t stride, uint32_t nrows,
+                       const uint8_t *null_base, uint8_t null_mask, const uint8_t *vardata,
+                       const std::string &default_value)
+            : base(base), null_base(null_base), vardata(vardata), stride(stride), nrows(nrows),
+              null_mask(null_mask),
+              default_value(reinterpret_cast<const uint8_t *>(default_value.data()),
+                            default_value.size()) { }
+
+        uint32_t size() const { return nrows; }
+
+        uint32_t getStride() const { return stride; }
+
+        bool nullable() const { return null_base != NULL; }
+
+        bool isNull(uint32_t row) const {
+            DEBUG_SINVARIANT(row < nrows);
+            return null_base != NULL && (null_base[row * stride] & null_mask) != 0;
+        }
+
+        NullView nulls() const {
+            return NullView(null_base, stride, nrows, null_mask);
+        }
+
+        /// value stored in row, ignoring the null flag
+        Variable32Ref raw(uint32_t row) const {
+            DEBUG_SINVARIANT(row < nrows);
+            int32_t var_offset = *reinterpret_cast<const int32_t *>(base + row * stride);
+            return Variable32Ref(vardata + var_offset + 4,
+                                 *reinterpret_cast<const int32_t *>(vardata + var_offset));
+        }
+
+        Variable32Ref operator [](uint32_t row) const {
+            return isNull(row) ? default_value : raw(row);
+        }
+
+        const_iterator begin() const { return const_iterator(this, 0); }
+        const_iterator end() const { return const_iterator(this, nrows); }
+
+        /// Copy the refs for every row into out[0..size())
+        void gather(Variable32Ref *out) const {
+            for (uint32_t i = 0; i < nrows; ++i) {
+                out[i] = (*this)[i];
+            }
+        }
+
+        /// Copy the lengths of every row into out[0..size())
+        void gatherSizes(int32_t *out) const {
+            for (uint32_t i = 0; i < nrows; ++i) {
+                out[i] = (*this)[i].size;
+            }
+        }
+
+      private:
+        const uint8_t *base, *null_base, *vardata;
+        uint32_t stride, nrows;
+        uint8_t null_mask;
+        Variable32Ref default_value;
+    };
+}
+
+#endif
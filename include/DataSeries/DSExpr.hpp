@@ -20,7 +20,9 @@
 #include <boost/smart_ptr.hpp>
 #include <boost/utility.hpp>
 
+#include <DataSeries/ColumnSpan.hpp>
 #include <DataSeries/ExtentSeries.hpp>
+#include <DataSeries/ZoneMap.hpp>
 
 class DSExpr;
 class DSExprParser;
@@ -103,6 +105,23 @@ class DSExpr : boost::noncopyable {
 
     virtual void dump(std::ostream &) = 0;
 
+    /** Evaluate the expression as a predicate over every row in the current extent of series,
+        and store the rows for which valBool() is true into selection in increasing order.
+        Expressions whose fields all come from series are evaluated a column at a time rather
+        than a row at a time.  The position of series is unspecified afterwards. */
+    virtual void selectRows(ExtentSeries &series, dataseries::RowSelection &selection);
+
+    /** Evaluate valDouble() over every row in the current extent of series, or over just the
+        selected rows if selection is not NULL, and store the results into values.  The
+        position of series is unspecified afterwards. */
+    virtual void valDoubles(ExtentSeries &series, const dataseries::RowSelection *selection,
+                            std::vector<double> &values);
+
+    /** Returns false only if, given the zone maps of an extent, no row of that extent can make
+        the expression true.  Comparisons of a zoned field against a constant, and &&, || and !
+        over them, are checked; anything else may match. */
+    virtual bool mayMatch(const dataseries::ExtentZones &zones);
+
     /// Make an expression over a single series.
     static DSExpr *make(ExtentSeries &series, const std::string &expr_string) {
         boost::scoped_ptr<DSExprParser> parser(DSExprParser::MakeDefaultParser());
@@ -13,14 +13,24 @@
 #ifndef __DATASERIES_DSSTATGROUPBY_H
 #define __DATASERIES_DSSTATGROUPBY_H
 
-#include <Lintel/HashMap.hpp>
+#include <Lintel/Stats.hpp>
 
 #include <DataSeries/DSExpr.hpp>
-#include <DataSeries/GeneralField.hpp>
-#include <DataSeries/RowAnalysisModule.hpp>
+#include <DataSeries/NormalizedKey.hpp>
+#include <DataSeries/ParallelRowAnalysisModule.hpp>
 
-class DSStatGroupByModule : public RowAnalysisModule {
+/** \brief Calculates statistics over expressions, grouped by the values of some fields.
+
+ * Any number of (stat type, expression) pairs are calculated in a single
+ * pass, sharing the where clause and the grouping.  The group of each row
+ * is found through a normalized key over the group by fields, so any
+ * number of fields of the usual types can be used.  The module is a
+ * ParallelRowAnalysisModule::BatchAnalysis, so it can also be run on multiple
+ * threads, each with its own table, with the tables merged at the end. */
+class DSStatGroupByModule : public ParallelRowAnalysisModule::BatchAnalysis {
   public:
+    /** groupby is empty for no grouping, or a comma separated list of
+        fields */
     DSStatGroupByModule(DataSeriesModule &source,
                         const std::string &expression,
                         const std::string &groupby,
@@ -28,22 +38,49 @@ class DSStatGroupByModule : public RowAnalysisModule {
                         const std::string &whereexpr = "",
                         ExtentSeries::typeCompatibilityT tc = ExtentSeries::typeExact);
 
-    typedef HashMap<GeneralValue, Stats *> mytableT;
+    /** calculate stattypes[i] over expressions[i] for each i, grouped by
+        the groupby fields (none for no grouping) */
+    DSStatGroupByModule(DataSeriesModule &source,
+                        const std::vector<std::string> &expressions,
+                        const std::vector<std::string> &stattypes,
+                        const std::vector<std::string> &groupby,
+                        const std::string &whereexpr = "",
+                        ExtentSeries::typeCompatibilityT tc = ExtentSeries::typeExact);
 
     virtual ~DSStatGroupByModule();
-    
+
     virtual void prepareForProcessing();
-    virtual void processRow();
+    virtual void processBatch(uint32_t nrows, const dataseries::RowSelection *selection);
+    /// from must have been constructed with the same arguments
+    virtual void merge(ParallelRowAnalysisModule::Analysis &from);
+    /// prints one block per statistic
     virtual void printResult();
 
+    /// number of groups seen so far
+    size_t groupCount() const {
+        return groups.size();
+    }
+
     /// return true if the specified stat_type is valid for constructing a
-    /// DSStatGroupByModule.
+    /// DSStatGroupByModule: basic, quantile (a StatsQuantile), or
+    /// sketch[=error] (a dataseries::QuantileSketch, error defaults to 0.01)
     static bool validStatType(const std::string &stat_type);
   private:
-    mytableT mystats;
-    std::string expression, groupby_name, stattype;
-    GeneralField *groupby;
-    DSExpr *expr;
+    void init();
+    /// the stats for the group with the key, made if necessary
+    Stats **groupStats(const uint8_t *key, uint32_t key_size);
+    /// make the key encoder once the type is known
+    void initKeys();
+
+    std::vector<std::string> expressions, stattypes, groupby_names;
+    std::vector<DSExpr *> exprs;
+    dataseries::KeyEncoder key_encoder;
+    bool keys_ready;
+    dataseries::KeyTable<uint32_t> groups; // key -> group number
+    std::vector<Stats *> stats; // expressions.size() per group, by group number
+    std::vector<std::vector<double> > values;
+    std::string keys;
+    std::vector<uint32_t> key_offsets;
 };
 
 #endif
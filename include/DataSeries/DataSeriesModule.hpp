@@ -15,12 +15,14 @@
 #ifndef DATASERIES_MODULE_H
 #define DATASERIES_MODULE_H
 
+#include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/utility.hpp>
 
 #include <Lintel/CompilerMarkup.hpp>
 #include <Lintel/PThread.hpp>
 
+#include <DataSeries/ColumnSpan.hpp>
 #include <DataSeries/DataSeriesSource.hpp>
 #include <DataSeries/Extent.hpp>
 #include <DataSeries/ExtentSeries.hpp>
@@ -81,7 +83,9 @@ class DataSeriesModule : boost::noncopyable {
     /** Returns an Extent which ought to have been allocated with global new. It is the caller's
         responsibility to delete it. Each call to this function should return a different @c
         Extent. Derived classes should return a null pointer to indicate the end of the sequence of
-        Extents. NOTE: This function is being deprecated in preference to getSharedExtent. */
+        Extents. NOTE: This function is being deprecated in preference to getSharedExtent.  The
+        default implementation returns the extent from getSharedExtent(), or a copy of it if it
+        is shared, for example with the ExtentCache. */
     virtual Extent *getExtent() DS_RAW_EXTENT_PTR_DEPRECATED;
 
     /** Returns a new Extent that has been allocated with global new, and may be read-shared with
@@ -90,10 +94,25 @@ class DataSeriesModule : boost::noncopyable {
         the end of the sequence of Extents. */
     virtual Extent::Ptr getSharedExtent();
 
+    /** Returns the next Extent along with the rows of it that this module passes on, so that a
+        filter can hand on its input extent instead of copying the selected rows into a new one.
+        selection is set to NULL if every row is passed on, and otherwise to the selected row
+        numbers in increasing order; it remains valid until the next call.  The returned Extent
+        may have no selected rows.  Modules that need a contiguous Extent can use
+        materializeSelection().  The default returns getSharedExtent() with every row selected;
+        filters override this and make getSharedExtent() materialize its result. */
+    virtual Extent::Ptr getSelectedExtent(const dataseries::RowSelection *&selection);
+
+    /** Returns a new Extent holding just the selected rows of e in order, or e itself if
+        selection is NULL. */
+    static Extent::Ptr materializeSelection(const Extent::Ptr &e,
+                                            const dataseries::RowSelection *selection);
+
     /** get all the extents from module and delete them via the getExtent() interface. */
     void getAndDelete() DS_RAW_EXTENT_PTR_DEPRECATED;
 
-    /** get all the extents from module and delete them via the getExtentShared() interface. */
+    /** get all the extents from module and delete them via the getSelectedExtent() interface, so
+        that no rows are copied just to be thrown away. */
     void getAndDeleteShared();
 };
 
@@ -138,17 +157,24 @@ class FilterModule : public DataSeriesModule {
     std::string type_prefix;
 };
 
+namespace dataseries { class ColumnBatch; class ExtentSizeTuner; }
+
 /** \brief Splits a sequence of records into "bite-sized" Extents.
 
     Since the unit of processing in DataSeries is a single
     @c Extent, this provides a way to keep Extents from getting
-    too big to fit in memory. */
+    too big to fit in memory.  A target extent size of auto_extent_size
+    lets a dataseries::ExtentSizeTuner choose it, and adjust it as the
+    extents are packed. */
 class OutputModule {
   public:
+    /// target extent size that chooses the size automatically
+    static const uint32_t auto_extent_size = 0;
+
     // TODO: Replace constructor with OutputModule(DataSeriesSink
     // &sink, const ExtentType &outputtype, uint32_t
-    // target_extent_size = 0) auto-infer tes if it is 0 same as with
-    // commonargs, then make the extentseries a real class member.
+    // target_extent_size = auto_extent_size), then make the
+    // extentseries a real class member.
 
     // you are still responsible for closing the sink if necessary;
     // this module just helps with making records of close the the
@@ -171,6 +197,10 @@ class OutputModule {
     // you should call writeExtentLibrary before calling this too
     // many times or it will try to write an extent.
     void newRecord();
+    /** Append all the records of batch, a column at a time, flushing extents as they reach
+        the target extent size just as a newRecord() per record would.  Leaves the series on
+        the last record appended. */
+    void appendColumns(const dataseries::ColumnBatch &batch);
     /** force current extent out, you can continue writing. */
     void flushExtent();
     /** Force current @c Extent out.  After calling close, it is illegal
@@ -183,16 +213,28 @@ class OutputModule {
         before you close the sink or call @c DataSeriesSink::flushPending. */
     dataseries::IExtentSink::Stats getStats();
 
+    /** the size extents are currently cut at, which changes as it is tuned if
+        isAutoExtentSize() */
     uint32_t getTargetExtentSize() {
         return target_extent_size;
     }
 
-    void setTargetExtentSize(uint32_t bytes) {
-        // setting this will only have an effect after the next call to
-        // newRecord.
-        target_extent_size = bytes;
+    /** Setting this will only have an effect after the next call to newRecord.  Setting
+        auto_extent_size, which is only valid before any extent has been written, starts
+        choosing the size automatically, and any other size stops.  The sizes chosen are
+        noted with the sink, see IExtentSink::noteAutoExtentSize(); the tuning uses
+        getStats(), so the sink has to support it. */
+    void setTargetExtentSize(uint32_t bytes);
+
+    bool isAutoExtentSize() const {
+        return tuner != NULL;
     }
 
+    /** Set the number of threads expected to read the output in parallel, which limits the
+        automatically chosen sizes; defaults to one per CPU.  Only valid if
+        isAutoExtentSize(). */
+    void setConsumerThreads(uint32_t n);
+
     void printStats(std::ostream &to);
     const ExtentType &outputtype DSM_VAR_DEPRECATED;
     ExtentType::Ptr getOutputType(); // re-inline this function once deprecated var is changed to ptr
@@ -210,6 +252,8 @@ class OutputModule {
     }
   private:
     uint32_t target_extent_size; 
+    boost::scoped_ptr<dataseries::ExtentSizeTuner> tuner;
+    bool wrote_extent;
 
     dataseries::IExtentSink::Stats stats;
     
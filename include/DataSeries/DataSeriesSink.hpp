@@ -17,7 +17,9 @@
 #include <Lintel/PThread.hpp>
 
 #include <DataSeries/ExtentField.hpp>
+#include <DataSeries/BloomFilter.hpp>
 #include <DataSeries/IExtentSink.hpp>
+#include <DataSeries/ZoneMap.hpp>
 
 /** \brief Writes Extents to a DataSeries file.
  */
@@ -93,6 +95,17 @@ class DataSeriesSink : public dataseries::IExtentSink {
         are not used. */
     void writeExtentLibrary(const ExtentTypeLibrary &lib);
 
+    /** Compute zone maps (see dataseries::ZoneMap) of the named fields for every extent of
+        type type_name written to this file, and write them out at close().  Must be called
+        before writeExtentLibrary; the extra type is added to the written library. */
+    void setZoneMapFields(const std::string &type_name, const std::vector<std::string> &fields);
+
+    /** As setZoneMapFields, but for Bloom filters (see dataseries::BloomFilter) of the named
+        fields, each sized at bits_per_value bits per distinct value in the extent. */
+    void setBloomFilterFields(const std::string &type_name,
+                              const std::vector<std::string> &fields,
+                              uint32_t bits_per_value = 10);
+
     /** See dataseries::IExtentSink documentation */
     virtual void writeExtent(Extent &e, Stats *toUpdate);
 
@@ -109,8 +122,21 @@ class DataSeriesSink : public dataseries::IExtentSink {
     /** See dataseries::IExtentSink documentation */
     virtual void removeStatsUpdate(Stats *would_update);
 
+    /** Records the sizes chosen for each type in an extent of type
+        dataseries::ExtentSizeTuner::extentType() written at close().  That type is added to the
+        written library if a size is noted before writeExtentLibrary, so create automatically
+        sized OutputModules before writing the library.  Sizes for metadata types (see
+        isMetadataType()) aren't recorded. */
+    virtual void noteAutoExtentSize(const std::string &type_name, uint32_t target_extent_size);
+
     static void verifyTail(ExtentType::byte *data, bool need_bitflip,
                            const std::string &filename);
+
+    /** True for the names of the types a sink writes to describe the file itself: the type
+        library, the index, the zone maps, the Bloom filters and the automatic extent sizes.
+        Their records refer to the other extents in the file, so tools that copy or print
+        extents should skip them. */
+    static bool isMetadataType(const std::string &type_name);
     
     /** Sets the number of threads that each @c DataSeriesSink uses to
         compress Extents.
@@ -135,6 +161,8 @@ class DataSeriesSink : public dataseries::IExtentSink {
         bool in_progress;
         uint32_t checksum;
         Extent::ByteArray compressed;
+        dataseries::ExtentZones zones;
+        dataseries::BloomFilter::ByField bloom_filters;
         ToCompress(Extent::Ptr e, Stats *_to_update)
                 : extent(e), to_update(_to_update), in_progress(false), checksum(0) 
         { }
@@ -190,6 +218,7 @@ class DataSeriesSink : public dataseries::IExtentSink {
         ExtentSeries index_series;
         Int64Field field_extentOffset;
         Variable32Field field_extentType;
+        ExtentSeries zone_series, bloom_series;
         ExtentWriteCallback extent_write_callback;
 
         WriterInfo()
@@ -197,13 +226,17 @@ class DataSeriesSink : public dataseries::IExtentSink {
                   index_series(ExtentType::getDataSeriesIndexTypeV0Ptr()), 
                   field_extentOffset(index_series,"offset"),
                   field_extentType(index_series,"extenttype"), 
+                  zone_series(dataseries::ZoneMap::extentType()),
+                  bloom_series(dataseries::BloomFilter::extentType()),
                   extent_write_callback()
         { }
         void writeOutPending(PThreadScopedLock &lock, WorkerInfo &worker_info);
         void checkedWrite(const void *buf, int bufsize);
         bool isQuiesced() {
             return fd == -1 && wrote_library == false && cur_offset == -1
-                    && !index_series.hasExtent() && chained_checksum == 0;
+                    && !index_series.hasExtent() && !zone_series.hasExtent()
+                    && !bloom_series.hasExtent()
+                    && chained_checksum == 0;
         }
     };
 
@@ -214,6 +247,9 @@ class DataSeriesSink : public dataseries::IExtentSink {
 
     void queueWriteExtent(Extent::Ptr e, Stats *to_update);
     void lockedProcessToCompress(PThreadScopedLock &lock, ToCompress *work);
+    uint32_t lockedWriteFinalExtent(PThreadScopedLock &lock, Extent::Ptr e);
+    // the sizes noted by noteAutoExtentSize(); call with the lock held
+    Extent::Ptr autoExtentSizeExtent();
 
     static int compressor_count;
 
@@ -223,6 +259,15 @@ class DataSeriesSink : public dataseries::IExtentSink {
                lintel::SharedPointerEqual<const ExtentType> > valid_types;
     const int compression_modes;
     const int compression_level;
+    // type name -> fields; fixed once the library is written, so the compressors read it unlocked
+    std::map<std::string, std::vector<std::string> > zone_map_fields, bloom_filter_fields;
+    uint32_t bloom_bits_per_value;
+    struct AutoExtentSize {
+        uint32_t target, min, max, changes;
+    };
+    // type name -> sizes noted by noteAutoExtentSize(); protected by mutex
+    std::map<std::string, AutoExtentSize> auto_extent_sizes;
+    bool warned_auto_extent_size;
 
     WriterInfo writer_info;
     WorkerInfo worker_info;
@@ -12,10 +12,20 @@
 #ifndef DATASERIES_SOURCE_H
 #define DATASERIES_SOURCE_H
 
+#include <sys/stat.h>
+
+#include <vector>
+
 #include <DataSeries/Extent.hpp>
 
 /** \brief Reads Extents from a DataSeries file.
  *
+ * If the environment variable DATASERIES_METADATA_CACHE names a directory,
+ * the header, type extent, tail and index extent of each fully opened file
+ * are cached in a small sidecar file in that directory.  The entry is only
+ * used if the size and modify time of the file still match, the same check
+ * that reopenfile() uses, so the directory can be shared by many processes
+ * and never needs to be cleaned for correctness.
  **/
 class DataSeriesSource {
   public:
@@ -112,10 +122,38 @@ class DataSeriesSource {
 
     /** get the Filename associated with this file */
     const std::string &getFilename() { return filename; }
+
+    /** the modify time of the file when the metadata was last read */
+    int64_t getModifyTimeNanoSec() { return mtime_nanosec; }
+
+    /** Open each of filenames using up to nthreads threads (-1 ==> # cpus)
+        so that the metadata cache has a valid entry for every file.  Files
+        with a valid entry are not re-read.  Does nothing if the metadata
+        cache is not enabled. */
+    static void warmMetadataCache(const std::vector<std::string> &filenames,
+                                  int nthreads = -1);
+
+    /** Counts of the metadata cache lookups and writes by all the sources
+        in the process; stale counts entries that were found but no longer
+        match the file. */
+    struct MetadataCacheStats {
+        uint64_t hits, misses, stale, writes;
+        MetadataCacheStats() : hits(0), misses(0), stale(0), writes(0) { }
+    };
+
+    static MetadataCacheStats getMetadataCacheStats();
   private:
     void checkHeader();
-    void readTypeExtent();
-    void readTailIndex();
+    void readTypeExtent(Extent::ByteArray &type_bytes);
+    void readTailIndex(Extent::ByteArray &index_bytes, off64_t &index_offset);
+    void parseTypeExtent(Extent::ByteArray &type_bytes);
+    void parseIndexExtent(Extent::ByteArray &index_bytes, off64_t index_offset);
+
+    std::string metadataCachePath();
+    bool readMetadataCache(const struct stat &stat_buf, Extent::ByteArray &type_bytes,
+                           Extent::ByteArray &index_bytes, off64_t &index_offset);
+    void writeMetadataCache(const struct stat &stat_buf, const Extent::ByteArray &type_bytes,
+                            const Extent::ByteArray &index_bytes, off64_t index_offset);
 
     ExtentTypeLibrary mylibrary;
 
@@ -22,6 +22,7 @@ extern "C" {
 #include <unistd.h>
 #include <inttypes.h>
 #include <cstring>
+#include <algorithm>
 
 #if defined(__linux__) && defined(__GNUC__) && __GNUC__ >= 2 
 #  ifdef __i386__
@@ -90,7 +91,7 @@ class Extent : boost::noncopyable, public boost::enable_shared_from_this<Extent>
     // arrays have to be contiguous, so we could switch back at some point.
     class ByteArray {
       public:
-        ByteArray() { beginV = endV = maxV = NULL; }
+        ByteArray() { beginV = endV = maxV = NULL; borrowed = false; }
         ~ByteArray();
         size_t size() const { return endV - beginV; }
         void resize(size_t newsize, bool zero_it = true) {
@@ -109,6 +110,10 @@ class Extent : boost::noncopyable, public boost::enable_shared_from_this<Extent>
         }
         void clear(); // frees allocated memory
         void reserve(size_t reserve_bytes);
+        /** Refer to the bytes of from rather than owning a copy; the caller keeps from alive.
+            Growing the array copies the bytes into memory of its own first, but writes within
+            the current size go to from's bytes. */
+        void borrow(const ByteArray &from);
         bool empty() const { return endV == beginV; }
         byte *begin() const { return beginV; };
         byte *begin(size_t offset) const { return beginV + offset; }
@@ -119,6 +124,7 @@ class Extent : boost::noncopyable, public boost::enable_shared_from_this<Extent>
             swap(beginV,with.beginV);
             swap(endV,with.endV);
             swap(maxV,with.maxV);
+            std::swap(borrowed,with.borrowed);
         }
       
         typedef byte * iterator;
@@ -141,6 +147,7 @@ class Extent : boost::noncopyable, public boost::enable_shared_from_this<Extent>
       
         void copyResize(size_t newsize, bool zero_it);
         byte *beginV, *endV, *maxV;
+        bool borrowed;
     };
   
     /// \cond INTERNAL_ONLY
@@ -195,6 +202,18 @@ class Extent : boost::noncopyable, public boost::enable_shared_from_this<Extent>
         function does not throw. */
     void swap(Extent &with);
 
+    /** Returns an Extent of view_type, a view (see ExtentType::makeView) of
+        the type of e, holding the rows of e.  No rows are copied: if e is not
+        shared, its data moves into the result and e is left empty, and
+        otherwise the result refers to the data of e, keeping e alive, so it
+        has to be treated as read-only like e. */
+    static Ptr makeView(const Ptr &e, const ExtentType::Ptr &view_type);
+
+    /** Returns a copy of the visible columns of e in an Extent of
+        getMaterializedTypePtr() if the type of e is a view, and e otherwise.
+        Extents of views are materialized this way when they are written. */
+    static Ptr materialize(const Ptr &e);
+
     /** Clears the contents of the Extent.  Note that
         there is no way to clear the type. */
     void clear() {
@@ -453,6 +472,9 @@ class Extent : boost::noncopyable, public boost::enable_shared_from_this<Extent>
                                  byte compression_mode, int32 intosize,
                                  int32 fromsize);
 
+    // the extent whose data a view made by makeView() borrows
+    Ptr view_source;
+
     void compactNulls(Extent::ByteArray &fixed_coded);
     void uncompactNulls(Extent::ByteArray &fixed_coded, int32_t &size);
     friend class ExtentSeries;
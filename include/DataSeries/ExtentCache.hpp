@@ -0,0 +1,104 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    A process-wide cache of unpacked extents.
+*/
+
+#ifndef DATASERIES_EXTENTCACHE_HPP
+#define DATASERIES_EXTENTCACHE_HPP
+
+#include <list>
+#include <map>
+
+#include <Lintel/PThread.hpp>
+
+#include <DataSeries/Extent.hpp>
+
+/** \brief LRU cache of unpacked extents shared by all the index source modules in a process.
+
+ * Entries are keyed by (filename, modify time, offset), so a file that is
+ * rewritten simply stops hitting in the cache, and are bounded by the
+ * unpacked size of the extents.  The cache is disabled until setMaxBytes()
+ * is called with a non-zero size, or the environment variable
+ * DATASERIES_EXTENT_CACHE_MB is set when the cache is first used.
+ *
+ * Cached extents are handed to every reader of the same extent, so they
+ * have to be treated as read-only; readers using the deprecated getExtent()
+ * get a copy of their own. */
+class ExtentCache : boost::noncopyable {
+  public:
+    struct Stats {
+        uint64_t hits, misses, inserts, evictions;
+        size_t cur_bytes, max_bytes;
+        Stats() : hits(0), misses(0), inserts(0), evictions(0), cur_bytes(0), max_bytes(0) { }
+
+        double hitRate() const {
+            return hits + misses == 0 ? 0 : hits / static_cast<double>(hits + misses);
+        }
+    };
+
+    /** the process-wide cache */
+    static ExtentCache &instance();
+
+    /** set the maximum unpacked bytes held by the cache, evicting as
+        necessary; 0 disables the cache. */
+    void setMaxBytes(size_t max_bytes);
+
+    /** cheap check so that callers can skip building a key */
+    bool enabled() {
+        return max_bytes > 0;
+    }
+
+    /** returns the cached extent, or NULL (and counts a miss) */
+    Extent::Ptr lookup(const std::string &filename, int64_t mtime_nanosec, int64_t offset);
+
+    /** adds an extent; extents larger than the whole cache are ignored */
+    void insert(const std::string &filename, int64_t mtime_nanosec, int64_t offset,
+                const Extent::Ptr &extent);
+
+    /** removes all entries, keeps the statistics */
+    void clear();
+
+    Stats getStats();
+
+  private:
+    ExtentCache();
+
+    struct Key {
+        std::string filename;
+        int64_t mtime_nanosec, offset;
+        Key(const std::string &filename, int64_t mtime_nanosec, int64_t offset)
+            : filename(filename), mtime_nanosec(mtime_nanosec), offset(offset) { }
+        bool operator <(const Key &rhs) const {
+            if (offset != rhs.offset) return offset < rhs.offset;
+            if (mtime_nanosec != rhs.mtime_nanosec) return mtime_nanosec < rhs.mtime_nanosec;
+            return filename < rhs.filename;
+        }
+    };
+
+    struct Entry {
+        Key key;
+        Extent::Ptr extent;
+        size_t size; // as inserted, in case a reader breaks the read-only rule
+        Entry(const Key &key, const Extent::Ptr &extent)
+            : key(key), extent(extent), size(extent->size()) { }
+    };
+
+    typedef std::list<Entry> LRUList; // front is most recent
+    typedef std::map<Key, LRUList::iterator> KeyToEntry;
+
+    void lockedEvict(size_t target_bytes);
+
+    PThreadMutex mutex;
+    LRUList lru;
+    KeyToEntry entries;
+    Stats stats;
+    size_t max_bytes; // read unlocked in enabled(), only a hint there
+};
+
+#endif
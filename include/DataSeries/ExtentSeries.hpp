@@ -324,6 +324,21 @@ class ExtentSeries {
         my_extent->createRecords(nrecords);
         pos.cur_pos = my_extent->fixeddata.begin() + offset;
     }
+    /** Appends nrecords records onto the end of the current @c Extent with a
+        single resize, and moves to the first of them.  The same cautions apply
+        as for @c newRecord.  Returns the row number of the first new record,
+        so the fields' setColumn() can fill in all of the new records.
+
+        Preconditions:
+        - The current extent cannot be null */
+    uint32_t appendRecords(uint32_t nrecords) {
+        INVARIANT(my_extent != NULL,
+                  "must set extent for data series before calling appendRecords()");
+        size_t offset = my_extent->fixeddata.size();
+        my_extent->createRecords(nrecords);
+        pos.cur_pos = my_extent->fixeddata.begin() + offset;
+        return offset / type->fixedrecordsize();
+    }
     /// \cond INTERNAL_ONLY
     // TODO: make this class go away, it doesn't actually make sense since
     // each of the fields are tied to the ExtentSeries, not to the iterator
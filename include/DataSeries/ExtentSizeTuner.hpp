@@ -0,0 +1,92 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    Automatic choice of the target extent size for OutputModule
+*/
+
+#ifndef DATASERIES_EXTENTSIZETUNER_HPP
+#define DATASERIES_EXTENTSIZETUNER_HPP
+
+#include <DataSeries/IExtentSink.hpp>
+
+namespace dataseries {
+    /** \brief Chooses the target size of the extents of one type from how they pack.
+
+        Larger extents compress better, smaller ones decompress in parallel and fit in cache.
+        The tuner starts at min_extent_size, and measures the compression ratio and pack rate
+        over windows of extents cut at the current target.  It keeps doubling the target while
+        each doubling shrinks the packed data by at least 3% without slowing packing by more
+        than 1.5x, steps back if a doubling gains less than 1%, and then stays put, trying the
+        next size up again every reprobe_windows windows in case the data has changed.  The
+        target never exceeds the unpacked bytes seen so far divided among two extents per
+        consumer thread, so small outputs stay readable in parallel.
+
+        OutputModule uses one of these when given a target extent size of
+        OutputModule::auto_extent_size, and reports each choice to its sink, which
+        DataSeriesSink records in the file as an extent of type extentType(). */
+    class ExtentSizeTuner {
+      public:
+        static const uint32_t min_extent_size = 64 * 1024;
+        static const uint32_t max_extent_size = 64 * 1024 * 1024;
+        /// extents measured before each decision
+        static const uint32_t window_extents = 4;
+        /// windows at a settled size before trying the next size up
+        static const uint32_t reprobe_windows = 32;
+
+        /// consumer_threads of 0 means one per CPU
+        explicit ExtentSizeTuner(uint32_t consumer_threads = 0);
+
+        uint32_t targetSize() const {
+            return target;
+        }
+
+        /// the threads expected to read the output in parallel
+        uint32_t getConsumerThreads() const {
+            return consumer_threads;
+        }
+
+        /// 0 means one per CPU
+        void setConsumerThreads(uint32_t n);
+
+        /** Note that an extent of unpacked_size bytes was cut at targetSize().  Returns true
+            if the tuner could use the current stats, i.e. update() should be called. */
+        bool extentFlushed(uint32_t unpacked_size);
+
+        /** Adjust the target given the statistics for all the extents flushed so far that
+            have been packed; returns true if targetSize() changed. */
+        bool update(const IExtentSink::Stats &packed);
+
+        /// type of the extents that record the chosen sizes, "DataSeries: ExtentSize"
+        static const ExtentType::Ptr &extentType();
+
+      private:
+        uint32_t sizeCap() const;
+        void startWindow(const IExtentSink::Stats &packed);
+        void changeTarget(uint32_t to);
+        void settle(uint32_t at);
+
+        uint32_t target, consumer_threads;
+        uint64_t flushed, unpacked_seen;
+
+        // the window at the current target starts with extent number window_first; base
+        // holds the stats for the extents before it, once they have all been packed
+        uint64_t window_first;
+        bool have_base;
+        uint64_t base_extents, base_unpacked, base_packed;
+        double base_pack_time;
+
+        // measurements at half the current target, while growing
+        bool have_prev;
+        double prev_ratio, prev_rate;
+
+        bool settled;
+        uint32_t settled_windows;
+    };
+}
+
+#endif
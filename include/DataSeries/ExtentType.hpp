@@ -319,6 +319,30 @@ class ExtentType : boost::noncopyable, public boost::enable_shared_from_this<con
     /** Returns the string used to represent the type in XML */
     static const std::string &fieldTypeString(fieldType ft);
 
+    /** Returns a view of this type showing only the given columns, in the
+        order of this type, and named name ("project (<this name>)" if
+        empty).  Extents of a view keep the record layout of the type it was
+        made from, so Extent::makeView() can turn an extent of this type into
+        one of the view without copying any rows, and ExtentSeries and fields
+        bind to it as to any other type; the hidden columns can't be found.
+        Views are shared like the types from
+        ExtentTypeLibrary::sharedExtentTypePtr().  A view of a view is a view
+        of the original type. */
+    Ptr makeView(const std::vector<std::string> &columns,
+                 const std::string &name = std::string()) const;
+
+    /** Returns true if this type is a view made by makeView() */
+    bool isView() const { return rep.view_base != NULL; }
+
+    /** Returns the type a view was made from, or NULL if this is not a view */
+    Ptr getViewBasePtr() const { return rep.view_base; }
+
+    /** Returns the type with just the visible columns and a record layout of
+        its own, i.e. the type of getXmlDescriptionString(); extents of a view
+        are copied into it when they are written out.  Returns this type if
+        it is not a view. */
+    Ptr getMaterializedTypePtr() const;
+
     /** versionCompatible() determines whether Extents created using this type
         are compatible with an application created for a possibly different
         version of the ExtentType.  The version number is of the form
@@ -467,6 +491,8 @@ class ExtentType : boost::noncopyable, public boost::enable_shared_from_this<con
         PackPadRecord pad_record;
         PackFieldOrdering field_ordering;
         void sortAssignNCI(std::vector<nullCompactInfo> &nci);
+        /// for views, the type whose record layout this shares
+        Ptr view_base;
 
         ~ParsedRepresentation() {
             xmlFreeDoc(xml_description_doc);
@@ -481,6 +507,8 @@ class ExtentType : boost::noncopyable, public boost::enable_shared_from_this<con
         return getColumnNumber(rep, reinterpret_cast<const char *>(column));
     }
     static ParsedRepresentation parseXML(const std::string &xmldesc);
+    static ParsedRepresentation parseView(const Ptr &base, const std::string &view_xmldesc,
+                                          const std::vector<std::string> &columns);
     const ParsedRepresentation rep;
 
     friend class Extent;
@@ -489,6 +517,8 @@ class ExtentType : boost::noncopyable, public boost::enable_shared_from_this<con
     friend class dataseries::xmlDecode;
 
     ExtentType(const std::string &xmldesc);
+    ExtentType(const Ptr &base, const std::string &view_xmldesc,
+               const std::vector<std::string> &columns);
   private:
     static void parsePackBitFields(ParsedRepresentation &ret, 
                                    int32 &byte_pos);
@@ -12,6 +12,7 @@
 #ifndef DATASERIES_FIXEDFIELD_HPP
 #define DATASERIES_FIXEDFIELD_HPP
 
+#include <DataSeries/ColumnSpan.hpp>
 #include <DataSeries/Field.hpp>
 
 /** \brief Base class for fixed size fields. */
@@ -157,6 +158,54 @@ namespace dataseries { namespace detail {
                     : CommonFixedField<T, SimpleFixedFieldImpl<T> >(series, field, flags, default_value)
             { }
 
+            /** Returns a span over this field in every row of the series' current extent.
+
+                Preconditions:
+                - The name of the Field must have been set and the
+                @c ExtentSeries must have an extent. */
+            ColumnSpan<T> span() const {
+                return span(this->dataseries.getExtentRef());
+            }
+
+            /** Returns a span over this field in every row of e.
+
+                Preconditions:
+                - The name of the Field must have been set. */
+            ColumnSpan<T> span(const Extent &e) const {
+                DEBUG_SINVARIANT(e.getTypePtr() == this->dataseries.getTypePtr());
+                uint32_t stride = e.getTypePtr()->fixedrecordsize();
+                const uint8_t *row0 = e.fixeddata.begin();
+                return ColumnSpan<T>(row0 + this->offset, stride, e.fixeddata.size() / stride,
+                                     this->nullable ? row0 + this->null_offset : NULL,
+                                     static_cast<uint8_t>(this->null_bit_mask),
+                                     this->default_value);
+            }
+
+            /** Sets this field in the nrows rows of the series' current extent starting at
+                first_row to values[0..nrows), or to null for the rows where nulls[i] is
+                non-zero.  nulls is laid out as NullView::gather() writes it, and may be NULL
+                if no row is null.
+
+                Preconditions:
+                - The name of the Field must have been set and the rows must exist, e.g.
+                from ExtentSeries::appendRecords(). */
+            void setColumn(uint32_t first_row, uint32_t nrows, const T *values,
+                           const uint8_t *nulls = NULL) {
+                Extent &e(this->dataseries.getExtentRef());
+                size_t stride = e.getTypePtr()->fixedrecordsize();
+                INVARIANT((first_row + static_cast<size_t>(nrows)) * stride <= e.fixeddata.size(),
+                          boost::format("%s: setColumn past the end of the extent")
+                          % this->getName());
+                uint8_t *row_pos = e.fixeddata.begin() + first_row * stride;
+                for (uint32_t i = 0; i < nrows; ++i, row_pos += stride) {
+                    if (nulls != NULL && nulls[i]) {
+                        this->setNull(e, row_pos, true);
+                    } else {
+                        this->SimpleFixedFieldImpl<T>::set(e, row_pos, values[i]);
+                    }
+                }
+            }
+
             // nset is used for data formats where a sentintal value was used as "null" or "default". Note
             // that in the typical use case, the sentinal value is not typically the same as the value you
             // would want to use when blindly reading the value.  That is, the default_value is not going
@@ -522,6 +522,14 @@ class GF_FixedWidth : public GeneralField {
 
 /** \brief Copies records from one @c Extent to another.
 
+    prep() works out once how to copy between the two types.  If they are the
+    same, records are copied with a single memcpy and then the variable32
+    fields are fixed up.  Otherwise fields laid out the same way in both types
+    are copied as runs of bytes, one memcpy per run of adjacent fields, bool
+    fields and null bits are copied a byte at a time, and only fields whose
+    representation differs (e.g. an int32 copied into an int64, or a double
+    with a different base) go through GeneralField.
+
     \todo TODO: add an output module as an optional argument; if it exists, 
     automatically do the newRecord stuff. */
 class ExtentRecordCopy {
@@ -548,15 +556,49 @@ class ExtentRecordCopy {
     void copyRecord();
 
     /** Copies the record from extent at offset into the current record of the destination
-        @c ExtentSeries.  Prerequisite: the record for the destination series should already
+        @c ExtentSeries, converting fields as copyRecord() does.  Prerequisites: extent has the
+        type of the source series, and the record for the destination series should already
         exist. */
     void copyRecord(const Extent &extent, const dataseries::SEP_RowOffset &offset);
+
+    /** Appends copies of the nrecords records starting at record first_record of the current
+        extent of the source @c ExtentSeries to the extent of the destination @c ExtentSeries,
+        leaving the destination on the last of the new records, as a sequence of newRecord()
+        and copyRecord() would.  The position of the source is unchanged. */
+    void copyRecords(uint32_t first_record, uint32_t nrecords);
+
+    /** Appends copies of the listed records of the current extent of the source, which must be
+        in increasing order, as copyRecords(first_record, nrecords) does; each run of adjacent
+        records is copied at once. */
+    void copyRecords(const std::vector<uint32_t> &records);
+
   private:
+    /// nbytes copied from source_offset in the source record to dest_offset in the dest record
+    struct ByteRun {
+        uint32_t source_offset, dest_offset, nbytes;
+    };
+    /// the source_mask bits of a source byte, shifted left by shift into a dest byte
+    struct BitCopy {
+        uint32_t source_offset, dest_offset;
+        int32_t shift;
+        uint8_t source_mask, dest_mask;
+    };
+
+    void prepPlan(const ExtentType::Ptr &copy_type);
+    void addBitCopy(const std::string &source_name, const std::string &dest_name);
+    /// copy the fields in byte_runs and bit_copies from one record to another
+    void copyFixed(const uint8_t *from, uint8_t *to) const;
+    /// fix up or copy the variable32 fields of the record at to_offset in dest
+    void copyVariable(const Extent &from_extent, const dataseries::SEP_RowOffset &from_offset,
+                      Extent &to_extent, const dataseries::SEP_RowOffset &to_offset);
+
     bool did_prep;
-    int fixed_copy_size;
+    int fixed_copy_size; // record size if the types are identical, 0 if copying by plan
     ExtentSeries &source, &dest;
-    std::vector<GeneralField *> sourcefields, destfields; // all fields here if f_c_s == 0
-    std::vector<Variable32Field *> sourcevarfields, destvarfields; // only used if fixed_copy_size >0
+    std::vector<ByteRun> byte_runs;
+    std::vector<BitCopy> bit_copies;
+    std::vector<GeneralField *> sourcefields, destfields; // fields whose representation differs
+    std::vector<Variable32Field *> sourcevarfields, destvarfields;
 };
 
 #endif
@@ -12,10 +12,11 @@
 #ifndef __GROUP_BY_MODULE_H
 #define __GROUP_BY_MODULE_H
 
-#include <Lintel/HashTable.hpp>
-#include <DataSeries/RowAnalysisModule.hpp>
+#include <Lintel/PThread.hpp>
 
-// TODO: start using this or drop it.
+#include <DataSeries/GeneralField.hpp>
+#include <DataSeries/NormalizedKey.hpp>
+#include <DataSeries/RowAnalysisModule.hpp>
 
 /** \brief Single series analysis handling different rows in different groups
 
@@ -24,69 +25,136 @@
  * an independent rollup is calculated across each of the different
  * groups.  The output for this class first lists the values in the
  * group, and then calls the individual rollup print operation to
- * print out the results for that row. 
+ * print out the results for that row.
+
+ * The values of the key fields in each row are encoded into a
+ * normalized key by a dataseries::KeyEncoder, a byte string that
+ * compares with memcmp in the same order as the values; groups are
+ * found in a dataseries::KeyTable over those bytes, so no GeneralValue
+ * is built per row.  Keys are encoded an extent at a time on the thread
+ * calling getSharedExtent().
+ *
+ * With more than one thread, the groups are split into one partition
+ * per thread by the hash of their key; each partition has its own series
+ * and table, and only its thread touches the analyses in it.  With a
+ * memory limit, a partition that grows past its share of the limit
+ * writes its groups out to a sorted run in a temporary file and starts
+ * over; the runs are merged back a group at a time when the results are
+ * visited, so spilling needs Analysis::save(), restore() and merge().
 
  * TODO: perhaps we should generate output as a dataseries and then
  * run it through DStoTextModule to make printable output */
 
-class GroupByModule : public RowAnalysisModule {
+class GroupByModule : public BatchAnalysisModule {
   public:
     /** this is the virtual class that the user will define to perform
      * the analysis over each of the separate groups */
     class Analysis {
       public:
         Analysis(ExtentSeries &_s) : s(_s) { }
+        virtual ~Analysis() { }
+
+        /** called for each row in the group, with s positioned on the row */
         virtual void doGroupRow() = 0;
+
+        /** print the rollup for the group; the key values have already
+            been printed on the same line */
         virtual void printResults() = 0;
+
+        /** approximate bytes of memory used by this analysis, for the
+            memory limit; the default is a guess for a few counters */
+        virtual size_t memoryUsage() const;
+
+        /** Append the state of this analysis to into; only needed if the
+            groups may be spilled.  The default aborts. */
+        virtual void save(std::string &into) const;
+
+        /** Set the state of this freshly made analysis from the bytes
+            save() produced.  The default aborts. */
+        virtual void restore(const std::string &from);
+
+        /** fold the state of from, an analysis of the same group, into
+            this one.  The default aborts. */
+        virtual void merge(Analysis &from);
+
       protected:
         ExtentSeries &s;
     };
 
     /** this is the virtual class that the user will provide to return
-     * the analysis classes that they want. */
+     * the analysis classes that they want.  Analyses may make fields on
+     * the series they are given; with more than one thread operator() is
+     * called concurrently from the partition threads, each with its own
+     * series. */
     class Factory {
       public:
-        virtual Analysis *operator(ExtentSeries &s) = 0;
+        virtual ~Factory() { }
+        virtual Analysis *operator()(ExtentSeries &s) = 0;
     };
 
-    GroupByModule(DataSeriesModule &source,
-                  Factory *f,
-                  ExtentSeries::typeCompatibilityT type_compatibility = ExtentSeries::typeXMLIdentical);
+    /** called by visitGroups() with the values of the key fields of each
+        group, in the order the key fields were given; nulls are
+        GeneralValues of type ft_unknown. */
+    class Visitor {
+      public:
+        virtual ~Visitor() { }
+        virtual void operator()(const std::vector<GeneralValue> &key, Analysis &analysis) = 0;
+    };
 
-    virtual void processRow();
+    /** key_fields must be of type bool, byte, int32, int64, double,
+        variable32 or fixedwidth, and may be nullable; nthreads == -1 ==>
+        use # cpus */
+    GroupByModule(DataSeriesModule &source, const std::vector<std::string> &key_fields,
+                  Factory &factory, int nthreads = 1,
+                  ExtentSeries::typeCompatibilityT type_compatibility
+                  = ExtentSeries::typeExact);
+
+    virtual ~GroupByModule();
+
+    /** Limit the memory used by the groups to about bytes, spilling
+        groups into files in spill_directory (default $TMPDIR or /tmp)
+        when a partition exceeds its share.  0 means no limit. */
+    void setMemoryLimit(size_t bytes, const std::string &spill_directory = "");
+
+    virtual void prepareForProcessing();
+    virtual void processBatch(uint32_t nrows, const dataseries::RowSelection *selection);
+    virtual void completeProcessing();
+
+    /** call visitor on each group in the order of the key values; can be
+        called more than once.  Returns the number of groups. */
+    uint64_t visitGroups(Visitor &visitor);
 
     virtual void printResult();
-  private: 
-    struct hteData {
-        vector<GeneralValue> keys;
-        Analysis *v;
-    };
-    struct hteHash {
-      public:
-        unsigned int operator()(const hteData &k) const {
-            unsigned int hash = 1972;
-            for (vector<GeneralValue>::iterator i = k.keys.begin();
-                i != k.keys.end(); ++i) {
-                hash = i->incrementalHash(hash);
-            }
-            return hash;
-        }
-    };
 
-    struct hteEqual {
-      public:
-        unsigned int operator()(const hteData &a, const hteData &b) const {
-            if (a.size() != b.size())
-                return false;
-            for (unsigned i = 0; i < a.size(); ++i) {
-                if (a[i] != b[i])
-                    return false;
-            }
-            return true;
-        }
-    };
-    HashTable<hteData, hteHash, hteEqual> rollup;
+    /** number of times a partition was spilled, and the total number of
+        groups written out */
+    uint64_t spills, spilled_groups;
+
+    /// \cond INTERNAL_ONLY
+    struct Batch;
+    struct Partition;
+    void workerThread(unsigned partition);
+    /// \endcond
+
+  private:
+    void encodeKeys(Batch &batch, uint32_t nrows, const dataseries::RowSelection *selection);
+    void processPartition(Partition &partition, const Batch &batch);
+    void spill(Partition &partition);
+    void stopWorkers();
+
+    std::vector<std::string> key_field_names;
+    dataseries::KeyEncoder key_encoder;
+    Factory &factory;
+    unsigned nthreads;
+    size_t memory_limit;
+    std::string spill_directory;
+    std::vector<Partition *> partitions;
+    std::vector<PThread *> workers;
+
+    PThreadMutex mutex;
+    PThreadCond work_cond, done_cond;
+    unsigned outstanding_batches;
+    bool source_done;
 };
 
 #endif
-
@@ -0,0 +1,69 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    Approximate distinct counting in bounded space
+*/
+
+#ifndef DATASERIES_HYPERLOGLOG_HPP
+#define DATASERIES_HYPERLOGLOG_HPP
+
+#include <inttypes.h>
+
+#include <vector>
+
+namespace dataseries {
+    /** \brief Mergeable approximate count of distinct values.
+
+        A HyperLogLog sketch with the HyperLogLog++ changes that don't need empirical tables:
+        values are hashed to 64 bits, so there is no large range correction, and small sets are
+        kept exactly as a list of hashes until the list would be as big as the registers.  Like
+        the original, small dense estimates use linear counting.  A dense sketch uses
+        2^precision bytes and has a relative standard error of 1.04 / sqrt(2^precision).  Two
+        sketches of the same precision merge into the sketch of the union of their values. */
+    class HyperLogLog {
+      public:
+        /// precision in [4, 18]
+        explicit HyperLogLog(uint8_t precision = 14);
+
+        /// precision giving a relative standard error of at most error
+        static uint8_t precisionForError(double error);
+
+        void add(const void *data, uint32_t size) {
+            addHash(hash(data, size));
+        }
+        void addHash(uint64_t hash);
+        /// from must have the same precision
+        void add(const HyperLogLog &from);
+
+        /// estimated number of distinct values added
+        double estimate() const;
+
+        /// relative standard error of estimate() once the sketch is dense
+        double error() const {
+            return errorForPrecision(precision);
+        }
+
+        static double errorForPrecision(uint8_t precision);
+
+        size_t memoryUsage() const;
+
+        static uint64_t hash(const void *data, uint32_t size);
+
+      private:
+        void flushSparse() const;
+        void makeDense();
+        void setRegister(uint64_t hash);
+
+        uint8_t precision;
+        // until the sketch is dense: distinct hashes, sorted, plus unsorted recent additions
+        mutable std::vector<uint64_t> sparse, recent;
+        std::vector<uint8_t> registers; // empty while sparse
+    };
+}
+
+#endif
@@ -132,6 +132,12 @@ namespace dataseries {
             write to a DataSeriesFile before you close the file, you need
             to call this. */
         virtual void removeStatsUpdate(Stats *would_update) = 0;
+
+        /** Note that the target size of extents of type type_name is being chosen
+            automatically (see ExtentSizeTuner), and is now target_extent_size bytes.  Sinks
+            that can record the choice in their output do; by default it is ignored. */
+        virtual void noteAutoExtentSize(const std::string &type_name,
+                                        uint32_t target_extent_size);
     };
 };
 
@@ -12,10 +12,14 @@
 #ifndef __DATASERIES_INDEXSOURCEMODULE_H
 #define __DATASERIES_INDEXSOURCEMODULE_H
 
+#include <map>
+#include <set>
+
 #include <Lintel/PThread.hpp>
 #include <Lintel/Deque.hpp>
 #include <Lintel/Stats.hpp>
 
+#include <DataSeries/BloomFilter.hpp>
 #include <DataSeries/DataSeriesModule.hpp>
 
 /** \brief Base class for source modules that select a subset of the
@@ -70,10 +74,30 @@ class IndexSourceModule : public SourceModule {
         be automatically called when you call getExtent; Max
         compressed may slightly overrun because we don't know the size
         of compressed extents until we read them. nthreads == -1 ==>
-        use # cpus */
+        use # cpus.  If unordered is true, extents are returned as soon as
+        any of them has been unpacked rather than in index order, so one
+        slow to decompress extent does not hold up the ones behind it.
+        Each returned extent still has extent_source and
+        extent_source_offset set so that a consumer that cares can
+        restore the order. */
     virtual void startPrefetching(unsigned prefetch_max_compressed = 8 * 1024 * 1024,
                                   unsigned prefetch_max_unpacked = 32 * 1024 * 1024,
-                                  int n_unpack_threads = -1);
+                                  int n_unpack_threads = -1,
+                                  bool unordered = false);
+    /** call this before startPrefetching() to have the module adjust the
+        number of unpack threads and the compressed and unpacked queue limits
+        while it runs.  The values given to startPrefetching() become the
+        starting point; the controller uses the WaitStats to grow whichever
+        of them is making the consumer wait, and shrinks them back when the
+        consumer is not waiting so as to use as little memory as possible.
+        At most max_unpack_threads (-1 ==> # cpus, or the number started if
+        that is more) unpack threads run; any more started are parked.
+        Decisions are logged under the IndexSourceModule::autotune debug
+        category. */
+    void enableAutoTune(unsigned max_compressed = 64 * 1024 * 1024,
+                        unsigned max_unpacked = 256 * 1024 * 1024,
+                        int max_unpack_threads = -1);
+
     /** call this to start the index source module over again from the 
         beginning */
     virtual void resetPos();
@@ -98,6 +122,7 @@ class IndexSourceModule : public SourceModule {
         uint64_t unpack_no_upstream, unpack_downstream_full;
         uint64_t unpack_yield_front, unpack_yield_ready;
         uint64_t skip_unpack_signal;
+        uint64_t unpack_parked; // times an unpack thread was parked by autotuning
 
         Stats active_unpack_stats;
         int active_unpackers;
@@ -108,13 +133,65 @@ class IndexSourceModule : public SourceModule {
                 : nextents(0), consumer(0), compressed_downstream_full(0),
                   unpack_no_upstream(0), unpack_downstream_full(0),
                   unpack_yield_front(0), unpack_yield_ready(0),
-                  skip_unpack_signal(0), active_unpackers(0)
+                  skip_unpack_signal(0), unpack_parked(0), active_unpackers(0)
         { }
     };
 
     /** returns true if there were wait statistics, false otherwise */
     bool getWaitStats(WaitStats &stats);
 
+    /** What autotuning adjusts: the number of unpack threads allowed to run
+        (the rest are parked), and the compressed and unpacked queue limits. */
+    struct PrefetchLimits {
+        unsigned unpack_threads, compressed, unpacked;
+        PrefetchLimits(unsigned unpack_threads = 0, unsigned compressed = 0,
+                       unsigned unpacked = 0)
+            : unpack_threads(unpack_threads), compressed(compressed), unpacked(unpacked) { }
+    };
+
+    /** One autotuning decision from the wait statistics now and as of the
+        last decision, base.  While the consumer waits, grows whichever of
+        limits is holding it up, up to max; while it doesn't, shrinks one of
+        them, down to one thread and 1MiB queues.  Makes at most one change.
+        Returns false, leaving limits alone, until enough extents have been
+        returned since base to decide. */
+    static bool autoTune(const WaitStats &now, const WaitStats &base, PrefetchLimits &limits,
+                         const PrefetchLimits &max);
+
+    /** Lookup mode: only return extents that may have a row with field == value, as judged
+        by the Bloom filters stored in the files (see DataSeriesSink::setBloomFilterFields).
+        Lookups on different fields all have to match; multiple values for one field match if
+        any of them does.  Extents without a filter for any of the fields are returned.  Must
+        be called before prefetching starts.  The caller still has to select the matching
+        rows. */
+    void addLookup(const std::string &field, const GeneralValue &value);
+
+    /** In lookup mode, also count how many of the extents the filters pass really have a
+        matching row, by searching each of them.  Off by default, as that is an extra pass
+        over the rows of every extent returned.  Must be called before prefetching starts. */
+    void setCountLookupPositives(bool count = true);
+
+    struct LookupStats {
+        uint64_t checked; // extents considered while in lookup mode
+        uint64_t skipped; // extents ruled out by their filters
+        uint64_t unfiltered; // extents returned because they had no filters for the fields
+        uint64_t passed; // extents returned because their filters matched
+        // with setCountLookupPositives(), the passed extents that did, and did not, have a
+        // matching row
+        uint64_t true_positives, false_positives;
+
+        LookupStats() : checked(0), skipped(0), unfiltered(0), passed(0), true_positives(0),
+                        false_positives(0) { }
+
+        /// fraction of the extents passed by the filters that had no matching row, if counted
+        double falsePositiveRate() const {
+            uint64_t passed = true_positives + false_positives;
+            return passed == 0 ? 0 : false_positives / static_cast<double>(passed);
+        }
+    };
+
+    LookupStats getLookupStats();
+
     /** use readCompressed() to create this structure, it will unlock
         the mutex while doing the work to get the compressed data */
     struct PrefetchExtent {
@@ -122,17 +199,21 @@ class IndexSourceModule : public SourceModule {
         ExtentType::Ptr type;
         Extent::Ptr unpacked;
         bool need_bitflip;
+        bool lookup_filtered; // passed by lookup filters, and to count as a true or false positive
         std::string uncompressed_type, extent_source;
-        int64_t extent_source_offset;
+        int64_t extent_source_offset, extent_source_mtime;
         PrefetchExtent() 
-                : type(), unpacked(), need_bitflip(false), extent_source_offset(-1) { }
+                : type(), unpacked(), need_bitflip(false), lookup_filtered(false),
+                  extent_source_offset(-1), extent_source_mtime(-1) { }
     };
 
   protected:
     bool startedPrefetching() { return prefetch != NULL; }
 
     /** utility function to read compressed data, it will unlock and relock
-        the mutex associated with prefetching */
+        the mutex associated with prefetching.  If the ExtentCache is
+        enabled and has the extent, the returned structure will already
+        have unpacked set and no bytes. */
     PrefetchExtent *readCompressed(DataSeriesSource *dss,
                                    off64_t offset, 
                                    const std::string &uncompressed_type);
@@ -149,16 +230,30 @@ class IndexSourceModule : public SourceModule {
     // index module without extending the indexer.
     virtual PrefetchExtent *lockedGetCompressedExtent() = 0;
 
+    /** In lookup mode, returns false if the filters in dss show that the extent at offset
+        can't match the lookups; always true otherwise.  Sub-classes call this before
+        readCompressed() for each extent they would return, and readCompressed() has to be
+        the next call for an extent that was passed. */
+    bool lockedLookupMayMatch(DataSeriesSource *dss, off64_t offset);
+
   private:
+    bool lookupFound(const Extent::Ptr &e);
+
     bool lockedIsClosed();
     void lockedStartThreads();
+    void lockedAddUnpackThread();
+    void lockedAutoTune();
+    void lockedFinishUnpack(PrefetchExtent *pe);
 
     friend class IndexSourceModuleCompressedPrefetchThread;
     friend class IndexSourceModuleUnpackThread;
     void compressedPrefetchThread();
-    void unpackThread();
+    void unpackThread(unsigned thread_num);
 
     bool getting_extent;
+    bool autotune;
+    unsigned autotune_max_compressed, autotune_max_unpacked;
+    int autotune_max_threads;
 
     struct Queue {
         Queue(unsigned _limit) : cur(0), limit(_limit) { }
@@ -171,8 +266,15 @@ class IndexSourceModule : public SourceModule {
             SINVARIANT(amount >= 0);
             return can_add(static_cast<uint32_t>(amount));
         }
+        static uint32_t unpackedSize(PrefetchExtent *pe) {
+            if (pe->unpacked != NULL) { // from the ExtentCache
+                return pe->unpacked->size();
+            } else {
+                return Extent::unpackedSize(pe->bytes, pe->need_bitflip,pe->type);
+            }
+        }
         bool can_add(PrefetchExtent *pe) {
-            return can_add(Extent::unpackedSize(pe->bytes, pe->need_bitflip,pe->type));
+            return can_add(unpackedSize(pe));
         }
         bool empty() { 
             return data.empty();
@@ -181,6 +283,14 @@ class IndexSourceModule : public SourceModule {
             cur += size;
             data.push_back(pe);
         }
+        /// account for size without queueing anything; used in unordered
+        /// mode where an extent is only queued once it is unpacked.
+        void reserve(unsigned size) {
+            cur += size;
+        }
+        void addReserved(PrefetchExtent *pe) {
+            data.push_back(pe);
+        }
         void subtract(unsigned size) {
             SINVARIANT(cur >= size);
             cur -= size;
@@ -206,15 +316,21 @@ class IndexSourceModule : public SourceModule {
         std::vector<PThread *> unpack_threads;
         PThreadMutex mutex;
         PThreadCond compressed_cond, unpack_cond, ready_cond;
+        PThreadCond park_cond; // unpack threads idled by autotuning wait here
+        unsigned active_unpack_threads; // threads >= this number are parked
+        WaitStats autotune_base; // stats as of the last autotune decision
         bool source_done;
+        bool unordered; // queue extents in unpacked in completion order
         uint32_t abort_prefetching; // number of threads remaining to abort 
+        uint32_t unpacking; // extents taken from compressed, not yet queued
 
-        PrefetchInfo(unsigned cmm, unsigned tum) 
-                : compressed(cmm), unpacked(tum), source_done(false), abort_prefetching(0)
+        PrefetchInfo(unsigned cmm, unsigned tum, bool _unordered) 
+                : compressed(cmm), unpacked(tum), active_unpack_threads(0), source_done(false),
+                  unordered(_unordered), abort_prefetching(0), unpacking(0)
         { }
 
         bool allDone() {
-            return source_done && compressed.empty() && unpacked.empty();
+            return source_done && compressed.empty() && unpacked.empty() && unpacking == 0;
         }
 
         bool unpackedReady() {
@@ -223,6 +339,13 @@ class IndexSourceModule : public SourceModule {
     };
 
     PrefetchInfo *prefetch; // NULL until startPrefetching() is called
+
+    // lookup mode; keys are BloomFilter::key() of the values
+    std::map<std::string, std::set<std::string> > lookup_keys;
+    std::string lookup_filename; // file lookup_filters came from
+    std::map<int64_t, dataseries::BloomFilter::ByField> lookup_filters;
+    bool lookup_last_filtered, count_lookup_positives;
+    LookupStats lookup_stats; // protected by prefetch->mutex
 };
     
 
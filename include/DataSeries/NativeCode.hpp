@@ -0,0 +1,89 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    Compile generated C++ into a shared object and load it.
+*/
+
+#ifndef DATASERIES_NATIVECODE_HPP
+#define DATASERIES_NATIVECODE_HPP
+
+#include <string>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+
+#include <DataSeries/ExtentType.hpp>
+
+/** \brief Generated C++ for one specific operation, compiled and loaded into the process.
+
+ * Operations like expressions and sort comparisons are normally interpreted through the
+ * field accessors.  Once the extent type is known, they can instead be written out as C++ with
+ * the offsets of the fields as constants, compiled by the local compiler into a shared object,
+ * and loaded with dlopen.  Shared objects are cached on disk by a hash of the source, and the
+ * generators put the type XML and the expression into the source, so each (type, operation)
+ * is only compiled once.
+ *
+ * Native code is disabled until setEnabled(true) is called, or the environment variable
+ * DATASERIES_NATIVE_CODE is set to 1 when it is first checked.  compile() returns an empty
+ * pointer if native code is disabled, or if the compiler is missing or fails, and every user
+ * has to fall back to the interpreted path in that case.  The compiler and flags default to
+ * the ones DataSeries was built with and can be overridden by DATASERIES_NATIVE_CXX and
+ * DATASERIES_NATIVE_CXXFLAGS; the cache directory defaults to
+ * $TMPDIR/dataseries-native-<uid> and can be overridden by DATASERIES_NATIVE_CACHE. */
+class NativeCode : boost::noncopyable {
+  public:
+    typedef boost::shared_ptr<NativeCode> Ptr;
+
+    ~NativeCode();
+
+    static bool enabled();
+    static void setEnabled(bool enabled);
+
+    /** Compile prelude() + source, or find it in the cache, and load it.  Returns an empty
+        pointer if that isn't possible. */
+    static Ptr compile(const std::string &source);
+
+    /** returns the address of an extern "C" symbol, or NULL if it isn't defined */
+    void *lookup(const std::string &symbol) const;
+
+    const std::string &getPath() const {
+        return path;
+    }
+
+    /** Declarations available to all generated code: the loaders used by the expressions
+        returned from isNull() and value(), a Str struct (data, size) for variable32 values
+        with compare() and equal(), and Lintel's Double for epsilon comparisons. */
+    static const std::string &prelude();
+
+    /** C++ expression for whether column is null in the row whose fixed data starts at
+        row_var; always false for non-nullable columns. */
+    static std::string isNull(const ExtentType &type, const std::string &column,
+                              const std::string &row_var);
+
+    /** C++ expression for the value of column in the row whose fixed data starts at row_var,
+        with the variable data of the extent at vardata_var.  Null values read as 0, false or
+        "" like the default values of the field accessors.  The expression has the type of the
+        column (bool, uint8_t, int32_t, int64_t, double or Str).  Returns an empty string for
+        column types without native support (fixedwidth). */
+    static std::string value(const ExtentType &type, const std::string &column,
+                             const std::string &row_var, const std::string &vardata_var);
+
+    /** C++ expression for a Str holding bytes */
+    static std::string literal(const std::string &bytes);
+
+    /** Prefix every line of text with "// " for embedding in generated code */
+    static std::string comment(const std::string &text);
+
+  private:
+    NativeCode(void *handle, const std::string &path) : handle(handle), path(path) { }
+
+    void *handle;
+    const std::string path;
+};
+
+#endif
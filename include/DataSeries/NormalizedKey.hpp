@@ -0,0 +1,195 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    Multi-column keys encoded as byte strings, and hash tables over them
+*/
+
+#ifndef DATASERIES_NORMALIZEDKEY_HPP
+#define DATASERIES_NORMALIZEDKEY_HPP
+
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include <Lintel/HashFns.hpp>
+
+#include <DataSeries/ColumnSpan.hpp>
+#include <DataSeries/GeneralField.hpp>
+
+namespace dataseries {
+    /** \brief Encodes the values of some fields of a row into a normalized key.
+
+        A normalized key is a byte string that compares with memcmp in the same order as the
+        values it was made from, field by field, with nulls first.  Keys are built from the typed
+        column spans without making a GeneralValue per row, and can be hashed and compared as
+        plain bytes.  The fields may be bool, byte, int32, int64, double, variable32 or
+        fixedwidth, and may be nullable. */
+    class KeyEncoder {
+      public:
+        KeyEncoder() : series(NULL) { }
+        ~KeyEncoder();
+
+        /** Make the fields to read the key from on series, whose type must already be set; the
+            fields are deleted with the encoder, so it must not outlive the series. */
+        void init(ExtentSeries &series, const std::vector<std::string> &field_names);
+
+        /// number of fields in the key
+        size_t size() const {
+            return columns.size();
+        }
+
+        /** Encode the keys of either every row (selection == NULL) or the selected rows of the
+            series' current extent, which has nrows rows, back to back into keys; the key of
+            the i'th row encoded is keys[offsets[i] .. offsets[i+1]). */
+        void encodeRows(uint32_t nrows, const RowSelection *selection, std::string &keys,
+                        std::vector<uint32_t> &offsets);
+
+        /** decode a key made by this encoder into the values of its fields; nulls are
+            GeneralValues of type ft_unknown */
+        void decode(const uint8_t *key, std::vector<GeneralValue> &into) const;
+
+        static uint32_t hash(const void *key, uint32_t size) {
+            return lintel::bobJenkinsHash(1972, key, size);
+        }
+
+        /** <0, 0, >0 as a's values are less than, equal to or greater than b's.  Keys are prefix
+            free, so the common prefix and then the sizes decide. */
+        static int compare(const uint8_t *a, uint32_t a_size, const uint8_t *b,
+                           uint32_t b_size) {
+            int ret = memcmp(a, b, std::min(a_size, b_size));
+            if (ret != 0) {
+                return ret;
+            }
+            return a_size < b_size ? -1 : (a_size > b_size ? 1 : 0);
+        }
+
+        /// \cond INTERNAL_ONLY
+        class Column;
+        /// \endcond
+
+      private:
+        KeyEncoder(const KeyEncoder &); // not copyable, owns fields
+        KeyEncoder &operator =(const KeyEncoder &);
+
+        ExtentSeries *series;
+        std::vector<Column *> columns;
+    };
+
+    /** \brief Open addressing hash table from normalized keys to values of type V.
+
+        The keys are copied into one buffer, and the entries are kept in the order they were
+        made, so iterating over entries() is cheap and entries can be referred to by index.
+        Entries can't be removed except by clear(). */
+    template<typename V> class KeyTable {
+      public:
+        struct Entry {
+            Entry(uint32_t hash, uint32_t key_offset, uint32_t key_size)
+                : hash(hash), key_offset(key_offset), key_size(key_size), value() { }
+            uint32_t hash, key_offset, key_size;
+            V value;
+        };
+
+        /** The entry with the key, made with a default value if it isn't there; hash must be
+            KeyEncoder::hash(key, size).  The reference is valid until the next lookup. */
+        Entry &lookup(uint32_t hash, const uint8_t *key, uint32_t size, bool &inserted) {
+            if ((entries_.size() + 1) * 2 > slots.size()) {
+                grow();
+            }
+            size_t mask = slots.size() - 1;
+            for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+                int32_t e = slots[i];
+                if (e < 0) {
+                    slots[i] = entries_.size();
+                    entries_.push_back(Entry(hash, keys.size(), size));
+                    keys.append(reinterpret_cast<const char *>(key), size);
+                    inserted = true;
+                    return entries_.back();
+                }
+                Entry &entry(entries_[e]);
+                if (entry.hash == hash && entry.key_size == size
+                    && memcmp(keys.data() + entry.key_offset, key, size) == 0) {
+                    inserted = false;
+                    return entry;
+                }
+            }
+        }
+
+        const uint8_t *key(const Entry &entry) const {
+            return reinterpret_cast<const uint8_t *>(keys.data()) + entry.key_offset;
+        }
+
+        size_t size() const {
+            return entries_.size();
+        }
+
+        bool empty() const {
+            return entries_.empty();
+        }
+
+        /// the entries in the order they were made
+        std::vector<Entry> &entries() {
+            return entries_;
+        }
+
+        const std::vector<Entry> &entries() const {
+            return entries_;
+        }
+
+        /// bytes used by the table itself, not counting anything the values point to
+        size_t memoryUsage() const {
+            return keys.capacity() + entries_.capacity() * sizeof(Entry)
+                + slots.capacity() * sizeof(int32_t);
+        }
+
+        /// indexes into entries() in the order of the keys
+        void sortedOrder(std::vector<uint32_t> &order) const {
+            order.resize(entries_.size());
+            for (uint32_t i = 0; i < order.size(); ++i) {
+                order[i] = i;
+            }
+            std::sort(order.begin(), order.end(), KeyLess(*this));
+        }
+
+        void clear() {
+            entries_.clear();
+            slots.clear();
+            keys.clear();
+        }
+
+      private:
+        void grow() {
+            slots.assign(std::max(static_cast<size_t>(1024), slots.size() * 2), -1);
+            size_t mask = slots.size() - 1;
+            for (size_t e = 0; e < entries_.size(); ++e) {
+                size_t i = entries_[e].hash & mask;
+                while (slots[i] >= 0) {
+                    i = (i + 1) & mask;
+                }
+                slots[i] = e;
+            }
+        }
+
+        struct KeyLess {
+            KeyLess(const KeyTable &table) : table(table) { }
+            bool operator()(uint32_t a, uint32_t b) const {
+                const Entry &ea(table.entries_[a]), &eb(table.entries_[b]);
+                return KeyEncoder::compare(table.key(ea), ea.key_size,
+                                           table.key(eb), eb.key_size) < 0;
+            }
+            const KeyTable &table;
+        };
+
+        std::string keys; // the keys of the entries, back to back
+        std::vector<Entry> entries_;
+        std::vector<int32_t> slots; // indexes into entries_, -1 if empty; size is a power of 2
+    };
+}
+
+#endif
@@ -0,0 +1,122 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    Row analysis spread across multiple threads with mergeable state
+*/
+
+#ifndef DATASERIES_PARALLEL_ROW_ANALYSIS_MODULE_HPP
+#define DATASERIES_PARALLEL_ROW_ANALYSIS_MODULE_HPP
+
+#include <deque>
+
+#include <Lintel/PThread.hpp>
+
+#include <DataSeries/RowAnalysisModule.hpp>
+
+/** \brief Runs a row analysis over multiple threads, merging the per-thread results at the end.
+
+ * A RowAnalysisModule runs processRow() on the thread that pulls the
+ * extents, so no matter how many threads are unpacking, the analysis
+ * itself uses one core.  This module instead hands each extent it pulls
+ * from the source to one of a pool of worker threads; each worker has its
+ * own Analysis (a RowAnalysisModule with its own series, fields and where
+ * clause) made by the Factory.  Idle workers steal extents queued for
+ * busy ones.  Once the source is exhausted, the analyses are merged into
+ * the first one, which then gets completeProcessing() and printResult().
+ *
+ * Extents are passed downstream as soon as they are queued, so the
+ * analyses and anything downstream must treat them as read-only.  Rows
+ * are not processed in order across extents. */
+class ParallelRowAnalysisModule : public RowAnalysisModule {
+  public:
+    /** this is the class the user defines for the per-thread state; the
+     * usual RowAnalysisModule hooks (firstExtent, prepareForProcessing,
+     * processRow) are called on the worker thread that owns it. */
+    class Analysis : public RowAnalysisModule {
+      public:
+        Analysis(DataSeriesModule &source, ExtentSeries::typeCompatibilityT type_compatibility
+                 = ExtentSeries::typeExact)
+            : RowAnalysisModule(source, type_compatibility) { }
+
+        /** fold the state of from into this analysis; from was made by the
+            same factory, but may not have seen any extents. */
+        virtual void merge(Analysis &from) = 0;
+    };
+
+    /** an Analysis that handles all the selected rows of an extent at
+     * once, overriding processBatch() instead of processRow(); see
+     * BatchAnalysisModule. */
+    class BatchAnalysis : public Analysis {
+      public:
+        BatchAnalysis(DataSeriesModule &source, ExtentSeries::typeCompatibilityT
+                      type_compatibility = ExtentSeries::typeExact)
+            : Analysis(source, type_compatibility) { }
+
+        virtual void processBatch(uint32_t nrows, const dataseries::RowSelection *selection) = 0;
+
+      private:
+        /// only called by RowAnalysisModule::processBatch()
+        virtual void processRow();
+    };
+
+    /** this is the class the user provides to make one Analysis per thread;
+     * the source should be passed on to the Analysis constructor, but the
+     * analysis should not pull extents from it. */
+    class Factory {
+      public:
+        virtual ~Factory() { }
+        virtual Analysis *operator()(DataSeriesModule &source) = 0;
+    };
+
+    /** nthreads == -1 ==> use # cpus; max_queued_bytes bounds the extents
+        waiting for a worker */
+    ParallelRowAnalysisModule(DataSeriesModule &source, Factory &factory, int nthreads = -1,
+                              size_t max_queued_bytes = 32 * 1024 * 1024);
+    virtual ~ParallelRowAnalysisModule();
+
+    virtual Extent::Ptr getSharedExtent();
+
+    /** never called; rows are processed by the per-thread analyses */
+    virtual void processRow();
+
+    /** waits for the workers, merges their analyses and calls
+        completeProcessing() on the merged analysis */
+    virtual void completeProcessing();
+
+    /** prints the merged analysis */
+    virtual void printResult();
+
+    /** the merged analysis, NULL until processing has completed */
+    Analysis *getMergedAnalysis() {
+        return merged ? analyses.front() : NULL;
+    }
+
+    /** number of extents a worker took from another worker's queue */
+    uint64_t steals;
+
+    /// \cond INTERNAL_ONLY
+    void workerThread(unsigned thread_num);
+    /// \endcond
+
+  private:
+    void startWorkers();
+
+    Factory &factory;
+    unsigned nthreads;
+    std::vector<Analysis *> analyses;
+    std::vector<PThread *> workers;
+
+    PThreadMutex mutex;
+    PThreadCond work_cond, space_cond;
+    std::vector<std::deque<Extent::Ptr> > queues; // one per worker
+    unsigned next_queue;
+    size_t queued_bytes, max_queued_bytes;
+    bool source_done, merged;
+};
+
+#endif
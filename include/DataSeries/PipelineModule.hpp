@@ -0,0 +1,81 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    A linear series of modules, each running on its own thread
+*/
+
+#ifndef DATASERIES_PIPELINEMODULE_HPP
+#define DATASERIES_PIPELINEMODULE_HPP
+
+#include <iostream>
+
+#include <DataSeries/PrefetchBufferModule.hpp>
+#include <DataSeries/SequenceModule.hpp>
+
+/** \brief A SequenceModule whose modules run in parallel as a pipeline.
+
+ * In a SequenceModule each getSharedExtent() pulls an extent through every
+ * module on the caller's thread, so a filter, a transform and an analysis
+ * take turns.  A PipelineModule is built the same way, but tail() returns
+ * a bounded queue (a PrefetchBufferModule) fed from the last module by a
+ * thread of its own, so each module added after it runs on a different
+ * thread than the module before.  The last module runs on the caller's
+ * thread.  The queues aren't part of the sequence, so iterating over the
+ * modules or RowAnalysisModule::printAllResults() work as before.
+ *
+ * Each stage's busy and idle times are kept so the slowest one, which
+ * limits the throughput of the whole pipeline, can be found.
+ **/
+class PipelineModule : public SequenceModule {
+  public:
+    /** @param max_queue_memory bounds each queue between stages as for
+        PrefetchBufferModule; the memory used is at most about this times
+        the number of stages. */
+    PipelineModule(DataSeriesModule *head, unsigned max_queue_memory = 16*1024*1024);
+    PipelineModule(DsmPtr head, unsigned max_queue_memory = 16*1024*1024);
+
+    /** Stops the threads and deletes the queues before the modules. */
+    virtual ~PipelineModule();
+
+    /** a queue fed from the last module by a thread of its own; repeated
+        calls without an addModule in between return the same queue. */
+    virtual DataSeriesModule &tail();
+
+    /** gets the next extent from the last module on this thread. */
+    virtual Extent::Ptr getSharedExtent();
+
+    /** likewise, passing on the selection of the last module */
+    virtual Extent::Ptr getSelectedExtent(const dataseries::RowSelection *&selection);
+
+    /** likewise, for callers of the deprecated getExtent() */
+    virtual Extent *getExtent();
+
+    /** Seconds a stage's module spent working, and waiting for its input or
+        for room in its output queue. */
+    struct StageTimes {
+        double busy, idle;
+        StageTimes() : busy(0), idle(0) { }
+    };
+
+    /** times for each module, in the order they were added */
+    std::vector<StageTimes> getStageTimes();
+
+    /** print a line with the busy and idle times of each stage, marking the
+        slowest */
+    void printStageTimes(std::ostream &to = std::cout);
+
+  private:
+    DataSeriesModule &lastStage();
+
+    unsigned max_queue_memory;
+    /// queue fed from module i, or NULL if no module reads from it
+    std::vector<PrefetchBufferModule *> queues;
+    double tail_time; // seconds the caller spent getting extents
+};
+
+#endif
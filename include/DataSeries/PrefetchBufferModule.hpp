@@ -42,6 +42,16 @@ class PrefetchBufferModule : public DataSeriesModule {
     /** Launch the worker thread that gets Extents from the source. */
     void startPrefetching();
 
+    /** Seconds spent on either side of the queue so far, for finding which of the
+        source and the consumer is the bottleneck. */
+    struct Times {
+        double source; ///< prefetch thread getting extents from the source
+        double full; ///< prefetch thread waiting for room in the queue
+        double empty; ///< consumer waiting for an extent
+        Times() : source(0), full(0), empty(0) { }
+    };
+    Times getTimes();
+
     /// \cond INTERNAL_ONLY
     void prefetcherThread();
     /// \endcond
@@ -51,6 +61,7 @@ class PrefetchBufferModule : public DataSeriesModule {
     Deque<Extent::Ptr> buffer;
     bool source_done, start_prefetching, abort_prefetching;
     unsigned cur_used_memory, max_used_memory;
+    Times times;
     PThreadMutex mutex;
     PThreadCond cond;
 };
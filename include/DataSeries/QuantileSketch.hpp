@@ -0,0 +1,87 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    Mergeable quantile sketch with a bounded size
+*/
+
+#ifndef DATASERIES_QUANTILESKETCH_HPP
+#define DATASERIES_QUANTILESKETCH_HPP
+
+#include <ostream>
+#include <vector>
+
+#include <Lintel/Stats.hpp>
+
+namespace dataseries {
+    /** \brief Approximate quantiles in bounded space, mergeable across threads and runs.
+
+        A StatsQuantile is sized for the number of values it may see, so keeping one per group
+        of a large group by uses a lot of memory.  This is a KLL sketch: values go into a stack
+        of compactors, and a full compactor sorts itself and passes every other value up to the
+        next one, where each value stands for twice as many.  The size is O(k) no matter how
+        many values are added, the rank error of a quantile is about error() with high
+        probability, and two sketches with the same k merge into one with the same bounds.
+        The count, mean, stddev, min and max are exact, as for Stats.  The choice of which half
+        of a compactor moves up is random, but seeded the same for every sketch, so results
+        are repeatable. */
+    class QuantileSketch : public Stats {
+      public:
+        /// error is the target normalized rank error of getQuantile()
+        explicit QuantileSketch(double error = 0.01);
+        virtual ~QuantileSketch();
+
+        virtual void reset();
+        virtual void add(const double value);
+        /// from must have been made with the same error
+        void add(const QuantileSketch &from);
+
+        /// value with about quantile * count() values <= it; quantile is in [0,1]
+        double getQuantile(double quantile) const;
+
+        /// nranges - 1 evenly spaced quantiles after a summary line
+        void printTextRanges(std::ostream &to, int nranges) const;
+        /// deciles and tails
+        virtual void printText(std::ostream &to) const;
+
+        /// bytes in use, including the object itself
+        size_t memoryUsage() const;
+
+        /// normalized rank error for the compactor size
+        double error() const;
+
+      private:
+        typedef std::vector<std::pair<double, uint64_t> > Weighted; // value, weight
+
+        void compress();
+        uint32_t levelCapacity(size_t level) const;
+        void updateCapacity();
+        void weightedItems(Weighted &into) const;
+        static double quantileOf(const Weighted &items, uint64_t total, double quantile);
+
+        uint32_t k;
+        std::vector<std::vector<double> > levels; // level i values each stand for 2^i values
+        size_t nitems, capacity;
+        uint32_t coin;
+    };
+
+    /** Make a StatsQuantile(error, nbound) if sketch_error is 0, otherwise a
+        QuantileSketch(sketch_error); the functions below work on either, so analyses can
+        offer a sketch as an option without duplicating their printing code. */
+    Stats *newQuantileStats(double sketch_error, double error = 0.01,
+                            int64_t nbound = 1000 * 1000 * 1000);
+    /// quantile of a StatsQuantile or QuantileSketch
+    double getQuantile(Stats &stats, double quantile);
+    /// merge from into into; both must be StatsQuantile or both QuantileSketch
+    void mergeQuantiles(Stats &into, Stats &from);
+    /// printTextRanges of a StatsQuantile or QuantileSketch
+    void printQuantileRanges(Stats &stats, std::ostream &to, int nranges);
+    /// memoryUsage of a StatsQuantile or QuantileSketch
+    size_t quantileMemoryUsage(Stats &stats);
+}
+
+#endif
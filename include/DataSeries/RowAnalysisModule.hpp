@@ -12,6 +12,7 @@
 #ifndef __ROW_ANALYSIS_MODULE_H
 #define __ROW_ANALYSIS_MODULE_H
 
+#include <DataSeries/ColumnSpan.hpp>
 #include <DataSeries/DataSeriesModule.hpp>
 
 class DSExpr;
@@ -34,8 +35,24 @@ class RowAnalysisModule : public DataSeriesModule {
                       = ExtentSeries::typeExact);
     virtual ~RowAnalysisModule();
     
+    /** Processes the next extent from the source and returns it.  If the
+        source passed on only some of the rows of the extent, the returned
+        extent is a copy of just those rows. */
     virtual Extent::Ptr getSharedExtent();
 
+    /** Like getSharedExtent(), but returns the source's extent and selection
+        as they are, so a filter in front of the analysis never has to copy
+        rows.  A subclass that overrides getSharedExtent() without calling
+        this class's version always passes on every row. */
+    virtual Extent::Ptr getSelectedExtent(const dataseries::RowSelection *&selection);
+
+    /** Runs the hooks and processBatch() over the rows of e, or just over
+        the rows in input_selection if it is not NULL; getSharedExtent() calls
+        this for each extent it gets from the source.  Drivers such as
+        ParallelRowAnalysisModule call it directly to push extents in. */
+    void processExtent(const Extent::Ptr &e,
+                       const dataseries::RowSelection *input_selection = NULL);
+
     // TODO: think about a firstExtentHook; primary (only?) use of
     // newExtentHook so far has been to handle the case of different
     // field names, and for that, you only need to hook on the first
@@ -65,9 +82,19 @@ class RowAnalysisModule : public DataSeriesModule {
         be called if there were no extents to process */
     virtual void prepareForProcessing();
 
-    /** this function will get called to process each row. */
+    /** this function will get called to process each row */
     virtual void processRow() = 0;
 
+    /** Called once per extent with the rows that passed the where clause.
+        The series is set to the extent and positioned at its first row.
+        nrows is the number of rows in the extent; selection is NULL if every
+        row was selected, and otherwise holds the selected row numbers in
+        increasing order.  Analyses can override this to run tight loops over
+        the values from Field::span(); the default positions the series on
+        each selected row in turn and calls processRow().  Analyses that only
+        work on whole extents derive from BatchAnalysisModule instead. */
+    virtual void processBatch(uint32_t nrows, const dataseries::RowSelection *selection);
+
     /** this function will get called once all data has been processed */
     virtual void completeProcessing();
     
@@ -80,6 +107,8 @@ class RowAnalysisModule : public DataSeriesModule {
      * function will be called.  For each row the expression is
      * evaluated, and if it evaluates to true, then processRow will be
      * called. An empty expression is treated as true for all values.
+     * The expression is evaluated over each extent at once with
+     * DSExpr::selectRows, and the result is passed to processBatch.
      *
      * @param where_expression the expression to evaluate
      */
@@ -104,6 +133,29 @@ class RowAnalysisModule : public DataSeriesModule {
 
     std::string where_expr_str;
     DSExpr *where_expr;
+
+  private:
+    dataseries::RowSelection selection, where_selection;
+    /// where getSharedExtent() leaves the input selection when called from getSelectedExtent()
+    const dataseries::RowSelection **pass_selection;
+};
+
+/** \brief A RowAnalysisModule that handles all the selected rows of an
+    extent at once.
+
+ * Analyses that run their own loops over each extent derive from this
+ * and have to override processBatch() instead of processRow(). */
+class BatchAnalysisModule : public RowAnalysisModule {
+  public:
+    BatchAnalysisModule(DataSeriesModule &source, ExtentSeries::typeCompatibilityT
+                        type_compatibility = ExtentSeries::typeExact)
+        : RowAnalysisModule(source, type_compatibility) { }
+
+    virtual void processBatch(uint32_t nrows, const dataseries::RowSelection *selection) = 0;
+
+  private:
+    /// only called by RowAnalysisModule::processBatch()
+    virtual void processRow();
 };
 
 #endif
@@ -128,6 +128,11 @@ namespace dataseries {
             DEBUG_SINVARIANT(extent == them.extent);
             return row_offset >= them.row_offset;
         }
+
+        /// start of the row in e, for code that reads rows directly rather than through fields
+        const uint8_t *rowPosition(const Extent &e) const {
+            return rowPos(e);
+        }
         
       private:
         uint8_t *rowPos(const Extent &e) const {
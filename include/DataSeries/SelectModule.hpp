@@ -0,0 +1,52 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    Module passing on the rows that match a where expression
+*/
+
+#ifndef DATASERIES_SELECTMODULE_HPP
+#define DATASERIES_SELECTMODULE_HPP
+
+#include <boost/scoped_ptr.hpp>
+
+#include <DataSeries/DataSeriesModule.hpp>
+#include <DataSeries/DSExpr.hpp>
+#include <DataSeries/GeneralField.hpp>
+
+/** \brief Passes on the rows of its source for which a where expression is true.
+
+    getSelectedExtent() hands on each extent of the source that has any
+    matching rows together with the selection of those rows, so an analysis
+    after the select (e.g. a RowAnalysisModule) visits just those rows and
+    nothing is copied.  getSharedExtent() instead copies the selected rows into
+    extents of about target_extent_size bytes for modules that need
+    contiguous extents; an extent in which every row matched is passed on as
+    it is. */
+class SelectModule : public DataSeriesModule {
+  public:
+    SelectModule(DataSeriesModule &source, const std::string &where_expr,
+                 uint32_t target_extent_size = 96*1024);
+    virtual ~SelectModule();
+
+    virtual Extent::Ptr getSharedExtent();
+    virtual Extent::Ptr getSelectedExtent(const dataseries::RowSelection *&selection);
+
+    /// rows passed on by the source, and rows of those that matched
+    uint64_t input_rows, selected_rows;
+
+  private:
+    DataSeriesModule &source;
+    const std::string where_expr_str;
+    const uint32_t target_extent_size;
+    ExtentSeries input_series, output_series;
+    ExtentRecordCopy copier;
+    boost::scoped_ptr<DSExpr> where_expr;
+    dataseries::RowSelection selection, where_selection;
+};
+
+#endif
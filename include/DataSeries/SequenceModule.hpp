@@ -44,7 +44,7 @@ class SequenceModule : public DataSeriesModule {
 
     /** get the last data series module in the sequence for connecting in to the next module
         in the sequence.  Usually used like seq_mod.addModule(new Module(seq_mod.tail())) */
-    DataSeriesModule &tail();
+    virtual DataSeriesModule &tail();
 
     /** mod should be connected to the previous tail, and will become the new
         tail of the series; mod should have been allocated with new.  The
@@ -76,6 +76,10 @@ class SequenceModule : public DataSeriesModule {
         all the \link DataSeriesModule modules \endlink added.*/
     virtual Extent::Ptr getSharedExtent();
 
+    /** calls \link DataSeriesModule::getSelectedExtent getSelectedExtent \endlink on
+        the tail, so that a filter in the sequence can pass on its input extents. */
+    virtual Extent::Ptr getSelectedExtent(const dataseries::RowSelection *&selection);
+
     /** Returns the number of Modules added, including the one passed to the
         constructor. */
     unsigned size() { return modules.size(); }
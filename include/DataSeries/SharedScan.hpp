@@ -0,0 +1,99 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    Many analyses over a single scan of the same files
+*/
+
+#ifndef DATASERIES_SHAREDSCAN_HPP
+#define DATASERIES_SHAREDSCAN_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <DataSeries/BroadcastBuffer.hpp>
+#include <DataSeries/SequenceModule.hpp>
+#include <DataSeries/TypeIndexModule.hpp>
+
+/** \brief Runs many analyses over the same files, reading and unpacking each
+    type only once.
+
+    Each analysis is a SequenceModule headed by every extent of the types
+    matching its type match; add the analysis modules to it as usual.  run()
+    makes one TypeIndexModule per distinct type match, shares its extents
+    among all the analyses of that type match through a BroadcastBuffer, and
+    runs each analysis on a thread of its own.  The analyses must not modify
+    the extents.
+
+    \code
+    SharedScan scan;
+    SequenceModule &latency(scan.newAnalysis("NFS trace: common"));
+    latency.addModule(new DSStatGroupByModule(latency.tail(), ...));
+    SequenceModule &hosts(scan.newAnalysis("NFS trace: common"));
+    hosts.addModule(...);
+    scan.addSource(file);
+    scan.run();
+    RowAnalysisModule::printAllResults(latency);
+    \endcode
+*/
+class SharedScan {
+  public:
+    /** @param max_buffer_memory bounds the extents buffered for each type
+        match, so how far apart its analyses can get */
+    SharedScan(size_t max_buffer_memory = 64*1024*1024);
+    /** deletes the analyses, then the scans */
+    ~SharedScan();
+
+    /** add a file for all of the scans; must be called before run() */
+    void addSource(const std::string &filename);
+
+    /** a new analysis over the extents of the types matching type_match, as
+        for TypeIndexModule; owned by the SharedScan, and all of them must be
+        made before run() */
+    SequenceModule &newAnalysis(const std::string &type_match);
+
+    /** scan the files once for each type match, running all the analyses */
+    void run();
+
+    /// analyses in the order they were made
+    size_t analysisCount() const {
+        return analyses.size();
+    }
+    SequenceModule &analysis(size_t i) {
+        return *analyses[i].sequence;
+    }
+    const std::string &analysisTypeMatch(size_t i) const {
+        return analyses[i].type_match;
+    }
+
+    /// the scan for a type match, e.g. for its statistics
+    TypeIndexModule &scan(const std::string &type_match);
+
+    /// number of distinct type matches, i.e. scans
+    size_t scanCount() const {
+        return scans.size();
+    }
+
+  private:
+    struct Scan {
+        TypeIndexModule *source;
+        BroadcastBuffer *broadcast;
+    };
+    struct Analysis {
+        std::string type_match;
+        SequenceModule *sequence;
+    };
+
+    const size_t max_buffer_memory;
+    std::map<std::string, Scan> scans; // by type match
+    std::vector<Analysis> analyses;
+    std::vector<std::string> filenames;
+    bool started;
+};
+
+#endif
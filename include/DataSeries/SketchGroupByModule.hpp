@@ -0,0 +1,163 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    Approximate distinct counts and top-k over fields, grouped by other fields
+*/
+
+#ifndef DATASERIES_SKETCHGROUPBYMODULE_HPP
+#define DATASERIES_SKETCHGROUPBYMODULE_HPP
+
+#include <DataSeries/DSExpr.hpp>
+#include <DataSeries/HyperLogLog.hpp>
+#include <DataSeries/NormalizedKey.hpp>
+#include <DataSeries/ParallelRowAnalysisModule.hpp>
+#include <DataSeries/SpaceSaving.hpp>
+
+/** \brief Keeps a sketch over the values of some fields for each group of rows.
+
+ * The value of a row is the normalized key of the value fields, and its
+ * group is the normalized key of the group by fields (none for a single
+ * group), so both can be any number of fields of the usual types.  The
+ * sketches have bounded size no matter how many distinct values there
+ * are, and merge, so this is a ParallelRowAnalysisModule::BatchAnalysis.
+ * Subclasses say what the sketch is. */
+class SketchGroupByModule : public ParallelRowAnalysisModule::BatchAnalysis {
+  public:
+    virtual ~SketchGroupByModule();
+
+    virtual void prepareForProcessing();
+    virtual void processBatch(uint32_t nrows, const dataseries::RowSelection *selection);
+    /// from must have been constructed with the same arguments
+    virtual void merge(ParallelRowAnalysisModule::Analysis &from);
+    virtual void printResult();
+
+    /// number of groups seen so far
+    size_t groupCount() const {
+        return groups.size();
+    }
+
+    /// true for distinct[=error] and topk[=k][:weight-expr]
+    static bool validStatType(const std::string &stat_type);
+
+    /** the DistinctCountModule or TopKModule for a stat type, over the comma separated
+        value_fields */
+    static SketchGroupByModule *make(DataSeriesModule &source, const std::string &stat_type,
+                                     const std::string &value_fields,
+                                     const std::vector<std::string> &groupby,
+                                     const std::string &where_expr = "",
+                                     ExtentSeries::typeCompatibilityT tc
+                                     = ExtentSeries::typeExact);
+
+  protected:
+    SketchGroupByModule(DataSeriesModule &source, const std::string &name,
+                        const std::vector<std::string> &value_fields,
+                        const std::vector<std::string> &groupby, const std::string &where_expr,
+                        ExtentSeries::typeCompatibilityT tc);
+
+    /// make the sketch for group number groupCount() - 1
+    virtual void newGroup() = 0;
+    /** add the selected rows; the value of the i'th is value_keys[value_offsets[i] ..
+        value_offsets[i+1]) and its group row_groups[i] */
+    virtual void addRows(uint32_t nrows, const dataseries::RowSelection *selection,
+                         const std::vector<uint32_t> &row_groups) = 0;
+    /// merge group from_group of from into group
+    virtual void mergeGroup(uint32_t group, SketchGroupByModule &from, uint32_t from_group) = 0;
+    /// the header line(s) for the statistic; groupby_list is empty for no grouping
+    virtual void printHeader(const std::string &groupby_list) = 0;
+    /** print a group; key has the group by values, and the line prefix should start each
+        line of a single line result */
+    virtual void printGroup(uint32_t group, const std::vector<GeneralValue> &key,
+                            const std::string &prefix) = 0;
+
+    const std::vector<std::string> value_fields, groupby_names;
+    dataseries::KeyEncoder value_encoder;
+    std::string value_keys;
+    std::vector<uint32_t> value_offsets;
+
+  private:
+    void initKeys();
+
+    const std::string name;
+    dataseries::KeyEncoder group_encoder;
+    bool keys_ready;
+    dataseries::KeyTable<uint32_t> groups; // key -> group number
+    std::string group_keys;
+    std::vector<uint32_t> group_offsets, row_groups;
+};
+
+/** \brief Approximate number of distinct values of some fields in each group, using a
+    dataseries::HyperLogLog for each. */
+class DistinctCountModule : public SketchGroupByModule {
+  public:
+    /// error is the target relative standard error
+    DistinctCountModule(DataSeriesModule &source, const std::vector<std::string> &value_fields,
+                        const std::vector<std::string> &groupby, double error = 0.01,
+                        const std::string &where_expr = "",
+                        ExtentSeries::typeCompatibilityT tc = ExtentSeries::typeExact);
+    virtual ~DistinctCountModule();
+
+    /// estimated distinct values in group number group
+    double estimate(uint32_t group) const {
+        return sketches[group]->estimate();
+    }
+
+  protected:
+    virtual void newGroup();
+    virtual void addRows(uint32_t nrows, const dataseries::RowSelection *selection,
+                         const std::vector<uint32_t> &row_groups);
+    virtual void mergeGroup(uint32_t group, SketchGroupByModule &from, uint32_t from_group);
+    virtual void printHeader(const std::string &groupby_list);
+    virtual void printGroup(uint32_t group, const std::vector<GeneralValue> &key,
+                            const std::string &prefix);
+
+  private:
+    const uint8_t precision;
+    std::vector<dataseries::HyperLogLog *> sketches; // by group number
+};
+
+/** \brief Approximate k most frequent values of some fields in each group, by row count or by
+    the sum of a weight expression, using a dataseries::SpaceSaving for each. */
+class TopKModule : public SketchGroupByModule {
+  public:
+    /// weight_expr is empty to count rows
+    TopKModule(DataSeriesModule &source, const std::vector<std::string> &value_fields,
+               const std::vector<std::string> &groupby, uint32_t k = 100,
+               const std::string &weight_expr = "", const std::string &where_expr = "",
+               ExtentSeries::typeCompatibilityT tc = ExtentSeries::typeExact);
+    virtual ~TopKModule();
+
+    virtual void prepareForProcessing();
+
+    /// the counted values of group number group by decreasing count
+    void top(uint32_t group, std::vector<dataseries::SpaceSaving::Entry> &into) const {
+        sketches[group]->top(into);
+    }
+
+    /// decode the key of a value returned by top()
+    void decodeValue(const std::string &key, std::vector<GeneralValue> &into) const {
+        value_encoder.decode(reinterpret_cast<const uint8_t *>(key.data()), into);
+    }
+
+  protected:
+    virtual void newGroup();
+    virtual void addRows(uint32_t nrows, const dataseries::RowSelection *selection,
+                         const std::vector<uint32_t> &row_groups);
+    virtual void mergeGroup(uint32_t group, SketchGroupByModule &from, uint32_t from_group);
+    virtual void printHeader(const std::string &groupby_list);
+    virtual void printGroup(uint32_t group, const std::vector<GeneralValue> &key,
+                            const std::string &prefix);
+
+  private:
+    const uint32_t k;
+    const std::string weight_expr_str;
+    DSExpr *weight_expr;
+    std::vector<double> weights;
+    std::vector<dataseries::SpaceSaving *> sketches; // by group number
+};
+
+#endif
@@ -0,0 +1,74 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    Approximate heavy hitters in bounded space
+*/
+
+#ifndef DATASERIES_SPACESAVING_HPP
+#define DATASERIES_SPACESAVING_HPP
+
+#include <inttypes.h>
+
+#include <string>
+#include <vector>
+
+#include <Lintel/HashMap.hpp>
+
+namespace dataseries {
+    /** \brief Mergeable approximate top-k by count or weight.
+
+        The Space-Saving algorithm: at most capacity keys are counted; a key that isn't counted
+        replaces the key with the smallest count, and inherits that count as its error.  Every
+        key whose true weight is more than total() / capacity is counted, and for each counted
+        key, count - error <= true weight <= count.  Weights must be non-negative.  Merging keeps
+        the same guarantee for the combined input, with keys missing from a full summary
+        charged that summary's smallest count. */
+    class SpaceSaving {
+      public:
+        struct Entry {
+            Entry(const std::string &key, double count, double error)
+                : key(key), count(count), error(error) { }
+            std::string key;
+            double count, error;
+        };
+
+        explicit SpaceSaving(uint32_t capacity = 100);
+
+        void add(const void *key, uint32_t size, double weight = 1);
+        /// from may have a different capacity; this one's is kept
+        void add(const SpaceSaving &from);
+
+        /// the counted keys by decreasing count
+        void top(std::vector<Entry> &into) const;
+
+        /// sum of the weights added
+        double total() const {
+            return total_weight;
+        }
+
+        uint32_t capacity() const {
+            return capacity_;
+        }
+
+        size_t memoryUsage() const;
+
+      private:
+        void siftDown(size_t pos);
+        void swapEntries(size_t a, size_t b);
+        double minCount() const {
+            return heap.size() < capacity_ ? 0 : heap[0].count;
+        }
+
+        uint32_t capacity_;
+        double total_weight;
+        std::vector<Entry> heap; // min-heap on count
+        HashMap<std::string, size_t> positions; // key -> index in heap
+    };
+}
+
+#endif
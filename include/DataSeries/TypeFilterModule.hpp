@@ -13,6 +13,9 @@
 
 #include <string>
 #include <vector>
+
+#include <Lintel/HashMap.hpp>
+
 #include <DataSeries/IndexSourceModule.hpp>
 
 /** \brief A Filter class for the TypeFilterModule that returns any type matching a given prefix.
@@ -36,20 +39,31 @@ class PrefixFilter {
  * Each DataSeries file contains an index that tells the type and
  * offset of every extent in that file.  This source module takes a
  * Filter class as a template parameter which specifies which types
- * to return and which to ignore. */
+ * to return and which to ignore.  The filter is evaluated once per type
+ * name, and the types in each file are resolved and checked for
+ * consistency with the earlier files only when the scan reaches that file. */
 template<class Filter>
 class TypeFilterModule : public IndexSourceModule {
   public:
     TypeFilterModule(Filter &f)
     : IndexSourceModule(), filter(f), index_series(ExtentSeries::typeExact),
       extent_offset(index_series, "offset"), extent_type(index_series, "extenttype"),
-      cur_file(0), cur_source(NULL)
+      cur_file(0), cur_source(NULL), type_compatibility(ExtentSeries::typeExact)
     { }
 
     void addSource(const std::string &filename) {
         input_files.push_back(filename);
     }
 
+    /** With the default of typeExact, a type name that passes the filter has
+        to have the identical type in every file.  With typeLoose, the
+        definition may change between files. */
+    void setTypeCompatibility(ExtentSeries::typeCompatibilityT tc) {
+        INVARIANT(startedPrefetching() == false,
+                  "invalid to change type compatibility after we start prefetching");
+        type_compatibility = tc;
+    }
+
     virtual void lockedResetModule() {
         index_series.clearExtent();
         cur_file = 0;
@@ -65,10 +79,11 @@ class TypeFilterModule : public IndexSourceModule {
                 cur_source = new DataSeriesSource(input_files[cur_file]);
                 INVARIANT(cur_source->index_extent != NULL,
                           "can't handle source with null index extent\n");
+                checkTypes();
                 index_series.setExtent(cur_source->index_extent);
             }
             for (; index_series.morerecords(); ++index_series) {
-                if (filter(extent_type.stringval())) {
+                if (matches(extent_type.stringval())) {
                     off64_t v = extent_offset.val();
                     PrefetchExtent *ret = readCompressed(cur_source, v, extent_type.stringval());
                     ++index_series;
@@ -92,9 +107,43 @@ class TypeFilterModule : public IndexSourceModule {
     Variable32Field extent_type;
 
   private:
+    bool matches(const std::string &type_name) {
+        bool *ret = filter_results.lookup(type_name);
+        if (ret == NULL) {
+            ret = &filter_results[type_name];
+            *ret = filter(type_name);
+        }
+        return *ret;
+    }
+
+    void checkTypes() {
+        const ExtentTypeLibrary::NameToType &types(cur_source->getLibrary().name_to_type);
+        for (ExtentTypeLibrary::NameToType::const_iterator i = types.begin();
+             i != types.end(); ++i) {
+            if (!matches(i->first)) {
+                continue;
+            }
+            ExtentType::Ptr &prev(matched_types[i->first]);
+            if (prev == NULL) {
+                prev = i->second;
+            } else if (prev != i->second) {
+                INVARIANT(type_compatibility == ExtentSeries::typeLoose,
+                          boost::format("type %s changed definition; this is only valid with"
+                                        " typeLoose compatibility\nFile with mismatch was %s\n"
+                                        "Type 1:\n%s\nType 2:\n%s\n")
+                          % i->first % input_files[cur_file]
+                          % prev->getXmlDescriptionString()
+                          % i->second->getXmlDescriptionString());
+            }
+        }
+    }
+
     unsigned int cur_file;
     DataSeriesSource *cur_source;
     std::vector<std::string> input_files;
+    ExtentSeries::typeCompatibilityT type_compatibility;
+    HashMap<std::string, bool> filter_results;
+    HashMap<std::string, ExtentType::Ptr> matched_types;
 };
 
 typedef TypeFilterModule<PrefixFilter> PrefixFilterModule;
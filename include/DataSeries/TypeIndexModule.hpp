@@ -13,7 +13,11 @@
 #ifndef __DATASERIES_TYPEINDEXMODULE_H
 #define __DATASERIES_TYPEINDEXMODULE_H
 
+#include <boost/scoped_ptr.hpp>
+
+#include <DataSeries/DSExpr.hpp>
 #include <DataSeries/IndexSourceModule.hpp>
+#include <DataSeries/ZoneMap.hpp>
 
 /** \brief Source module that returns extents matching a particular type
 
@@ -22,7 +26,14 @@
  * extent type match; if the match type is empty, this returns all of
  * the extents, and otherwise, chooses a type using
  * ExtentTypeLibrary::getTypeMatch, and returns all of the extents
- * which have the same type. */
+ * which have the same type.  The match is resolved separately for each
+ * file when that file is opened, so nothing is read from a file until the
+ * scan reaches it; files which have no matching type are skipped.
+ *
+ * If the files have zone maps (see DataSeriesSink::setZoneMapFields), a zone predicate or
+ * zone ranges let the module skip the extents whose zone maps show that none of their rows can
+ * match, without reading them.  Skipping is only an optimization; the extents that are
+ * returned still have to be filtered, and files without zone maps return every extent. */
 class TypeIndexModule : public IndexSourceModule {
   public:
     typedef boost::shared_ptr<TypeIndexModule> Ptr;
@@ -45,10 +56,32 @@ class TypeIndexModule : public IndexSourceModule {
         inputFiles = from.inputFiles;
     }
 
+    /** With the default of typeExact, every file has to match the identical
+        type (checked as each file is opened).  With typeLoose, the matched
+        type may differ between files; the series reading the extents then
+        also needs to be typeLoose. */
+    void setTypeCompatibility(ExtentSeries::typeCompatibilityT tc);
+
+    /** Skip extents for which the zone maps show that expr (a DSExpr over the fields of the
+        matched type) is false for every row.  Requires a non-empty type match. */
+    void setZonePredicate(const std::string &expr);
+
+    /** Skip extents for which the zone maps show that no row has field in [min, max].  Multiple
+        ranges all have to overlap for an extent to be returned. */
+    void addZoneRange(const std::string &field, const GeneralValue &min,
+                      const GeneralValue &max);
+
+    /// number of extents skipped because of their zone maps
+    uint64_t getZoneSkippedExtents() {
+        return zone_skipped_extents;
+    }
+
     const ExtentType *getType() FUNC_DEPRECATED {
         return my_type.get();
     }
 
+    /** Returns the type matched in the first file that had a match, NULL if
+        no file has been opened or matched yet. */
     const ExtentType::Ptr getTypePtr() {
         return my_type;
     }
@@ -62,12 +95,28 @@ class TypeIndexModule : public IndexSourceModule {
     virtual PrefetchExtent *lockedGetCompressedExtent();
 
   private:
+    struct ZoneRange {
+        std::string field;
+        GeneralValue min, max;
+    };
+
     const ExtentType::Ptr matchType(); // May return NULL
+    void lockedReadZones();
+    bool zonesMayMatch(int64_t offset);
 
     unsigned int cur_file;
     DataSeriesSource *cur_source;
     std::vector<std::string> inputFiles;
-    ExtentType::Ptr my_type;
+    ExtentType::Ptr my_type, cur_type; // first matched type, type in cur_source
+    ExtentSeries::typeCompatibilityT type_compatibility;
+
+    std::string zone_predicate;
+    std::vector<ZoneRange> zone_ranges;
+    std::map<int64_t, dataseries::ExtentZones> file_zones; // zones in cur_source by offset
+    boost::scoped_ptr<ExtentSeries> zone_expr_series; // of zone_expr_type
+    boost::scoped_ptr<DSExpr> zone_expr;
+    ExtentType::Ptr zone_expr_type;
+    uint64_t zone_skipped_extents;
 };
 
 #endif
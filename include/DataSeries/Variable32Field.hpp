@@ -145,6 +145,44 @@ class Variable32Field : public Field {
         clear(e, rowPos(e, row_offset));
     }
 
+    /** Returns a span over this field in every row of the series' current extent.  The span
+        refers to default_value for null rows, so it must not outlive the field.
+
+        Preconditions:
+        - The name of the Field must have been set and the
+        @c ExtentSeries must have an extent. */
+    dataseries::Variable32Span span() const {
+        return span(dataseries.getExtentRef());
+    }
+
+    /** Returns a span over this field in every row of e.
+
+        Preconditions:
+        - The name of the Field must have been set. */
+    dataseries::Variable32Span span(const Extent &e) const {
+        DEBUG_SINVARIANT(e.getTypePtr() == dataseries.getTypePtr());
+        uint32_t stride = e.getTypePtr()->fixedrecordsize();
+        const uint8_t *row0 = e.fixeddata.begin();
+        return dataseries::Variable32Span(row0 + offset_pos, stride, e.fixeddata.size() / stride,
+                                          nullable ? row0 + null_offset : NULL,
+                                          static_cast<uint8_t>(null_bit_mask),
+                                          e.variabledata.begin(), default_value);
+    }
+
+    /** Sets this field in the nrows rows of the series' current extent starting at first_row
+        to values[0..nrows), or to null for the rows where nulls[i] is non-zero, as
+        SimpleFixedField::setColumn does.  The variable data for all the values is reserved
+        at once.
+
+        Preconditions:
+        - The name of the Field must have been set and the rows must exist. */
+    void setColumn(uint32_t first_row, uint32_t nrows, const std::string *values,
+                   const uint8_t *nulls = NULL);
+
+    /// As above, but from refs to the values
+    void setColumn(uint32_t first_row, uint32_t nrows, const dataseries::Variable32Ref *values,
+                   const uint8_t *nulls = NULL);
+
     bool equal(const std::string &to) {
         if (isNull()) {
             return false;
@@ -236,6 +274,9 @@ class Variable32Field : public Field {
     bool unique;
 
   private:
+    template<class Value> void setColumnImpl(uint32_t first_row, uint32_t nrows,
+                                             const Value *values, const uint8_t *nulls);
+
     const byte *val(const Extent &e, uint8_t *row_pos) const {
         DEBUG_SINVARIANT(&e != NULL);
         if (nullable && isNull(e, row_pos)) {
@@ -0,0 +1,90 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    Per-extent min/max/null summaries stored inside DataSeries files
+*/
+
+#ifndef DATASERIES_ZONEMAP_HPP
+#define DATASERIES_ZONEMAP_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <DataSeries/ExtentSeries.hpp>
+#include <DataSeries/GeneralField.hpp>
+
+class DataSeriesSource;
+
+namespace dataseries {
+    /** \brief Summary of one field over the rows of one extent.
+
+        min and max are over the non-null values.  They are null (GeneralValue()) if there are no
+        non-null values, or if the range isn't usable, e.g. a double field with a NaN in it.
+        Integer fields (bool, byte, int32, int64) have int64 min/max, double fields double
+        min/max, and variable32 fields string min/max. */
+    struct FieldZone {
+        FieldZone() : rows(0), nulls(0), min(), max() { }
+
+        bool hasRange() const {
+            return min.getType() != ExtentType::ft_unknown;
+        }
+
+        uint32_t rows, nulls;
+        GeneralValue min, max;
+    };
+
+    /// zones for the summarized fields of one extent, by field name
+    typedef std::map<std::string, FieldZone> ExtentZones;
+
+    /** \brief Zone maps: min, max and null counts of selected fields for each extent in a file.
+
+        DataSeriesSink::setZoneMapFields() makes the sink compute the zones as it packs each
+        extent, and write them at the end of the file as an extent of type extentType(),
+        which is listed in the file's index and type library like any other extent.  The
+        zones refer to extents by their offset in the file, so tools that copy extents
+        between files have to skip that type (see DataSeriesSink::isMetadataType()).
+        TypeIndexModule uses them to skip extents that can't match a predicate without
+        reading them. */
+    class ZoneMap {
+      public:
+        /// type of the extents that hold zone maps, "DataSeries: ZoneMap"
+        static const ExtentType::Ptr &extentType();
+
+        /** Compute the zones of the named fields over all the rows of e.  Fields whose type has
+            no ordering (fixedwidth) are left out. */
+        static void compute(const Extent::Ptr &e, const std::vector<std::string> &fields,
+                            ExtentZones &into);
+
+        /** Append the zones for the extent of type type_name at offset in the file to series,
+            which must be of extentType(); starts a new extent in series if it doesn't have
+            one. */
+        static void append(ExtentSeries &series, int64_t offset, const std::string &type_name,
+                           const ExtentZones &zones);
+
+        /** Read all the zone maps in source, by extent offset.  Returns false if the file
+            doesn't have any.  Zones for offsets that the index doesn't list as an extent of
+            the zoned type are ignored. */
+        static bool read(DataSeriesSource &source, std::map<int64_t, ExtentZones> &into);
+
+        /** true unless zone shows that no row of the extent has a value in [min, max].  Nulls
+            count as 0 or "", as they are in expressions; the bounds are compared as strings if
+            min is a string, and as doubles otherwise. */
+        static bool mayOverlap(const FieldZone &zone, const GeneralValue &min,
+                               const GeneralValue &max);
+
+        /** The range of values an expression can see for a numeric field given its zone, i.e.
+            including 0 if there are nulls.  Returns false if the range is unknown. */
+        static bool valueRange(const FieldZone &zone, double &lo, double &hi);
+
+        /// as valueRange() for variable32 fields
+        static bool valueRange(const FieldZone &zone, std::string &lo, std::string &hi);
+    };
+}
+
+#endif
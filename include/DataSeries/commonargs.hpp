@@ -17,7 +17,7 @@
 struct commonPackingArgs {
     int compress_level;
     int compress_modes;
-    int extent_size;
+    int extent_size; // 0 for --extent-size=auto, see OutputModule::auto_extent_size
     commonPackingArgs() 
             : compress_level(9), 
               compress_modes(Extent::compress_all), 
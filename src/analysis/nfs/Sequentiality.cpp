@@ -1,9 +1,11 @@
+#include <boost/scoped_ptr.hpp>
+
 #include <Lintel/HashMap.hpp>
 #include <Lintel/LintelLog.hpp>
 #include <Lintel/RotatingHashMap.hpp>
-#include <Lintel/StatsQuantile.hpp>
 
 #include <DataSeries/ExtentField.hpp>
+#include <DataSeries/QuantileSketch.hpp>
 #include <DataSeries/RowAnalysisModule.hpp>
 
 #include <analysis/nfs/common.hpp>
@@ -46,17 +48,11 @@ class Sequentiality : public RowAnalysisModule {
               operation_count(0), process_count(0), reset_count(0), continue_count(0),
               reorder_count(0),
               overlapping_reorder_slop_seconds(0), overlapping_reorder_slop_raw(0),
-              mode(RequestOrder),
-              skip_distribution(0.005, nvals), count_stat(0.005, nvals), bytes_stat(0.005, nvals),
-              op_bytes_fraction(0.005, nvals), file_bytes_fraction(0.005, nvals), 
-              reorder_count_stat(0.005, nvals), reorder_fraction(0.005, nvals),
-              sequentiality_count_fraction(0.005, nvals), sequentiality_bytes_fraction(0.005, nvals),
-              in_random_sequential_run_count(0.005, nvals), 
-              in_random_sequential_run_bytes(0.005, nvals), eof_count(0.005, nvals),
-              unknown_file_size_count(0)
+              mode(RequestOrder), unknown_file_size_count(0)
     { 
         ignore_client = false;
         ignore_server = false;
+        double sketch_error = 0;
         vector<string> args = split(arg_str, ",");
         for (unsigned i = 0; i < args.size(); ++i) {
             if (args[i] == "ignore_client") {
@@ -74,10 +70,26 @@ class Sequentiality : public RowAnalysisModule {
                 mode = OverlappingReorder;
             } else if (args[i] == "request_order") {
                 mode = RequestOrder;
+            } else if (args[i] == "sketch") {
+                sketch_error = 0.005;
+            } else if (prefixequal(args[i], "sketch=")) {
+                sketch_error = doubleModArg("sketch", args[i]);
             } else {
                 FATAL_ERROR(format("unknown option %s") % args[i]);
             }
         }
+        skip_distribution.reset(newStat(sketch_error));
+        count_stat.init(sketch_error);
+        bytes_stat.init(sketch_error);
+        op_bytes_fraction.init(sketch_error);
+        file_bytes_fraction.init(sketch_error);
+        reorder_count_stat.reset(newStat(sketch_error));
+        reorder_fraction.reset(newStat(sketch_error));
+        sequentiality_count_fraction.reset(newStat(sketch_error));
+        sequentiality_bytes_fraction.reset(newStat(sketch_error));
+        in_random_sequential_run_count.reset(newStat(sketch_error));
+        in_random_sequential_run_bytes.reset(newStat(sketch_error));
+        eof_count.reset(newStat(sketch_error));
         if (LintelLog::wouldDebug("memory_usage")) {
             last_reported_memory_usage = 1;
             reportMemoryUsage();
@@ -174,7 +186,7 @@ class Sequentiality : public RowAnalysisModule {
             return;
         }
         size_t a = key_to_ops.memoryUsage();
-        size_t b = skip_distribution.memoryUsage();
+        size_t b = dataseries::quantileMemoryUsage(*skip_distribution);
         size_t sum = a + b + operations_memory_usage;
         if (sum > last_reported_memory_usage + 1 * 1024 * 1024 || always) {
             LintelLogDebug("memory_usage",
@@ -217,26 +229,26 @@ class Sequentiality : public RowAnalysisModule {
                 ++unknown_file_size_count;
                 SINVARIANT(file_size == -1);
             }
-            reorder_count_stat.add(state.reorder_count);
+            reorder_count_stat->add(state.reorder_count);
 
             divisor = state.read_count + state.write_count;
             SINVARIANT(divisor > 0);
-            reorder_fraction.add(state.reorder_count / divisor);
+            reorder_fraction->add(state.reorder_count / divisor);
 
             divisor = state.sequential_count + state.random_count;
             SINVARIANT(divisor > 0);
-            sequentiality_count_fraction.add(state.sequential_count / divisor);
+            sequentiality_count_fraction->add(state.sequential_count / divisor);
 
             divisor = state.random_bytes + state.sequential_bytes;
             SINVARIANT(divisor > 0);
-            sequentiality_bytes_fraction.add(state.sequential_bytes / divisor);
+            sequentiality_bytes_fraction->add(state.sequential_bytes / divisor);
             
             if (state.random_count > 0 && (state.sequential_count + state.random_count >= 2)) {
                 // If it's only the initial 1 I/O or it was entirely
                 // sequential, then ignore it.
                 SINVARIANT(state.cur_sequential_run_count > 0);
-                in_random_sequential_run_count.add(state.cur_sequential_run_count);
-                in_random_sequential_run_bytes.add(state.cur_sequential_run_bytes);
+                in_random_sequential_run_count->add(state.cur_sequential_run_count);
+                in_random_sequential_run_bytes->add(state.cur_sequential_run_bytes);
             }
         }
         state.reset();
@@ -280,8 +292,8 @@ class Sequentiality : public RowAnalysisModule {
             ++state.random_count;
             state.random_bytes += op.len;
             if (state.cur_sequential_run_count > 0) {
-                in_random_sequential_run_count.add(state.cur_sequential_run_count);
-                in_random_sequential_run_bytes.add(state.cur_sequential_run_bytes);
+                in_random_sequential_run_count->add(state.cur_sequential_run_count);
+                in_random_sequential_run_bytes->add(state.cur_sequential_run_bytes);
             }
             state.cur_sequential_run_count = 1;
             state.cur_sequential_run_bytes = op.len;
@@ -293,7 +305,7 @@ class Sequentiality : public RowAnalysisModule {
         }
 
         if (state.last_end_offset != numeric_limits<int64_t>::min()) {
-            skip_distribution.add(op.start_offset - state.last_end_offset);
+            skip_distribution->add(op.start_offset - state.last_end_offset);
         }
         state.last_end_offset = op.start_offset + op.len;
         state.latest_reply_at = max(state.latest_reply_at, op.reply_at);
@@ -434,7 +446,7 @@ class Sequentiality : public RowAnalysisModule {
         }
 
         completeOpAccessGroup(state, ops, file_size);
-        eof_count.add(state.eof_count);
+        eof_count->add(state.eof_count);
 
         LintelLogDebug("Sequentiality::po", "");
     }
@@ -565,28 +577,33 @@ class Sequentiality : public RowAnalysisModule {
         cout << format("Reorder count: %d/%d, %.3f%%\n")
                 % reorder_count % operation_count % (100.0 * reorder_count / operation_count);
         
-        printStat("Skip distribution", skip_distribution);
+        printStat("Skip distribution", *skip_distribution);
 
         count_stat.print("count");
         bytes_stat.print("bytes");
         op_bytes_fraction.print("op_bytes_fraction");
         cout << format("unknown file size count %d\n") % unknown_file_size_count;
         file_bytes_fraction.print("file_bytes_fraction");
-        printStat("reorder_count", reorder_count_stat);
-        printStat("reorder_fraction", reorder_fraction);
-        printStat("sequentiality_count_fraction", sequentiality_count_fraction);
-        printStat("sequentiality_bytes_fraction", sequentiality_bytes_fraction);
-        printStat("in_random_sequential_run_count", in_random_sequential_run_count);
-        printStat("in_random_sequential_run_bytes", in_random_sequential_run_bytes);
-        printStat("eof_count", eof_count);
+        printStat("reorder_count", *reorder_count_stat);
+        printStat("reorder_fraction", *reorder_fraction);
+        printStat("sequentiality_count_fraction", *sequentiality_count_fraction);
+        printStat("sequentiality_bytes_fraction", *sequentiality_bytes_fraction);
+        printStat("in_random_sequential_run_count", *in_random_sequential_run_count);
+        printStat("in_random_sequential_run_bytes", *in_random_sequential_run_bytes);
+        printStat("eof_count", *eof_count);
 
         SINVARIANT(operations_memory_usage == 0);
         cout << format("End-%s\n") % __PRETTY_FUNCTION__;
     }
 
-    void printStat(const string &description, StatsQuantile &stat) {
+    /// a StatsQuantile, or a QuantileSketch if sketch_error > 0
+    static Stats *newStat(double sketch_error) {
+        return dataseries::newQuantileStats(sketch_error, 0.005, nvals);
+    }
+
+    void printStat(const string &description, Stats &stat) {
         cout << description << ":\n";
-        stat.printTextRanges(cout, 100);
+        dataseries::printQuantileRanges(stat, cout, 100);
     }
 
     struct FileSize {
@@ -596,22 +613,24 @@ class Sequentiality : public RowAnalysisModule {
     };
 
     struct StatsRW {
-        StatsRW(double epsilon, uint64_t nvals) 
-                : read(epsilon, nvals), write(epsilon, nvals), total(epsilon, nvals) 
-        { }
-        StatsQuantile read, write, total;
+        void init(double sketch_error) {
+            read.reset(newStat(sketch_error));
+            write.reset(newStat(sketch_error));
+            total.reset(newStat(sketch_error));
+        }
+        boost::scoped_ptr<Stats> read, write, total;
         void add(double read_val, double write_val) {
-            read.add(read_val);
-            write.add(write_val);
-            total.add(write_val + read_val);
+            read->add(read_val);
+            write->add(write_val);
+            total->add(write_val + read_val);
         }
         void print(const string &stat_name) {
             cout << format("read %s distribution:\n") % stat_name;
-            read.printTextRanges(cout, 100);
+            dataseries::printQuantileRanges(*read, cout, 100);
             cout << format("write %s distribution:\n") % stat_name;
-            write.printTextRanges(cout, 100);
+            dataseries::printQuantileRanges(*write, cout, 100);
             cout << format("total %s distribution:\n") % stat_name;
-            total.printTextRanges(cout, 100);
+            dataseries::printQuantileRanges(*total, cout, 100);
         }
     };
 
@@ -641,9 +660,9 @@ class Sequentiality : public RowAnalysisModule {
     int64_t overlapping_reorder_slop_raw;
     Mode mode;
 
-    StatsQuantile skip_distribution;
+    boost::scoped_ptr<Stats> skip_distribution;
     StatsRW count_stat, bytes_stat, op_bytes_fraction, file_bytes_fraction;
-    StatsQuantile reorder_count_stat, reorder_fraction, sequentiality_count_fraction, 
+    boost::scoped_ptr<Stats> reorder_count_stat, reorder_fraction, sequentiality_count_fraction, 
                     sequentiality_bytes_fraction, in_random_sequential_run_count, 
                     in_random_sequential_run_bytes, eof_count;
     uint64_t unknown_file_size_count;
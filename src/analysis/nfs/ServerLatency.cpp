@@ -3,8 +3,10 @@
 #include <Lintel/HashMap.hpp>
 #include <Lintel/LintelLog.hpp>
 #include <Lintel/StatsQuantile.hpp>
+#include <Lintel/StringUtil.hpp>
 
 #include <DataSeries/GeneralField.hpp>
+#include <DataSeries/QuantileSketch.hpp>
 
 #include <analysis/nfs/common.hpp>
 
@@ -53,12 +55,22 @@ class ServerLatency : public RowAnalysisModule {
               min_packet_time_raw(numeric_limits<int64_t>::max()),
               max_packet_time_raw(numeric_limits<int64_t>::min()),
               duplicate_request_min_retry_raw(numeric_limits<int64_t>::max()),
-              output_text(true)
+              output_text(true), sketch_error(0)
     {
         pending1 = new pendingT;
-        if (!arg.empty()) {
-            SINVARIANT(arg == "output_sql");
-            output_text = false;
+        vector<string> args = split(arg, ",");
+        for (vector<string>::iterator i = args.begin(); i != args.end(); ++i) {
+            if (*i == "output_sql") {
+                output_text = false;
+            } else if (*i == "sketch") {
+                sketch_error = 0.005;
+            } else if (prefixequal(*i, "sketch=")) {
+                sketch_error = doubleModArg("sketch", *i);
+            } else if (i->empty()) {
+                // ignore
+            } else {
+                FATAL_ERROR(format("unknown option %s") % *i);
+            }
         }
     }
 
@@ -146,32 +158,33 @@ class ServerLatency : public RowAnalysisModule {
             missing_reply_firstlat = 0;
             missing_reply_lastlat = 0;
         }
-        StatsQuantile *first_latency_ms, *last_latency_ms;
+        // StatsQuantile, or QuantileSketch if sketch_error > 0
+        Stats *first_latency_ms, *last_latency_ms;
         Stats *duplicates;
         uint64_t missing_reply_count, missing_request_count, 
             duplicate_reply_count;
         double missing_reply_firstlat, missing_reply_lastlat;
-        void initStats(bool enable_first, bool enable_last) {
+        void initStats(bool enable_first, bool enable_last, double sketch_error) {
             INVARIANT(first_latency_ms == NULL && last_latency_ms == NULL && duplicates == NULL, "bad");
             double error = 0.005;
             uint64_t nvals = (uint64_t)10*1000*1000*1000;
             if (enable_first) {
-                first_latency_ms = new StatsQuantile(error, nvals);
+                first_latency_ms = dataseries::newQuantileStats(sketch_error, error, nvals);
             }
             if (enable_last) {
-                last_latency_ms = new StatsQuantile(error, nvals);
+                last_latency_ms = dataseries::newQuantileStats(sketch_error, error, nvals);
             }
             duplicates = new Stats;
         };
-        void add(StatsData &d, bool enable_first, bool enable_last) {
+        void add(StatsData &d, bool enable_first, bool enable_last, double sketch_error) {
             if (first_latency_ms == NULL) {
-                initStats(enable_first, enable_last);
+                initStats(enable_first, enable_last, sketch_error);
             }
             if (first_latency_ms) {
-                first_latency_ms->add(*d.first_latency_ms);
+                dataseries::mergeQuantiles(*first_latency_ms, *d.first_latency_ms);
             }
             if (last_latency_ms) {
-                last_latency_ms->add(*d.last_latency_ms);
+                dataseries::mergeQuantiles(*last_latency_ms, *d.last_latency_ms);
             }
             duplicates->add(*d.duplicates);
         }
@@ -292,7 +305,8 @@ class ServerLatency : public RowAnalysisModule {
 
             // add to statistics per request type and server
             if (d == NULL) { // create new entry
-                hdummy.initStats(enable_first_latency_stat, enable_last_latency_stat);
+                hdummy.initStats(enable_first_latency_stat, enable_last_latency_stat,
+                                 sketch_error);
                 d = stats_table.add(hdummy);
             }
             d->add(delay_first_ms, delay_last_ms);
@@ -348,11 +362,11 @@ class ServerLatency : public RowAnalysisModule {
           return nops_a > nops_b;
       }};
 
-    void printOneQuant(StatsQuantile *v) {
+    void printOneQuant(Stats *v) {
         if (v) {
             cout << format("; %7.3f %6.3f %6.3f ") 
-                    % v->mean() % v->getQuantile(0.5)
-                    % v->getQuantile(0.9);
+                    % v->mean() % dataseries::getQuantile(*v, 0.5)
+                    % dataseries::getQuantile(*v, 0.9);
         }
     }
 
@@ -381,7 +395,8 @@ class ServerLatency : public RowAnalysisModule {
 
             for (double quantile = 0.01; quantile < 0.995; quantile += 0.01) {
                 cout << format("insert into server_latency_quantile (server, operation, quantile, latency) values (%s, %s, %.2f, %.8g);\n")
-                        % serverip % operation % quantile % j.first_latency_ms->getQuantile(quantile);
+                        % serverip % operation % quantile
+                        % dataseries::getQuantile(*j.first_latency_ms, quantile);
             }
         }
         
@@ -483,15 +498,15 @@ class ServerLatency : public RowAnalysisModule {
             
             if (enable_server_rollup) {
                 server_rollup[d.serverip].add(d, enable_first_latency_stat, 
-                                              enable_last_latency_stat);
+                                              enable_last_latency_stat, sketch_error);
             }
             if (enable_operation_rollup) {
                 operation_rollup[d.operation].add(d, enable_first_latency_stat,
-                                                  enable_last_latency_stat);
+                                                  enable_last_latency_stat, sketch_error);
             }
             if (enable_overall_rollup) {
                 overall.add(d, enable_first_latency_stat, 
-                            enable_last_latency_stat);
+                            enable_last_latency_stat, sketch_error);
             }
         }
 
@@ -567,6 +582,7 @@ class ServerLatency : public RowAnalysisModule {
 
     int64_t duplicate_request_min_retry_raw;
     bool output_text;
+    double sketch_error; // 0 for StatsQuantile latency stats
 };
 
 namespace NFSDSAnalysisMod {
@@ -14,6 +14,10 @@
 #include <ostream>
 #include <algorithm>
 
+#include <boost/bind.hpp>
+#include <boost/function.hpp>
+#include <boost/scoped_ptr.hpp>
+
 #include <Lintel/AssertBoost.hpp>
 #include <Lintel/ConstantString.hpp>
 #include <Lintel/HashTable.hpp>
@@ -24,6 +28,7 @@
 #include <Lintel/Stats.hpp>
 #include <Lintel/StringUtil.hpp>
 
+#include <DataSeries/BroadcastBuffer.hpp>
 #include <DataSeries/DStoTextModule.hpp>
 #include <DataSeries/GeneralField.hpp>
 #include <DataSeries/PrefetchBufferModule.hpp>
@@ -112,7 +117,10 @@
   request to each reply.  This emulates the delay seen by the client.
   The code has support for calculating the latency from the last
   request, which provides more information on how the server generating
-  latency, but that code is currently disabled.
+  latency, but that code is currently disabled.  The sketch[=error]
+  option keeps the latency quantiles in bounded-size quantile sketches
+  (default error 0.005) rather than StatsQuantile, which uses much less
+  memory when there are many (server, operation) pairs.
 
   =head3 Example Output
 
@@ -241,6 +249,14 @@
   FHOL: 1063931188.266179000 10.12.11.75 10.110.1.14 ; getattr file 25cccd0040f47d05200000000160929015f77d0578e4003e1630670064637600 '' ; 325880 1023314262.000000000
   FHOL: 1063931190.068588000 10.12.11.77 10.110.1.14 ; getattr directory 0138c000948119052000000000c03801948119050b71002c40000000ffa72e00 '' ; 4096 1050428920.444579000
 
+  =head2 -P # Run the analyses of the common table concurrently
+
+  Normally the analyses that only read the common table (-b, -c and -j)
+  are chained, so each extent goes through them one after the other on a
+  single thread.  With -P, each of them runs on a thread of its own,
+  reading the same decoded extents from a BroadcastBuffer, so the common
+  table is still read only once.
+
   =head1 DISABLED ANALYSIS
 
   Most of the analysis were writen in early 2003, they do not have
@@ -1422,6 +1438,12 @@ static bool need_mount_by_filehandle = false;
 static bool need_filename_by_filehandle = false;
 static bool late_filename_by_filehandle_ok = true;
 
+// the analyses of just the common table; they are made after all the options are parsed, so
+// -P applies to all of them
+typedef boost::function<RowAnalysisModule *(DataSeriesModule &)> CommonAnalysisMaker;
+static vector<CommonAnalysisMaker> common_analyses;
+static bool concurrent_common_analyses = false;
+
 void
 usage(char *progname) 
 {
@@ -1437,13 +1459,14 @@ usage(char *progname)
         
     cout << "    -h # display this help\n";
     cout << "    -a # Operation count by filehandle\n";
-    cout << "    -b {,output_sql} # Server latency analysis\n";
+    cout << "    -b {,output_sql,sketch[=error]} # Server latency analysis\n";
     cout << "    -c <seconds> # Host analysis\n";
     cout << "    -d <fh|fh-list pathname> # directory path lookup\n";
     cout << "    -e <fh | fh-list pathname> # look up all the operations associated with a filehandle\n";
     cout << "    -f # Read/Write Extent analysis\n";
     cout << "    -g # Attr-Ops Extent analysis\n";
-    cout << "    -i # Sequentiality analysis\n";
+    cout << "    -i {,sketch[=error],...} # Sequentiality analysis\n";
+    cout << "    -P # run the analyses of the common table (-b, -c, -j) concurrently\n";
     cout << "    -Z <series-to-print> # common, attr-ops, rw, merge12, merge123\n";
 
     //    cerr << "    #-b # Unique bytes in file handles analysis\n";
@@ -1488,7 +1511,7 @@ int parseopts(int argc, char *argv[], SequenceModule &commonSequence,
     bool add_file_handle_operation_lookup = false;
 
     while (1) {
-        int opt = getopt(argc, argv, "hab:c:d:e:fgi:jZ:");
+        int opt = getopt(argc, argv, "hab:c:d:e:fgi:jPZ:");
         if (opt == -1) break;
         any_selected = true;
         switch(opt){
@@ -1498,12 +1521,12 @@ int parseopts(int argc, char *argv[], SequenceModule &commonSequence,
                 need_mount_by_filehandle = 1;
                 break;
             case 'b': 
-                commonSequence.addModule
-                        (NFSDSAnalysisMod::newServerLatency(commonSequence.tail(), optarg));
+                common_analyses.push_back
+                        (boost::bind(NFSDSAnalysisMod::newServerLatency, _1, string(optarg)));
                 break;
             case 'c': 
-                commonSequence.addModule
-                        (NFSDSAnalysisMod::newHostInfo(commonSequence.tail(), optarg));
+                common_analyses.push_back
+                        (boost::bind(NFSDSAnalysisMod::newHostInfo, _1, optarg));
                 break;
             case 'd': 
                 need_mount_by_filehandle = true;
@@ -1534,7 +1557,10 @@ int parseopts(int argc, char *argv[], SequenceModule &commonSequence,
                         (newSequentiality(merge123Sequence.tail(), optarg));
                 break;
             case 'j':
-                commonSequence.addModule(newMissingOps(commonSequence.tail()));
+                common_analyses.push_back(newMissingOps);
+                break;
+            case 'P':
+                concurrent_common_analyses = true;
                 break;
             case 'Z': {
                 string arg = optarg;
@@ -1630,6 +1656,56 @@ int parseopts(int argc, char *argv[], SequenceModule &commonSequence,
     return optind;
 }
 
+/** Add the analyses of the common table to commonSequence, or with -P, each to its own
+    sequence reading from a broadcast of commonSequence, which continues with one more
+    consumer of the broadcast. */
+void addCommonAnalyses(SequenceModule &commonSequence,
+                       boost::scoped_ptr<BroadcastBuffer> &broadcast,
+                       vector<SequenceModule *> &concurrent) {
+    if (!concurrent_common_analyses || common_analyses.size() < 2) {
+        for (vector<CommonAnalysisMaker>::iterator i = common_analyses.begin();
+             i != common_analyses.end(); ++i) {
+            commonSequence.addModule((*i)(commonSequence.tail()));
+        }
+        return;
+    }
+    broadcast.reset(new BroadcastBuffer(commonSequence.tail(), 64*1024*1024));
+    for (vector<CommonAnalysisMaker>::iterator i = common_analyses.begin();
+         i != common_analyses.end(); ++i) {
+        concurrent.push_back(new SequenceModule(broadcast->newConsumer()));
+        concurrent.back()->addModule((*i)(concurrent.back()->tail()));
+    }
+    commonSequence.addModule(broadcast->newConsumer());
+}
+
+/** run seq, and the concurrent common analyses on threads of their own; once seq is done
+    the analyses no longer wait for it to read the common table. */
+void getAndDeleteShared(SequenceModule &seq, SequenceModule &commonSequence,
+                        vector<SequenceModule *> &concurrent) {
+    if (concurrent.empty()) {
+        seq.getAndDeleteShared();
+        return;
+    }
+    vector<DataSeriesModule *> tails;
+    for (vector<SequenceModule *>::iterator i = concurrent.begin(); i != concurrent.end(); ++i) {
+        tails.push_back(*i);
+    }
+    PThreadFunction analyses(boost::bind(&BroadcastBuffer::getAndDeleteSharedConcurrently,
+                                         tails));
+    analyses.start();
+    seq.getAndDeleteShared();
+    // the common sequence ends with its consumer unless -P was given
+    BroadcastBuffer::Consumer *consumer = NULL;
+    for (SequenceModule::iterator i = commonSequence.begin(); i != commonSequence.end(); ++i) {
+        if (dynamic_cast<BroadcastBuffer::Consumer *>(i->get()) != NULL) {
+            consumer = dynamic_cast<BroadcastBuffer::Consumer *>(i->get());
+        }
+    }
+    SINVARIANT(consumer != NULL);
+    consumer->close();
+    analyses.join();
+}
+
 void printResult(SequenceModule::DsmPtr mod) {
     if (mod == NULL) {
         return;
@@ -1642,7 +1718,8 @@ void printResult(SequenceModule::DsmPtr mod) {
         rowmod->printResult();
     } else {
         INVARIANT(dynamic_cast<DStoTextModule *>(mod.get()) != NULL
-                  || dynamic_cast<PrefetchBufferModule *>(mod.get()) != NULL,
+                  || dynamic_cast<PrefetchBufferModule *>(mod.get()) != NULL
+                  || dynamic_cast<BroadcastBuffer::Consumer *>(mod.get()) != NULL,
                   "Found unexpected module in chain");
     }
 
@@ -1711,6 +1788,10 @@ int main(int argc, char *argv[]) {
     TypeIndexModule *sourced = new TypeIndexModule("NFS trace: mount");
     sourced->setSecondMatch("Trace::NFS::mount");
 
+    // the broadcast of the common table for -P; deleted after all its consumers
+    boost::scoped_ptr<BroadcastBuffer> common_broadcast;
+    vector<SequenceModule *> concurrent_common_sequences;
+
     SequenceModule commonSequence(sourcea);
     SequenceModule attrOpsSequence(sourceb);
     SequenceModule rwSequence(sourcec);
@@ -1724,6 +1805,8 @@ int main(int argc, char *argv[]) {
         usage(argv[0]);
     }
 
+    addCommonAnalyses(commonSequence, common_broadcast, concurrent_common_sequences);
+
     setupInputs(first, argc, argv, sourcea, sourceb,
                 sourcec, sourced, commonSequence);
 
@@ -1776,18 +1859,18 @@ int main(int argc, char *argv[]) {
         sourcea->startPrefetching(32*1024*1024, 96*1024*1024);
         sourceb->startPrefetching(32*1024*1024, 96*1024*1024);
         sourcec->startPrefetching(32*1024*1024, 96*1024*1024);
-        merge123Sequence.getAndDeleteShared();
+        getAndDeleteShared(merge123Sequence, commonSequence, concurrent_common_sequences);
     } else if (merge12Sequence.size()> 1) {
         sourcea->startPrefetching(32*1024*1024, 96*1024*1024);
         sourceb->startPrefetching(32*1024*1024, 96*1024*1024);
-        merge12Sequence.getAndDeleteShared();
+        getAndDeleteShared(merge12Sequence, commonSequence, concurrent_common_sequences);
         if (rwSequence.size() > 1) {
             rwSequence.getAndDeleteShared();
         }
     } else {
         if (commonSequence.size() > 1) {
             sourcea->startPrefetching(8*32*1024*1024, 8*96*1024*1024);
-            commonSequence.getAndDeleteShared();
+            getAndDeleteShared(commonSequence, commonSequence, concurrent_common_sequences);
         }
         if (attrOpsSequence.size() > 1) {
             sourceb->startPrefetching(32*1024*1024, 96*1024*1024);
@@ -1805,6 +1888,10 @@ int main(int argc, char *argv[]) {
         i != commonSequence.end(); ++i) {
         printResult(*i);
     }
+    for (vector<SequenceModule *>::iterator i = concurrent_common_sequences.begin();
+         i != concurrent_common_sequences.end(); ++i) {
+        printResult(*((*i)->begin() + 1));
+    }
     for (SequenceModule::iterator i = attrOpsSequence.begin() + 1;
         i != attrOpsSequence.end(); ++i) {
         printResult(*i);
@@ -1847,6 +1934,10 @@ int main(int argc, char *argv[]) {
     sourcec->close();
     sourced->close();
     delete sourced; // a-c deleted by their SequenceModules
+    for (vector<SequenceModule *>::iterator i = concurrent_common_sequences.begin();
+         i != concurrent_common_sequences.end(); ++i) {
+        delete *i;
+    }
     return 0;
 }
 
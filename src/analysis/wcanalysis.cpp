@@ -173,32 +173,19 @@ class WorldCupSimpleAnalysis : public RowAnalysisModule {
         SINVARIANT(file_type.val() < file_type_count);
     }
 
-#if 0
-    virtual Extent::Ptr getSharedExtent() {
-        Extent::Ptr e = source.getSharedExtent();
-        if (e == NULL) {
-            completeProcessing();
-            return NULL;
-        }
-        series.setExtent(e);
-        if (!prepared) {
-            prepareForProcessing();
-            prepared = true;
+    virtual void processBatch(uint32_t nrows, const dataseries::RowSelection *selection) {
+        if (selection != NULL) {
+            RowAnalysisModule::processBatch(nrows, selection);
+            return;
         }
-        for (;series.pos.morerecords();++series.pos) {
+        for (; series.morerecords(); ++series) {
             inlineProcessRow();
         }
-        series.clearExtent();
-        return e;
     }
-    virtual void processRow() { 
-        FATAL_ERROR("no");
-    }
-#else
+
     virtual void processRow() {
         inlineProcessRow();
     }
-#endif
 
     virtual void completeProcessing() {
     }
@@ -6,8 +6,12 @@
 #include <Lintel/LintelLog.hpp>
 #include <Lintel/HashFns.hpp>
 
+#include <DataSeries/ExtentSizeTuner.hpp>
+
 dataseries::IExtentSink::~IExtentSink() { }
 
+void dataseries::IExtentSink::noteAutoExtentSize(const std::string &, uint32_t) { }
+
 using namespace std;
 using boost::format;
 
@@ -104,14 +108,16 @@ void DataSeriesSink::WorkerInfo::flushPending(PThreadMutex &mutex) {
 
 DataSeriesSink::DataSeriesSink(int compression_modes, int compression_level)
         : stats(), mutex(), valid_types(), compression_modes(compression_modes),
-          compression_level(compression_level), writer_info(), 
+          compression_level(compression_level), bloom_bits_per_value(10),
+          warned_auto_extent_size(false), writer_info(),
           worker_info(256*1024*1024), filename()
 { }
 
 DataSeriesSink::DataSeriesSink(const string &filename, int compression_modes,
                                int compression_level)
         : stats(), mutex(), valid_types(), compression_modes(compression_modes),
-          compression_level(compression_level), writer_info(),
+          compression_level(compression_level), bloom_bits_per_value(10),
+          warned_auto_extent_size(false), writer_info(),
           worker_info(256*1024*1024), filename()
 {
     open(filename);
@@ -170,6 +176,20 @@ void DataSeriesSink::close(bool do_fsync, Stats *to_update) {
     writer_info.writeOutPending(lock, worker_info);
 
     SINVARIANT(worker_info.pending_work.empty() && worker_info.bytes_in_progress == 0);
+    if (writer_info.zone_series.hasExtent()) {
+        lockedWriteFinalExtent(lock, writer_info.zone_series.getSharedExtent());
+        writer_info.zone_series.clearExtent();
+    }
+    if (writer_info.bloom_series.hasExtent()) {
+        lockedWriteFinalExtent(lock, writer_info.bloom_series.getSharedExtent());
+        writer_info.bloom_series.clearExtent();
+    }
+    if (!auto_extent_sizes.empty()
+        && valid_types.exists(dataseries::ExtentSizeTuner::extentType())) {
+        lockedWriteFinalExtent(lock, autoExtentSizeExtent());
+    }
+    auto_extent_sizes.clear();
+    warned_auto_extent_size = false;
     ExtentType::int64 index_offset = writer_info.cur_offset;
     
     // Special case handling of record for index series; this will
@@ -180,23 +200,8 @@ void DataSeriesSink::close(bool do_fsync, Stats *to_update) {
     writer_info.field_extentOffset.set(writer_info.cur_offset);
     writer_info.field_extentType.set(writer_info.index_series.getTypePtr()->getName());
 
-    worker_info.bytes_in_progress += writer_info.index_series.getExtentRef().size();
-    worker_info.pending_work.push_back
-            (new ToCompress(writer_info.index_series.getSharedExtent(), NULL));
-    worker_info.pending_work.front()->in_progress = true;
-    lockedProcessToCompress(lock, worker_info.pending_work.front());
-
-    SINVARIANT(worker_info.bytes_in_progress 
-               == worker_info.pending_work.front()->compressed.size());
-    SINVARIANT(worker_info.pending_work.size() == 1);
-    SINVARIANT(worker_info.pending_work.front()->readyToWrite());
-    uint32_t packed_size = worker_info.pending_work.front()->compressed.size();
-
-    writer_info.writeOutPending(lock, worker_info);
-
-    INVARIANT(worker_info.pending_work.empty() && worker_info.bytes_in_progress == 0, 
-              format("bad %d %d") % worker_info.pending_work.empty()
-              % worker_info.bytes_in_progress);
+    uint32_t packed_size
+        = lockedWriteFinalExtent(lock, writer_info.index_series.getSharedExtent());
 
     char *tail = new char[7*4];
     INVARIANT((reinterpret_cast<unsigned long>(tail) % 8) == 0, 
@@ -228,6 +233,26 @@ void DataSeriesSink::close(bool do_fsync, Stats *to_update) {
     stats.reset();
 }
 
+uint32_t DataSeriesSink::lockedWriteFinalExtent(PThreadScopedLock &lock, Extent::Ptr e) {
+    worker_info.bytes_in_progress += e->size();
+    worker_info.pending_work.push_back(new ToCompress(e, NULL));
+    worker_info.pending_work.front()->in_progress = true;
+    lockedProcessToCompress(lock, worker_info.pending_work.front());
+
+    SINVARIANT(worker_info.bytes_in_progress 
+               == worker_info.pending_work.front()->compressed.size());
+    SINVARIANT(worker_info.pending_work.size() == 1);
+    SINVARIANT(worker_info.pending_work.front()->readyToWrite());
+    uint32_t packed_size = worker_info.pending_work.front()->compressed.size();
+
+    writer_info.writeOutPending(lock, worker_info);
+
+    INVARIANT(worker_info.pending_work.empty() && worker_info.bytes_in_progress == 0, 
+              format("bad %d %d") % worker_info.pending_work.empty()
+              % worker_info.bytes_in_progress);
+    return packed_size;
+}
+
 void DataSeriesSink::rotate(const string &new_filename, const ExtentTypeLibrary &library,
                             bool do_fsync, Stats *to_update) {
     FATAL_ERROR("unimplemented");
@@ -243,20 +268,46 @@ void DataSeriesSink::WriterInfo::checkedWrite(const void *buf, int bufsize) {
 void DataSeriesSink::writeExtent(Extent &e, Stats *stats) {
     INVARIANT(writer_info.wrote_library,
               "must write extent type library before writing extents!\n");
-    INVARIANT(valid_types.exists(e.type), format("type %s (%p) wasn't in your type library")
+    INVARIANT(valid_types.exists(e.type->getMaterializedTypePtr()),
+              format("type %s (%p) wasn't in your type library")
               % e.getTypePtr()->getName() % e.getTypePtr().get());
     INVARIANT(worker_info.keep_going, "must not call writeExtent after calling close()");
     
     Extent::Ptr we(new Extent(e.getTypePtr()));
     we->swap(e);
+    // the records of a view still hold its hidden columns; write just the visible ones
+    we = Extent::materialize(we);
     
     queueWriteExtent(we, stats);
 }
 
+// every type and field that a per-extent summary is requested for has to exist
+static void checkSummaryFields(const ExtentTypeLibrary &lib,
+                               const map<string, vector<string> > &type_fields,
+                               const string &what) {
+    for (map<string, vector<string> >::const_iterator i = type_fields.begin();
+         i != type_fields.end(); ++i) {
+        const ExtentType::Ptr et(lib.getTypeByNamePtr(i->first, true));
+        INVARIANT(et != NULL, format("%s type %s isn't in your type library") % what % i->first);
+        for (vector<string>::const_iterator j = i->second.begin(); j != i->second.end(); ++j) {
+            INVARIANT(et->hasColumn(*j), format("%s field %s isn't in type %s")
+                      % what % *j % i->first);
+        }
+    }
+}
+
 void DataSeriesSink::writeExtentLibrary(const ExtentTypeLibrary &lib) {
     INVARIANT(!writer_info.wrote_library, "Can only write extent library once");
     ExtentSeries type_extent_series(ExtentType::getDataSeriesXMLTypePtr());
     type_extent_series.newExtent();
+    const ExtentType::Ptr &zone_type(dataseries::ZoneMap::extentType());
+    const ExtentType::Ptr &bloom_type(dataseries::BloomFilter::extentType());
+    const ExtentType::Ptr &size_type(dataseries::ExtentSizeTuner::extentType());
+    bool record_sizes;
+    {
+        PThreadScopedLock lock(mutex);
+        record_sizes = !auto_extent_sizes.empty();
+    }
 
     Variable32Field typevar(type_extent_series,"xmltype");
     for (ExtentTypeLibrary::NameToType::const_iterator i = lib.name_to_type.begin();
@@ -265,12 +316,17 @@ void DataSeriesSink::writeExtentLibrary(const ExtentTypeLibrary &lib) {
         if (et->getName() == "DataSeries: XmlType") {
             continue; // no point of writing this out; can't use it.
         }
+        if ((!zone_map_fields.empty() && et->getName() == zone_type->getName())
+            || (!bloom_filter_fields.empty() && et->getName() == bloom_type->getName())
+            || (record_sizes && et->getName() == size_type->getName())) {
+            continue; // written below
+        }
 
         type_extent_series.newRecord();
         const string &type_desc(et->getXmlDescriptionString());
         INVARIANT(!type_desc.empty(), "whoa extenttype has no xml data?!");
         typevar.set(type_desc);
-        valid_types.add(et);
+        valid_types.add(et->getMaterializedTypePtr()); // a view is written as its columns
         if ((et->majorVersion() == 0 && et->minorVersion() == 0) ||
             et->getNamespace().empty()) {
             // Once we have a version of dsrepack/dsselect that can
@@ -279,6 +335,23 @@ void DataSeriesSink::writeExtentLibrary(const ExtentTypeLibrary &lib) {
                     % et->getName() << endl;
         }
     }
+    checkSummaryFields(lib, zone_map_fields, "zone map");
+    checkSummaryFields(lib, bloom_filter_fields, "Bloom filter");
+    if (!zone_map_fields.empty()) {
+        type_extent_series.newRecord();
+        typevar.set(zone_type->getXmlDescriptionString());
+        valid_types.add(zone_type);
+    }
+    if (!bloom_filter_fields.empty()) {
+        type_extent_series.newRecord();
+        typevar.set(bloom_type->getXmlDescriptionString());
+        valid_types.add(bloom_type);
+    }
+    if (record_sizes) {
+        type_extent_series.newRecord();
+        typevar.set(size_type->getXmlDescriptionString());
+        valid_types.add(size_type);
+    }
     queueWriteExtent(type_extent_series.getSharedExtent(), NULL);
 
     PThreadScopedLock lock(mutex);
@@ -286,6 +359,64 @@ void DataSeriesSink::writeExtentLibrary(const ExtentTypeLibrary &lib) {
     writer_info.wrote_library = true; 
 }
 
+void DataSeriesSink::setZoneMapFields(const string &type_name, const vector<string> &fields) {
+    PThreadScopedLock lock(mutex);
+    INVARIANT(!writer_info.wrote_library, "must set zone map fields before writing the library");
+    zone_map_fields[type_name] = fields;
+}
+
+void DataSeriesSink::setBloomFilterFields(const string &type_name, const vector<string> &fields,
+                                          uint32_t bits_per_value) {
+    PThreadScopedLock lock(mutex);
+    INVARIANT(!writer_info.wrote_library,
+              "must set Bloom filter fields before writing the library");
+    INVARIANT(bits_per_value > 0, "need at least one bit per value");
+    bloom_filter_fields[type_name] = fields;
+    bloom_bits_per_value = bits_per_value;
+}
+
+void DataSeriesSink::noteAutoExtentSize(const string &type_name, uint32_t target_extent_size) {
+    if (isMetadataType(type_name)) {
+        return;
+    }
+    PThreadScopedLock lock(mutex);
+    map<string, AutoExtentSize>::iterator i = auto_extent_sizes.find(type_name);
+    if (i == auto_extent_sizes.end()) {
+        AutoExtentSize sizes = { target_extent_size, target_extent_size, target_extent_size, 0 };
+        auto_extent_sizes[type_name] = sizes;
+    } else if (i->second.target != target_extent_size) {
+        i->second.target = target_extent_size;
+        i->second.min = min(i->second.min, target_extent_size);
+        i->second.max = max(i->second.max, target_extent_size);
+        ++i->second.changes;
+    }
+    if (writer_info.wrote_library && !warned_auto_extent_size
+        && !valid_types.exists(dataseries::ExtentSizeTuner::extentType())) {
+        cerr << format("Warning: the extent size for %s in %s is chosen automatically, but won't"
+                       " be recorded in the file since it was noted after writing the library")
+            % type_name % filename << endl;
+        warned_auto_extent_size = true;
+    }
+}
+
+Extent::Ptr DataSeriesSink::autoExtentSizeExtent() {
+    ExtentSeries series(dataseries::ExtentSizeTuner::extentType());
+    Variable32Field extenttype(series, "extenttype");
+    Int32Field target(series, "target_extent_size"), min_size(series, "min_extent_size"),
+        max_size(series, "max_extent_size"), changes(series, "changes");
+    series.newExtent();
+    for (map<string, AutoExtentSize>::iterator i = auto_extent_sizes.begin();
+         i != auto_extent_sizes.end(); ++i) {
+        series.newRecord();
+        extenttype.set(i->first);
+        target.set(i->second.target);
+        min_size.set(i->second.min);
+        max_size.set(i->second.max);
+        changes.set(i->second.changes);
+    }
+    return series.getSharedExtent();
+}
+
 void DataSeriesSink::removeStatsUpdate(Stats *would_update) {
     PThreadScopedLock lock(mutex);
 
@@ -322,6 +453,13 @@ void DataSeriesSink::verifyTail(ExtentType::byte *tail,
     INVARIANT(bjhash == check_bjhash, "bad hash in the tail!");
 }
 
+bool DataSeriesSink::isMetadataType(const string &type_name) {
+    return type_name == "DataSeries: XmlType" || type_name == "DataSeries: ExtentIndex"
+        || type_name == dataseries::ZoneMap::extentType()->getName()
+        || type_name == dataseries::BloomFilter::extentType()->getName()
+        || type_name == dataseries::ExtentSizeTuner::extentType()->getName();
+}
+
 void DataSeriesSink::setCompressorCount(int count) {
     INVARIANT(count >= -1, "?");
     compressor_count = count;
@@ -392,6 +530,15 @@ void DataSeriesSink::WriterInfo::writeOutPending(PThreadScopedLock &lock, Worker
                 ewc(cur_offset, *tc->extent);
             }
             tc->wipeExtent();
+            if (!tc->zones.empty()) {
+                dataseries::ZoneMap::append(zone_series, cur_offset,
+                                            tc->extent->getTypePtr()->getName(), tc->zones);
+            }
+            if (!tc->bloom_filters.empty()) {
+                dataseries::BloomFilter::append(bloom_series, cur_offset,
+                                                tc->extent->getTypePtr()->getName(),
+                                                tc->bloom_filters);
+            }
             
             index_series.newRecord();
             field_extentOffset.set(cur_offset);
@@ -471,6 +618,18 @@ void DataSeriesSink::lockedProcessToCompress(PThreadScopedLock &lock, ToCompress
         struct timespec pack_start, pack_end;
         get_thread_cputime(pack_start);
 
+        map<string, vector<string> >::const_iterator zone_fields
+            = zone_map_fields.find(work->extent->getTypePtr()->getName());
+        if (zone_fields != zone_map_fields.end()) {
+            dataseries::ZoneMap::compute(work->extent, zone_fields->second, work->zones);
+        }
+        map<string, vector<string> >::const_iterator bloom_fields
+            = bloom_filter_fields.find(work->extent->getTypePtr()->getName());
+        if (bloom_fields != bloom_filter_fields.end()) {
+            dataseries::BloomFilter::compute(work->extent, bloom_fields->second,
+                                             bloom_bits_per_value, work->bloom_filters);
+        }
+
         uint32_t headersize, fixedsize, variablesize;
         work->checksum = work->extent->packData(work->compressed, compression_modes,
                                                 compression_level, &headersize,
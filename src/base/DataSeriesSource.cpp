@@ -14,6 +14,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <stdlib.h>
 #include <sys/resource.h>
 #include <sys/time.h>
 
@@ -23,8 +24,10 @@
 
 #include <Lintel/Double.hpp>
 #include <Lintel/FileUtil.hpp>
+#include <Lintel/HashFns.hpp>
 #include <Lintel/HashTable.hpp>
 #include <Lintel/LintelLog.hpp>
+#include <Lintel/PThread.hpp>
 
 #include <DataSeries/DataSeriesFile.hpp>
 #include <DataSeries/ExtentField.hpp>
@@ -77,9 +80,19 @@ void DataSeriesSource::reopenfile() {
     int error = fstat(fd, &stat_buf);
     INVARIANT(error == 0, format("error on file '%s' for stat: %s") % filename % strerror(errno));
     if (lintel::modifyTimeNanoSec(stat_buf) != mtime_nanosec) {
-        checkHeader();
-        readTypeExtent();
-        readTailIndex();
+        Extent::ByteArray type_bytes, index_bytes;
+        off64_t index_offset = -1;
+        if (!readMetadataCache(stat_buf, type_bytes, index_bytes, index_offset)) {
+            checkHeader();
+            readTypeExtent(type_bytes);
+            readTailIndex(index_bytes, index_offset);
+            if (read_index) {
+                // unpacking may bitflip the bytes in place, so write first
+                writeMetadataCache(stat_buf, type_bytes, index_bytes, index_offset);
+            }
+        }
+        parseTypeExtent(type_bytes);
+        parseIndexExtent(index_bytes, index_offset);
         mtime_nanosec = lintel::modifyTimeNanoSec(stat_buf);
     }      
 }
@@ -121,11 +134,13 @@ void DataSeriesSource::checkHeader() {
               "NaN double check failed");
 }
 
-void DataSeriesSource::readTypeExtent() {
-    Extent::ByteArray extentdata;
-    INVARIANT(Extent::preadExtent(fd,cur_offset,extentdata,need_bitflip),
+void DataSeriesSource::readTypeExtent(Extent::ByteArray &type_bytes) {
+    INVARIANT(Extent::preadExtent(fd,cur_offset,type_bytes,need_bitflip),
               "Invalid file, must have a first extent");
-    Extent::Ptr e(new Extent(mylibrary,extentdata,need_bitflip));
+}
+
+void DataSeriesSource::parseTypeExtent(Extent::ByteArray &type_bytes) {
+    Extent::Ptr e(new Extent(mylibrary,type_bytes,need_bitflip));
     INVARIANT(e->type == ExtentType::getDataSeriesXMLTypePtr(),
               "First extent must be the type defining extent");
 
@@ -137,12 +152,12 @@ void DataSeriesSource::readTypeExtent() {
     }
 }
 
-void DataSeriesSource::readTailIndex() {
+void DataSeriesSource::readTailIndex(Extent::ByteArray &index_bytes, off64_t &indexoffset) {
     if (read_index) {
         check_tail = true;
     }
 
-    off64_t indexoffset = -1;
+    indexoffset = -1;
     if (check_tail) {
         struct stat ds_file_stats;
         int ret_val = fstat(fd,&ds_file_stats);
@@ -163,13 +178,233 @@ void DataSeriesSource::readTailIndex() {
                   format("mismatch on index offset %d - %d != %d!")
                   % tailoffset % packedsize % indexoffset);
     }
-    index_extent.reset();
     if (read_index) {
-        index_extent.reset(preadExtent(indexoffset));
-        INVARIANT(index_extent != NULL, "index extent read failed");
+        off64_t tmp_offset = indexoffset;
+        INVARIANT(Extent::preadExtent(fd, tmp_offset, index_bytes, need_bitflip),
+                  "index extent read failed");
     }
 }    
 
+void DataSeriesSource::parseIndexExtent(Extent::ByteArray &index_bytes, off64_t index_offset) {
+    index_extent.reset();
+    if (read_index) {
+        SINVARIANT(!index_bytes.empty() && index_offset > 0);
+        index_extent.reset(new Extent(mylibrary, index_bytes, need_bitflip));
+        index_extent->extent_source = filename;
+        index_extent->extent_source_offset = index_offset;
+    }
+}
+
+// Metadata cache entries are written in host byte order, they are a local
+// cache rather than an interchange format.
+namespace {
+    const char metadata_cache_magic[8] = { 'D', 'S', 'm', 'e', 't', 'a', '1', '\0' };
+
+    struct MetadataCacheHeader {
+        char magic[8];
+        int64_t mtime_nanosec, file_size, first_extent_offset, index_offset;
+        int32_t need_bitflip, filename_size, type_bytes_size, index_bytes_size;
+    };
+
+    PThreadMutex metadata_cache_mutex;
+    DataSeriesSource::MetadataCacheStats metadata_cache_stats;
+
+    string metadataCacheDir() {
+        const char *dir = getenv("DATASERIES_METADATA_CACHE");
+        return dir == NULL ? string() : string(dir);
+    }
+
+    string absolutePath(const string &filename) {
+        char *path = realpath(filename.c_str(), NULL);
+        if (path == NULL) {
+            return filename;
+        }
+        string ret(path);
+        free(path);
+        return ret;
+    }
+}
+
+string DataSeriesSource::metadataCachePath() {
+    string dir = metadataCacheDir();
+    if (dir.empty() || !read_index) {
+        return string();
+    }
+    string path(absolutePath(filename));
+    // two 32 bit hashes so that collisions between the many files in a
+    // collection are unlikely; the stored filename catches the rest.
+    uint32_t a = lintel::bobJenkinsHash(1972, path.data(), path.size());
+    uint32_t b = lintel::bobJenkinsHash(2013, path.data(), path.size());
+    return (format("%s/%08x%08x.dsmeta") % dir % a % b).str();
+}
+
+bool DataSeriesSource::readMetadataCache(const struct stat &stat_buf, 
+                                         Extent::ByteArray &type_bytes,
+                                         Extent::ByteArray &index_bytes, off64_t &index_offset) {
+    string cache_path(metadataCachePath());
+    if (cache_path.empty()) {
+        return false;
+    }
+    int cache_fd = open(cache_path.c_str(), O_RDONLY);
+    if (cache_fd < 0) {
+        LintelLogDebug("DataSeriesSource::metadataCache", format("miss on %s") % filename);
+        PThreadScopedLock lock(metadata_cache_mutex);
+        ++metadata_cache_stats.misses;
+        return false;
+    }
+    Extent::ByteArray data;
+    struct stat cache_stat;
+    bool ok = fstat(cache_fd, &cache_stat) == 0 
+        && static_cast<size_t>(cache_stat.st_size) >= sizeof(MetadataCacheHeader);
+    if (ok) {
+        data.resize(cache_stat.st_size, false);
+        ok = Extent::checkedPread(cache_fd, 0, data.begin(), data.size(), true);
+    }
+    CHECKED(close(cache_fd) == 0, format("close failed: %s") % strerror(errno));
+
+    string path(absolutePath(filename));
+    const MetadataCacheHeader *header = reinterpret_cast<MetadataCacheHeader *>(data.begin());
+    ok = ok && memcmp(header->magic, metadata_cache_magic, sizeof(metadata_cache_magic)) == 0
+        && header->mtime_nanosec == lintel::modifyTimeNanoSec(stat_buf)
+        && header->file_size == stat_buf.st_size
+        && header->filename_size >= 0 && header->type_bytes_size > 0 
+        && header->index_bytes_size > 0
+        && data.size() == sizeof(MetadataCacheHeader) + header->filename_size 
+                           + header->type_bytes_size + header->index_bytes_size
+        && path.size() == static_cast<size_t>(header->filename_size)
+        && memcmp(path.data(), data.begin(sizeof(MetadataCacheHeader)), path.size()) == 0;
+    if (!ok) {
+        LintelLogDebug("DataSeriesSource::metadataCache", format("stale entry for %s") % filename);
+        PThreadScopedLock lock(metadata_cache_mutex);
+        ++metadata_cache_stats.stale;
+        return false;
+    }
+    LintelLogDebug("DataSeriesSource::metadataCache", format("hit on %s") % filename);
+    {
+        PThreadScopedLock lock(metadata_cache_mutex);
+        ++metadata_cache_stats.hits;
+    }
+
+    need_bitflip = header->need_bitflip != 0;
+    cur_offset = header->first_extent_offset;
+    index_offset = header->index_offset;
+    const byte *type_begin = data.begin(sizeof(MetadataCacheHeader) + header->filename_size);
+    type_bytes.resize(header->type_bytes_size, false);
+    memcpy(type_bytes.begin(), type_begin, header->type_bytes_size);
+    index_bytes.resize(header->index_bytes_size, false);
+    memcpy(index_bytes.begin(), type_begin + header->type_bytes_size, header->index_bytes_size);
+    return true;
+}
+
+void DataSeriesSource::writeMetadataCache(const struct stat &stat_buf, 
+                                          const Extent::ByteArray &type_bytes,
+                                          const Extent::ByteArray &index_bytes,
+                                          off64_t index_offset) {
+    string cache_path(metadataCachePath());
+    if (cache_path.empty()) {
+        return;
+    }
+    string path(absolutePath(filename));
+    MetadataCacheHeader header;
+    memcpy(header.magic, metadata_cache_magic, sizeof(metadata_cache_magic));
+    header.mtime_nanosec = lintel::modifyTimeNanoSec(stat_buf);
+    header.file_size = stat_buf.st_size;
+    header.first_extent_offset = cur_offset;
+    header.index_offset = index_offset;
+    header.need_bitflip = need_bitflip ? 1 : 0;
+    header.filename_size = path.size();
+    header.type_bytes_size = type_bytes.size();
+    header.index_bytes_size = index_bytes.size();
+
+    Extent::ByteArray data;
+    data.resize(sizeof(header) + path.size() + type_bytes.size() + index_bytes.size(), false);
+    byte *pos = data.begin();
+    memcpy(pos, &header, sizeof(header)); pos += sizeof(header);
+    memcpy(pos, path.data(), path.size()); pos += path.size();
+    memcpy(pos, type_bytes.begin(), type_bytes.size()); pos += type_bytes.size();
+    memcpy(pos, index_bytes.begin(), index_bytes.size()); pos += index_bytes.size();
+    SINVARIANT(pos == data.end());
+
+    // Other processes may be reading or writing the same entry; write to a
+    // private name and rename so they only ever see complete entries.  The
+    // cache is only an optimization, so failures are not fatal.
+    string tmp_path((format("%s.%d-%p.tmp") % cache_path % getpid() % this).str());
+    int cache_fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (cache_fd < 0) {
+        LintelLogDebug("DataSeriesSource::metadataCache", 
+                       format("unable to create %s: %s") % tmp_path % strerror(errno));
+        return;
+    }
+    ssize_t amount = write(cache_fd, data.begin(), data.size());
+    bool ok = amount == static_cast<ssize_t>(data.size());
+    ok = close(cache_fd) == 0 && ok;
+    ok = ok && rename(tmp_path.c_str(), cache_path.c_str()) == 0;
+    if (!ok) {
+        LintelLogDebug("DataSeriesSource::metadataCache", 
+                       format("unable to write %s: %s") % cache_path % strerror(errno));
+        unlink(tmp_path.c_str());
+    } else {
+        PThreadScopedLock lock(metadata_cache_mutex);
+        ++metadata_cache_stats.writes;
+    }
+}
+
+DataSeriesSource::MetadataCacheStats DataSeriesSource::getMetadataCacheStats() {
+    PThreadScopedLock lock(metadata_cache_mutex);
+    return metadata_cache_stats;
+}
+
+class DataSeriesSourceWarmThread : public PThread {
+  public:
+    DataSeriesSourceWarmThread(const vector<string> &filenames, size_t &next, PThreadMutex &mutex)
+        : filenames(filenames), next(next), mutex(mutex) { }
+
+    virtual ~DataSeriesSourceWarmThread() { }
+
+    virtual void *run() {
+        while (true) {
+            size_t i;
+            {
+                PThreadScopedLock lock(mutex);
+                if (next == filenames.size()) {
+                    break;
+                }
+                i = next;
+                ++next;
+            }
+            DataSeriesSource source(filenames[i]);
+        }
+        return NULL;
+    }
+
+    const vector<string> &filenames;
+    size_t &next;
+    PThreadMutex &mutex;
+};
+
+void DataSeriesSource::warmMetadataCache(const vector<string> &filenames, int nthreads) {
+    if (metadataCacheDir().empty() || filenames.empty()) {
+        return;
+    }
+    if (nthreads == -1) {
+        nthreads = min(PThreadMisc::getNCpus(), MAX_THREADS);
+    }
+    SINVARIANT(nthreads > 0);
+    nthreads = min(static_cast<size_t>(nthreads), filenames.size());
+
+    size_t next = 0;
+    PThreadMutex mutex;
+    vector<PThread *> threads;
+    for (int i = 0; i < nthreads; ++i) {
+        threads.push_back(new DataSeriesSourceWarmThread(filenames, next, mutex));
+        threads.back()->start();
+    }
+    for (vector<PThread *>::iterator i = threads.begin(); i != threads.end(); ++i) {
+        (**i).join();
+        delete *i;
+    }
+}
+
 Extent *DataSeriesSource::preadExtent(off64_t &offset, unsigned *compressedSize) {
     Extent::ByteArray extentdata;
     
@@ -73,6 +73,7 @@ extern "C" {
 #include <DataSeries/Extent.hpp>
 #include <DataSeries/ExtentField.hpp>
 #include <DataSeries/DataSeriesFile.hpp>
+#include <DataSeries/GeneralField.hpp>
 
 using namespace std;
 using boost::format;
@@ -109,12 +110,24 @@ void Extent::ByteArray::initMallocTuning() {
 }
 
 Extent::ByteArray::~ByteArray() {
-    delete [] beginV;
+    if (!borrowed) {
+        delete [] beginV;
+    }
 }
 
 void Extent::ByteArray::clear() {
-    delete [] beginV;
+    if (!borrowed) {
+        delete [] beginV;
+    }
     beginV = endV = maxV = NULL;
+    borrowed = false;
+}
+
+void Extent::ByteArray::borrow(const ByteArray &from) {
+    clear();
+    beginV = from.beginV;
+    endV = maxV = from.endV; // so that any growth copies
+    borrowed = true;
 }
 
 void Extent::ByteArray::reserve(size_t reserve_bytes) {
@@ -135,7 +148,10 @@ void Extent::ByteArray::reserve(size_t reserve_bytes) {
               format("internal error, misaligned malloc(%d) return %d mod %d\n")
               % reserve_bytes % actual_align % expect_align);
     memcpy(newV,beginV,oldsize);
-    delete [] beginV;
+    if (!borrowed) {
+        delete [] beginV;
+    }
+    borrowed = false;
     beginV = newV;
     endV = newV + oldsize;
     maxV = newV + reserve_bytes;    
@@ -281,6 +297,41 @@ void Extent::swap(Extent &with) {
     INVARIANT(with.type == type, "can't swap between incompatible types");
     fixeddata.swap(with.fixeddata);
     variabledata.swap(with.variabledata);
+    view_source.swap(with.view_source);
+}
+
+Extent::Ptr Extent::makeView(const Ptr &e, const ExtentType::Ptr &view_type) {
+    SINVARIANT(e != NULL);
+    const ExtentType::Ptr base(e->type->isView() ? e->type->getViewBasePtr() : e->type);
+    INVARIANT(view_type->getViewBasePtr() == base,
+              format("type '%s' is not a view of '%s'") % view_type->getName() % base->getName());
+    Ptr ret(new Extent(view_type));
+    if (e.unique()) {
+        ret->fixeddata.swap(e->fixeddata);
+        ret->variabledata.swap(e->variabledata);
+        ret->view_source.swap(e->view_source);
+    } else {
+        ret->fixeddata.borrow(e->fixeddata);
+        ret->variabledata.borrow(e->variabledata);
+        ret->view_source = e->view_source != NULL ? e->view_source : e;
+    }
+    ret->extent_source = e->extent_source;
+    ret->extent_source_offset = e->extent_source_offset;
+    return ret;
+}
+
+Extent::Ptr Extent::materialize(const Ptr &e) {
+    if (e == NULL || !e->type->isView()) {
+        return e;
+    }
+    ExtentSeries source(e), dest(e->type->getMaterializedTypePtr());
+    dest.newExtent();
+    ExtentRecordCopy copier(source, dest);
+    copier.copyRecords(0, e->nRecords());
+    Ptr ret = dest.getSharedExtent();
+    ret->extent_source = e->extent_source;
+    ret->extent_source_offset = e->extent_source_offset;
+    return ret;
 }
 
 void Extent::createRecords(unsigned int nrecords) {
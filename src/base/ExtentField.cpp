@@ -192,6 +192,50 @@ void Variable32Field::partialSet(Extent &e, uint8_t *row_pos,
 }
 
 
+namespace {
+    const void *valueData(const string &value) { return value.data(); }
+    uint32_t valueSize(const string &value) { return value.size(); }
+    const void *valueData(const dataseries::Variable32Ref &value) { return value.data; }
+    uint32_t valueSize(const dataseries::Variable32Ref &value) { return value.size; }
+}
+
+template<class Value>
+void Variable32Field::setColumnImpl(uint32_t first_row, uint32_t nrows, const Value *values,
+                                    const uint8_t *nulls) {
+    Extent &e(dataseries.getExtentRef());
+    size_t stride = e.getTypePtr()->fixedrecordsize();
+    INVARIANT((first_row + static_cast<size_t>(nrows)) * stride <= e.fixeddata.size(),
+              format("%s: setColumn past the end of the extent") % getName());
+
+    size_t var_size = e.variabledata.size();
+    for (uint32_t i = 0; i < nrows; ++i) {
+        if ((nulls == NULL || !nulls[i]) && valueSize(values[i]) > 0) {
+            var_size += 4 + roundupSize(valueSize(values[i]));
+        }
+    }
+    e.variabledata.reserve(var_size);
+
+    uint8_t *row_pos = e.fixeddata.begin() + first_row * stride;
+    for (uint32_t i = 0; i < nrows; ++i, row_pos += stride) {
+        if (nulls != NULL && nulls[i]) {
+            clear(e, row_pos);
+            setNull(e, row_pos, true);
+        } else {
+            set(e, row_pos, valueData(values[i]), valueSize(values[i]));
+        }
+    }
+}
+
+void Variable32Field::setColumn(uint32_t first_row, uint32_t nrows, const string *values,
+                                const uint8_t *nulls) {
+    setColumnImpl(first_row, nrows, values, nulls);
+}
+
+void Variable32Field::setColumn(uint32_t first_row, uint32_t nrows,
+                                const dataseries::Variable32Ref *values, const uint8_t *nulls) {
+    setColumnImpl(first_row, nrows, values, nulls);
+}
+
 void Variable32Field::selfcheck(const Extent::ByteArray &varbytes, int32 varoffset) {
     INVARIANT(varoffset >= 0 && (uint32_t)varoffset <= (varbytes.size() - 4),
               format("Internal error, bad variable offset %d") % varoffset);
@@ -133,8 +133,11 @@ void ExtentSeries::addField(Field &field) {
 
 void ExtentSeries::removeField(Field &field, bool must_exist) {
     bool found = false;
-    for (vector<Field *>::iterator i = my_fields.begin(); 
-        i != my_fields.end(); ++i) {
+    // search from the back so that removing fields in the reverse of the
+    // order they were added is cheap even with many fields
+    for (vector<Field *>::iterator i = my_fields.end(); 
+        i != my_fields.begin(); ) {
+        --i;
         if (*i == &field) {
             found = true;
             my_fields.erase(i);
@@ -16,6 +16,7 @@
 
 #include <Lintel/AssertBoost.hpp>
 #include <Lintel/HashMap.hpp>
+#include <Lintel/HashUnique.hpp>
 #include <Lintel/LintelLog.hpp>
 #include <Lintel/PThread.hpp>
 #include <Lintel/StringUtil.hpp>
@@ -606,6 +607,38 @@ ExtentType::ExtentType(const string &_xmldesc)
         : rep(parseXML(_xmldesc))
 { }
 
+ExtentType::ExtentType(const Ptr &base, const string &view_xmldesc,
+                       const vector<string> &columns)
+        : rep(parseView(base, view_xmldesc, columns))
+{ }
+
+ExtentType::ParsedRepresentation 
+ExtentType::parseView(const Ptr &base, const string &view_xmldesc,
+                      const vector<string> &columns) {
+    // same layout as the base; only the visible fields and the names differ
+    ParsedRepresentation ret(parseXML(base->getXmlDescriptionString()));
+    ParsedRepresentation view(parseXML(view_xmldesc));
+    ret.name = view.name;
+    ret.xml_description_str = view_xmldesc;
+    ret.view_base = base;
+
+    HashUnique<string> keep;
+    for (vector<string>::const_iterator i = columns.begin(); i != columns.end(); ++i) {
+        keep.add(*i);
+    }
+    vector<int> visible;
+    for (vector<int>::iterator i = ret.visible_fields.begin(); 
+         i != ret.visible_fields.end(); ++i) {
+        if (keep.exists(ret.field_info[*i].name)) {
+            visible.push_back(*i);
+        } else {
+            ret.field_info[*i].name.clear(); // so that lookups by name fail
+        }
+    }
+    ret.visible_fields.swap(visible);
+    return ret;
+}
+
 int ExtentType::getColumnNumber(const ParsedRepresentation &rep,
                                 const string &column,
                                 bool missing_ok) {
@@ -880,6 +913,46 @@ const ExtentType::Ptr ExtentTypeLibrary::sharedExtentTypePtr(const string &xmlde
     return tmp;
 }
 
+ExtentType::Ptr ExtentType::makeView(const vector<string> &columns, const string &name) const {
+    if (isView()) {
+        for (vector<string>::const_iterator i = columns.begin(); i != columns.end(); ++i) {
+            INVARIANT(hasColumn(*i), format("Unknown column '%s' in view '%s'") % *i % rep.name);
+        }
+        return rep.view_base->makeView(columns, name);
+    }
+    HashUnique<string> keep;
+    for (vector<string>::const_iterator i = columns.begin(); i != columns.end(); ++i) {
+        INVARIANT(hasColumn(*i), format("Unknown column '%s' in type '%s'") % *i % rep.name);
+        keep.add(*i);
+    }
+    string view_xml(str(format("<ExtentType name=\"%s\" namespace=\"%s\" version=\"%d.%d\">\n")
+                        % (name.empty() ? "project (" + rep.name + ")" : name)
+                        % rep.type_namespace % rep.major_version % rep.minor_version));
+    for (uint32_t i = 0; i < getNFields(); ++i) {
+        if (keep.exists(getFieldName(i))) {
+            view_xml.append(xmlFieldDesc(getFieldName(i)));
+        }
+    }
+    view_xml.append("</ExtentType>\n");
+
+    // can't be mistaken for the XML of a real type
+    string key("view\n" + rep.xml_description_str + view_xml);
+    using dataseries::decodeInfo;
+    PThreadAutoLocker lock(decodeInfo().mutex);
+    ExtentType::Ptr *d = decodeInfo().table.lookup(key);
+    if (d != NULL) {
+        return *d;
+    }
+    ExtentType::Ptr tmp(new ExtentType(shared_from_this(), view_xml, columns));
+    decodeInfo().table[key] = tmp;
+    return tmp;
+}
+
+ExtentType::Ptr ExtentType::getMaterializedTypePtr() const {
+    return isView() ? ExtentTypeLibrary::sharedExtentTypePtr(rep.xml_description_str)
+        : shared_from_this();
+}
+
 ExtentType::~ExtentType() { 
     SINVARIANT(dataseries::in_tilde_xml_decode);
 }
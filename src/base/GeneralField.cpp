@@ -1410,8 +1410,10 @@ void ExtentRecordCopy::prepPtr(const ExtentType::Ptr copy_type_in) {
     }
     if (source.getTypeCompat() == ExtentSeries::typeExact 
         && dest.getTypeCompat() == ExtentSeries::typeExact
-        && source.getTypePtr() == dest.getTypePtr() && source.getTypePtr() == copy_type) {
-        // Can do a bitwise copy.
+        && source.getTypePtr() == dest.getTypePtr() && source.getTypePtr() == copy_type
+        && !copy_type->isView()) {
+        // Can do a bitwise copy; not for views, whose hidden variable32 columns would
+        // point at variable data that is not copied.
         fixed_copy_size = source.getTypePtr()->fixedrecordsize();
         INVARIANT(fixed_copy_size > 0,"internal error");
         for (unsigned i=0;i<source.getTypePtr()->getNFields(); ++i) {
@@ -1424,14 +1426,96 @@ void ExtentRecordCopy::prepPtr(const ExtentType::Ptr copy_type_in) {
         }
     } else {
         fixed_copy_size = 0;
-        for (unsigned i=0; i < copy_type->getNFields(); ++i) {
-            const std::string &fieldname = copy_type->getFieldName(i);
+        prepPlan(copy_type);
+    }
+}
+
+namespace {
+    template<class T> struct bySourceOffset {
+        bool operator()(const T &a, const T &b) const {
+            return a.source_offset < b.source_offset
+                || (a.source_offset == b.source_offset && a.dest_offset < b.dest_offset);
+        }
+    };
+}
+
+void ExtentRecordCopy::prepPlan(const ExtentType::Ptr &copy_type) {
+    const ExtentType::Ptr from(source.getTypePtr()), to(dest.getTypePtr());
+    // With loose series the types, and so the layouts, can change under us.
+    bool use_layout = source.getTypeCompat() == ExtentSeries::typeExact 
+        && dest.getTypeCompat() == ExtentSeries::typeExact;
+    for (unsigned i=0; i < copy_type->getNFields(); ++i) {
+        const std::string &fieldname = copy_type->getFieldName(i);
+        INVARIANT(to->hasColumn(fieldname),
+                  format("Destination for copy is missing field %s") % fieldname);
+        ExtentType::fieldType type = from->getFieldType(fieldname);
+        bool same = use_layout && type == to->getFieldType(fieldname)
+            && from->getNullable(fieldname) == to->getNullable(fieldname);
+        if (same && type == ExtentType::ft_variable32) {
+            // also copies the null bit
+            sourcevarfields.push_back(new Variable32Field(source, fieldname,
+                                                          Field::flag_nullable));
+            destvarfields.push_back(new Variable32Field(dest, fieldname, Field::flag_nullable));
+            continue;
+        } else if (same && type == ExtentType::ft_bool) {
+            addBitCopy(fieldname, fieldname);
+        } else if (same && type != ExtentType::ft_unknown
+                   && from->getSize(fieldname) == to->getSize(fieldname)
+                   && (type != ExtentType::ft_double 
+                       || from->getDoubleBase(fieldname) == to->getDoubleBase(fieldname))) {
+            ByteRun run;
+            run.source_offset = from->getOffset(fieldname);
+            run.dest_offset = to->getOffset(fieldname);
+            run.nbytes = from->getSize(fieldname);
+            byte_runs.push_back(run);
+        } else {
             sourcefields.push_back(GeneralField::create(NULL, source, fieldname));
-            INVARIANT(dest.getTypePtr()->hasColumn(fieldname),
-                      format("Destination for copy is missing field %s") % fieldname);
             destfields.push_back(GeneralField::create(NULL, dest, fieldname));
+            continue;
+        }
+        if (from->getNullable(fieldname)) {
+            addBitCopy(ExtentType::nullableFieldname(fieldname),
+                       ExtentType::nullableFieldname(fieldname));
         }
     }
+
+    // Fields next to each other in both types become one memcpy
+    sort(byte_runs.begin(), byte_runs.end(), bySourceOffset<ByteRun>());
+    std::vector<ByteRun> runs;
+    for (std::vector<ByteRun>::iterator i = byte_runs.begin(); i != byte_runs.end(); ++i) {
+        if (!runs.empty() && runs.back().source_offset + runs.back().nbytes == i->source_offset
+            && runs.back().dest_offset + runs.back().nbytes == i->dest_offset) {
+            runs.back().nbytes += i->nbytes;
+        } else {
+            runs.push_back(*i);
+        }
+    }
+    byte_runs.swap(runs);
+
+    // and bits moving between the same pair of bytes by the same amount one mask and shift
+    sort(bit_copies.begin(), bit_copies.end(), bySourceOffset<BitCopy>());
+    std::vector<BitCopy> bits;
+    for (std::vector<BitCopy>::iterator i = bit_copies.begin(); i != bit_copies.end(); ++i) {
+        if (!bits.empty() && bits.back().source_offset == i->source_offset
+            && bits.back().dest_offset == i->dest_offset && bits.back().shift == i->shift) {
+            bits.back().source_mask |= i->source_mask;
+            bits.back().dest_mask |= i->dest_mask;
+        } else {
+            bits.push_back(*i);
+        }
+    }
+    bit_copies.swap(bits);
+}
+
+void ExtentRecordCopy::addBitCopy(const std::string &source_name, const std::string &dest_name) {
+    const ExtentType::Ptr from(source.getTypePtr()), to(dest.getTypePtr());
+    BitCopy bit;
+    bit.source_offset = from->getOffset(source_name);
+    bit.dest_offset = to->getOffset(dest_name);
+    bit.shift = to->getBitPos(dest_name) - from->getBitPos(source_name);
+    bit.source_mask = 1 << from->getBitPos(source_name);
+    bit.dest_mask = 1 << to->getBitPos(dest_name);
+    bit_copies.push_back(bit);
 }
 
 ExtentRecordCopy::~ExtentRecordCopy() {
@@ -1446,6 +1530,37 @@ ExtentRecordCopy::~ExtentRecordCopy() {
     }
 }
 
+void ExtentRecordCopy::copyFixed(const uint8_t *from, uint8_t *to) const {
+    for (std::vector<ByteRun>::const_iterator i = byte_runs.begin(); i != byte_runs.end(); ++i) {
+        memcpy(to + i->dest_offset, from + i->source_offset, i->nbytes);
+    }
+    for (std::vector<BitCopy>::const_iterator i = bit_copies.begin(); 
+         i != bit_copies.end(); ++i) {
+        uint8_t bits = from[i->source_offset] & i->source_mask;
+        bits = i->shift >= 0 ? bits << i->shift : bits >> -i->shift;
+        to[i->dest_offset] = (to[i->dest_offset] & ~i->dest_mask) | bits;
+    }
+}
+
+void ExtentRecordCopy::copyVariable(const Extent &from_extent, 
+                                    const dataseries::SEP_RowOffset &from_offset,
+                                    Extent &to_extent, const dataseries::SEP_RowOffset &to_offset) {
+    // need to do things this way because in the process of doing
+    // a memcpy we mangled the variable offsets that are stored
+    // in the fixed fields.  If we don't pre-clear them, when we
+    // call set it could try to overwrite non-existant bits.
+    for (unsigned int i=0;i<sourcevarfields.size();++i) {
+        destvarfields[i]->clear(to_extent, to_offset);
+        if (sourcevarfields[i]->isNull(from_extent, from_offset)) {
+            destvarfields[i]->setNull(to_extent, to_offset);
+        } else {
+            destvarfields[i]->set(to_extent, to_offset, 
+                                  sourcevarfields[i]->val(from_extent, from_offset),
+                                  sourcevarfields[i]->size(from_extent, from_offset));
+        }
+    }
+}
+
 void ExtentRecordCopy::copyRecord() {
     if (fixed_copy_size == -1) {
         prep();
@@ -1455,24 +1570,17 @@ void ExtentRecordCopy::copyRecord() {
     if (fixed_copy_size > 0) {
         dest.checkOffset(fixed_copy_size-1);
         memcpy(dest.pos.record_start(),source.pos.record_start(),fixed_copy_size);
-        // need to do things this way because in the process of doing
-        // the memcpy we mangled the variable offsets that are stored
-        // in the fixed fields.  If we don't pre-clear them, when we
-        // call set it could try to overwrite non-existant bits.
-        for (unsigned int i=0;i<sourcevarfields.size();++i) {
-            destvarfields[i]->clear();
-            if (sourcevarfields[i]->isNull()) {
-                destvarfields[i]->setNull();
-            } else {
-                destvarfields[i]->set(*sourcevarfields[i]);
-            }
-        }
     } else {
-        SINVARIANT(destfields.size() == sourcefields.size());
-        for (unsigned int i=0;i<sourcefields.size();++i) {
-            destfields[i]->set(sourcefields[i]);
-        }
-    }   
+        copyFixed(source.pos.record_start(), dest.pos.record_start());
+    }
+    if (!sourcevarfields.empty()) {
+        copyVariable(source.getExtentRef(), source.getRowOffset(), 
+                     dest.getExtentRef(), dest.getRowOffset());
+    }
+    SINVARIANT(destfields.size() == sourcefields.size());
+    for (unsigned int i=0;i<sourcefields.size();++i) {
+        destfields[i]->set(sourcefields[i]);
+    }
 }
 
 void ExtentRecordCopy::copyRecord(const Extent &extent, const dataseries::SEP_RowOffset &offset) {
@@ -1480,28 +1588,92 @@ void ExtentRecordCopy::copyRecord(const Extent &extent, const dataseries::SEP_Ro
         prep();
     }
     INVARIANT(dest.morerecords(), "you forgot to create the destination record");
+    SINVARIANT(extent.getTypePtr() == source.getTypePtr());
 
+    const uint8_t *row_pos = offset.rowPosition(extent);
     if (fixed_copy_size > 0) {
-        SINVARIANT(extent.getTypePtr() == source.getTypePtr());
-        const uint8_t *row_pos = offset.rowPos(extent);
         dest.checkOffset(fixed_copy_size-1);
         memcpy(dest.pos.record_start(), row_pos, fixed_copy_size);
-        // need to do things this way because in the process of doing
-        // the memcpy we mangled the variable offsets that are stored
-        // in the fixed fields.  If we don't pre-clear them, when we
-        // call set it could try to overwrite non-existant bits.
-        for (unsigned int i=0;i<sourcevarfields.size();++i) {
-            destvarfields[i]->clear();
-            destvarfields[i]->set(sourcevarfields[i]->val(extent, offset),
-                                  sourcevarfields[i]->size(extent, offset));
-        }
     } else {
-        SINVARIANT(destfields.size() == sourcefields.size());
-        for (unsigned int i=0;i<sourcefields.size();++i) {
-            FATAL_ERROR("unimplemented; will need a variant of set that takes extent, offset");
-            //      destfields[i]->set(sourcefields[i]->val(extent, offset),
-            //                               sourcefields[i]-);
+        copyFixed(row_pos, dest.pos.record_start());
+    }
+    if (!sourcevarfields.empty()) {
+        copyVariable(extent, offset, dest.getExtentRef(), dest.getRowOffset());
+    }
+    SINVARIANT(destfields.size() == sourcefields.size());
+    for (unsigned int i=0;i<sourcefields.size();++i) {
+        GeneralValue value(sourcefields[i]->val(extent, offset));
+        if (value.getType() == ExtentType::ft_double
+            && destfields[i]->getType() == ExtentType::ft_double) {
+            // keep the absolute value across different bases, as GF_Double::set(GeneralField *)
+            value.setDouble(value.valDouble()
+                            + static_cast<GF_Double *>(sourcefields[i])->myfield.base_val
+                            - static_cast<GF_Double *>(destfields[i])->myfield.base_val);
         }
-    }   
+        destfields[i]->set(dest.getExtentRef(), dest.getRowOffset(), value);
+    }
 }
 
+void ExtentRecordCopy::copyRecords(uint32_t first_record, uint32_t nrecords) {
+    if (fixed_copy_size == -1) {
+        prep();
+    }
+    INVARIANT(source.hasExtent() && dest.hasExtent(), "copyRecords needs both extents set");
+    Extent &from(source.getExtentRef());
+    Extent &to(dest.getExtentRef());
+    INVARIANT(static_cast<size_t>(first_record) + nrecords <= from.nRecords(),
+              format("can't copy records [%d, %d) of %d") % first_record 
+              % (first_record + nrecords) % from.nRecords());
+    if (nrecords == 0) {
+        return;
+    }
+    const size_t from_size = from.getTypePtr()->fixedrecordsize();
+    const size_t to_size = to.getTypePtr()->fixedrecordsize();
+    const size_t to_first = to.nRecords();
+    
+    dest.createRecords(nrecords);
+    if (!sourcevarfields.empty()) {
+        // reserve the range's share of the variable data once rather than growing per value
+        to.variabledata.reserve(to.variabledata.size() 
+                                + from.variabledata.size() * nrecords / from.nRecords());
+    }
+    const uint8_t *from_pos = from.fixeddata.begin() + first_record * from_size;
+    uint8_t *to_pos = to.fixeddata.begin() + to_first * to_size;
+    if (fixed_copy_size > 0) {
+        memcpy(to_pos, from_pos, nrecords * to_size);
+    } else if (!byte_runs.empty() || !bit_copies.empty()) {
+        for (uint32_t i = 0; i < nrecords; ++i) {
+            copyFixed(from_pos + i * from_size, to_pos + i * to_size);
+        }
+    }
+    if (!sourcevarfields.empty()) {
+        for (uint32_t i = 0; i < nrecords; ++i) {
+            copyVariable(from, dataseries::SEP_RowOffset((first_record + i) * from_size, &from),
+                         to, dataseries::SEP_RowOffset((to_first + i) * to_size, &to));
+        }
+    }
+    if (!sourcefields.empty()) {
+        const void *source_pos = source.getCurPos();
+        for (uint32_t i = 0; i < nrecords; ++i) {
+            source.setCurPos(from_pos + i * from_size);
+            dest.setCurPos(to_pos + i * to_size);
+            for (unsigned int j = 0; j < sourcefields.size(); ++j) {
+                destfields[j]->set(sourcefields[j]);
+            }
+        }
+        source.setCurPos(source_pos);
+    }
+    dest.setCurPos(to_pos + (nrecords - 1) * to_size);
+}
+
+void ExtentRecordCopy::copyRecords(const std::vector<uint32_t> &records) {
+    std::vector<uint32_t>::const_iterator i = records.begin();
+    while (i != records.end()) {
+        std::vector<uint32_t>::const_iterator j = i + 1;
+        while (j != records.end() && *j == *(j - 1) + 1) {
+            ++j;
+        }
+        copyRecords(*i, j - i);
+        i = j;
+    }
+}
@@ -0,0 +1,307 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    implementation
+*/
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include <boost/format.hpp>
+
+#include <Lintel/HashFns.hpp>
+
+#include <DataSeries/BloomFilter.hpp>
+#include <DataSeries/DataSeriesSource.hpp>
+#include <DataSeries/ExtentField.hpp>
+
+using namespace std;
+using boost::format;
+using namespace dataseries;
+
+namespace {
+    const string bloom_filter_type_xml(
+        "<ExtentType name=\"DataSeries: BloomFilter\" namespace=\"ssd.hpl.hp.com\""
+        " version=\"1.0\" comment=\"Bloom filters of fields for each extent in this file\" >\n"
+        "  <field type=\"int64\" name=\"offset\" comment=\"offset of the extent\" />\n"
+        "  <field type=\"variable32\" name=\"extenttype\" pack_unique=\"yes\" />\n"
+        "  <field type=\"variable32\" name=\"field\" pack_unique=\"yes\" />\n"
+        "  <field type=\"int32\" name=\"nvalues\" comment=\"distinct non-null values\" />\n"
+        "  <field type=\"int32\" name=\"nhashes\" />\n"
+        "  <field type=\"variable32\" name=\"bits\" />\n"
+        "</ExtentType>\n");
+
+    // Keys are a tag byte and then the value, integers little endian so that a filter works
+    // the same after being read on a machine of the other endianness.
+    const char int_tag = 'i', double_tag = 'd', bytes_tag = 's';
+
+    void intKey(int64_t v, string &into) {
+        into.resize(9);
+        into[0] = int_tag;
+        uint64_t u = static_cast<uint64_t>(v);
+        for (int i = 0; i < 8; ++i) {
+            into[i + 1] = static_cast<char>((u >> (8 * i)) & 0xFF);
+        }
+    }
+
+    void doubleKey(double v, string &into) {
+        if (v == floor(v) && fabs(v) < 9.0e18) {
+            intKey(static_cast<int64_t>(v), into);
+            return;
+        }
+        uint64_t u;
+        memcpy(&u, &v, sizeof(u));
+        intKey(static_cast<int64_t>(u), into);
+        into[0] = double_tag;
+    }
+
+    void bytesKey(const void *data, size_t size, string &into) {
+        into.resize(size + 1);
+        into[0] = bytes_tag;
+        if (size > 0) {
+            memcpy(&into[1], data, size);
+        }
+    }
+
+    uint64_t keyHash(const void *key, size_t size) {
+        uint32_t a = lintel::bobJenkinsHash(1972, key, size);
+        uint32_t b = lintel::bobJenkinsHash(2013, key, size);
+        return (static_cast<uint64_t>(a) << 32) | b;
+    }
+
+    /// hashes of the canonical keys of the non-null values of a numeric span
+    template<typename T>
+    void intHashes(const ColumnSpan<T> &span, vector<uint64_t> &into) {
+        string key;
+        for (uint32_t i = 0; i < span.size(); ++i) {
+            if (!span.isNull(i)) {
+                intKey(static_cast<int64_t>(span.raw(i)), key);
+                into.push_back(keyHash(key.data(), key.size()));
+            }
+        }
+    }
+}
+
+BloomFilter::BloomFilter(uint32_t nvalues, uint32_t bits_per_value) : nvalues(0) {
+    SINVARIANT(bits_per_value > 0);
+    uint64_t nbits = max(static_cast<uint64_t>(64),
+                         static_cast<uint64_t>(nvalues) * bits_per_value);
+    bits.assign((nbits + 7) / 8, '\0');
+    // k = ln(2) * bits/value minimizes the false positive rate
+    nhashes = max(1, min(16, static_cast<int>(bits_per_value * 0.693 + 0.5)));
+}
+
+string BloomFilter::key(const GeneralValue &v) {
+    string ret;
+    switch (v.getType())
+        {
+        case ExtentType::ft_unknown: break;
+        case ExtentType::ft_bool: intKey(v.valBool() ? 1 : 0, ret); break;
+        case ExtentType::ft_byte: intKey(v.valByte(), ret); break;
+        case ExtentType::ft_int32: intKey(v.valInt32(), ret); break;
+        case ExtentType::ft_int64: intKey(v.valInt64(), ret); break;
+        case ExtentType::ft_double: doubleKey(v.valDouble(), ret); break;
+        case ExtentType::ft_variable32: case ExtentType::ft_fixedwidth: {
+            const string s(v.valString());
+            bytesKey(s.data(), s.size(), ret);
+            break;
+        }
+        default:
+            FATAL_ERROR(format("internal error, unexpected type %s")
+                        % ExtentType::fieldTypeToStr(v.getType()));
+        }
+    return ret;
+}
+
+// Kirsch and Mitzenmacher's double hashing: bit i is h1 + i * h2, which is as good as k
+// independent hashes.
+void BloomFilter::addHash(uint64_t h) {
+    SINVARIANT(!bits.empty());
+    uint32_t h1 = h >> 32, h2 = (h & 0xFFFFFFFF) | 1;
+    uint64_t nbits = bits.size() * 8;
+    for (uint32_t i = 0; i < nhashes; ++i) {
+        uint64_t bit = (h1 + static_cast<uint64_t>(i) * h2) % nbits;
+        bits[bit / 8] |= static_cast<char>(1 << (bit % 8));
+    }
+    ++nvalues;
+}
+
+void BloomFilter::add(const void *key, size_t size) {
+    addHash(keyHash(key, size));
+}
+
+bool BloomFilter::mayContain(const void *key, size_t size) const {
+    if (bits.empty()) {
+        return true;
+    }
+    uint64_t h = keyHash(key, size);
+    uint32_t h1 = h >> 32, h2 = (h & 0xFFFFFFFF) | 1;
+    uint64_t nbits = bits.size() * 8;
+    for (uint32_t i = 0; i < nhashes; ++i) {
+        uint64_t bit = (h1 + static_cast<uint64_t>(i) * h2) % nbits;
+        if ((bits[bit / 8] & (1 << (bit % 8))) == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const ExtentType::Ptr &BloomFilter::extentType() {
+    static const ExtentType::Ptr type(
+        ExtentTypeLibrary::sharedExtentTypePtr(bloom_filter_type_xml));
+    return type;
+}
+
+void BloomFilter::compute(const Extent::Ptr &e, const vector<string> &fields,
+                          uint32_t bits_per_value, ByField &into) {
+    into.clear();
+    ExtentSeries series(e);
+    const ExtentType &type(*e->getTypePtr());
+    vector<uint64_t> hashes;
+    for (vector<string>::const_iterator i = fields.begin(); i != fields.end(); ++i) {
+        hashes.clear();
+        hashes.reserve(e->nRecords());
+        switch (type.getFieldType(*i))
+            {
+            case ExtentType::ft_bool: {
+                BoolField field(series, *i, Field::flag_nullable);
+                intHashes(field.span(), hashes);
+                break;
+            }
+            case ExtentType::ft_byte: {
+                ByteField field(series, *i, Field::flag_nullable);
+                intHashes(field.span(), hashes);
+                break;
+            }
+            case ExtentType::ft_int32: {
+                Int32Field field(series, *i, Field::flag_nullable);
+                intHashes(field.span(), hashes);
+                break;
+            }
+            case ExtentType::ft_int64: {
+                Int64Field field(series, *i, Field::flag_nullable);
+                intHashes(field.span(), hashes);
+                break;
+            }
+            case ExtentType::ft_double: {
+                DoubleField field(series, *i, Field::flag_nullable
+                                  | DoubleField::flag_allownonzerobase);
+                ColumnSpan<double> span(field.span());
+                string key;
+                for (uint32_t row = 0; row < span.size(); ++row) {
+                    if (!span.isNull(row)) {
+                        doubleKey(span.raw(row), key);
+                        hashes.push_back(keyHash(key.data(), key.size()));
+                    }
+                }
+                break;
+            }
+            case ExtentType::ft_variable32: {
+                Variable32Field field(series, *i, Field::flag_nullable);
+                Variable32Span span(field.span());
+                string key;
+                for (uint32_t row = 0; row < span.size(); ++row) {
+                    if (!span.isNull(row)) {
+                        Variable32Ref v(span.raw(row));
+                        bytesKey(v.data, v.size, key);
+                        hashes.push_back(keyHash(key.data(), key.size()));
+                    }
+                }
+                break;
+            }
+            case ExtentType::ft_fixedwidth: {
+                FixedWidthField field(series, *i, Field::flag_nullable);
+                string key;
+                for (; series.more(); series.next()) { // series starts at the first row
+                    if (!field.isNull()) {
+                        bytesKey(field.val(), field.size(), key);
+                        hashes.push_back(keyHash(key.data(), key.size()));
+                    }
+                }
+                break;
+            }
+            default:
+                FATAL_ERROR(format("internal error, unexpected type for %s") % *i);
+            }
+        sort(hashes.begin(), hashes.end());
+        hashes.erase(unique(hashes.begin(), hashes.end()), hashes.end());
+
+        BloomFilter &filter(into[*i]);
+        filter = BloomFilter(hashes.size(), bits_per_value);
+        for (vector<uint64_t>::iterator h = hashes.begin(); h != hashes.end(); ++h) {
+            filter.addHash(*h);
+        }
+    }
+}
+
+void BloomFilter::append(ExtentSeries &series, int64_t offset, const string &type_name,
+                         const ByField &filters) {
+    if (!series.hasExtent()) {
+        series.newExtent();
+    }
+    Int64Field f_offset(series, "offset");
+    Variable32Field f_extenttype(series, "extenttype"), f_field(series, "field");
+    Int32Field f_nvalues(series, "nvalues"), f_nhashes(series, "nhashes");
+    Variable32Field f_bits(series, "bits");
+
+    for (ByField::const_iterator i = filters.begin(); i != filters.end(); ++i) {
+        series.newRecord();
+        f_offset.set(offset);
+        f_extenttype.set(type_name);
+        f_field.set(i->first);
+        f_nvalues.set(i->second.nvalues);
+        f_nhashes.set(i->second.nhashes);
+        f_bits.set(i->second.bits);
+    }
+}
+
+bool BloomFilter::read(DataSeriesSource &source, map<int64_t, ByField> &into) {
+    into.clear();
+    const string &bloom_type_name(extentType()->getName());
+    if (source.getLibrary().getTypeByNamePtr(bloom_type_name, true) == NULL) {
+        return false;
+    }
+
+    ExtentSeries index_series(source.index_extent);
+    Int64Field index_offset(index_series, "offset");
+    Variable32Field index_type(index_series, "extenttype");
+
+    // as for zone maps, filters copied from another file would be for its offsets
+    map<int64_t, string> extent_types;
+    vector<int64_t> filter_offsets;
+    for (; index_series.more(); index_series.next()) {
+        if (index_type.equal(bloom_type_name)) {
+            filter_offsets.push_back(index_offset.val());
+        } else {
+            extent_types[index_offset.val()] = index_type.stringval();
+        }
+    }
+
+    ExtentSeries series;
+    Int64Field f_offset(series, "offset");
+    Variable32Field f_extenttype(series, "extenttype"), f_field(series, "field");
+    Int32Field f_nvalues(series, "nvalues"), f_nhashes(series, "nhashes");
+    Variable32Field f_bits(series, "bits");
+
+    for (vector<int64_t>::iterator i = filter_offsets.begin(); i != filter_offsets.end(); ++i) {
+        off64_t offset = *i;
+        Extent::Ptr e(source.preadExtent(offset));
+        for (series.setExtent(e); series.more(); series.next()) {
+            map<int64_t, string>::iterator extent = extent_types.find(f_offset.val());
+            if (extent == extent_types.end() || !f_extenttype.equal(extent->second)) {
+                continue;
+            }
+            into[f_offset.val()][f_field.stringval()]
+                = BloomFilter(f_bits.stringval(), f_nhashes.val(), f_nvalues.val());
+        }
+        series.clearExtent();
+    }
+    return true;
+}
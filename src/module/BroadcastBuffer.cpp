@@ -0,0 +1,140 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    implementation
+*/
+
+#include <algorithm>
+#include <limits>
+
+#include <boost/bind.hpp>
+
+#include <DataSeries/BroadcastBuffer.hpp>
+
+using namespace std;
+
+namespace {
+    const uint64_t closed_position = numeric_limits<uint64_t>::max();
+}
+
+BroadcastBuffer::BroadcastBuffer(DataSeriesModule &source, size_t max_extent_memory)
+    : source(source), first_position(0), cur_used_memory(0), max_used_memory(0),
+      max_extent_memory(max_extent_memory), reading(false), source_done(false)
+{
+    INVARIANT(max_extent_memory > 0, "can't have 0 max extent memory");
+}
+
+BroadcastBuffer::~BroadcastBuffer() {
+    INVARIANT(consumers.empty(), "deleting a BroadcastBuffer that still has consumers");
+}
+
+BroadcastBuffer::Consumer::~Consumer() {
+    buffer.removeConsumer(*this);
+}
+
+Extent::Ptr BroadcastBuffer::Consumer::getSharedExtent() {
+    return buffer.next(*this);
+}
+
+void BroadcastBuffer::Consumer::close() {
+    buffer.close(*this);
+}
+
+BroadcastBuffer::Consumer *BroadcastBuffer::newConsumer() {
+    PThreadScopedLock lock(mutex);
+    INVARIANT(first_position == 0 && buffer.empty() && !source_done,
+              "all the consumers have to be made before reading any extents");
+    consumers.push_back(new Consumer(*this));
+    return consumers.back();
+}
+
+void BroadcastBuffer::getAndDeleteSharedConcurrently(const vector<DataSeriesModule *> &modules) {
+    vector<PThread *> threads;
+    for (vector<DataSeriesModule *>::const_iterator i = modules.begin();
+         i != modules.end(); ++i) {
+        threads.push_back(new PThreadFunction(boost::bind(&DataSeriesModule::getAndDeleteShared,
+                                                          *i)));
+        threads.back()->start();
+    }
+    for (vector<PThread *>::iterator i = threads.begin(); i != threads.end(); ++i) {
+        (*i)->join();
+        delete *i;
+    }
+}
+
+size_t BroadcastBuffer::maxUsedMemory() {
+    PThreadScopedLock lock(mutex);
+    return max_used_memory;
+}
+
+Extent::Ptr BroadcastBuffer::next(Consumer &consumer) {
+    PThreadScopedLock lock(mutex);
+    while (true) {
+        if (consumer.position == closed_position) {
+            return Extent::Ptr();
+        } else if (consumer.position < first_position + buffer.size()) {
+            Extent::Ptr ret = buffer[consumer.position - first_position];
+            ++consumer.position;
+            release();
+            return ret;
+        } else if (source_done) {
+            return Extent::Ptr();
+        } else if (!reading && cur_used_memory < max_extent_memory) {
+            // this is the furthest along consumer; read for everyone
+            reading = true;
+            Extent::Ptr e;
+            {
+                PThreadScopedUnlock unlock(lock);
+                e = source.getSharedExtent();
+            }
+            reading = false;
+            if (e == NULL) {
+                source_done = true;
+            } else {
+                buffer.push_back(e);
+                cur_used_memory += e->size();
+                max_used_memory = max(max_used_memory, cur_used_memory);
+            }
+            cond.broadcast();
+        } else {
+            // someone else is reading, or we have to wait for the slowest consumer
+            cond.wait(mutex);
+        }
+    }
+}
+
+void BroadcastBuffer::close(Consumer &consumer) {
+    PThreadScopedLock lock(mutex);
+    consumer.position = closed_position;
+    release();
+}
+
+void BroadcastBuffer::removeConsumer(Consumer &consumer) {
+    PThreadScopedLock lock(mutex);
+    vector<Consumer *>::iterator i = find(consumers.begin(), consumers.end(), &consumer);
+    SINVARIANT(i != consumers.end());
+    consumers.erase(i);
+    release();
+}
+
+void BroadcastBuffer::release() {
+    uint64_t slowest = closed_position;
+    for (vector<Consumer *>::iterator i = consumers.begin(); i != consumers.end(); ++i) {
+        slowest = min(slowest, (*i)->position);
+    }
+    bool released = false;
+    while (!buffer.empty() && first_position < slowest) {
+        cur_used_memory -= buffer.front()->size();
+        buffer.pop_front();
+        ++first_position;
+        released = true;
+    }
+    if (released) {
+        cond.broadcast();
+    }
+}
@@ -6,6 +6,41 @@ using namespace std;
 
 //////////////////////////////////////////////////////////////////////
 
+void DSExpr::selectRows(ExtentSeries &series, dataseries::RowSelection &selection) {
+    selection.clear();
+    series.setCurPos(series.getExtentRef().fixeddata.begin());
+    for (uint32_t row = 0; series.morerecords(); ++series, ++row) {
+        if (valBool()) {
+            selection.push_back(row);
+        }
+    }
+}
+
+void DSExpr::valDoubles(ExtentSeries &series, const dataseries::RowSelection *selection,
+                        vector<double> &values) {
+    Extent &e(series.getExtentRef());
+    if (selection == NULL) {
+        values.resize(e.nRecords());
+        series.setCurPos(e.fixeddata.begin());
+        for (uint32_t row = 0; series.morerecords(); ++series, ++row) {
+            values[row] = valDouble();
+        }
+    } else {
+        values.resize(selection->size());
+        uint32_t stride = e.getTypePtr()->fixedrecordsize();
+        for (size_t i = 0; i < selection->size(); ++i) {
+            series.setCurPos(e.fixeddata.begin() + (*selection)[i] * stride);
+            values[i] = valDouble();
+        }
+    }
+}
+
+bool DSExpr::mayMatch(const dataseries::ExtentZones &) {
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+
 class DefaultParser : public DSExprParser {
     DSExpr *parse(ExtentSeries &series, const string &expr) {
         // TODO: DSExprImpl::Driver and the defined factory interface
@@ -13,13 +48,13 @@ class DefaultParser : public DSExprParser {
         // change.
         DSExprImpl::Driver driver(series);
         driver.doit(expr);
-        return driver.expr;
+        return DSExprImpl::compile(driver.expr);
     }
 
     DSExpr *parse(const FieldNameToSelector &field_name_to_selector, const string &expr) {
         DSExprImpl::Driver driver(field_name_to_selector);
         driver.doit(expr);
-        return driver.expr;
+        return DSExprImpl::compile(driver.expr);
     }
 
     const string getUsage() const {
@@ -0,0 +1,1122 @@
+/* -*- C++ -*-
+   (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    Compile a parsed DSExpr tree into flat typed programs.
+
+    The tree evaluates by walking virtual nodes, and every access to a field goes through a
+    GeneralField and often a temporary GeneralValue (which copies strings).  Since the type of
+    every field is known once the expression is parsed, we instead compile one program per
+    result type (double, int64, bool, string); each node is compiled in the mode its parent asks
+    for, so the arithmetic is exactly what the tree's valDouble/valInt64/... would have done.
+    Fields are read through typed fields registered on the series, strings are passed as
+    pointer + length into the extent, and anything without a compiled form (functions, fixed
+    width fields, the combinations that are errors) calls back into the tree node, so results
+    and error messages match the interpreter.
+
+    The bool and double programs are also compiled a second time without short circuits for
+    extent at a time evaluation (DSExpr::selectRows/valDoubles).  There each instruction runs
+    over every row of the extent in a simple loop over dense arrays, which the C++ compiler can
+    turn into SIMD code; since a loop can't call back into the tree, expressions that need to
+    are evaluated a row at a time as before.
+
+    When NativeCode is enabled, selectRows/valDoubles instead write the scalar bool and double
+    programs out as C++ for the extent type of the series, with the field offsets as constants,
+    and run the compiled loop over the extent.  Programs that call back into the tree or
+    concatenate strings have no native form and use the paths above. */
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <set>
+#include <sstream>
+
+#include <Lintel/Double.hpp>
+
+#include <DataSeries/ExtentField.hpp>
+#include <DataSeries/NativeCode.hpp>
+
+#include "DSExprImpl.hpp"
+
+using namespace std;
+using boost::format;
+
+namespace DSExprImpl {
+
+    class Program {
+      public:
+        enum Op {
+            PushD, PushI, PushB, PushS,
+            LoadBoolD, LoadBoolI, LoadBoolB,
+            LoadByteD, LoadByteI, LoadByteB,
+            LoadInt32D, LoadInt32I, LoadInt32B,
+            LoadInt64D, LoadInt64I, LoadInt64B,
+            LoadDoubleD, LoadDoubleI, LoadDoubleB,
+            LoadVariable32S,
+            NegD, NegI, AddD, AddI, SubD, SubI, MulD, MulI, DivD, DivI, ConcatS,
+            EqD, NeqD, GtD, LtD, GeqD, LeqD,
+            EqS, NeqS, GtS, LtS, GeqS, LeqS,
+            Not, JumpIfTrue, JumpIfFalse, Pop, AndB, OrB,
+            TfracToSeconds,
+            CallD, CallI, CallB, CallS
+        };
+
+        struct Instr {
+            Instr(Op op) : op(op), target(0), d(0), p(NULL) { }
+
+            Op op;
+            uint32_t target; // jump target or index into scratch
+            double d;
+            const void *p; // field, node or constant string
+        };
+
+        struct Slot {
+            union {
+                double d;
+                int64_t i;
+                bool b;
+            };
+            const char *s;
+            size_t s_len;
+        };
+
+        Program() : max_depth(0) { }
+
+        void run() {
+            Slot *sp = &stack[0];
+            size_t pc = 0, n = instrs.size();
+            while (pc < n) {
+                const Instr &in(instrs[pc++]);
+                switch (in.op) {
+                    case PushD: sp->d = in.d; ++sp; break;
+                    case PushI: sp->i = static_cast<int64_t>(in.d); ++sp; break;
+                    case PushB: sp->b = in.d ? true : false; ++sp; break;
+                    case PushS: {
+                        const string *str = static_cast<const string *>(in.p);
+                        sp->s = str->data();
+                        sp->s_len = str->size();
+                        ++sp;
+                        break;
+                    }
+
+                    case LoadBoolD: sp->d = field<BoolField>(in).val() ? 1 : 0; ++sp; break;
+                    case LoadBoolI: sp->i = field<BoolField>(in).val() ? 1 : 0; ++sp; break;
+                    case LoadBoolB: sp->b = field<BoolField>(in).val(); ++sp; break;
+                    case LoadByteD: sp->d = field<ByteField>(in).val(); ++sp; break;
+                    case LoadByteI: sp->i = field<ByteField>(in).val(); ++sp; break;
+                    case LoadByteB: sp->b = field<ByteField>(in).val() != 0; ++sp; break;
+                    case LoadInt32D: sp->d = field<Int32Field>(in).val(); ++sp; break;
+                    case LoadInt32I: sp->i = field<Int32Field>(in).val(); ++sp; break;
+                    case LoadInt32B: sp->b = field<Int32Field>(in).val() != 0; ++sp; break;
+                    case LoadInt64D: sp->d = field<Int64Field>(in).val(); ++sp; break;
+                    case LoadInt64I: sp->i = field<Int64Field>(in).val(); ++sp; break;
+                    case LoadInt64B: sp->b = field<Int64Field>(in).val() != 0; ++sp; break;
+                    case LoadDoubleD: sp->d = field<DoubleField>(in).val(); ++sp; break;
+                    case LoadDoubleI:
+                        sp->i = static_cast<int64_t>(field<DoubleField>(in).val()); ++sp; break;
+                    case LoadDoubleB:
+                        sp->b = field<DoubleField>(in).val() ? true : false; ++sp; break;
+                    case LoadVariable32S: {
+                        const Variable32Field &f(field<Variable32Field>(in));
+                        sp->s = reinterpret_cast<const char *>(f.val());
+                        sp->s_len = f.size();
+                        ++sp;
+                        break;
+                    }
+
+                    case NegD: sp[-1].d = -sp[-1].d; break;
+                    case NegI: sp[-1].i = -sp[-1].i; break;
+                    case AddD: --sp; sp[-1].d = sp[-1].d + sp->d; break;
+                    case AddI: --sp; sp[-1].i = sp[-1].i + sp->i; break;
+                    case SubD: --sp; sp[-1].d = sp[-1].d - sp->d; break;
+                    case SubI: --sp; sp[-1].i = sp[-1].i - sp->i; break;
+                    case MulD: --sp; sp[-1].d = sp[-1].d * sp->d; break;
+                    case MulI: --sp; sp[-1].i = sp[-1].i * sp->i; break;
+                    case DivD: --sp; sp[-1].d = sp[-1].d / sp->d; break;
+                    case DivI: --sp; sp[-1].i = sp[-1].i / sp->i; break;
+                    case ConcatS: {
+                        --sp;
+                        string &into(scratch[in.target]);
+                        into.assign(sp[-1].s, sp[-1].s_len);
+                        into.append(sp->s, sp->s_len);
+                        sp[-1].s = into.data();
+                        sp[-1].s_len = into.size();
+                        break;
+                    }
+
+                    case EqD: --sp; sp[-1].b = Double::eq(sp[-1].d, sp->d); break;
+                    case NeqD: --sp; sp[-1].b = !Double::eq(sp[-1].d, sp->d); break;
+                    case GtD: --sp; sp[-1].b = Double::gt(sp[-1].d, sp->d); break;
+                    case LtD: --sp; sp[-1].b = Double::lt(sp[-1].d, sp->d); break;
+                    case GeqD: --sp; sp[-1].b = Double::geq(sp[-1].d, sp->d); break;
+                    case LeqD: --sp; sp[-1].b = Double::leq(sp[-1].d, sp->d); break;
+
+                    case EqS: --sp; sp[-1].b = equal(sp[-1], *sp); break;
+                    case NeqS: --sp; sp[-1].b = !equal(sp[-1], *sp); break;
+                    case GtS: --sp; sp[-1].b = compare(sp[-1], *sp) > 0; break;
+                    case LtS: --sp; sp[-1].b = compare(sp[-1], *sp) < 0; break;
+                    case GeqS: --sp; sp[-1].b = compare(sp[-1], *sp) >= 0; break;
+                    case LeqS: --sp; sp[-1].b = compare(sp[-1], *sp) <= 0; break;
+
+                    case Not: sp[-1].b = !sp[-1].b; break;
+                    case JumpIfTrue: if (sp[-1].b) { pc = in.target; } break;
+                    case JumpIfFalse: if (!sp[-1].b) { pc = in.target; } break;
+                    case Pop: --sp; break;
+
+                    case TfracToSeconds: sp[-1].d = sp[-1].i / 4294967296.0; break;
+
+                    case CallD: sp->d = node(in)->valDouble(); ++sp; break;
+                    case CallI: sp->i = node(in)->valInt64(); ++sp; break;
+                    case CallB: sp->b = node(in)->valBool(); ++sp; break;
+                    case CallS: {
+                        string &into(scratch[in.target]);
+                        into = node(in)->valString();
+                        sp->s = into.data();
+                        sp->s_len = into.size();
+                        ++sp;
+                        break;
+                    }
+                    default: FATAL_ERROR(format("internal error, unknown op %d") % in.op);
+                }
+            }
+            DEBUG_SINVARIANT(sp == &stack[0] + 1);
+        }
+
+        const Slot &result() const {
+            return stack[0];
+        }
+
+        /// true if VectorEval can run this program
+        bool vectorizable() const {
+            for (vector<Instr>::const_iterator i = instrs.begin(); i != instrs.end(); ++i) {
+                switch (i->op) {
+                    case ConcatS: case JumpIfTrue: case JumpIfFalse: case Pop:
+                    case CallD: case CallI: case CallB: case CallS:
+                        return false;
+                    default:
+                        break;
+                }
+            }
+            return true;
+        }
+
+        vector<Instr> instrs;
+        vector<Slot> stack;
+        vector<string> scratch;
+        size_t max_depth;
+
+      private:
+        template<class FT> static const FT &field(const Instr &in) {
+            return *static_cast<const FT *>(in.p);
+        }
+
+        static DSExpr *node(const Instr &in) {
+            return const_cast<DSExpr *>(static_cast<const DSExpr *>(in.p));
+        }
+
+        static int compare(const Slot &a, const Slot &b) {
+            int ret = memcmp(a.s, b.s, a.s_len < b.s_len ? a.s_len : b.s_len);
+            if (ret != 0) {
+                return ret;
+            }
+            return a.s_len < b.s_len ? -1 : (a.s_len > b.s_len ? 1 : 0);
+        }
+
+        static bool equal(const Slot &a, const Slot &b) {
+            return a.s_len == b.s_len && memcmp(a.s, b.s, a.s_len) == 0;
+        }
+    };
+
+    /** Runs a program compiled without short circuits over all the rows of an extent at once.
+        Each stack slot is a column holding one value per row, bools are stored as bytes. */
+    class VectorEval {
+      public:
+        struct Column {
+            vector<double> d;
+            vector<int64_t> i;
+            vector<uint8_t> b;
+            vector<dataseries::Variable32Ref> s;
+        };
+
+        void run(const Program &prog, uint32_t n) {
+            if (stack.size() < prog.max_depth) {
+                stack.resize(prog.max_depth);
+            }
+            Column *sp = &stack[0];
+            for (vector<Program::Instr>::const_iterator i = prog.instrs.begin();
+                 i != prog.instrs.end(); ++i) {
+                const Program::Instr &in(*i);
+                switch (in.op) {
+                    case Program::PushD: sp->d.assign(n, in.d); ++sp; break;
+                    case Program::PushI: sp->i.assign(n, static_cast<int64_t>(in.d)); ++sp; break;
+                    case Program::PushB: sp->b.assign(n, in.d ? 1 : 0); ++sp; break;
+                    case Program::PushS: {
+                        const string *str = static_cast<const string *>(in.p);
+                        sp->s.assign(n, dataseries::Variable32Ref(
+                                         reinterpret_cast<const uint8_t *>(str->data()),
+                                         str->size()));
+                        ++sp;
+                        break;
+                    }
+
+                    case Program::LoadBoolD:
+                        load(field<BoolField>(in).span(), sp->d, n); ++sp; break;
+                    case Program::LoadBoolI:
+                        load(field<BoolField>(in).span(), sp->i, n); ++sp; break;
+                    case Program::LoadBoolB:
+                        loadBool(field<BoolField>(in).span(), sp->b, n); ++sp; break;
+                    case Program::LoadByteD:
+                        load(field<ByteField>(in).span(), sp->d, n); ++sp; break;
+                    case Program::LoadByteI:
+                        load(field<ByteField>(in).span(), sp->i, n); ++sp; break;
+                    case Program::LoadByteB:
+                        loadBool(field<ByteField>(in).span(), sp->b, n); ++sp; break;
+                    case Program::LoadInt32D:
+                        load(field<Int32Field>(in).span(), sp->d, n); ++sp; break;
+                    case Program::LoadInt32I:
+                        load(field<Int32Field>(in).span(), sp->i, n); ++sp; break;
+                    case Program::LoadInt32B:
+                        loadBool(field<Int32Field>(in).span(), sp->b, n); ++sp; break;
+                    case Program::LoadInt64D:
+                        load(field<Int64Field>(in).span(), sp->d, n); ++sp; break;
+                    case Program::LoadInt64I:
+                        load(field<Int64Field>(in).span(), sp->i, n); ++sp; break;
+                    case Program::LoadInt64B:
+                        loadBool(field<Int64Field>(in).span(), sp->b, n); ++sp; break;
+                    case Program::LoadDoubleD:
+                        load(field<DoubleField>(in).span(), sp->d, n); ++sp; break;
+                    case Program::LoadDoubleI:
+                        load(field<DoubleField>(in).span(), sp->i, n); ++sp; break;
+                    case Program::LoadDoubleB:
+                        loadBool(field<DoubleField>(in).span(), sp->b, n); ++sp; break;
+                    case Program::LoadVariable32S: {
+                        dataseries::Variable32Span span(field<Variable32Field>(in).span());
+                        sp->s.resize(n);
+                        for (uint32_t r = 0; r < n; ++r) {
+                            sp->s[r] = span[r];
+                        }
+                        ++sp;
+                        break;
+                    }
+
+                    case Program::NegD: unary(sp[-1].d, sp[-1].d, n, negate<double>()); break;
+                    case Program::NegI: unary(sp[-1].i, sp[-1].i, n, negate<int64_t>()); break;
+                    case Program::AddD:
+                        --sp; binary(sp[-1].d, sp[-1].d, sp->d, n, plus<double>()); break;
+                    case Program::AddI:
+                        --sp; binary(sp[-1].i, sp[-1].i, sp->i, n, plus<int64_t>()); break;
+                    case Program::SubD:
+                        --sp; binary(sp[-1].d, sp[-1].d, sp->d, n, minus<double>()); break;
+                    case Program::SubI:
+                        --sp; binary(sp[-1].i, sp[-1].i, sp->i, n, minus<int64_t>()); break;
+                    case Program::MulD:
+                        --sp; binary(sp[-1].d, sp[-1].d, sp->d, n, multiplies<double>()); break;
+                    case Program::MulI:
+                        --sp; binary(sp[-1].i, sp[-1].i, sp->i, n, multiplies<int64_t>()); break;
+                    case Program::DivD:
+                        --sp; binary(sp[-1].d, sp[-1].d, sp->d, n, divides<double>()); break;
+                    case Program::DivI:
+                        --sp; binary(sp[-1].i, sp[-1].i, sp->i, n, DivideI()); break;
+
+                    case Program::EqD: --sp; binary(sp[-1].b, sp[-1].d, sp->d, n, EqD()); break;
+                    case Program::NeqD: --sp; binary(sp[-1].b, sp[-1].d, sp->d, n, NeqD()); break;
+                    case Program::GtD: --sp; binary(sp[-1].b, sp[-1].d, sp->d, n, GtD()); break;
+                    case Program::LtD: --sp; binary(sp[-1].b, sp[-1].d, sp->d, n, LtD()); break;
+                    case Program::GeqD: --sp; binary(sp[-1].b, sp[-1].d, sp->d, n, GeqD()); break;
+                    case Program::LeqD: --sp; binary(sp[-1].b, sp[-1].d, sp->d, n, LeqD()); break;
+
+                    case Program::EqS: --sp; binary(sp[-1].b, sp[-1].s, sp->s, n, EqS()); break;
+                    case Program::NeqS: --sp; binary(sp[-1].b, sp[-1].s, sp->s, n, NeqS()); break;
+                    case Program::GtS:
+                        --sp; binary(sp[-1].b, sp[-1].s, sp->s, n, CompareS<1, 0>()); break;
+                    case Program::LtS:
+                        --sp; binary(sp[-1].b, sp[-1].s, sp->s, n, CompareS<-1, 0>()); break;
+                    case Program::GeqS:
+                        --sp; binary(sp[-1].b, sp[-1].s, sp->s, n, CompareS<1, 1>()); break;
+                    case Program::LeqS:
+                        --sp; binary(sp[-1].b, sp[-1].s, sp->s, n, CompareS<-1, 1>()); break;
+
+                    case Program::Not: unary(sp[-1].b, sp[-1].b, n, logical_not<uint8_t>()); break;
+                    case Program::AndB:
+                        --sp; binary(sp[-1].b, sp[-1].b, sp->b, n, bit_and<uint8_t>()); break;
+                    case Program::OrB:
+                        --sp; binary(sp[-1].b, sp[-1].b, sp->b, n, bit_or<uint8_t>()); break;
+
+                    case Program::TfracToSeconds:
+                        unary(sp[-1].d, sp[-1].i, n, TfracToSeconds()); break;
+
+                    default:
+                        FATAL_ERROR(format("internal error, op %d can't be vectorized") % in.op);
+                }
+            }
+            DEBUG_SINVARIANT(sp == &stack[0] + 1);
+        }
+
+        const Column &result() const {
+            return stack[0];
+        }
+
+      private:
+        template<class FT> static const FT &field(const Program::Instr &in) {
+            return *static_cast<const FT *>(in.p);
+        }
+
+        // Null rows get the field's default, which for the fields the compiler makes is 0, the
+        // same as val().
+        template<typename T, typename Out>
+        static void load(const dataseries::ColumnSpan<T> &span, vector<Out> &out, uint32_t n) {
+            DEBUG_SINVARIANT(span.size() == n);
+            out.resize(n);
+            for (uint32_t r = 0; r < n; ++r) {
+                out[r] = static_cast<Out>(span[r]);
+            }
+        }
+
+        template<typename T>
+        static void loadBool(const dataseries::ColumnSpan<T> &span, vector<uint8_t> &out,
+                             uint32_t n) {
+            DEBUG_SINVARIANT(span.size() == n);
+            out.resize(n);
+            for (uint32_t r = 0; r < n; ++r) {
+                out[r] = span[r] != 0 ? 1 : 0;
+            }
+        }
+
+        // out may be the same vector as a; the resize is then a no-op
+        template<typename R, typename T, class F>
+        static void unary(vector<R> &out, const vector<T> &a, uint32_t n, F f) {
+            out.resize(n);
+            for (uint32_t r = 0; r < n; ++r) {
+                out[r] = f(a[r]);
+            }
+        }
+
+        template<typename R, typename T, class F>
+        static void binary(vector<R> &out, const vector<T> &a, const vector<T> &b, uint32_t n,
+                           F f) {
+            out.resize(n);
+            for (uint32_t r = 0; r < n; ++r) {
+                out[r] = f(a[r], b[r]);
+            }
+        }
+
+        // Every row is computed, including the ones a short circuit would have skipped, so
+        // integer division by zero gives 0 rather than trapping.
+        struct DivideI {
+            int64_t operator()(int64_t a, int64_t b) const { return b == 0 ? 0 : a / b; }
+        };
+        struct TfracToSeconds {
+            double operator()(int64_t a) const { return a / 4294967296.0; }
+        };
+        struct EqD {
+            uint8_t operator()(double a, double b) const { return Double::eq(a, b); }
+        };
+        struct NeqD {
+            uint8_t operator()(double a, double b) const { return !Double::eq(a, b); }
+        };
+        struct GtD {
+            uint8_t operator()(double a, double b) const { return Double::gt(a, b); }
+        };
+        struct LtD {
+            uint8_t operator()(double a, double b) const { return Double::lt(a, b); }
+        };
+        struct GeqD {
+            uint8_t operator()(double a, double b) const { return Double::geq(a, b); }
+        };
+        struct LeqD {
+            uint8_t operator()(double a, double b) const { return Double::leq(a, b); }
+        };
+
+        typedef dataseries::Variable32Ref Ref;
+        struct EqS {
+            uint8_t operator()(const Ref &a, const Ref &b) const {
+                return a.size == b.size && memcmp(a.data, b.data, a.size) == 0;
+            }
+        };
+        struct NeqS {
+            uint8_t operator()(const Ref &a, const Ref &b) const { return !EqS()(a, b); }
+        };
+        /// true if the comparison of a to b has sign want, or is 0 and or_equal is set
+        template<int want, int or_equal> struct CompareS {
+            uint8_t operator()(const Ref &a, const Ref &b) const {
+                int ret = memcmp(a.data, b.data, a.size < b.size ? a.size : b.size);
+                if (ret == 0) {
+                    ret = a.size < b.size ? -1 : (a.size > b.size ? 1 : 0);
+                }
+                return ret == 0 ? or_equal : ((ret < 0 ? -1 : 1) == want);
+            }
+        };
+
+        vector<Column> stack;
+    };
+
+    /** Writes a scalar program out as C++ for NativeCode, with the field offsets of one extent
+        type as constants.  Each stack slot becomes one local per type, and jumps become gotos,
+        so the generated code short circuits exactly like Program::run(). */
+    class NativeGen {
+      public:
+        NativeGen(const Program &prog, const ExtentType &type) : prog(prog), type(type) { }
+
+        /// C++ statements computing the program's result into slot 0 for the row at "row", or
+        /// an empty string if the program has instructions without a native form.
+        string body() {
+            ostringstream out;
+            for (size_t k = 0; k < prog.max_depth; ++k) {
+                out << format("        double d%d; int64_t i%d; bool b%d; Str s%d;\n")
+                    % k % k % k % k;
+            }
+            set<size_t> targets;
+            for (size_t pc = 0; pc < prog.instrs.size(); ++pc) {
+                if (prog.instrs[pc].op == Program::JumpIfTrue
+                    || prog.instrs[pc].op == Program::JumpIfFalse) {
+                    targets.insert(prog.instrs[pc].target);
+                }
+            }
+            size_t depth = 0;
+            for (size_t pc = 0; pc < prog.instrs.size(); ++pc) {
+                if (targets.count(pc) > 0) {
+                    out << format("      L%d:\n") % pc;
+                }
+                string stmt;
+                if (!statement(prog.instrs[pc], depth, stmt)) {
+                    return string();
+                }
+                if (!stmt.empty()) {
+                    out << "        " << stmt << ";\n";
+                }
+            }
+            if (targets.count(prog.instrs.size()) > 0) {
+                out << format("      L%d: ;\n") % prog.instrs.size();
+            }
+            SINVARIANT(depth == 1);
+            return out.str();
+        }
+
+      private:
+        string load(const Program::Instr &in) {
+            return NativeCode::value(type, static_cast<const Field *>(in.p)->getName(),
+                                     "row", "vardata");
+        }
+
+        /// statement for in, which starts with depth values on the stack; false if in has
+        /// no native form
+        bool statement(const Program::Instr &in, size_t &depth, string &stmt) {
+            size_t t = depth - 1, u = depth - 2; // top and second from top before in
+            switch (in.op) {
+                case Program::PushD:
+                    stmt = str(format("d%d = %.17g") % depth % in.d); ++depth; break;
+                case Program::PushI:
+                    stmt = str(format("i%d = static_cast<int64_t>(%.17g)") % depth % in.d);
+                    ++depth; break;
+                case Program::PushB:
+                    stmt = str(format("b%d = %s") % depth % (in.d ? "true" : "false"));
+                    ++depth; break;
+                case Program::PushS:
+                    stmt = str(format("s%d = %s") % depth
+                               % NativeCode::literal(*static_cast<const string *>(in.p)));
+                    ++depth; break;
+
+                case Program::LoadBoolD:
+                    stmt = str(format("d%d = %s ? 1 : 0") % depth % load(in)); ++depth; break;
+                case Program::LoadBoolI:
+                    stmt = str(format("i%d = %s ? 1 : 0") % depth % load(in)); ++depth; break;
+                case Program::LoadBoolB: case Program::LoadDoubleB:
+                    stmt = str(format("b%d = %s ? true : false") % depth % load(in));
+                    ++depth; break;
+                case Program::LoadByteD: case Program::LoadInt32D: case Program::LoadInt64D:
+                case Program::LoadDoubleD:
+                    stmt = str(format("d%d = %s") % depth % load(in)); ++depth; break;
+                case Program::LoadByteI: case Program::LoadInt32I: case Program::LoadInt64I:
+                case Program::LoadDoubleI:
+                    stmt = str(format("i%d = static_cast<int64_t>(%s)") % depth % load(in));
+                    ++depth; break;
+                case Program::LoadByteB: case Program::LoadInt32B: case Program::LoadInt64B:
+                    stmt = str(format("b%d = %s != 0") % depth % load(in)); ++depth; break;
+                case Program::LoadVariable32S:
+                    stmt = str(format("s%d = %s") % depth % load(in)); ++depth; break;
+
+                case Program::NegD: stmt = str(format("d%d = -d%d") % t % t); break;
+                case Program::NegI: stmt = str(format("i%d = -i%d") % t % t); break;
+                case Program::AddD: stmt = binary("d%d = d%d + d%d", u, t, depth); break;
+                case Program::AddI: stmt = binary("i%d = i%d + i%d", u, t, depth); break;
+                case Program::SubD: stmt = binary("d%d = d%d - d%d", u, t, depth); break;
+                case Program::SubI: stmt = binary("i%d = i%d - i%d", u, t, depth); break;
+                case Program::MulD: stmt = binary("d%d = d%d * d%d", u, t, depth); break;
+                case Program::MulI: stmt = binary("i%d = i%d * i%d", u, t, depth); break;
+                case Program::DivD: stmt = binary("d%d = d%d / d%d", u, t, depth); break;
+                case Program::DivI: stmt = binary("i%d = i%d / i%d", u, t, depth); break;
+
+                case Program::EqD:
+                    stmt = binary("b%d = Double::eq(d%d, d%d)", u, t, depth); break;
+                case Program::NeqD:
+                    stmt = binary("b%d = !Double::eq(d%d, d%d)", u, t, depth); break;
+                case Program::GtD:
+                    stmt = binary("b%d = Double::gt(d%d, d%d)", u, t, depth); break;
+                case Program::LtD:
+                    stmt = binary("b%d = Double::lt(d%d, d%d)", u, t, depth); break;
+                case Program::GeqD:
+                    stmt = binary("b%d = Double::geq(d%d, d%d)", u, t, depth); break;
+                case Program::LeqD:
+                    stmt = binary("b%d = Double::leq(d%d, d%d)", u, t, depth); break;
+
+                case Program::EqS: stmt = binary("b%d = equal(s%d, s%d)", u, t, depth); break;
+                case Program::NeqS: stmt = binary("b%d = !equal(s%d, s%d)", u, t, depth); break;
+                case Program::GtS:
+                    stmt = binary("b%d = compare(s%d, s%d) > 0", u, t, depth); break;
+                case Program::LtS:
+                    stmt = binary("b%d = compare(s%d, s%d) < 0", u, t, depth); break;
+                case Program::GeqS:
+                    stmt = binary("b%d = compare(s%d, s%d) >= 0", u, t, depth); break;
+                case Program::LeqS:
+                    stmt = binary("b%d = compare(s%d, s%d) <= 0", u, t, depth); break;
+
+                case Program::Not: stmt = str(format("b%d = !b%d") % t % t); break;
+                case Program::JumpIfTrue:
+                    stmt = str(format("if (b%d) goto L%d") % t % in.target); break;
+                case Program::JumpIfFalse:
+                    stmt = str(format("if (!b%d) goto L%d") % t % in.target); break;
+                case Program::Pop: --depth; break;
+                case Program::AndB: stmt = binary("b%d = b%d && b%d", u, t, depth); break;
+                case Program::OrB: stmt = binary("b%d = b%d || b%d", u, t, depth); break;
+
+                case Program::TfracToSeconds:
+                    stmt = str(format("d%d = i%d / 4294967296.0") % t % t); break;
+
+                default: // ConcatS needs scratch space and Call* need the tree
+                    return false;
+            }
+            return true;
+        }
+
+        static string binary(const char *fmt, size_t u, size_t t, size_t &depth) {
+            --depth;
+            return str(format(fmt) % u % u % t);
+        }
+
+        const Program &prog;
+        const ExtentType &type;
+    };
+
+    class CompiledExpr : public DSExpr {
+      public:
+        CompiledExpr(DSExpr *tree)
+            : tree(tree), null_fallback(false), field_series(NULL), multiple_series(false) { }
+
+        virtual ~CompiledExpr() {
+            delete tree;
+            for (vector<Field *>::iterator i = fields.begin(); i != fields.end(); ++i) {
+                delete *i;
+            }
+        }
+
+        virtual expr_type_t getType() {
+            return tree->getType();
+        }
+
+        virtual double valDouble() {
+            prog_double.run();
+            return prog_double.result().d;
+        }
+
+        virtual int64_t valInt64() {
+            prog_int64.run();
+            return prog_int64.result().i;
+        }
+
+        virtual bool valBool() {
+            prog_bool.run();
+            return prog_bool.result().b;
+        }
+
+        virtual const string valString() {
+            prog_string.run();
+            return string(prog_string.result().s, prog_string.result().s_len);
+        }
+
+        virtual bool isNull() {
+            if (null_fallback) {
+                return tree->isNull();
+            }
+            for (vector<Field *>::iterator i = nullable_fields.begin();
+                 i != nullable_fields.end(); ++i) {
+                if ((**i).isNull()) {
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        virtual void dump(ostream &out) {
+            tree->dump(out);
+        }
+
+        virtual bool mayMatch(const dataseries::ExtentZones &zones) {
+            return DSExprImpl::mayMatch(tree, zones);
+        }
+
+        virtual void selectRows(ExtentSeries &series, dataseries::RowSelection &selection) {
+            const Native *n = native(series);
+            if (n != NULL && n->select != NULL) {
+                Extent &e(series.getExtentRef());
+                selection.resize(e.nRecords());
+                selection.resize(n->select(e.fixeddata.begin(), e.variabledata.begin(),
+                                           e.nRecords(),
+                                           selection.empty() ? NULL : &selection[0]));
+                return;
+            }
+            if (!canVectorize(series, vec_bool)) {
+                DSExpr::selectRows(series, selection);
+                return;
+            }
+            uint32_t nrows = series.getExtentRef().nRecords();
+            eval.run(vec_bool, nrows);
+            const vector<uint8_t> &matched(eval.result().b);
+            // branch free compaction: every row is written, but only kept if it matched
+            selection.resize(nrows);
+            uint32_t nselected = 0;
+            for (uint32_t row = 0; row < nrows; ++row) {
+                selection[nselected] = row;
+                nselected += matched[row];
+            }
+            selection.resize(nselected);
+        }
+
+        virtual void valDoubles(ExtentSeries &series, const dataseries::RowSelection *selection,
+                                vector<double> &values) {
+            const Native *n = native(series);
+            if (n != NULL && n->values != NULL) {
+                Extent &e(series.getExtentRef());
+                uint32_t nrows = selection == NULL ? e.nRecords() : selection->size();
+                const uint32_t *rows = selection == NULL || selection->empty() ? NULL
+                    : &(*selection)[0];
+                values.resize(nrows);
+                n->values(e.fixeddata.begin(), e.variabledata.begin(), rows, nrows,
+                          values.empty() ? NULL : &values[0]);
+                return;
+            }
+            if (!canVectorize(series, vec_double)) {
+                DSExpr::valDoubles(series, selection, values);
+                return;
+            }
+            eval.run(vec_double, series.getExtentRef().nRecords());
+            const vector<double> &all(eval.result().d);
+            if (selection == NULL) {
+                values = all;
+            } else {
+                values.resize(selection->size());
+                for (size_t i = 0; i < selection->size(); ++i) {
+                    values[i] = all[(*selection)[i]];
+                }
+            }
+        }
+
+      private:
+        friend class Compiler;
+
+        typedef uint32_t (*SelectFn)(const uint8_t *fixed, const uint8_t *vardata, uint32_t nrows,
+                                     uint32_t *selection);
+        typedef void (*ValuesFn)(const uint8_t *fixed, const uint8_t *vardata,
+                                 const uint32_t *rows, uint32_t nrows, double *values);
+
+        /// generated code for one extent type; functions are NULL if they couldn't be compiled
+        struct Native {
+            Native() : code(), select(NULL), values(NULL) { }
+            NativeCode::Ptr code;
+            SelectFn select;
+            ValuesFn values;
+        };
+
+        bool singleSeries(ExtentSeries &series) const {
+            return !multiple_series && (field_series == NULL || field_series == &series);
+        }
+
+        bool canVectorize(ExtentSeries &series, const Program &prog) const {
+            return singleSeries(series) && prog.vectorizable();
+        }
+
+        /// native code for the type of series, compiled the first time the type is seen; NULL
+        /// if native code is disabled or the fields are in multiple series
+        const Native *native(ExtentSeries &series) {
+            if (!NativeCode::enabled() || !singleSeries(series)) {
+                return NULL;
+            }
+            // holding the Ptr keeps the type alive, so the key can't be reused by another type
+            const ExtentType::Ptr type(series.getTypePtr());
+            map<ExtentType::Ptr, Native>::iterator i = natives.find(type);
+            if (i == natives.end()) {
+                i = natives.insert(make_pair(type, compileNative(*type))).first;
+            }
+            return &i->second;
+        }
+
+        Native compileNative(const ExtentType &type) {
+            Native ret;
+            string select_body(NativeGen(prog_bool, type).body());
+            string values_body(NativeGen(prog_double, type).body());
+            if (select_body.empty() && values_body.empty()) {
+                return ret;
+            }
+            ostringstream expr, source;
+            tree->dump(expr);
+            source << NativeCode::comment("DSExpr: " + expr.str())
+                   << NativeCode::comment(type.getXmlDescriptionString()) << "\n";
+            if (!select_body.empty()) {
+                source << "extern \"C\" uint32_t dataseries_select(const uint8_t *fixed, "
+                       << "const uint8_t *vardata, uint32_t nrows, uint32_t *selection) {\n"
+                       << "    uint32_t nselected = 0;\n"
+                       << "    for (uint32_t r = 0; r < nrows; ++r) {\n"
+                       << format("        const uint8_t *row = fixed + static_cast<size_t>(r)"
+                                 " * %d;\n") % type.fixedrecordsize()
+                       << select_body
+                       << "        selection[nselected] = r;\n"
+                       << "        nselected += b0 ? 1 : 0;\n"
+                       << "    }\n"
+                       << "    return nselected;\n"
+                       << "}\n\n";
+            }
+            if (!values_body.empty()) {
+                source << "extern \"C\" void dataseries_values(const uint8_t *fixed, "
+                       << "const uint8_t *vardata, const uint32_t *rows, uint32_t nrows, "
+                       << "double *values) {\n"
+                       << "    for (uint32_t j = 0; j < nrows; ++j) {\n"
+                       << format("        const uint8_t *row = fixed + static_cast<size_t>"
+                                 "(rows == NULL ? j : rows[j]) * %d;\n")
+                          % type.fixedrecordsize()
+                       << values_body
+                       << "        values[j] = d0;\n"
+                       << "    }\n"
+                       << "}\n";
+            }
+            ret.code = NativeCode::compile(source.str());
+            if (ret.code != NULL) {
+                ret.select = reinterpret_cast<SelectFn>(ret.code->lookup("dataseries_select"));
+                ret.values = reinterpret_cast<ValuesFn>(ret.code->lookup("dataseries_values"));
+            }
+            return ret;
+        }
+
+        DSExpr *tree;
+        Program prog_double, prog_int64, prog_bool, prog_string;
+        /// no short circuit versions of prog_bool and prog_double for eval
+        Program vec_bool, vec_double;
+        VectorEval eval;
+
+        /// typed fields used by the programs, one per distinct (series, field name)
+        vector<Field *> fields;
+        /// isNull() is true iff one of these is null, unless null_fallback is set because the
+        /// tree has a node that doesn't follow the "any field null" rule
+        vector<Field *> nullable_fields;
+        bool null_fallback;
+        /// the series all the fields are in, unless multiple_series is set
+        ExtentSeries *field_series;
+        bool multiple_series;
+        /// native versions of prog_bool and prog_double, by extent type
+        map<ExtentType::Ptr, Native> natives;
+    };
+
+    class Compiler {
+      public:
+        enum Mode { m_Double, m_Int64, m_Bool, m_String };
+
+        Compiler(CompiledExpr &into) : into(into), prog(NULL), depth(0), vector_mode(false) { }
+
+        void compile() {
+            findFields(into.tree);
+            compileProgram(into.prog_double, m_Double);
+            compileProgram(into.prog_int64, m_Int64);
+            compileProgram(into.prog_bool, m_Bool);
+            compileProgram(into.prog_string, m_String);
+            vector_mode = true;
+            compileProgram(into.vec_bool, m_Bool);
+            compileProgram(into.vec_double, m_Double);
+        }
+
+      private:
+        typedef Program::Op Op;
+
+        void compileProgram(Program &p, Mode mode) {
+            prog = &p;
+            depth = 0;
+            compile(into.tree, mode);
+            SINVARIANT(depth == 1);
+            p.stack.resize(p.max_depth);
+        }
+
+        void emit(const Program::Instr &in, int depth_change) {
+            prog->instrs.push_back(in);
+            depth += depth_change;
+            SINVARIANT(depth >= 1 || (depth == 0 && in.op == Program::Pop));
+            if (static_cast<size_t>(depth) > prog->max_depth) {
+                prog->max_depth = depth;
+            }
+        }
+
+        void emit(Op op, int depth_change) {
+            emit(Program::Instr(op), depth_change);
+        }
+
+        uint32_t newScratch() {
+            prog->scratch.push_back(string());
+            return prog->scratch.size() - 1;
+        }
+
+        /// evaluate the tree node itself, used for everything we don't have a compiled form for.
+        void emitCall(DSExpr *node, Mode mode) {
+            static const Op ops[] = { Program::CallD, Program::CallI, Program::CallB,
+                                      Program::CallS };
+            Program::Instr in(ops[mode]);
+            in.p = node;
+            if (mode == m_String) {
+                in.target = newScratch();
+            }
+            emit(in, 1);
+        }
+
+        void emitBinary(ExprBinary *b, Mode sub_mode, Op op) {
+            compile(b->left, sub_mode);
+            compile(b->right, sub_mode);
+            emit(op, -1);
+        }
+
+        void emitArith(ExprBinary *b, Mode mode, Op d_op, Op i_op) {
+            if (mode == m_Double) {
+                emitBinary(b, m_Double, d_op);
+            } else if (mode == m_Int64) {
+                emitBinary(b, m_Int64, i_op);
+            } else {
+                emitCall(b, mode);
+            }
+        }
+
+        void emitCompare(ExprBinary *b, Mode mode, Op d_op, Op s_op) {
+            if (mode != m_Bool) {
+                emitCall(b, mode);
+            } else if (b->either_string()) {
+                emitBinary(b, m_String, s_op);
+            } else {
+                emitBinary(b, m_Double, d_op);
+            }
+        }
+
+        void emitLogical(ExprBinary *b, Mode mode, Op jump_op) {
+            if (mode != m_Bool) {
+                emitCall(b, mode);
+                return;
+            }
+            if (vector_mode) {
+                emitBinary(b, m_Bool, jump_op == Program::JumpIfTrue ? Program::OrB
+                           : Program::AndB);
+                return;
+            }
+            // short circuit the same as the tree: leave the left value if it decides the result
+            compile(b->left, m_Bool);
+            size_t jump = prog->instrs.size();
+            emit(jump_op, 0);
+            emit(Program::Pop, -1);
+            compile(b->right, m_Bool);
+            prog->instrs[jump].target = prog->instrs.size();
+        }
+
+        void emitField(ExprField *f, Mode mode) {
+            Field *field = typedField(f);
+            static const Op bool_ops[] = { Program::LoadBoolD, Program::LoadBoolI,
+                                           Program::LoadBoolB };
+            static const Op byte_ops[] = { Program::LoadByteD, Program::LoadByteI,
+                                           Program::LoadByteB };
+            static const Op int32_ops[] = { Program::LoadInt32D, Program::LoadInt32I,
+                                            Program::LoadInt32B };
+            static const Op int64_ops[] = { Program::LoadInt64D, Program::LoadInt64I,
+                                            Program::LoadInt64B };
+            static const Op double_ops[] = { Program::LoadDoubleD, Program::LoadDoubleI,
+                                             Program::LoadDoubleB };
+            const Op *ops = NULL;
+            switch (f->field->getType())
+                {
+                case ExtentType::ft_bool: ops = bool_ops; break;
+                case ExtentType::ft_byte: ops = byte_ops; break;
+                case ExtentType::ft_int32: ops = int32_ops; break;
+                case ExtentType::ft_int64: ops = int64_ops; break;
+                case ExtentType::ft_double: ops = double_ops; break;
+                case ExtentType::ft_variable32:
+                    if (mode == m_String) {
+                        Program::Instr in(Program::LoadVariable32S);
+                        in.p = field;
+                        emit(in, 1);
+                        return;
+                    }
+                    break;
+                default: break;
+                }
+            if (ops == NULL || mode == m_String) {
+                // conversions to or from strings and fixed width fields go through GeneralValue
+                emitCall(f, mode);
+            } else {
+                Program::Instr in(ops[mode]);
+                in.p = field;
+                emit(in, 1);
+            }
+        }
+
+        void compile(DSExpr *node, Mode mode) {
+            if (ExprNumericConstant *c = dynamic_cast<ExprNumericConstant *>(node)) {
+                static const Op ops[] = { Program::PushD, Program::PushI, Program::PushB };
+                if (mode == m_String) {
+                    emitCall(c, mode);
+                } else {
+                    Program::Instr in(ops[mode]);
+                    in.d = c->val;
+                    emit(in, 1);
+                }
+            } else if (ExprStrLiteral *s = dynamic_cast<ExprStrLiteral *>(node)) {
+                if (mode == m_String) {
+                    Program::Instr in(Program::PushS);
+                    in.p = &s->s;
+                    emit(in, 1);
+                } else {
+                    emitCall(s, mode);
+                }
+            } else if (ExprField *f = dynamic_cast<ExprField *>(node)) {
+                emitField(f, mode);
+            } else if (ExprMinus *m = dynamic_cast<ExprMinus *>(node)) {
+                if (mode == m_Double || mode == m_Int64) {
+                    compile(static_cast<ExprUnary *>(m)->subexpr, mode);
+                    emit(mode == m_Double ? Program::NegD : Program::NegI, 0);
+                } else {
+                    emitCall(m, mode);
+                }
+            } else if (ExprLnot *n = dynamic_cast<ExprLnot *>(node)) {
+                if (mode == m_Bool) {
+                    compile(static_cast<ExprUnary *>(n)->subexpr, m_Bool);
+                    emit(Program::Not, 0);
+                } else {
+                    emitCall(n, mode);
+                }
+            } else if (ExprFnTfracToSeconds *t = dynamic_cast<ExprFnTfracToSeconds *>(node)) {
+                if (mode == m_Double) {
+                    compile(static_cast<ExprUnary *>(t)->subexpr, m_Int64);
+                    emit(Program::TfracToSeconds, 0);
+                } else {
+                    emitCall(t, mode);
+                }
+            } else if (ExprAdd *a = dynamic_cast<ExprAdd *>(node)) {
+                if (mode == m_String) {
+                    Program::Instr in(Program::ConcatS);
+                    in.target = newScratch();
+                    compile(a->left, m_String);
+                    compile(a->right, m_String);
+                    emit(in, -1);
+                } else {
+                    emitArith(a, mode, Program::AddD, Program::AddI);
+                }
+            } else if (ExprSubtract *b = dynamic_cast<ExprSubtract *>(node)) {
+                emitArith(b, mode, Program::SubD, Program::SubI);
+            } else if (ExprMultiply *b = dynamic_cast<ExprMultiply *>(node)) {
+                emitArith(b, mode, Program::MulD, Program::MulI);
+            } else if (ExprDivide *b = dynamic_cast<ExprDivide *>(node)) {
+                emitArith(b, mode, Program::DivD, Program::DivI);
+            } else if (ExprEq *b = dynamic_cast<ExprEq *>(node)) {
+                emitCompare(b, mode, Program::EqD, Program::EqS);
+            } else if (ExprNeq *b = dynamic_cast<ExprNeq *>(node)) {
+                emitCompare(b, mode, Program::NeqD, Program::NeqS);
+            } else if (ExprGt *b = dynamic_cast<ExprGt *>(node)) {
+                emitCompare(b, mode, Program::GtD, Program::GtS);
+            } else if (ExprLt *b = dynamic_cast<ExprLt *>(node)) {
+                emitCompare(b, mode, Program::LtD, Program::LtS);
+            } else if (ExprGeq *b = dynamic_cast<ExprGeq *>(node)) {
+                emitCompare(b, mode, Program::GeqD, Program::GeqS);
+            } else if (ExprLeq *b = dynamic_cast<ExprLeq *>(node)) {
+                emitCompare(b, mode, Program::LeqD, Program::LeqS);
+            } else if (ExprLor *b = dynamic_cast<ExprLor *>(node)) {
+                emitLogical(b, mode, Program::JumpIfTrue);
+            } else if (ExprLand *b = dynamic_cast<ExprLand *>(node)) {
+                emitLogical(b, mode, Program::JumpIfFalse);
+            } else {
+                emitCall(node, mode);
+            }
+        }
+
+        /// Build the typed fields, and the list of fields that decide isNull()
+        void findFields(DSExpr *node) {
+            if (ExprField *f = dynamic_cast<ExprField *>(node)) {
+                Field *field = typedField(f);
+                if (field == NULL) {
+                    into.null_fallback = true;
+                } else if (find(into.nullable_fields.begin(), into.nullable_fields.end(), field)
+                           == into.nullable_fields.end()) {
+                    // Field::isNull() is a cheap false for fields that aren't nullable
+                    into.nullable_fields.push_back(field);
+                }
+            } else if (ExprUnary *u = dynamic_cast<ExprUnary *>(node)) {
+                findFields(u->subexpr);
+            } else if (ExprBinary *b = dynamic_cast<ExprBinary *>(node)) {
+                findFields(b->left);
+                findFields(b->right);
+            } else if (dynamic_cast<ExprNumericConstant *>(node) == NULL
+                       && dynamic_cast<ExprStrLiteral *>(node) == NULL) {
+                into.null_fallback = true;
+            }
+        }
+
+        /// NULL for field types the programs read through the tree
+        Field *typedField(ExprField *f) {
+            FieldKey key(f->series, f->fieldname);
+            map<FieldKey, Field *>::iterator i = typed_fields.find(key);
+            if (i != typed_fields.end()) {
+                return i->second;
+            }
+            ExtentSeries &series(*f->series);
+            const string &name(f->fieldname);
+            if (into.field_series == NULL) {
+                into.field_series = &series;
+            } else if (into.field_series != &series) {
+                into.multiple_series = true;
+            }
+            Field *ret = NULL;
+            switch (f->field->getType())
+                {
+                case ExtentType::ft_bool:
+                    ret = new BoolField(series, name, Field::flag_nullable); break;
+                case ExtentType::ft_byte:
+                    ret = new ByteField(series, name, Field::flag_nullable); break;
+                case ExtentType::ft_int32:
+                    ret = new Int32Field(series, name, Field::flag_nullable); break;
+                case ExtentType::ft_int64:
+                    ret = new Int64Field(series, name, Field::flag_nullable); break;
+                case ExtentType::ft_double:
+                    // same flags as GF_Double so that val() matches
+                    ret = new DoubleField(series, name, Field::flag_nullable
+                                          | DoubleField::flag_allownonzerobase);
+                    break;
+                case ExtentType::ft_variable32:
+                    ret = new Variable32Field(series, name, Field::flag_nullable); break;
+                default:
+                    break;
+                }
+            if (ret != NULL) {
+                into.fields.push_back(ret);
+            }
+            typed_fields[key] = ret;
+            return ret;
+        }
+
+        typedef pair<ExtentSeries *, string> FieldKey;
+
+        CompiledExpr &into;
+        Program *prog;
+        int depth;
+        /// compile logical operators without short circuits
+        bool vector_mode;
+        map<FieldKey, Field *> typed_fields;
+    };
+
+    DSExpr *compile(DSExpr *expr) {
+        SINVARIANT(expr != NULL);
+        CompiledExpr *ret = new CompiledExpr(expr);
+        Compiler compiler(*ret);
+        compiler.compile();
+        return ret;
+    }
+}
@@ -40,6 +40,7 @@ void DSExprImpl::ExprNumericConstant::dump(ostream &out) {
 //////////////////////////////////////////////////////////////////////
 
 DSExprImpl::ExprField::ExprField(ExtentSeries &series, const string &fieldname_)
+    : series(&series)
 { 
     // Allow for almost arbitrary fieldnames through escaping...
     if (fieldname_.find('\\', 0) != string::npos) {
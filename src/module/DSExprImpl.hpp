@@ -22,6 +22,16 @@ namespace DSExprImpl {
 
     // TODO: make valGV to do general value calculations.
 
+    class Compiler;
+    class ZoneCheck;
+
+    /// Wrap a parsed expression in a compiled program that evaluates it without walking the tree;
+    /// takes ownership of expr.
+    DSExpr *compile(DSExpr *expr);
+
+    /// DSExpr::mayMatch() for a parsed expression
+    bool mayMatch(DSExpr *expr, const dataseries::ExtentZones &zones);
+
     class ExprNumericConstant : public DSExpr {
       public:
         // TODO: consider parsing the string as both a double and an
@@ -44,6 +54,8 @@ namespace DSExprImpl {
             return false;
         }
       private:
+        friend class Compiler;
+        friend class ZoneCheck;
         double val;
     };
 
@@ -82,7 +94,10 @@ namespace DSExprImpl {
         virtual void dump(ostream &out);
 
       private:
+        friend class Compiler;
+        friend class ZoneCheck;
         GeneralField *field;
+        ExtentSeries *series;
         string fieldname;
     };
 
@@ -115,6 +130,8 @@ namespace DSExprImpl {
         virtual void dump(ostream &out);
 
       private:
+        friend class Compiler;
+        friend class ZoneCheck;
         string s;
     };
 
@@ -136,6 +153,8 @@ namespace DSExprImpl {
             return subexpr->isNull();
         }
       protected:
+        friend class Compiler;
+        friend class ZoneCheck;
         DSExpr *subexpr;
     };
 
@@ -164,6 +183,8 @@ namespace DSExprImpl {
             return left->isNull() || right->isNull();
         }
       protected:
+        friend class Compiler;
+        friend class ZoneCheck;
         DSExpr *left, *right;
     };
 
@@ -0,0 +1,134 @@
+/* -*- C++ -*-
+   (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+   See the file named COPYING for license details
+*/
+
+/** @file
+    Decide from zone maps whether any row of an extent can satisfy a parsed expression.
+
+    A comparison of a field against a constant can be true for some row only if it is true for
+    some value in the range the zone gives for the field, which with the epsilon comparisons of
+    Double comes down to comparing the constant with one end of the range.  ! is pushed down to
+    the comparisons, inverting each of them (Double's comparisons invert exactly, !gt(a, b) is
+    leq(a, b)), and swapping && and || on the way.  Everything we can't reason about may
+    match. */
+
+#include "DSExprImpl.hpp"
+
+namespace DSExprImpl {
+    class ZoneCheck {
+      public:
+        enum Op { Eq, Neq, Gt, Lt, Geq, Leq };
+
+        ZoneCheck(const dataseries::ExtentZones &zones) : zones(zones) { }
+
+        bool mayBeTrue(DSExpr *expr, bool negate) {
+            if (ExprLnot *e = dynamic_cast<ExprLnot *>(expr)) {
+                return mayBeTrue(e->subexpr, !negate);
+            }
+            if (ExprLand *e = dynamic_cast<ExprLand *>(expr)) {
+                return negate ? mayBeTrue(e->left, true) || mayBeTrue(e->right, true)
+                    : mayBeTrue(e->left, false) && mayBeTrue(e->right, false);
+            }
+            if (ExprLor *e = dynamic_cast<ExprLor *>(expr)) {
+                return negate ? mayBeTrue(e->left, true) && mayBeTrue(e->right, true)
+                    : mayBeTrue(e->left, false) || mayBeTrue(e->right, false);
+            }
+            Op op;
+            if (dynamic_cast<ExprEq *>(expr) != NULL) {
+                op = negate ? Neq : Eq;
+            } else if (dynamic_cast<ExprNeq *>(expr) != NULL) {
+                op = negate ? Eq : Neq;
+            } else if (dynamic_cast<ExprGt *>(expr) != NULL) {
+                op = negate ? Leq : Gt;
+            } else if (dynamic_cast<ExprLt *>(expr) != NULL) {
+                op = negate ? Geq : Lt;
+            } else if (dynamic_cast<ExprGeq *>(expr) != NULL) {
+                op = negate ? Lt : Geq;
+            } else if (dynamic_cast<ExprLeq *>(expr) != NULL) {
+                op = negate ? Gt : Leq;
+            } else {
+                return true;
+            }
+            ExprBinary *cmp = static_cast<ExprBinary *>(expr);
+            if (ExprField *field = dynamic_cast<ExprField *>(cmp->left)) {
+                return mayCompare(field, op, cmp->right);
+            } else if (ExprField *field = dynamic_cast<ExprField *>(cmp->right)) {
+                return mayCompare(field, swapped(op), cmp->left);
+            } else {
+                return true;
+            }
+        }
+
+      private:
+        /// the operator that gives the same result with the operands the other way around
+        static Op swapped(Op op) {
+            switch (op)
+                {
+                case Gt: return Lt;
+                case Lt: return Gt;
+                case Geq: return Leq;
+                case Leq: return Geq;
+                default: return op;
+                }
+        }
+
+        /// can "field op constant" be true for some row?
+        bool mayCompare(ExprField *field, Op op, DSExpr *constant) {
+            dataseries::ExtentZones::const_iterator i = zones.find(field->fieldname);
+            if (i == zones.end()) {
+                return true;
+            }
+            if (ExprNumericConstant *c = dynamic_cast<ExprNumericConstant *>(constant)) {
+                double lo, hi;
+                if (field->getType() != DSExpr::t_Numeric
+                    || !dataseries::ZoneMap::valueRange(i->second, lo, hi)) {
+                    return true;
+                }
+                return mayCompare(op, lo, hi, c->val);
+            } else if (ExprStrLiteral *c = dynamic_cast<ExprStrLiteral *>(constant)) {
+                string lo, hi;
+                if (field->getType() != DSExpr::t_String
+                    || !dataseries::ZoneMap::valueRange(i->second, lo, hi)) {
+                    return true;
+                }
+                return mayCompare(op, lo, hi, c->s);
+            } else {
+                return true;
+            }
+        }
+
+        static bool mayCompare(Op op, double lo, double hi, double c) {
+            switch (op)
+                {
+                case Eq: return !(Double::lt(hi, c) || Double::gt(lo, c));
+                case Neq: return !(Double::eq(lo, c) && Double::eq(hi, c));
+                case Gt: return Double::gt(hi, c);
+                case Lt: return Double::lt(lo, c);
+                case Geq: return Double::geq(hi, c);
+                case Leq: return Double::leq(lo, c);
+                }
+            return true;
+        }
+
+        static bool mayCompare(Op op, const string &lo, const string &hi, const string &c) {
+            switch (op)
+                {
+                case Eq: return !(hi < c || c < lo);
+                case Neq: return !(lo == c && hi == c);
+                case Gt: return hi > c;
+                case Lt: return lo < c;
+                case Geq: return hi >= c;
+                case Leq: return lo <= c;
+                }
+            return true;
+        }
+
+        const dataseries::ExtentZones &zones;
+    };
+
+    bool mayMatch(DSExpr *expr, const dataseries::ExtentZones &zones) {
+        return ZoneCheck(zones).mayBeTrue(expr, false);
+    }
+}
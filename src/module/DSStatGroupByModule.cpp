@@ -11,117 +11,246 @@
 
 #include <Lintel/AssertBoost.hpp>
 #include <Lintel/StatsQuantile.hpp>
+#include <Lintel/StringUtil.hpp>
 
 #include <DataSeries/DSStatGroupByModule.hpp>
+#include <DataSeries/QuantileSketch.hpp>
 
 using namespace std;
 
 namespace {
     const string str_basic("basic");
     const string str_quantile("quantile");
+    const string str_sketch("sketch");
+    const double default_sketch_error = 0.01;
+
+    /// error of a sketch[=error] stat type, 0 if it isn't one
+    double sketchError(const string &stattype) {
+        if (stattype == str_sketch) {
+            return default_sketch_error;
+        } else if (prefixequal(stattype, str_sketch + "=")) {
+            double error = stringToDouble(stattype.substr(str_sketch.size() + 1));
+            return error > 0 && error < 1 ? error : 0;
+        } else {
+            return 0;
+        }
+    }
+
+    Stats *newStats(const string &stattype) {
+        if (stattype == str_basic) {
+            return new Stats();
+        } else if (stattype == str_quantile) {
+            return new StatsQuantile();
+        } else if (sketchError(stattype) > 0) {
+            return new dataseries::QuantileSketch(sketchError(stattype));
+        } else {
+            FATAL_ERROR(boost::format("unknown stattype %s") % stattype);
+        }
+    }
+
+    void mergeStats(const string &stattype, Stats &into, Stats &from) {
+        if (stattype == str_basic) {
+            into.add(from);
+        } else {
+            dataseries::mergeQuantiles(into, from);
+        }
+    }
+
+    vector<string> splitGroupBy(const string &groupby) {
+        vector<string> ret;
+        if (!groupby.empty()) {
+            split(groupby, ",", ret);
+        }
+        return ret;
+    }
+}
+
+DSStatGroupByModule::DSStatGroupByModule(DataSeriesModule &source,
+                                         const string &expression,
+                                         const string &groupby,
+                                         const string &stattype,
+                                         const string &where_expr,
+                                         ExtentSeries::typeCompatibilityT tc)
+        : ParallelRowAnalysisModule::BatchAnalysis(source, tc), expressions(1, expression),
+          stattypes(1, stattype), groupby_names(splitGroupBy(groupby)), keys_ready(false)
+{
+    if (!where_expr.empty()) {
+        setWhereExpr(where_expr);
+    }
+    init();
 }
 
 DSStatGroupByModule::DSStatGroupByModule(DataSeriesModule &source,
-                                         const string &_expression,
-                                         const string &_groupby,
-                                         const string &_stattype,
+                                         const vector<string> &expressions,
+                                         const vector<string> &stattypes,
+                                         const vector<string> &groupby,
                                          const string &where_expr,
                                          ExtentSeries::typeCompatibilityT tc)
-        : RowAnalysisModule(source, tc), expression(_expression), 
-          groupby_name(_groupby), stattype(_stattype), groupby(NULL),
-          expr(NULL)
+        : ParallelRowAnalysisModule::BatchAnalysis(source, tc), expressions(expressions),
+          stattypes(stattypes), groupby_names(groupby), keys_ready(false)
 {
-    SINVARIANT(validStatType(stattype));
     if (!where_expr.empty()) {
         setWhereExpr(where_expr);
     }
+    init();
+}
+
+void DSStatGroupByModule::init() {
+    INVARIANT(!expressions.empty() && expressions.size() == stattypes.size(),
+              "need a stat type for each of one or more expressions");
+    for (vector<string>::iterator i = stattypes.begin(); i != stattypes.end(); ++i) {
+        SINVARIANT(validStatType(*i));
+    }
+    values.resize(expressions.size());
 }
 
 DSStatGroupByModule::~DSStatGroupByModule() {
-    delete expr;
-    expr = NULL;
-    delete groupby;
-    groupby = NULL;
+    for (vector<DSExpr *>::iterator i = exprs.begin(); i != exprs.end(); ++i) {
+        delete *i;
+    }
+    for (vector<Stats *>::iterator i = stats.begin(); i != stats.end(); ++i) {
+        delete *i;
+    }
+}
+
+void DSStatGroupByModule::initKeys() {
+    if (!keys_ready) {
+        key_encoder.init(series, groupby_names);
+        keys_ready = true;
+    }
 }
 
 void DSStatGroupByModule::prepareForProcessing() {
     // Have to do this here rather than constructor as we need the XML
-    // from the first extent in order to build the generalfields
+    // from the first extent in order to build the fields
+    for (vector<string>::iterator i = expressions.begin(); i != expressions.end(); ++i) {
+        exprs.push_back(DSExpr::make(series, *i));
+    }
+    initKeys();
+}
 
-    expr = DSExpr::make(series, expression);
-    if (!groupby_name.empty()) {
-        groupby = GeneralField::create(NULL, series, groupby_name);
+Stats **DSStatGroupByModule::groupStats(const uint8_t *key, uint32_t key_size) {
+    bool inserted;
+    dataseries::KeyTable<uint32_t>::Entry &group
+        (groups.lookup(dataseries::KeyEncoder::hash(key, key_size), key, key_size, inserted));
+    if (inserted) {
+        group.value = stats.size() / stattypes.size();
+        for (vector<string>::iterator i = stattypes.begin(); i != stattypes.end(); ++i) {
+            stats.push_back(newStats(*i));
+        }
     }
+    return &stats[group.value * stattypes.size()];
 }
 
-void DSStatGroupByModule::processRow() {
-    GeneralValue groupby_val;
-    if (groupby != NULL) {
-        groupby_val.set(groupby);
-    } else {
-        groupby_val.setInt32(1);
+void DSStatGroupByModule::processBatch(uint32_t nrows, const dataseries::RowSelection *selection) {
+    if (nrows == 0) {
+        return;
     }
-    Stats *stat = mystats[groupby_val];
-    if (stat == NULL) {
-        if (stattype == str_basic) {
-            stat = new Stats();
-        } else if (stattype == str_quantile) {
-            stat = new StatsQuantile();
-        } else {
-            FATAL_ERROR(boost::format("unknown stattype %s") % stattype);
+    for (size_t i = 0; i < exprs.size(); ++i) {
+        exprs[i]->valDoubles(series, selection, values[i]);
+    }
+    size_t nselected = values[0].size();
+    if (groupby_names.empty()) {
+        Stats **group = groupStats(reinterpret_cast<const uint8_t *>(keys.data()), 0);
+        for (size_t i = 0; i < exprs.size(); ++i) {
+            for (vector<double>::iterator j = values[i].begin(); j != values[i].end(); ++j) {
+                group[i]->add(*j);
+            }
+        }
+        return;
+    }
+    key_encoder.encodeRows(nrows, selection, keys, key_offsets);
+    SINVARIANT(key_offsets.size() == nselected + 1);
+    const uint8_t *key_base = reinterpret_cast<const uint8_t *>(keys.data());
+    for (size_t row = 0; row < nselected; ++row) {
+        Stats **group = groupStats(key_base + key_offsets[row],
+                                   key_offsets[row + 1] - key_offsets[row]);
+        for (size_t i = 0; i < exprs.size(); ++i) {
+            group[i]->add(values[i][row]);
+        }
+    }
+}
+
+void DSStatGroupByModule::merge(ParallelRowAnalysisModule::Analysis &_from) {
+    DSStatGroupByModule &from(dynamic_cast<DSStatGroupByModule &>(_from));
+    SINVARIANT(from.expressions == expressions && from.stattypes == stattypes
+               && from.groupby_names == groupby_names);
+    if (!keys_ready && from.keys_ready) {
+        // this analysis saw no extents; it needs the type to print the keys
+        series.setType(from.series.getTypePtr());
+        initKeys();
+    }
+    size_t nstats = stattypes.size();
+    const vector<dataseries::KeyTable<uint32_t>::Entry> &entries(from.groups.entries());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        Stats **into = groupStats(from.groups.key(entries[i]), entries[i].key_size);
+        for (size_t j = 0; j < nstats; ++j) {
+            mergeStats(stattypes[j], *into[j], *from.stats[entries[i].value * nstats + j]);
         }
-        mystats[groupby_val] = stat;
     }
-    stat->add(expr->valDouble());
 }
 
 void DSStatGroupByModule::printResult() {
-    cout << "# Begin DSStatGroupByModule\n";
-    cout << boost::format("# processed %d rows, where clause eliminated %d rows\n") 
-            % processed_rows % ignored_rows;
-
-    // Someone might call printResult on an interim basis so we can't sort 
-    // the underlying hashtable.
-    vector<GeneralValue> keys = mystats.keys();
-    sort(keys.begin(), keys.end());
-
-    if (stattype == str_basic) {
-        if (groupby_name.empty()) {
-            cout << boost::format("# count(*), mean(%s), stddev, min, max\n") % expression;
-        } else {
-            cout << boost::format("# %s, count(*), mean(%s), stddev, min, max\n")
-                    % groupby_name % expression;
+    // Someone might call printResult on an interim basis, so sort the
+    // order rather than the table
+    vector<uint32_t> order;
+    groups.sortedOrder(order);
+    vector<GeneralValue> key;
+    const string groupby_list(join(", ", groupby_names));
+    size_t nstats = stattypes.size();
+
+    for (size_t s = 0; s < nstats; ++s) {
+        const string &stattype(stattypes[s]), &expression(expressions[s]);
+        if (s > 0) {
+            cout << "\n"; // as printAllResults separates modules
         }
-        for (vector<GeneralValue>::iterator i = keys.begin(); i != keys.end(); ++i) {
-            GeneralValue &k(*i);
-            Stats *v = mystats[k];
+        cout << "# Begin DSStatGroupByModule\n";
+        cout << boost::format("# processed %d rows, where clause eliminated %d rows\n")
+                % processed_rows % ignored_rows;
 
-            if (!groupby_name.empty()) {
-                cout << k << ", ";
+        if (stattype == str_basic) {
+            if (groupby_names.empty()) {
+                cout << boost::format("# count(*), mean(%s), stddev, min, max\n") % expression;
+            } else {
+                cout << boost::format("# %s, count(*), mean(%s), stddev, min, max\n")
+                        % groupby_list % expression;
+            }
+        } else if (stattype == str_quantile || sketchError(stattype) > 0) {
+            if (groupby_names.empty()) {
+                cout << boost::format("# %s(%s)\n") % stattype % expression;
+            } else {
+                cout << boost::format("# %s(%s) group by %s\n")
+                        % stattype % expression % groupby_list;
             }
-            cout << boost::format("%1%, %2$.6g, %3$.6g, %4$.6g, %5$.6g\n")
-                    % v->count() % v->mean() % v->stddev() % v->min() % v->max();
-        }
-    } else if (stattype == str_quantile) {
-        if (groupby_name.empty()) {
-            cout << boost::format("# %s(%s)\n") % stattype % expression;
         } else {
-            cout << boost::format("# %s(%s) group by %s\n") % stattype % expression % groupby_name;
+            FATAL_ERROR("wasn't stat type already checked?");
         }
-        for (vector<GeneralValue>::iterator i = keys.begin(); i != keys.end(); ++i) {
-            GeneralValue &k(*i);
-            Stats *v = mystats[k];
-            if (!groupby_name.empty()) {
-                cout << boost::format("# group %1%\n") % k;
+
+        for (vector<uint32_t>::iterator i = order.begin(); i != order.end(); ++i) {
+            const dataseries::KeyTable<uint32_t>::Entry &group(groups.entries()[*i]);
+            Stats *v = stats[group.value * nstats + s];
+            key_encoder.decode(groups.key(group), key);
+            if (stattype == str_basic) {
+                for (vector<GeneralValue>::iterator k = key.begin(); k != key.end(); ++k) {
+                    cout << *k << ", ";
+                }
+                cout << boost::format("%1%, %2$.6g, %3$.6g, %4$.6g, %5$.6g\n")
+                        % v->count() % v->mean() % v->stddev() % v->min() % v->max();
+            } else {
+                if (!groupby_names.empty()) {
+                    cout << "# group ";
+                    for (vector<GeneralValue>::iterator k = key.begin(); k != key.end(); ++k) {
+                        cout << (k == key.begin() ? "" : ", ") << *k;
+                    }
+                    cout << "\n";
+                }
+                v->printText(cout);
             }
-            v->printText(cout);
         }
-    } else {
-        FATAL_ERROR("wasn't stat type already checked?");
+        cout << "# End DSStatGroupByModule\n";
     }
-    cout << "# End DSStatGroupByModule\n";
 }
 
 bool DSStatGroupByModule::validStatType(const string &stat_type) {
-    return stat_type == str_basic || stat_type == str_quantile;
+    return stat_type == str_basic || stat_type == str_quantile || sketchError(stat_type) > 0;
 }
@@ -9,6 +9,7 @@
     implementation
 */
 
+#include <DataSeries/DataSeriesSink.hpp>
 #include <DataSeries/DSExpr.hpp>
 #include <DataSeries/DStoTextModule.hpp>
 #include <DataSeries/GeneralField.hpp>
@@ -302,6 +303,11 @@ Extent::Ptr DStoTextModule::getSharedExtent() {
         return e;
     }
 
+    if (e->type->getName() != "DataSeries: ExtentIndex"
+        && DataSeriesSink::isMetadataType(e->type->getName())) {
+        return e; // zone maps and the like describe the file, not its data
+    }
+
     PerTypeState &state = type_to_state[e->type->getName()];
 
     state.series.setExtent(e);
@@ -9,13 +9,18 @@
     implementation
 */
 
+#include <math.h>
+#include <string.h>
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <unistd.h>
 
 #define DS_RAW_EXTENT_PTR_DEPRECATED /* allowed */
 #define DSM_VAR_DEPRECATED /* allowed */
+#include <DataSeries/ColumnBatch.hpp>
 #include <DataSeries/DataSeriesModule.hpp>
+#include <DataSeries/ExtentSizeTuner.hpp>
+#include <DataSeries/GeneralField.hpp>
 
 namespace dataseries { namespace hack {
         Extent *releaseExtentSharedPtr(boost::shared_ptr<Extent> &p, Extent *e);
@@ -30,6 +35,16 @@ Extent *DataSeriesModule::getExtent() {
     Extent::Ptr e(getSharedExtent());
     if (e == NULL) {
         return NULL;
+    } else if (!e.unique()) {
+        // also held elsewhere, e.g. by the ExtentCache, so the caller gets a copy to delete
+        Extent *ret = new Extent(e->getTypePtr());
+        ret->fixeddata.resize(e->fixeddata.size(), false);
+        memcpy(ret->fixeddata.begin(), e->fixeddata.begin(), e->fixeddata.size());
+        ret->variabledata.resize(e->variabledata.size(), false);
+        memcpy(ret->variabledata.begin(), e->variabledata.begin(), e->variabledata.size());
+        ret->extent_source = e->extent_source;
+        ret->extent_source_offset = e->extent_source_offset;
+        return ret;
     } else {
         SINVARIANT(e->extent_source_offset != -2);
         SINVARIANT(dataseries::hack::extentSharedPtrSize() == sizeof(e));
@@ -65,10 +80,31 @@ void DataSeriesModule::getAndDelete() {
     }
 }
 
+Extent::Ptr DataSeriesModule::getSelectedExtent(const RowSelection *&selection) {
+    selection = NULL;
+    return getSharedExtent();
+}
+
+Extent::Ptr DataSeriesModule::materializeSelection(const Extent::Ptr &e,
+                                                   const RowSelection *selection) {
+    if (e == NULL || selection == NULL) {
+        return e;
+    }
+    ExtentSeries source(e), dest(e->getTypePtr());
+    dest.newExtent();
+    ExtentRecordCopy copier(source, dest);
+    copier.copyRecords(*selection);
+    Extent::Ptr ret = dest.getSharedExtent();
+    ret->extent_source = e->extent_source;
+    ret->extent_source_offset = e->extent_source_offset;
+    return ret;
+}
+
 void DataSeriesModule::getAndDeleteShared() {
+    const RowSelection *selection;
     Extent::Ptr e;
     do {
-        e = getSharedExtent();
+        e = getSelectedExtent(selection);
     } while (e != NULL);
 }
 
@@ -102,7 +138,7 @@ OutputModule::OutputModule(IExtentSink &sink, ExtentSeries &series,
                            const ExtentType *in_outputtype, 
                            int target_extent_size)
         : outputtype(*in_outputtype),
-          target_extent_size(target_extent_size),
+          target_extent_size(target_extent_size), wrote_extent(false),
           sink(sink), series(series)
 {
     SINVARIANT(&series != NULL);
@@ -112,13 +148,14 @@ OutputModule::OutputModule(IExtentSink &sink, ExtentSeries &series,
     series.setType(outputtype.shared_from_this());
     series.newExtent();
     cur_extent = series.getSharedExtent();
+    setTargetExtentSize(target_extent_size);
 }
 
 OutputModule::OutputModule(IExtentSink &sink, ExtentSeries &series,
                            const ExtentType &in_outputtype, 
                            int target_extent_size)
         : outputtype(in_outputtype),
-          target_extent_size(target_extent_size),
+          target_extent_size(target_extent_size), wrote_extent(false),
           sink(sink), series(series)
 {
     SINVARIANT(&series != NULL);
@@ -128,13 +165,14 @@ OutputModule::OutputModule(IExtentSink &sink, ExtentSeries &series,
     series.setType(outputtype.shared_from_this());
     series.newExtent();
     cur_extent = series.getSharedExtent();
+    setTargetExtentSize(target_extent_size);
 }
 
 OutputModule::OutputModule(IExtentSink &sink, ExtentSeries &series,
                            const ExtentType::Ptr in_outputtype, 
                            int target_extent_size)
         : outputtype(*in_outputtype), target_extent_size(target_extent_size),
-          sink(sink), series(series)
+          wrote_extent(false), sink(sink), series(series)
 {
     SINVARIANT(&series != NULL);
     INVARIANT(&outputtype != NULL, "can't create output module without type");
@@ -143,6 +181,7 @@ OutputModule::OutputModule(IExtentSink &sink, ExtentSeries &series,
     series.setType(in_outputtype);
     series.newExtent();
     cur_extent = series.getSharedExtent();
+    setTargetExtentSize(target_extent_size);
 }
 
 OutputModule::~OutputModule() {
@@ -172,11 +211,46 @@ void OutputModule::newRecord() {
     series.newRecord();
 }
 
+void OutputModule::appendColumns(const ColumnBatch &batch) {
+    INVARIANT(series.hasExtent() && cur_extent != NULL, "called appendColumns() after close()");
+    INVARIANT(series.getSharedExtent() == cur_extent,
+              "usage error, someone else changed the series extent");
+    if (batch.size() == 0) {
+        return;
+    }
+    const size_t fixed_size = outputtype.fixedrecordsize();
+    const double record_size = fixed_size
+        + static_cast<double>(batch.variableSize()) / batch.size();
+    for (uint32_t done = 0; done < batch.size(); ) {
+        if ((cur_extent->size() + fixed_size) > target_extent_size) {
+            flushExtent();
+        }
+        // as many records as fit in the rest of this extent; the last one may overshoot, as
+        // it would with newRecord()
+        double room = target_extent_size - static_cast<double>(cur_extent->size());
+        uint32_t nrecords = batch.size() - done;
+        if (room < nrecords * record_size) {
+            nrecords = room <= record_size ? 1 : static_cast<uint32_t>(ceil(room / record_size));
+        }
+        uint32_t first_row = series.appendRecords(nrecords);
+        batch.set(series, first_row, done, nrecords);
+        done += nrecords;
+    }
+    series.setCurPos(cur_extent->fixeddata.end() - fixed_size);
+}
+
 void OutputModule::flushExtent() {
     INVARIANT(cur_extent != NULL, "??");
     if (cur_extent->fixeddata.size() > 0) {
+        uint32_t unpacked_size = cur_extent->size();
         sink.writeExtent(*cur_extent, &stats);
+        wrote_extent = true;
         cur_extent->clear();
+        if (tuner != NULL && tuner->extentFlushed(unpacked_size)
+            && tuner->update(sink.getStats(&stats))) {
+            target_extent_size = tuner->targetSize();
+            sink.noteAutoExtentSize(outputtype.getName(), target_extent_size);
+        }
     }
 }
 
@@ -187,9 +261,28 @@ void OutputModule::close() {
 
     if (old_extent->fixeddata.size() > 0) {
         sink.writeExtent(*old_extent, &stats);
+        wrote_extent = true;
     }
 }
 
+void OutputModule::setTargetExtentSize(uint32_t bytes) {
+    if (bytes != auto_extent_size) {
+        tuner.reset();
+        target_extent_size = bytes;
+    } else if (tuner == NULL) {
+        INVARIANT(!wrote_extent, "can only choose the extent size automatically from the start");
+        tuner.reset(new ExtentSizeTuner());
+        target_extent_size = tuner->targetSize();
+        sink.noteAutoExtentSize(outputtype.getName(), target_extent_size);
+    }
+}
+
+void OutputModule::setConsumerThreads(uint32_t n) {
+    INVARIANT(tuner != NULL, "consumer threads only matter when choosing the extent size"
+              " automatically");
+    tuner->setConsumerThreads(n);
+}
+
 IExtentSink::Stats OutputModule::getStats() {
     return sink.getStats(&stats);
 }
@@ -0,0 +1,94 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    ExtentCache implementation
+*/
+
+#include <stdlib.h>
+
+#include <Lintel/LintelLog.hpp>
+#include <Lintel/StringUtil.hpp>
+
+#include <DataSeries/ExtentCache.hpp>
+
+using namespace std;
+using boost::format;
+
+ExtentCache &ExtentCache::instance() {
+    // Constructed on first use so that the environment is checked after
+    // main() has had a chance to set it.
+    static ExtentCache cache;
+    return cache;
+}
+
+ExtentCache::ExtentCache() : max_bytes(0) {
+    const char *mb = getenv("DATASERIES_EXTENT_CACHE_MB");
+    if (mb != NULL) {
+        setMaxBytes(stringToInteger<size_t>(mb) * 1024 * 1024);
+    }
+}
+
+void ExtentCache::setMaxBytes(size_t _max_bytes) {
+    PThreadScopedLock lock(mutex);
+    max_bytes = _max_bytes;
+    stats.max_bytes = max_bytes;
+    lockedEvict(max_bytes);
+}
+
+Extent::Ptr ExtentCache::lookup(const string &filename, int64_t mtime_nanosec, int64_t offset) {
+    PThreadScopedLock lock(mutex);
+    KeyToEntry::iterator i = entries.find(Key(filename, mtime_nanosec, offset));
+    if (i == entries.end()) {
+        ++stats.misses;
+        return Extent::Ptr();
+    }
+    ++stats.hits;
+    lru.splice(lru.begin(), lru, i->second);
+    LintelLogDebug("ExtentCache", format("hit %s:%d") % filename % offset);
+    return i->second->extent;
+}
+
+void ExtentCache::insert(const string &filename, int64_t mtime_nanosec, int64_t offset,
+                         const Extent::Ptr &extent) {
+    SINVARIANT(extent != NULL);
+    PThreadScopedLock lock(mutex);
+    if (extent->size() > max_bytes) {
+        return;
+    }
+    Key key(filename, mtime_nanosec, offset);
+    if (entries.find(key) != entries.end()) {
+        return; // another reader of the same file got here first
+    }
+    lockedEvict(max_bytes - extent->size());
+    lru.push_front(Entry(key, extent));
+    entries[key] = lru.begin();
+    stats.cur_bytes += extent->size();
+    ++stats.inserts;
+}
+
+void ExtentCache::clear() {
+    PThreadScopedLock lock(mutex);
+    lockedEvict(0);
+}
+
+ExtentCache::Stats ExtentCache::getStats() {
+    PThreadScopedLock lock(mutex);
+    return stats;
+}
+
+void ExtentCache::lockedEvict(size_t target_bytes) {
+    while (stats.cur_bytes > target_bytes) {
+        SINVARIANT(!lru.empty());
+        LRUList::iterator victim = --lru.end();
+        SINVARIANT(stats.cur_bytes >= victim->size);
+        stats.cur_bytes -= victim->size;
+        entries.erase(victim->key);
+        lru.erase(victim);
+        ++stats.evictions;
+    }
+}
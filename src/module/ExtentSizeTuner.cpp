@@ -0,0 +1,151 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    implementation
+*/
+
+#include <algorithm>
+
+#include <Lintel/PThread.hpp>
+
+#include <DataSeries/ExtentSizeTuner.hpp>
+#include <DataSeries/ExtentType.hpp>
+
+using namespace std;
+using namespace dataseries;
+
+namespace {
+    const string extent_size_type_xml(
+        "<ExtentType name=\"DataSeries: ExtentSize\" namespace=\"ssd.hpl.hp.com\" version=\"1.0\""
+        " comment=\"target extent sizes chosen automatically for the types in this file\" >\n"
+        "  <field type=\"variable32\" name=\"extenttype\" pack_unique=\"yes\" />\n"
+        "  <field type=\"int32\" name=\"target_extent_size\" comment=\"the last size chosen\" />\n"
+        "  <field type=\"int32\" name=\"min_extent_size\" />\n"
+        "  <field type=\"int32\" name=\"max_extent_size\" />\n"
+        "  <field type=\"int32\" name=\"changes\" />\n"
+        "</ExtentType>\n");
+
+    // a doubling has to shrink the packed data by this much to try the next one ...
+    const double min_gain = 0.03;
+    // ... and by this much to be kept
+    const double keep_gain = 0.01;
+    // and mustn't slow packing by more than this
+    const double max_slowdown = 1.5;
+}
+
+const uint32_t ExtentSizeTuner::min_extent_size;
+const uint32_t ExtentSizeTuner::max_extent_size;
+const uint32_t ExtentSizeTuner::window_extents;
+const uint32_t ExtentSizeTuner::reprobe_windows;
+
+ExtentSizeTuner::ExtentSizeTuner(uint32_t consumer_threads)
+    : target(min_extent_size), consumer_threads(0), flushed(0), unpacked_seen(0),
+      window_first(0), have_base(false), base_extents(0), base_unpacked(0), base_packed(0),
+      base_pack_time(0), have_prev(false), prev_ratio(0), prev_rate(0), settled(false),
+      settled_windows(0)
+{
+    setConsumerThreads(consumer_threads);
+}
+
+void ExtentSizeTuner::setConsumerThreads(uint32_t n) {
+    consumer_threads = n == 0 ? max(1, PThreadMisc::getNCpus()) : n;
+}
+
+bool ExtentSizeTuner::extentFlushed(uint32_t unpacked_size) {
+    ++flushed;
+    unpacked_seen += unpacked_size;
+    return !have_base || flushed >= base_extents + window_extents;
+}
+
+bool ExtentSizeTuner::update(const IExtentSink::Stats &packed) {
+    if (packed.extents < window_first) {
+        return false; // extents cut at an earlier target are still being packed
+    }
+    if (!have_base) {
+        startWindow(packed);
+        return false;
+    }
+    if (packed.extents < base_extents + window_extents) {
+        return false;
+    }
+
+    uint64_t unpacked = packed.unpacked_size - base_unpacked;
+    if (unpacked == 0) {
+        startWindow(packed);
+        return false;
+    }
+    double ratio = static_cast<double>(packed.packed_size - base_packed) / unpacked;
+    double pack_time = packed.pack_time - base_pack_time;
+    double rate = pack_time > 0 ? unpacked / pack_time : 0; // pack_time isn't always measured
+
+    uint32_t old_target = target;
+    if (settled) {
+        if (++settled_windows < reprobe_windows || 2 * static_cast<uint64_t>(target) > sizeCap()) {
+            startWindow(packed);
+            return false;
+        }
+        settled = false; // try the next size up, measuring against this window
+    } else if (have_prev) {
+        double gain = 1 - ratio / prev_ratio;
+        bool slower = rate > 0 && prev_rate > 0 && rate * max_slowdown < prev_rate;
+        if (gain < keep_gain || slower) {
+            settle(target / 2);
+            return true;
+        } else if (gain < min_gain) {
+            settle(target);
+            startWindow(packed);
+            return false;
+        }
+    }
+
+    if (2 * static_cast<uint64_t>(target) > sizeCap()) {
+        startWindow(packed); // wait for more data before trying the next size
+        return false;
+    }
+    have_prev = true;
+    prev_ratio = ratio;
+    prev_rate = rate;
+    changeTarget(2 * target);
+    return target != old_target;
+}
+
+const ExtentType::Ptr &ExtentSizeTuner::extentType() {
+    static const ExtentType::Ptr type(ExtentTypeLibrary::sharedExtentTypePtr(extent_size_type_xml));
+    return type;
+}
+
+uint32_t ExtentSizeTuner::sizeCap() const {
+    uint64_t per_extent = unpacked_seen / (2 * consumer_threads);
+    return static_cast<uint32_t>(min(static_cast<uint64_t>(max_extent_size),
+                                     max(static_cast<uint64_t>(min_extent_size), per_extent)));
+}
+
+void ExtentSizeTuner::startWindow(const IExtentSink::Stats &packed) {
+    have_base = true;
+    base_extents = packed.extents;
+    base_unpacked = packed.unpacked_size;
+    base_packed = packed.packed_size;
+    base_pack_time = packed.pack_time;
+}
+
+void ExtentSizeTuner::changeTarget(uint32_t to) {
+    target = max(min_extent_size, min(max_extent_size, to));
+    // every extent flushed from now on is cut at the new target; the window starts once
+    // all the earlier ones have been packed
+    window_first = flushed;
+    have_base = false;
+}
+
+void ExtentSizeTuner::settle(uint32_t at) {
+    settled = true;
+    settled_windows = 0;
+    have_prev = false;
+    if (at != target) {
+        changeTarget(at);
+    }
+}
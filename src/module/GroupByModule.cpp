@@ -0,0 +1,505 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    implementation
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <deque>
+
+#include <boost/format.hpp>
+#include <boost/shared_ptr.hpp>
+
+#include <Lintel/LintelLog.hpp>
+
+#include <DataSeries/GroupByModule.hpp>
+
+using namespace std;
+using boost::format;
+
+struct GroupByModule::Batch {
+    Extent::Ptr extent;
+    string keys;                  // normalized keys of the selected rows, back to back
+    vector<uint32_t> rows;        // row number of each selected row
+    vector<uint32_t> key_offsets; // rows.size() + 1 offsets into keys
+    vector<uint32_t> hashes;
+    vector<vector<uint32_t> > partition_rows; // indexes into rows for each partition
+    unsigned pending;             // partitions still to process this batch
+};
+
+struct GroupByModule::Partition {
+    typedef dataseries::KeyTable<Analysis *> Table;
+
+    Partition(unsigned index, ExtentSeries::typeCompatibilityT tc)
+        : index(index), series(tc), analysis_memory(0) { }
+
+    ~Partition() {
+        clear();
+        for (vector<FILE *>::iterator i = runs.begin(); i != runs.end(); ++i) {
+            fclose(*i);
+        }
+    }
+
+    size_t memory() const {
+        return table.memoryUsage() + analysis_memory;
+    }
+
+    /// drop all the groups; the analyses are deleted in the reverse of the order they were
+    /// made so that removing their fields from the series is cheap
+    void clear() {
+        vector<Table::Entry> &groups(table.entries());
+        for (vector<Table::Entry>::reverse_iterator i = groups.rbegin(); i != groups.rend(); ++i) {
+            delete i->value;
+        }
+        table.clear();
+        analysis_memory = 0;
+    }
+
+    unsigned index;
+    ExtentSeries series;
+    Table table;
+    size_t analysis_memory;
+    vector<FILE *> runs; // spilled groups, sorted by key
+    deque<boost::shared_ptr<Batch> > queue;
+};
+
+class GroupByModuleWorker : public PThread {
+  public:
+    GroupByModuleWorker(GroupByModule &module, unsigned partition)
+        : module(module), partition(partition) { }
+
+    virtual void *run() {
+        module.workerThread(partition);
+        return NULL;
+    }
+
+    GroupByModule &module;
+    unsigned partition;
+};
+
+size_t GroupByModule::Analysis::memoryUsage() const {
+    return 64;
+}
+
+void GroupByModule::Analysis::save(string &) const {
+    FATAL_ERROR("GroupByModule analyses have to implement save() to be spilled");
+}
+
+void GroupByModule::Analysis::restore(const string &) {
+    FATAL_ERROR("GroupByModule analyses have to implement restore() to be spilled");
+}
+
+void GroupByModule::Analysis::merge(Analysis &) {
+    FATAL_ERROR("GroupByModule analyses have to implement merge() to be spilled");
+}
+
+GroupByModule::GroupByModule(DataSeriesModule &source, const vector<string> &key_fields,
+                             Factory &factory, int _nthreads,
+                             ExtentSeries::typeCompatibilityT type_compatibility)
+    : BatchAnalysisModule(source, type_compatibility), spills(0), spilled_groups(0),
+      key_field_names(key_fields), factory(factory), nthreads(0), memory_limit(0),
+      outstanding_batches(0), source_done(false)
+{
+    SINVARIANT(!key_fields.empty());
+    if (_nthreads == -1) {
+        nthreads = min(PThreadMisc::getNCpus(), MAX_THREADS/2);
+    } else {
+        SINVARIANT(_nthreads > 0);
+        nthreads = static_cast<unsigned>(_nthreads);
+    }
+    for (unsigned i = 0; i < nthreads; ++i) {
+        partitions.push_back(new Partition(i, type_compatibility));
+    }
+}
+
+GroupByModule::~GroupByModule() {
+    stopWorkers();
+    for (vector<Partition *>::iterator i = partitions.begin(); i != partitions.end(); ++i) {
+        delete *i;
+    }
+}
+
+void GroupByModule::setMemoryLimit(size_t bytes, const string &dir) {
+    INVARIANT(!prepared, "can't set the memory limit after processing has started");
+    memory_limit = bytes;
+    if (!dir.empty()) {
+        spill_directory = dir;
+    } else if (getenv("TMPDIR") != NULL) {
+        spill_directory = getenv("TMPDIR");
+    } else {
+        spill_directory = "/tmp";
+    }
+}
+
+void GroupByModule::prepareForProcessing() {
+    key_encoder.init(series, key_field_names);
+    if (nthreads > 1) {
+        for (unsigned i = 0; i < nthreads; ++i) {
+            workers.push_back(new GroupByModuleWorker(*this, i));
+            workers.back()->start();
+        }
+    }
+}
+
+void GroupByModule::encodeKeys(Batch &batch, uint32_t nrows,
+                               const dataseries::RowSelection *selection) {
+    if (selection == NULL) {
+        batch.rows.resize(nrows);
+        for (uint32_t i = 0; i < nrows; ++i) {
+            batch.rows[i] = i;
+        }
+    } else {
+        batch.rows = *selection;
+    }
+    key_encoder.encodeRows(nrows, selection, batch.keys, batch.key_offsets);
+
+    size_t nselected = batch.rows.size();
+    batch.hashes.resize(nselected);
+    batch.partition_rows.resize(nthreads);
+    for (size_t i = 0; i < nselected; ++i) {
+        uint32_t hash = dataseries::KeyEncoder::hash(batch.keys.data() + batch.key_offsets[i],
+                                                     batch.key_offsets[i + 1]
+                                                     - batch.key_offsets[i]);
+        batch.hashes[i] = hash;
+        // the table uses the low bits of the hash, so partition on the high ones
+        batch.partition_rows[(static_cast<uint64_t>(hash) * nthreads) >> 32].push_back(i);
+    }
+}
+
+void GroupByModule::processBatch(uint32_t nrows, const dataseries::RowSelection *selection) {
+    if (nrows == 0) {
+        return;
+    }
+    boost::shared_ptr<Batch> batch(new Batch);
+    batch->extent = series.getSharedExtent();
+    encodeKeys(*batch, nrows, selection);
+    if (nthreads == 1) {
+        processPartition(*partitions[0], *batch);
+        return;
+    }
+
+    PThreadScopedLock lock(mutex);
+    // bound the memory held by batches waiting for the partition threads
+    while (outstanding_batches >= 2 * nthreads) {
+        done_cond.wait(mutex);
+    }
+    batch->pending = 0;
+    for (unsigned i = 0; i < nthreads; ++i) {
+        if (!batch->partition_rows[i].empty()) {
+            partitions[i]->queue.push_back(batch);
+            ++batch->pending;
+        }
+    }
+    if (batch->pending > 0) {
+        ++outstanding_batches;
+        work_cond.broadcast();
+    }
+}
+
+void GroupByModule::processPartition(Partition &partition, const Batch &batch) {
+    const vector<uint32_t> &mine(batch.partition_rows[partition.index]);
+    if (mine.empty()) {
+        return;
+    }
+    ExtentSeries &s(partition.series);
+    s.setExtent(batch.extent);
+    const uint8_t *row0 = batch.extent->fixeddata.begin();
+    uint32_t stride = s.getTypePtr()->fixedrecordsize();
+    const uint8_t *keys = reinterpret_cast<const uint8_t *>(batch.keys.data());
+    for (vector<uint32_t>::const_iterator i = mine.begin(); i != mine.end(); ++i) {
+        s.setCurPos(row0 + batch.rows[*i] * stride);
+        bool inserted;
+        Partition::Table::Entry &group
+            (partition.table.lookup(batch.hashes[*i], keys + batch.key_offsets[*i],
+                                    batch.key_offsets[*i + 1] - batch.key_offsets[*i], inserted));
+        if (inserted) {
+            group.value = factory(s);
+            SINVARIANT(group.value != NULL);
+            partition.analysis_memory += group.value->memoryUsage();
+        }
+        group.value->doGroupRow();
+    }
+    s.clearExtent();
+    if (memory_limit > 0 && partition.memory() > memory_limit / nthreads) {
+        spill(partition);
+    }
+}
+
+void GroupByModule::workerThread(unsigned index) {
+    Partition &partition(*partitions[index]);
+    PThreadScopedLock lock(mutex);
+    while (true) {
+        if (partition.queue.empty()) {
+            if (source_done) {
+                break;
+            }
+            work_cond.wait(mutex);
+            continue;
+        }
+        boost::shared_ptr<Batch> batch(partition.queue.front());
+        partition.queue.pop_front();
+        {
+            PThreadScopedUnlock unlock(lock);
+            processPartition(partition, *batch);
+        }
+        SINVARIANT(batch->pending > 0);
+        if (--batch->pending == 0) {
+            SINVARIANT(outstanding_batches > 0);
+            --outstanding_batches;
+            done_cond.signal();
+        }
+    }
+}
+
+namespace {
+    void spillWrite(FILE *to, const void *data, size_t size, const string &dir) {
+        INVARIANT(fwrite(data, 1, size, to) == size,
+                  format("error writing group by spill file in %s: %s") % dir % strerror(errno));
+    }
+
+    bool spillRead(FILE *from, void *data, size_t size) {
+        size_t amt = fread(data, 1, size, from);
+        INVARIANT(amt == size || (amt == 0 && feof(from)),
+                  format("error reading group by spill file: %s")
+                  % (ferror(from) ? strerror(errno) : "truncated"));
+        return amt == size;
+    }
+}
+
+// Each run is a series of records: the key size, the state size, the key and the state.
+void GroupByModule::spill(Partition &partition) {
+    vector<char> path(spill_directory.begin(), spill_directory.end());
+    const string suffix("/dsgroupby-XXXXXX");
+    path.insert(path.end(), suffix.begin(), suffix.end());
+    path.push_back('\0');
+    int fd = mkstemp(&path[0]);
+    INVARIANT(fd >= 0, format("can't make a group by spill file in %s: %s")
+              % spill_directory % strerror(errno));
+    CHECKED(unlink(&path[0]) == 0, format("unlink(%s) failed: %s") % &path[0] % strerror(errno));
+    FILE *run = fdopen(fd, "w+");
+    SINVARIANT(run != NULL);
+
+    vector<uint32_t> order;
+    partition.table.sortedOrder(order);
+    string state;
+    for (vector<uint32_t>::iterator i = order.begin(); i != order.end(); ++i) {
+        const Partition::Table::Entry &group(partition.table.entries()[*i]);
+        state.clear();
+        group.value->save(state);
+        uint32_t sizes[2] = { group.key_size, static_cast<uint32_t>(state.size()) };
+        spillWrite(run, sizes, sizeof(sizes), spill_directory);
+        spillWrite(run, partition.table.key(group), group.key_size, spill_directory);
+        spillWrite(run, state.data(), state.size(), spill_directory);
+    }
+    INVARIANT(fflush(run) == 0, format("error writing group by spill file in %s: %s")
+              % spill_directory % strerror(errno));
+    LintelLogDebug("GroupByModule", format("partition %d spilled %d groups, %d bytes")
+                   % partition.index % order.size() % partition.memory());
+    partition.runs.push_back(run);
+    partition.clear();
+
+    PThreadScopedLock lock(mutex);
+    ++spills;
+    spilled_groups += order.size();
+}
+
+void GroupByModule::stopWorkers() {
+    if (workers.empty()) {
+        return;
+    }
+    {
+        PThreadScopedLock lock(mutex);
+        source_done = true;
+        work_cond.broadcast();
+    }
+    for (vector<PThread *>::iterator i = workers.begin(); i != workers.end(); ++i) {
+        (**i).join();
+        delete *i;
+    }
+    workers.clear();
+    SINVARIANT(outstanding_batches == 0);
+}
+
+void GroupByModule::completeProcessing() {
+    stopWorkers();
+    source_done = true;
+    LintelLogDebug("GroupByModule", format("%d partitions, %d spills of %d groups")
+                   % nthreads % spills % spilled_groups);
+}
+
+namespace {
+    /// groups in key order from either the memory of a partition or one of its runs
+    struct GroupCursor {
+        GroupCursor(unsigned partition, FILE *run) : partition(partition), run(run), pos(0),
+                                                    key(NULL), key_size(0), analysis(NULL) { }
+        unsigned partition;
+        FILE *run; // NULL for the groups in memory
+        vector<uint32_t> order;
+        size_t pos;
+        const uint8_t *key;
+        uint32_t key_size;
+        string key_buf, state;
+        GroupByModule::Analysis *analysis;
+    };
+
+    struct CursorGreater {
+        bool operator()(const GroupCursor *a, const GroupCursor *b) const {
+            return dataseries::KeyEncoder::compare(a->key, a->key_size, b->key, b->key_size) > 0;
+        }
+    };
+
+    bool readRunGroup(GroupCursor &cursor) {
+        uint32_t sizes[2];
+        if (!spillRead(cursor.run, sizes, sizeof(sizes))) {
+            return false;
+        }
+        cursor.key_buf.resize(sizes[0]);
+        cursor.state.resize(sizes[1]);
+        SINVARIANT(sizes[0] > 0 && spillRead(cursor.run, &cursor.key_buf[0], sizes[0]));
+        SINVARIANT(sizes[1] == 0 || spillRead(cursor.run, &cursor.state[0], sizes[1]));
+        cursor.key = reinterpret_cast<const uint8_t *>(cursor.key_buf.data());
+        cursor.key_size = sizes[0];
+        return true;
+    }
+}
+
+uint64_t GroupByModule::visitGroups(Visitor &visitor) {
+    INVARIANT(workers.empty(), "visitGroups called while partition threads are running");
+    vector<GroupCursor *> heap;
+    for (vector<Partition *>::iterator i = partitions.begin(); i != partitions.end(); ++i) {
+        Partition &p(**i);
+        if (!p.table.empty()) {
+            heap.push_back(new GroupCursor(p.index, NULL));
+            p.table.sortedOrder(heap.back()->order);
+        }
+        for (vector<FILE *>::iterator j = p.runs.begin(); j != p.runs.end(); ++j) {
+            rewind(*j);
+            heap.push_back(new GroupCursor(p.index, *j));
+        }
+    }
+    // position each cursor on its first group; a cursor is only in the heap while it has one
+    vector<GroupCursor *> cursors(heap);
+    heap.clear();
+    for (vector<GroupCursor *>::iterator i = cursors.begin(); i != cursors.end(); ++i) {
+        GroupCursor &c(**i);
+        if (c.run == NULL) {
+            const Partition &p(*partitions[c.partition]);
+            const Partition::Table::Entry &group(p.table.entries()[c.order[0]]);
+            c.key = p.table.key(group);
+            c.key_size = group.key_size;
+            c.analysis = group.value;
+            heap.push_back(*i);
+        } else if (readRunGroup(c)) {
+            heap.push_back(*i);
+        }
+    }
+    make_heap(heap.begin(), heap.end(), CursorGreater());
+
+    uint64_t ngroups = 0;
+    vector<GroupCursor *> same;
+    vector<GeneralValue> key;
+    while (!heap.empty()) {
+        same.clear();
+        do {
+            pop_heap(heap.begin(), heap.end(), CursorGreater());
+            same.push_back(heap.back());
+            heap.pop_back();
+        } while (!heap.empty()
+                 && dataseries::KeyEncoder::compare(heap.front()->key, heap.front()->key_size,
+                                                    same[0]->key, same[0]->key_size) == 0);
+
+        Analysis *analysis, *merged = NULL;
+        if (same.size() == 1 && same[0]->run == NULL) {
+            analysis = same[0]->analysis;
+        } else {
+            // all the pieces of a group are in the same partition
+            ExtentSeries &s(partitions[same[0]->partition]->series);
+            analysis = merged = factory(s);
+            bool fresh = true;
+            for (vector<GroupCursor *>::iterator i = same.begin(); i != same.end(); ++i) {
+                if ((**i).run == NULL) {
+                    merged->merge(*(**i).analysis);
+                } else if (fresh) {
+                    merged->restore((**i).state);
+                } else {
+                    Analysis *piece = factory(s);
+                    piece->restore((**i).state);
+                    merged->merge(*piece);
+                    delete piece;
+                }
+                fresh = false;
+            }
+        }
+        key_encoder.decode(same[0]->key, key);
+        visitor(key, *analysis);
+        delete merged;
+        ++ngroups;
+
+        for (vector<GroupCursor *>::iterator i = same.begin(); i != same.end(); ++i) {
+            GroupCursor &c(**i);
+            bool more;
+            if (c.run == NULL) {
+                more = ++c.pos < c.order.size();
+                if (more) {
+                    const Partition &p(*partitions[c.partition]);
+                    const Partition::Table::Entry &group(p.table.entries()[c.order[c.pos]]);
+                    c.key = p.table.key(group);
+                    c.key_size = group.key_size;
+                    c.analysis = group.value;
+                }
+            } else {
+                more = readRunGroup(c);
+            }
+            if (more) {
+                heap.push_back(*i);
+                push_heap(heap.begin(), heap.end(), CursorGreater());
+            }
+        }
+    }
+    for (vector<GroupCursor *>::iterator i = cursors.begin(); i != cursors.end(); ++i) {
+        delete *i;
+    }
+    return ngroups;
+}
+
+namespace {
+    class PrintVisitor : public GroupByModule::Visitor {
+      public:
+        virtual void operator()(const vector<GeneralValue> &key,
+                                GroupByModule::Analysis &analysis) {
+            for (vector<GeneralValue>::const_iterator i = key.begin(); i != key.end(); ++i) {
+                if (i->getType() == ExtentType::ft_unknown) {
+                    cout << "null, ";
+                } else {
+                    cout << *i << ", ";
+                }
+            }
+            analysis.printResults();
+        }
+    };
+}
+
+void GroupByModule::printResult() {
+    cout << "# Begin GroupByModule\n";
+    cout << format("# processed %d rows, where clause eliminated %d rows\n")
+        % processed_rows % ignored_rows;
+    cout << "# ";
+    for (vector<string>::iterator i = key_field_names.begin(); i != key_field_names.end(); ++i) {
+        cout << *i << ", ";
+    }
+    cout << "results\n";
+    PrintVisitor visitor;
+    visitGroups(visitor);
+    cout << "# End GroupByModule\n";
+}
@@ -0,0 +1,162 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    implementation
+*/
+
+#include <math.h>
+
+#include <algorithm>
+
+#include <boost/format.hpp>
+
+#include <Lintel/AssertBoost.hpp>
+#include <Lintel/HashFns.hpp>
+
+#include <DataSeries/HyperLogLog.hpp>
+
+using namespace std;
+using boost::format;
+
+namespace dataseries {
+
+namespace {
+    const uint8_t min_precision = 4, max_precision = 18;
+    // additions buffered before being sorted into the sparse list
+    const size_t max_recent = 64;
+}
+
+HyperLogLog::HyperLogLog(uint8_t precision) : precision(precision) {
+    INVARIANT(precision >= min_precision && precision <= max_precision,
+              format("HyperLogLog precision %d not in [%d, %d]")
+              % static_cast<int>(precision) % static_cast<int>(min_precision)
+              % static_cast<int>(max_precision));
+}
+
+uint8_t HyperLogLog::precisionForError(double error) {
+    for (uint8_t p = min_precision; p < max_precision; ++p) {
+        if (errorForPrecision(p) <= error) {
+            return p;
+        }
+    }
+    return max_precision;
+}
+
+void HyperLogLog::addHash(uint64_t hash) {
+    if (!registers.empty()) {
+        setRegister(hash);
+        return;
+    }
+    recent.push_back(hash);
+    if (recent.size() >= max_recent) {
+        flushSparse();
+        // dense once the list would be bigger than the registers
+        if (sparse.size() * sizeof(uint64_t) > (static_cast<size_t>(1) << precision)) {
+            makeDense();
+        }
+    }
+}
+
+void HyperLogLog::add(const HyperLogLog &from) {
+    INVARIANT(precision == from.precision, format("can't merge HyperLogLogs of precision %d"
+                                                  " and %d") % static_cast<int>(precision)
+              % static_cast<int>(from.precision));
+    if (!from.registers.empty()) {
+        if (registers.empty()) {
+            makeDense();
+        }
+        for (size_t i = 0; i < registers.size(); ++i) {
+            registers[i] = max(registers[i], from.registers[i]);
+        }
+    } else {
+        from.flushSparse();
+        for (vector<uint64_t>::const_iterator i = from.sparse.begin();
+             i != from.sparse.end(); ++i) {
+            addHash(*i);
+        }
+    }
+}
+
+void HyperLogLog::flushSparse() const {
+    if (recent.empty()) {
+        return;
+    }
+    sort(recent.begin(), recent.end());
+    size_t old_size = sparse.size();
+    sparse.insert(sparse.end(), recent.begin(), recent.end());
+    inplace_merge(sparse.begin(), sparse.begin() + old_size, sparse.end());
+    sparse.erase(unique(sparse.begin(), sparse.end()), sparse.end());
+    recent.clear();
+}
+
+void HyperLogLog::makeDense() {
+    flushSparse();
+    registers.assign(static_cast<size_t>(1) << precision, 0);
+    for (vector<uint64_t>::iterator i = sparse.begin(); i != sparse.end(); ++i) {
+        setRegister(*i);
+    }
+    vector<uint64_t>().swap(sparse);
+    vector<uint64_t>().swap(recent);
+}
+
+void HyperLogLog::setRegister(uint64_t hash) {
+    // the top bits pick the register, which keeps the longest run of leading zeros (+1) of
+    // the rest
+    size_t index = hash >> (64 - precision);
+    uint64_t rest = hash << precision;
+    uint8_t rank = 1;
+    for (; rank <= 64 - precision && (rest & (static_cast<uint64_t>(1) << 63)) == 0; ++rank) {
+        rest <<= 1;
+    }
+    registers[index] = max(registers[index], rank);
+}
+
+double HyperLogLog::estimate() const {
+    if (registers.empty()) {
+        flushSparse();
+        return sparse.size(); // exact but for 64 bit hash collisions
+    }
+    double m = registers.size();
+    double sum = 0;
+    size_t zeros = 0;
+    for (vector<uint8_t>::const_iterator i = registers.begin(); i != registers.end(); ++i) {
+        sum += ldexp(1.0, -static_cast<int>(*i));
+        zeros += *i == 0 ? 1 : 0;
+    }
+    double alpha;
+    switch (precision)
+        {
+        case 4: alpha = 0.673; break;
+        case 5: alpha = 0.697; break;
+        case 6: alpha = 0.709; break;
+        default: alpha = 0.7213 / (1 + 1.079 / m);
+        }
+    double raw = alpha * m * m / sum;
+    // the raw estimate is badly biased for small counts; without the HyperLogLog++ bias
+    // tables, use linear counting over the empty registers there, as the original does
+    if (raw <= 2.5 * m && zeros > 0) {
+        return m * log(m / zeros);
+    }
+    return raw;
+}
+
+double HyperLogLog::errorForPrecision(uint8_t precision) {
+    return 1.04 / sqrt(static_cast<double>(1 << precision));
+}
+
+size_t HyperLogLog::memoryUsage() const {
+    return sizeof(*this) + (sparse.capacity() + recent.capacity()) * sizeof(uint64_t)
+        + registers.capacity();
+}
+
+uint64_t HyperLogLog::hash(const void *data, uint32_t size) {
+    return (static_cast<uint64_t>(lintel::bobJenkinsHash(1972, data, size)) << 32)
+        | lintel::bobJenkinsHash(2013, data, size);
+}
+
+}
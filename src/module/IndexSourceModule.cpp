@@ -16,6 +16,7 @@
 #include <Lintel/LintelLog.hpp>
 #include <Lintel/PThread.hpp>
 
+#include <DataSeries/ExtentCache.hpp>
 #include <DataSeries/IndexSourceModule.hpp>
 
 using namespace std;
@@ -39,22 +40,30 @@ class IndexSourceModuleCompressedPrefetchThread : public PThread {
 
 class IndexSourceModuleUnpackThread : public PThread {
   public:
-    IndexSourceModuleUnpackThread(IndexSourceModule &_ism)
-    : ism(_ism) { 
+    IndexSourceModuleUnpackThread(IndexSourceModule &_ism, unsigned _thread_num)
+    : ism(_ism), thread_num(_thread_num) { 
         setStackSize(256*1024); // shouldn't need much
     }
 
     virtual ~IndexSourceModuleUnpackThread() { }
 
     virtual void *run() {
-        ism.unpackThread();
+        ism.unpackThread(thread_num);
         return NULL;
     }
     IndexSourceModule &ism;
+    unsigned thread_num;
 };
 
+// How many extents the consumer has to receive between autotuning decisions;
+// fewer makes the decisions noisy, more makes the controller slow to react.
+static const uint64_t autotune_interval = 16;
+static const unsigned autotune_min_queue = 1024 * 1024;
+
 IndexSourceModule::IndexSourceModule()
-        : getting_extent(false), prefetch(NULL)
+        : getting_extent(false), autotune(false), autotune_max_compressed(0),
+          autotune_max_unpacked(0), autotune_max_threads(-1), prefetch(NULL),
+          lookup_last_filtered(false), count_lookup_positives(false)
 {
 }
 
@@ -68,14 +77,15 @@ IndexSourceModule::~IndexSourceModule() {
 void
 IndexSourceModule::startPrefetching(unsigned prefetch_max_compressed,
                                     unsigned prefetch_max_unpacked,
-                                    int n_unpack_threads)
+                                    int n_unpack_threads,
+                                    bool unordered)
 {
     INVARIANT(prefetch == NULL, "invalid to start prefetching twice without closing.");
     SINVARIANT(prefetch_max_compressed > 0);
     SINVARIANT(prefetch_max_unpacked > 0);
 
     PrefetchInfo *tmp = new PrefetchInfo(prefetch_max_compressed,
-                                         prefetch_max_unpacked);
+                                         prefetch_max_unpacked, unordered);
     tmp->mutex.lock();
     prefetch = tmp;
 
@@ -91,22 +101,148 @@ IndexSourceModule::startPrefetching(unsigned prefetch_max_compressed,
 
     INVARIANT(unpack_count > 0, "?");
     tmp->unpack_threads.resize(unpack_count);
+    tmp->active_unpack_threads = unpack_count;
+    if (autotune && autotune_max_threads > 0) {
+        tmp->active_unpack_threads = min(unpack_count,
+                                         static_cast<unsigned>(autotune_max_threads));
+    }
     INVARIANT(prefetch == tmp, "two simulataneous calls to startPrefetching??");
     lockedStartThreads();
     tmp->mutex.unlock();
     INVARIANT(prefetch == tmp, "two simulataneous calls to startPrefetching??");
 }
 
+void IndexSourceModule::enableAutoTune(unsigned max_compressed, unsigned max_unpacked,
+                                       int max_unpack_threads) {
+    INVARIANT(prefetch == NULL, "must enable autotuning before starting prefetching");
+    SINVARIANT(max_compressed > 0 && max_unpacked > 0);
+    SINVARIANT(max_unpack_threads == -1 || max_unpack_threads > 0);
+    autotune = true;
+    autotune_max_compressed = max_compressed;
+    autotune_max_unpacked = max_unpacked;
+    autotune_max_threads = max_unpack_threads;
+}
+
 void IndexSourceModule::lockedStartThreads() {
     prefetch->compressed_prefetch_thread = 
             new IndexSourceModuleCompressedPrefetchThread(*this);
     prefetch->compressed_prefetch_thread->start();
     for (unsigned i = 0; i < prefetch->unpack_threads.size(); ++i) {
-        prefetch->unpack_threads[i] = new IndexSourceModuleUnpackThread(*this);
+        prefetch->unpack_threads[i] = new IndexSourceModuleUnpackThread(*this, i);
         prefetch->unpack_threads[i]->start();
     }
 }
 
+void IndexSourceModule::lockedAddUnpackThread() {
+    unsigned thread_num = prefetch->unpack_threads.size();
+    PThread *thread = new IndexSourceModuleUnpackThread(*this, thread_num);
+    prefetch->unpack_threads.push_back(thread);
+    thread->start();
+}
+
+static unsigned growLimit(unsigned cur, unsigned max_limit) {
+    return static_cast<unsigned>(min(static_cast<uint64_t>(max_limit), 
+                                     2 * static_cast<uint64_t>(cur)));
+}
+
+static unsigned shrinkLimit(unsigned cur) {
+    return max(autotune_min_queue, cur - cur / 4);
+}
+
+bool IndexSourceModule::autoTune(const WaitStats &now, const WaitStats &base,
+                                 PrefetchLimits &limits, const PrefetchLimits &max) {
+    uint64_t nextents = now.nextents - base.nextents;
+    if (nextents < autotune_interval) {
+        return false;
+    }
+    double consumer_wait = (now.consumer - base.consumer) / static_cast<double>(nextents);
+    uint64_t no_upstream = now.unpack_no_upstream - base.unpack_no_upstream;
+    uint64_t downstream_full = now.unpack_downstream_full - base.unpack_downstream_full;
+
+    // Make at most one change per interval so that we can see its effect
+    // before deciding on the next one.
+    if (consumer_wait > 0.1) {
+        // The consumer is waiting; grow whatever is holding it up.
+        if (downstream_full > no_upstream && limits.unpacked < max.unpacked) {
+            // unpackers are blocked on a full unpacked queue
+            unsigned old_limit = limits.unpacked;
+            limits.unpacked = growLimit(limits.unpacked, max.unpacked);
+            LintelLogDebug("IndexSourceModule::autotune",
+                           format("consumer wait %.2f, unpackers blocked; unpacked limit %d -> %d")
+                           % consumer_wait % old_limit % limits.unpacked);
+        } else if (no_upstream > nextents && limits.compressed < max.compressed) {
+            // unpackers are starved for compressed extents
+            unsigned old_limit = limits.compressed;
+            limits.compressed = growLimit(limits.compressed, max.compressed);
+            LintelLogDebug("IndexSourceModule::autotune",
+                           format("consumer wait %.2f, unpackers starved; "
+                                  "compressed limit %d -> %d")
+                           % consumer_wait % old_limit % limits.compressed);
+        } else if (limits.unpack_threads < max.unpack_threads) {
+            // unpackers are all busy
+            ++limits.unpack_threads;
+            LintelLogDebug("IndexSourceModule::autotune",
+                           format("consumer wait %.2f, unpackers busy; %d unpack threads")
+                           % consumer_wait % limits.unpack_threads);
+        }
+    } else if (consumer_wait < 0.01) {
+        // The consumer is not waiting; give back threads and memory.
+        if (no_upstream > nextents && limits.unpack_threads > 1) {
+            --limits.unpack_threads;
+            LintelLogDebug("IndexSourceModule::autotune",
+                           format("consumer wait %.2f, unpackers idle; %d unpack threads")
+                           % consumer_wait % limits.unpack_threads);
+        } else if (limits.unpacked > autotune_min_queue) {
+            unsigned old_limit = limits.unpacked;
+            limits.unpacked = shrinkLimit(limits.unpacked);
+            LintelLogDebug("IndexSourceModule::autotune",
+                           format("consumer wait %.2f; unpacked limit %d -> %d")
+                           % consumer_wait % old_limit % limits.unpacked);
+        } else if (limits.compressed > autotune_min_queue) {
+            unsigned old_limit = limits.compressed;
+            limits.compressed = shrinkLimit(limits.compressed);
+            LintelLogDebug("IndexSourceModule::autotune",
+                           format("consumer wait %.2f; compressed limit %d -> %d")
+                           % consumer_wait % old_limit % limits.compressed);
+        }
+    }
+    return true;
+}
+
+void IndexSourceModule::lockedAutoTune() {
+    Queue &compressed(prefetch->compressed), &unpacked(prefetch->unpacked);
+    unsigned &nthreads(prefetch->active_unpack_threads);
+    PrefetchLimits limits(nthreads, compressed.limit, unpacked.limit);
+    PrefetchLimits max(0, autotune_max_compressed, autotune_max_unpacked);
+    if (autotune_max_threads > 0) {
+        max.unpack_threads = static_cast<unsigned>(autotune_max_threads);
+    } else {
+        max.unpack_threads = std::max(static_cast<unsigned>(prefetch->unpack_threads.size()),
+                                      static_cast<unsigned>(min(PThreadMisc::getNCpus(),
+                                                                MAX_THREADS)));
+    }
+    if (!autoTune(prefetch->stats, prefetch->autotune_base, limits, max)) {
+        return;
+    }
+    prefetch->autotune_base = prefetch->stats;
+
+    if (limits.unpacked > unpacked.limit) {
+        prefetch->unpack_cond.broadcast();
+    }
+    unpacked.limit = limits.unpacked;
+    if (limits.compressed > compressed.limit) {
+        prefetch->compressed_cond.signal();
+    }
+    compressed.limit = limits.compressed;
+    if (limits.unpack_threads > nthreads) {
+        while (prefetch->unpack_threads.size() < limits.unpack_threads) {
+            lockedAddUnpackThread();
+        }
+        prefetch->park_cond.broadcast();
+    }
+    nthreads = limits.unpack_threads; // threads past this park when they next look
+}
+
 static inline double 
 timediff(struct timeval &end,struct timeval &start)
 {
@@ -129,12 +265,23 @@ Extent::Ptr IndexSourceModule::getSharedExtent() {
         prefetch->ready_cond.wait(prefetch->mutex);
     }
     if (prefetch->allDone()) {
+        if (!lookup_keys.empty()) {
+            LintelLogDebug("IndexSourceModule::lookup",
+                           format("%d extents checked, %d skipped, %d without filters,"
+                                  " %d passed, %d of them known false positives")
+                           % lookup_stats.checked % lookup_stats.skipped
+                           % lookup_stats.unfiltered % lookup_stats.passed
+                           % lookup_stats.false_positives);
+        }
         prefetch->mutex.unlock();
         close();
         getting_extent = false;
         return Extent::Ptr();
     }
     ++prefetch->stats.nextents;
+    if (autotune) {
+        lockedAutoTune();
+    }
     SINVARIANT(!prefetch->unpacked.empty());
     PrefetchExtent *buf = prefetch->unpacked.getFront();
     SINVARIANT(buf->bytes.empty() && buf->unpacked != NULL);
@@ -165,6 +312,8 @@ void IndexSourceModule::resetPos() {
     prefetch->mutex.lock();
     SINVARIANT(lockedIsClosed());
     lockedResetModule();
+    lookup_filename.clear(); // the file may have changed
+    lookup_filters.clear();
     prefetch->source_done = false;
     SINVARIANT(prefetch->abort_prefetching == 0);
     lockedStartThreads();
@@ -184,6 +333,7 @@ void IndexSourceModule::close() {
         prefetch->abort_prefetching = 2 + prefetch->unpack_threads.size();
         prefetch->compressed_cond.broadcast();
         prefetch->unpack_cond.broadcast();
+        prefetch->park_cond.broadcast();
         prefetch->ready_cond.broadcast();
 
         while (prefetch->abort_prefetching > 1) {
@@ -270,6 +420,86 @@ IndexSourceModule::getWaitStats(WaitStats &stats)
     return true;
 }
 
+void IndexSourceModule::addLookup(const string &field, const GeneralValue &value) {
+    INVARIANT(prefetch == NULL, "must add lookups before starting prefetching");
+    INVARIANT(value.getType() != ExtentType::ft_unknown, "can't look up null values");
+    lookup_keys[field].insert(dataseries::BloomFilter::key(value));
+}
+
+void IndexSourceModule::setCountLookupPositives(bool count) {
+    INVARIANT(prefetch == NULL, "must set lookup counting before starting prefetching");
+    count_lookup_positives = count;
+}
+
+IndexSourceModule::LookupStats IndexSourceModule::getLookupStats() {
+    if (prefetch == NULL) {
+        return lookup_stats;
+    }
+    PThreadScopedLock lock(prefetch->mutex);
+    return lookup_stats;
+}
+
+bool IndexSourceModule::lockedLookupMayMatch(DataSeriesSource *dss, off64_t offset) {
+    lookup_last_filtered = false;
+    if (lookup_keys.empty()) {
+        return true;
+    }
+    if (dss->getFilename() != lookup_filename) {
+        lookup_filename = dss->getFilename();
+        dataseries::BloomFilter::read(*dss, lookup_filters);
+    }
+    ++lookup_stats.checked;
+    map<int64_t, dataseries::BloomFilter::ByField>::iterator filters
+        = lookup_filters.find(offset);
+    if (filters != lookup_filters.end()) {
+        for (map<string, set<string> >::iterator i = lookup_keys.begin();
+             i != lookup_keys.end(); ++i) {
+            dataseries::BloomFilter::ByField::iterator filter = filters->second.find(i->first);
+            if (filter == filters->second.end()) {
+                continue;
+            }
+            lookup_last_filtered = true;
+            bool any = false;
+            for (set<string>::iterator key = i->second.begin(); key != i->second.end(); ++key) {
+                if (filter->second.mayContainKey(*key)) {
+                    any = true;
+                    break;
+                }
+            }
+            if (!any) {
+                ++lookup_stats.skipped;
+                lookup_last_filtered = false;
+                return false;
+            }
+        }
+    }
+    ++(lookup_last_filtered ? lookup_stats.passed : lookup_stats.unfiltered);
+    return true;
+}
+
+bool IndexSourceModule::lookupFound(const Extent::Ptr &e) {
+    ExtentSeries series(e);
+    vector<GeneralField *> fields;
+    vector<const set<string> *> keys;
+    for (map<string, set<string> >::iterator i = lookup_keys.begin();
+         i != lookup_keys.end(); ++i) {
+        if (e->getTypePtr()->hasColumn(i->first)) {
+            fields.push_back(GeneralField::create(NULL, series, i->first));
+            keys.push_back(&i->second);
+        }
+    }
+    bool found = false;
+    for (; !found && series.more(); series.next()) {
+        found = true;
+        for (size_t i = 0; found && i < fields.size(); ++i) {
+            found = !fields[i]->isNull()
+                && keys[i]->count(dataseries::BloomFilter::key(GeneralValue(fields[i]))) > 0;
+        }
+    }
+    GeneralField::deleteFields(fields);
+    return found;
+}
+
 void IndexSourceModule::compressedPrefetchThread() {
     prefetch->mutex.lock();
     while (prefetch->abort_prefetching == 0) {
@@ -298,10 +528,19 @@ void IndexSourceModule::compressedPrefetchThread() {
     prefetch->mutex.unlock();
 }
 
-void IndexSourceModule::unpackThread() {
+void IndexSourceModule::unpackThread(unsigned thread_num) {
     prefetch->mutex.lock();
     ++prefetch->stats.active_unpackers;
     while (prefetch->abort_prefetching == 0) {
+        if (thread_num >= prefetch->active_unpack_threads) {
+            // parked by lockedAutoTune(); separate condition so that we don't
+            // swallow signals meant for the active unpackers.
+            --prefetch->stats.active_unpackers;
+            ++prefetch->stats.unpack_parked;
+            prefetch->park_cond.wait(prefetch->mutex);
+            ++prefetch->stats.active_unpackers;
+            continue;
+        }
         if (prefetch->compressed.data.empty() || 
             !prefetch->unpacked.can_add(prefetch->compressed.front())) {
             --prefetch->stats.active_unpackers;
@@ -323,10 +562,21 @@ void IndexSourceModule::unpackThread() {
             prefetch->unpacked.can_add(prefetch->compressed.front())) {
             PrefetchExtent *pe = prefetch->compressed.getFront();
             prefetch->compressed.subtract(pe->bytes.size());
-            uint32_t unpacked_size 
-                    = Extent::unpackedSize(pe->bytes, pe->need_bitflip,pe->type);
-            prefetch->unpacked.add(pe, unpacked_size);
+            uint32_t unpacked_size = prefetch->unpacked.unpackedSize(pe);
+            if (prefetch->unordered) {
+                // Only queue once unpacked so the consumer can take
+                // whichever extent finishes first.
+                prefetch->unpacked.reserve(unpacked_size);
+            } else {
+                prefetch->unpacked.add(pe, unpacked_size);
+            }
+            ++prefetch->unpacking;
             prefetch->compressed_cond.signal();
+            if (pe->unpacked != NULL) {
+                // extent cache hit, nothing to unpack
+                lockedFinishUnpack(pe);
+                continue;
+            }
             bool should_yield; 
             if (prefetch->unpackedReady()) {
                 // For small extents, almost equivalent to just having the
@@ -334,7 +584,8 @@ void IndexSourceModule::unpackThread() {
                 // really want a directed yield here to the consumer.
                 ++prefetch->stats.unpack_yield_ready;
                 should_yield = true;
-            } else if (prefetch->unpacked.data.size() > 2*prefetch->unpack_threads.size()) {
+            } else if (!prefetch->unordered &&
+                       prefetch->unpacked.data.size() > 2*prefetch->active_unpack_threads) {
                 ++prefetch->stats.unpack_yield_front;
                 // The front of the queue isn't done, but we have a lot of 
                 // things in the queue, this means whatever thread is working
@@ -355,16 +606,22 @@ void IndexSourceModule::unpackThread() {
             e->extent_source_offset = pe->extent_source_offset;
             SINVARIANT(e->type->getName() == pe->uncompressed_type);
             SINVARIANT(e->size() == unpacked_size);
+            ExtentCache &cache(ExtentCache::instance());
+            if (cache.enabled()) {
+                cache.insert(pe->extent_source, pe->extent_source_mtime,
+                             pe->extent_source_offset, e);
+            }
+            bool lookup_found = pe->lookup_filtered && lookupFound(e);
             prefetch->mutex.lock();
+            if (pe->lookup_filtered) {
+                ++(lookup_found ? lookup_stats.true_positives : lookup_stats.false_positives);
+            }
             SINVARIANT(pe->unpacked == NULL && pe->bytes.size() > 0);
             total_compressed_bytes += pe->bytes.size();
             total_uncompressed_bytes += e->size();
             pe->bytes.clear();
             pe->unpacked = e;
-            SINVARIANT(!prefetch->unpacked.empty());
-            if (prefetch->unpackedReady()) {
-                prefetch->ready_cond.signal();
-            }
+            lockedFinishUnpack(pe);
         }
     }
     --prefetch->stats.active_unpackers;
@@ -374,20 +631,52 @@ void IndexSourceModule::unpackThread() {
     prefetch->mutex.unlock();
 }
 
+void IndexSourceModule::lockedFinishUnpack(PrefetchExtent *pe) {
+    SINVARIANT(pe->unpacked != NULL && pe->bytes.empty());
+    SINVARIANT(prefetch->unpacking > 0);
+    --prefetch->unpacking;
+    if (prefetch->unordered) {
+        prefetch->unpacked.addReserved(pe);
+    }
+    SINVARIANT(!prefetch->unpacked.empty());
+    if (prefetch->unpackedReady()) {
+        prefetch->ready_cond.signal();
+    }
+}
+
 IndexSourceModule::PrefetchExtent *
 IndexSourceModule::readCompressed(DataSeriesSource *dss,
                                   off64_t offset,
                                   const string &uncompressed_type)
 {
+    bool lookup_filtered = lookup_last_filtered && count_lookup_positives;
+    lookup_last_filtered = false;
     prefetch->mutex.unlock();
     PrefetchExtent *p = new PrefetchExtent;
     p->extent_source = dss->getFilename();
     p->extent_source_offset = offset;
-    bool ok = dss->preadCompressed(offset,p->bytes);
-    INVARIANT(ok,"whoa, shouldn't have hit eof!");
-    p->type = dss->getLibrary().getTypeByNamePtr(Extent::getPackedExtentType(p->bytes));
-    p->need_bitflip = dss->needBitflip();
+    p->extent_source_mtime = dss->getModifyTimeNanoSec();
     p->uncompressed_type = uncompressed_type;
+    ExtentCache &cache(ExtentCache::instance());
+    if (cache.enabled()) {
+        p->unpacked = cache.lookup(p->extent_source, p->extent_source_mtime, offset);
+    }
+    if (p->unpacked != NULL) {
+        // goes through the compressed queue anyway to keep the index order
+        p->type = p->unpacked->getTypePtr();
+        SINVARIANT(p->type->getName() == uncompressed_type);
+        if (lookup_filtered) {
+            bool found = lookupFound(p->unpacked);
+            PThreadScopedLock lock(prefetch->mutex);
+            ++(found ? lookup_stats.true_positives : lookup_stats.false_positives);
+        }
+    } else {
+        p->lookup_filtered = lookup_filtered;
+        bool ok = dss->preadCompressed(offset,p->bytes);
+        INVARIANT(ok,"whoa, shouldn't have hit eof!");
+        p->type = dss->getLibrary().getTypeByNamePtr(Extent::getPackedExtentType(p->bytes));
+        p->need_bitflip = dss->needBitflip();
+    }
     prefetch->mutex.lock();
     return p;
 }
@@ -174,22 +174,23 @@ MinMaxIndexModule::lockedResetModule()
 IndexSourceModule::PrefetchExtent *
 MinMaxIndexModule::lockedGetCompressedExtent()
 {
-    if (cur_extent >= kept_extents.size()) {
-        delete cur_source;
-        cur_source = NULL;
-        cur_source_filename.clear();
-        return NULL;
-    }
-    if (cur_source_filename != kept_extents[cur_extent].filename) {
-        delete cur_source;
-        cur_source_filename = kept_extents[cur_extent].filename;
-        cur_source = new DataSeriesSource(cur_source_filename);
+    while (true) {
+        if (cur_extent >= kept_extents.size()) {
+            delete cur_source;
+            cur_source = NULL;
+            cur_source_filename.clear();
+            return NULL;
+        }
+        if (cur_source_filename != kept_extents[cur_extent].filename) {
+            delete cur_source;
+            cur_source_filename = kept_extents[cur_extent].filename;
+            cur_source = new DataSeriesSource(cur_source_filename);
+        }
+        off64_t offset = kept_extents[cur_extent].extent_offset;
+        ++cur_extent;
+        if (lockedLookupMayMatch(cur_source, offset)) {
+            return readCompressed(cur_source, offset, index_type);
+        }
     }
-    PrefetchExtent *ret = 
-            readCompressed(cur_source,
-                           kept_extents[cur_extent].extent_offset,
-                           index_type);
-    ++cur_extent;
-    return ret;
 }
 
@@ -0,0 +1,304 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    implementation
+*/
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+
+#include <boost/format.hpp>
+
+#include <Lintel/HashFns.hpp>
+#include <Lintel/LintelLog.hpp>
+#include <Lintel/PThread.hpp>
+
+#include <DataSeries/Config.hpp>
+#include <DataSeries/NativeCode.hpp>
+
+using namespace std;
+using boost::format;
+
+namespace {
+    PThreadMutex compile_mutex;
+    int enabled_state = -1; // -1 until the environment has been checked
+    bool compiler_missing = false;
+
+    string envOr(const char *name, const string &default_value) {
+        const char *v = getenv(name);
+        return v == NULL ? default_value : string(v);
+    }
+
+    string cacheDir() {
+        const char *dir = getenv("DATASERIES_NATIVE_CACHE");
+        if (dir != NULL) {
+            return string(dir);
+        }
+        return str(format("%s/dataseries-native-%d") % envOr("TMPDIR", "/tmp") % getuid());
+    }
+
+    /// create dir if needed, and make sure that nobody else can put code into it
+    bool privateDir(const string &dir) {
+        if (mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST) {
+            LintelLogDebug("NativeCode", format("can't create %s: %s") % dir % strerror(errno));
+            return false;
+        }
+        struct stat stat_buf;
+        if (stat(dir.c_str(), &stat_buf) != 0 || !S_ISDIR(stat_buf.st_mode)
+            || stat_buf.st_uid != getuid() || (stat_buf.st_mode & (S_IWGRP | S_IWOTH)) != 0) {
+            LintelLogDebug("NativeCode", format("not using %s, it is not a private directory")
+                           % dir);
+            return false;
+        }
+        return true;
+    }
+
+    bool readFile(const string &path, string &into) {
+        ifstream in(path.c_str());
+        if (!in) {
+            return false;
+        }
+        ostringstream data;
+        data << in.rdbuf();
+        into = data.str();
+        return true;
+    }
+
+    bool writeFile(const string &path, const string &data) {
+        ofstream out(path.c_str());
+        out << data;
+        out.close();
+        return !out.fail();
+    }
+
+    string quote(const string &path) {
+        INVARIANT(path.find('\'') == string::npos, format("can't quote path %s") % path);
+        return "'" + path + "'";
+    }
+
+    const string prelude_source(
+        "#include <stdint.h>\n"
+        "#include <string.h>\n"
+        "\n"
+        "#include <Lintel/Double.hpp>\n"
+        "\n"
+        "namespace {\n"
+        "    struct Str {\n"
+        "        const uint8_t *data;\n"
+        "        int32_t size;\n"
+        "    };\n"
+        "\n"
+        "    template<typename T> inline T load(const uint8_t *row, int32_t offset) {\n"
+        "        return *reinterpret_cast<const T *>(row + offset);\n"
+        "    }\n"
+        "\n"
+        "    inline bool loadBool(const uint8_t *row, int32_t offset, uint8_t mask) {\n"
+        "        return (row[offset] & mask) != 0;\n"
+        "    }\n"
+        "\n"
+        "    inline bool isNull(const uint8_t *row, int32_t offset, uint8_t mask) {\n"
+        "        return (row[offset] & mask) != 0;\n"
+        "    }\n"
+        "\n"
+        "    inline Str makeStr(const char *data, int32_t size) {\n"
+        "        Str ret = { reinterpret_cast<const uint8_t *>(data), size };\n"
+        "        return ret;\n"
+        "    }\n"
+        "\n"
+        "    inline Str loadStr(const uint8_t *row, int32_t offset, const uint8_t *vardata) {\n"
+        "        int32_t var_offset = load<int32_t>(row, offset);\n"
+        "        Str ret = { vardata + var_offset + 4, load<int32_t>(vardata, var_offset) };\n"
+        "        return ret;\n"
+        "    }\n"
+        "\n"
+        "    inline int compare(const Str &a, const Str &b) {\n"
+        "        int ret = memcmp(a.data, b.data, a.size < b.size ? a.size : b.size);\n"
+        "        if (ret != 0) {\n"
+        "            return ret;\n"
+        "        }\n"
+        "        return a.size < b.size ? -1 : (a.size > b.size ? 1 : 0);\n"
+        "    }\n"
+        "\n"
+        "    inline bool equal(const Str &a, const Str &b) {\n"
+        "        return a.size == b.size && memcmp(a.data, b.data, a.size) == 0;\n"
+        "    }\n"
+        "}\n"
+        "\n");
+}
+
+NativeCode::~NativeCode() {
+    dlclose(handle);
+}
+
+bool NativeCode::enabled() {
+    if (enabled_state < 0) {
+        enabled_state = envOr("DATASERIES_NATIVE_CODE", "0") == "1" ? 1 : 0;
+    }
+    return enabled_state == 1;
+}
+
+void NativeCode::setEnabled(bool enabled) {
+    enabled_state = enabled ? 1 : 0;
+}
+
+NativeCode::Ptr NativeCode::compile(const string &source) {
+    if (!enabled()) {
+        return Ptr();
+    }
+    string cxx(envOr("DATASERIES_NATIVE_CXX", DATASERIES_NATIVE_CXX));
+    string cxxflags(envOr("DATASERIES_NATIVE_CXXFLAGS", DATASERIES_NATIVE_CXXFLAGS));
+    // the compiler is part of the source so that changing it changes the hash
+    string full(str(format("// %s %s\n") % cxx % cxxflags) + prelude() + source);
+
+    string dir(cacheDir());
+    uint32_t a = lintel::bobJenkinsHash(1972, full.data(), full.size());
+    uint32_t b = lintel::bobJenkinsHash(2013, full.data(), full.size());
+    string base(str(format("%s/%08x%08x") % dir % a % b));
+    string so_path(base + ".so"), src_path(base + ".cpp");
+
+    PThreadScopedLock lock(compile_mutex);
+    if (!privateDir(dir)) {
+        return Ptr();
+    }
+    // the .so is renamed into place before the .cpp, so a matching .cpp means a complete .so,
+    // and comparing the whole source catches hash collisions.
+    string cached;
+    if (readFile(src_path, cached) && cached == full && access(so_path.c_str(), R_OK) == 0) {
+        LintelLogDebug("NativeCode", format("cache hit on %s") % so_path);
+    } else {
+        if (compiler_missing) {
+            return Ptr();
+        }
+        string tmp_base(str(format("%s.%d") % base % getpid()));
+        string tmp_src(tmp_base + ".cpp"), tmp_so(tmp_base + ".so"), log_path(base + ".log");
+        if (!writeFile(tmp_src, full)) {
+            LintelLogDebug("NativeCode", format("can't write %s") % tmp_src);
+            return Ptr();
+        }
+        string cmd(str(format("%s %s -O2 -fPIC -shared -o %s %s >%s 2>&1")
+                       % cxx % cxxflags % quote(tmp_so) % quote(tmp_src) % quote(log_path)));
+        LintelLogDebug("NativeCode", format("running %s") % cmd);
+        int status = system(cmd.c_str());
+        if (status != 0) {
+            unlink(tmp_src.c_str());
+            unlink(tmp_so.c_str());
+            if (WIFEXITED(status) && WEXITSTATUS(status) == 127) {
+                compiler_missing = true; // the shell couldn't find the compiler
+            }
+            LintelLogDebug("NativeCode", format("'%s' failed with status %d, see %s")
+                           % cmd % status % log_path);
+            return Ptr();
+        }
+        if (rename(tmp_so.c_str(), so_path.c_str()) != 0
+            || rename(tmp_src.c_str(), src_path.c_str()) != 0) {
+            LintelLogDebug("NativeCode", format("can't rename into %s: %s")
+                           % so_path % strerror(errno));
+            unlink(tmp_src.c_str());
+            unlink(tmp_so.c_str());
+            return Ptr();
+        }
+        unlink(log_path.c_str());
+    }
+
+    void *handle = dlopen(so_path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL) {
+        LintelLogDebug("NativeCode", format("can't load %s: %s") % so_path % dlerror());
+        return Ptr();
+    }
+    return Ptr(new NativeCode(handle, so_path));
+}
+
+void *NativeCode::lookup(const string &symbol) const {
+    return dlsym(handle, symbol.c_str());
+}
+
+const string &NativeCode::prelude() {
+    return prelude_source;
+}
+
+string NativeCode::isNull(const ExtentType &type, const string &column, const string &row_var) {
+    if (!type.getNullable(column)) {
+        return "false";
+    }
+    string null_column(ExtentType::nullableFieldname(column));
+    return str(format("isNull(%s, %d, %d)") % row_var % type.getOffset(null_column)
+               % (1 << type.getBitPos(null_column)));
+}
+
+string NativeCode::value(const ExtentType &type, const string &column, const string &row_var,
+                         const string &vardata_var) {
+    int32_t offset = type.getOffset(column);
+    string load, null_value("0");
+    switch (type.getFieldType(column))
+        {
+        case ExtentType::ft_bool:
+            load = str(format("loadBool(%s, %d, %d)") % row_var % offset
+                       % (1 << type.getBitPos(column)));
+            null_value = "false";
+            break;
+        case ExtentType::ft_byte:
+            load = str(format("load<uint8_t>(%s, %d)") % row_var % offset);
+            null_value = "uint8_t(0)";
+            break;
+        case ExtentType::ft_int32:
+            load = str(format("load<int32_t>(%s, %d)") % row_var % offset);
+            null_value = "int32_t(0)";
+            break;
+        case ExtentType::ft_int64:
+            load = str(format("load<int64_t>(%s, %d)") % row_var % offset);
+            null_value = "int64_t(0)";
+            break;
+        case ExtentType::ft_double:
+            load = str(format("load<double>(%s, %d)") % row_var % offset);
+            null_value = "0.0";
+            break;
+        case ExtentType::ft_variable32:
+            load = str(format("loadStr(%s, %d, %s)") % row_var % offset % vardata_var);
+            null_value = literal("");
+            break;
+        default:
+            return string();
+        }
+    if (!type.getNullable(column)) {
+        return load;
+    }
+    return str(format("(%s ? %s : %s)") % isNull(type, column, row_var) % null_value % load);
+}
+
+string NativeCode::literal(const string &bytes) {
+    // octal escapes are at most 3 digits, so unlike \x they can't run into the next byte
+    string escaped;
+    for (size_t i = 0; i < bytes.size(); ++i) {
+        escaped.append(str(format("\\%03o") % static_cast<unsigned>(
+                               static_cast<uint8_t>(bytes[i]))));
+    }
+    return str(format("makeStr(\"%s\", %d)") % escaped % bytes.size());
+}
+
+string NativeCode::comment(const string &text) {
+    string ret("// ");
+    for (size_t i = 0; i < text.size(); ++i) {
+        ret.push_back(text[i]);
+        if (text[i] == '\n' && i + 1 < text.size()) {
+            ret.append("// ");
+        }
+    }
+    if (ret.empty() || ret[ret.size() - 1] != '\n') {
+        ret.push_back('\n');
+    }
+    return ret;
+}
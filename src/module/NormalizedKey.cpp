@@ -0,0 +1,280 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    implementation
+*/
+
+#include <boost/format.hpp>
+
+#include <DataSeries/NormalizedKey.hpp>
+
+using namespace std;
+using boost::format;
+using namespace dataseries;
+
+// Normalized keys are, for each key field, a byte that is 0 for null and 1 otherwise, and then
+// for non-null values the value encoded so that memcmp orders keys like the values: integers
+// big endian with the sign bit flipped, doubles (with any opt_doublebase added back, so keys
+// from types with different bases compare) with the sign bit flipped for positive values
+// and all the bits flipped for negative ones, variable32 values with 0 bytes escaped as 0 0xFF
+// and terminated by 0 0, and fixedwidth values as is.  Every field's encoding is self
+// delimiting, so no key is a prefix of another.
+
+class KeyEncoder::Column {
+  public:
+    virtual ~Column() { }
+    /// called with the extent newly set in the series before encode()
+    virtual void newExtent(const Extent &e) = 0;
+    /// append the normalized value of row to into
+    virtual void encode(uint32_t row, string &into) const = 0;
+    /// decode the normalized value at p into the null GeneralValue into, and advance p past it
+    virtual void decode(const uint8_t *&p, GeneralValue &into) const = 0;
+};
+
+namespace {
+    void putBigEndian(uint64_t v, int bytes, string &into) {
+        for (int i = bytes - 1; i >= 0; --i) {
+            into.push_back(static_cast<char>((v >> (8 * i)) & 0xFF));
+        }
+    }
+
+    uint64_t getBigEndian(const uint8_t *&p, int bytes) {
+        uint64_t ret = 0;
+        for (int i = 0; i < bytes; ++i) {
+            ret = (ret << 8) | *p++;
+        }
+        return ret;
+    }
+
+    const uint64_t sign64 = static_cast<uint64_t>(1) << 63;
+
+    void putKey(bool v, string &into) { into.push_back(v ? 1 : 0); }
+    void putKey(uint8_t v, string &into) { into.push_back(static_cast<char>(v)); }
+    void putKey(int32_t v, string &into) {
+        putBigEndian(static_cast<uint32_t>(v) ^ 0x80000000U, 4, into);
+    }
+    void putKey(int64_t v, string &into) {
+        putBigEndian(static_cast<uint64_t>(v) ^ sign64, 8, into);
+    }
+    void putKey(double v, string &into) {
+        if (v == 0) {
+            v = 0; // -0 and 0 are the same group
+        }
+        uint64_t u;
+        memcpy(&u, &v, sizeof(u));
+        putBigEndian((u & sign64) ? ~u : u | sign64, 8, into);
+    }
+
+    void getKey(const uint8_t *&p, GeneralValue &into, bool) { into.setBool(*p++ != 0); }
+    void getKey(const uint8_t *&p, GeneralValue &into, uint8_t) { into.setByte(*p++); }
+    void getKey(const uint8_t *&p, GeneralValue &into, int32_t) {
+        into.setInt32(static_cast<int32_t>(getBigEndian(p, 4) ^ 0x80000000U));
+    }
+    void getKey(const uint8_t *&p, GeneralValue &into, int64_t) {
+        into.setInt64(static_cast<int64_t>(getBigEndian(p, 8) ^ sign64));
+    }
+    void getKey(const uint8_t *&p, GeneralValue &into, double) {
+        uint64_t u = getBigEndian(p, 8);
+        u = (u & sign64) ? u & ~sign64 : ~u;
+        double v;
+        memcpy(&v, &u, sizeof(v));
+        into.setDouble(v);
+    }
+
+    /// the value of a field in a key; raw is as stored in the extent
+    template<class FieldT, typename T> T keyValue(const FieldT &, T raw) { return raw; }
+    double keyValue(const DoubleField &field, double raw) { return raw + field.base_val; }
+
+    template<class FieldT, typename T> class FixedKeyColumn : public KeyEncoder::Column {
+      public:
+        FixedKeyColumn(ExtentSeries &series, const string &name, int flags = 0)
+            : field(series, name, Field::flag_nullable | flags) { }
+
+        virtual void newExtent(const Extent &) {
+            span = field.span();
+        }
+
+        virtual void encode(uint32_t row, string &into) const {
+            if (span.isNull(row)) {
+                into.push_back(0);
+            } else {
+                into.push_back(1);
+                putKey(keyValue(field, span.raw(row)), into);
+            }
+        }
+
+        virtual void decode(const uint8_t *&p, GeneralValue &into) const {
+            if (*p++ != 0) {
+                getKey(p, into, T());
+            }
+        }
+
+      private:
+        FieldT field;
+        dataseries::ColumnSpan<T> span;
+    };
+
+    class Variable32KeyColumn : public KeyEncoder::Column {
+      public:
+        Variable32KeyColumn(ExtentSeries &series, const string &name)
+            : field(series, name, Field::flag_nullable) { }
+
+        virtual void newExtent(const Extent &) {
+            span = field.span();
+        }
+
+        virtual void encode(uint32_t row, string &into) const {
+            if (span.isNull(row)) {
+                into.push_back(0);
+                return;
+            }
+            into.push_back(1);
+            dataseries::Variable32Ref v(span.raw(row));
+            for (int32_t i = 0; i < v.size; ++i) {
+                into.push_back(static_cast<char>(v.data[i]));
+                if (v.data[i] == 0) {
+                    into.push_back(static_cast<char>(0xFF));
+                }
+            }
+            into.push_back(0);
+            into.push_back(0);
+        }
+
+        virtual void decode(const uint8_t *&p, GeneralValue &into) const {
+            if (*p++ == 0) {
+                return;
+            }
+            string v;
+            while (true) {
+                if (p[0] != 0) {
+                    v.push_back(static_cast<char>(*p++));
+                } else if (p[1] == 0) {
+                    p += 2;
+                    break;
+                } else {
+                    DEBUG_SINVARIANT(p[1] == 0xFF);
+                    v.push_back(0);
+                    p += 2;
+                }
+            }
+            into.setVariable32(v);
+        }
+
+      private:
+        Variable32Field field;
+        dataseries::Variable32Span span;
+    };
+
+    class FixedWidthKeyColumn : public KeyEncoder::Column {
+      public:
+        FixedWidthKeyColumn(ExtentSeries &series, const string &name)
+            : field(series, name, Field::flag_nullable), extent(NULL), stride(0) { }
+
+        virtual void newExtent(const Extent &e) {
+            extent = &e;
+            stride = e.getTypePtr()->fixedrecordsize();
+        }
+
+        virtual void encode(uint32_t row, string &into) const {
+            dataseries::SEP_RowOffset offset(row * stride, extent);
+            if (field.isNull(*extent, offset)) {
+                into.push_back(0);
+            } else {
+                into.push_back(1);
+                into.append(reinterpret_cast<const char *>(field.val(*extent, offset)),
+                            field.size());
+            }
+        }
+
+        virtual void decode(const uint8_t *&p, GeneralValue &into) const {
+            if (*p++ != 0) {
+                into.setFixedWidth(string(reinterpret_cast<const char *>(p), field.size()));
+                p += field.size();
+            }
+        }
+
+      private:
+        FixedWidthField field;
+        const Extent *extent;
+        uint32_t stride;
+    };
+}
+
+KeyEncoder::~KeyEncoder() {
+    for (vector<Column *>::iterator i = columns.begin(); i != columns.end(); ++i) {
+        delete *i;
+    }
+}
+
+void KeyEncoder::init(ExtentSeries &series, const vector<string> &field_names) {
+    SINVARIANT(columns.empty());
+    this->series = &series;
+    const ExtentType &type(*series.getTypePtr());
+    for (vector<string>::const_iterator i = field_names.begin(); i != field_names.end(); ++i) {
+        Column *column;
+        switch (type.getFieldType(*i))
+            {
+            case ExtentType::ft_bool:
+                column = new FixedKeyColumn<BoolField, bool>(series, *i);
+                break;
+            case ExtentType::ft_byte:
+                column = new FixedKeyColumn<ByteField, uint8_t>(series, *i);
+                break;
+            case ExtentType::ft_int32:
+                column = new FixedKeyColumn<Int32Field, int32_t>(series, *i);
+                break;
+            case ExtentType::ft_int64:
+                column = new FixedKeyColumn<Int64Field, int64_t>(series, *i);
+                break;
+            case ExtentType::ft_double:
+                column = new FixedKeyColumn<DoubleField, double>
+                    (series, *i, DoubleField::flag_allownonzerobase);
+                break;
+            case ExtentType::ft_variable32:
+                column = new Variable32KeyColumn(series, *i);
+                break;
+            case ExtentType::ft_fixedwidth:
+                column = new FixedWidthKeyColumn(series, *i);
+                break;
+            default:
+                FATAL_ERROR(format("unsupported type for key field %s") % *i);
+            }
+        columns.push_back(column);
+    }
+}
+
+void KeyEncoder::encodeRows(uint32_t nrows, const RowSelection *selection, string &keys,
+                            vector<uint32_t> &offsets) {
+    keys.clear();
+    size_t nselected = selection == NULL ? nrows : selection->size();
+    offsets.resize(nselected + 1);
+    if (nselected == 0) {
+        offsets[0] = 0;
+        return;
+    }
+    const Extent &e(series->getExtentRef());
+    for (vector<Column *>::iterator i = columns.begin(); i != columns.end(); ++i) {
+        (**i).newExtent(e);
+    }
+    for (size_t i = 0; i < nselected; ++i) {
+        offsets[i] = keys.size();
+        uint32_t row = selection == NULL ? i : (*selection)[i];
+        for (vector<Column *>::iterator j = columns.begin(); j != columns.end(); ++j) {
+            (**j).encode(row, keys);
+        }
+    }
+    offsets[nselected] = keys.size();
+}
+
+void KeyEncoder::decode(const uint8_t *key, vector<GeneralValue> &into) const {
+    into.clear();
+    into.resize(columns.size());
+    for (size_t i = 0; i < columns.size(); ++i) {
+        columns[i]->decode(key, into[i]);
+    }
+}
@@ -0,0 +1,180 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    implementation
+*/
+
+#include <Lintel/LintelLog.hpp>
+
+#include <DataSeries/ParallelRowAnalysisModule.hpp>
+
+using namespace std;
+using boost::format;
+
+class ParallelRowAnalysisModuleWorker : public PThread {
+  public:
+    ParallelRowAnalysisModuleWorker(ParallelRowAnalysisModule &_pram, unsigned _thread_num)
+    : pram(_pram), thread_num(_thread_num) { }
+
+    virtual ~ParallelRowAnalysisModuleWorker() { }
+
+    virtual void *run() {
+        pram.workerThread(thread_num);
+        return NULL;
+    }
+    ParallelRowAnalysisModule &pram;
+    unsigned thread_num;
+};
+
+ParallelRowAnalysisModule::ParallelRowAnalysisModule(DataSeriesModule &source, Factory &factory,
+                                                     int _nthreads, size_t max_queued_bytes)
+    : RowAnalysisModule(source), steals(0), factory(factory), nthreads(0), next_queue(0), 
+      queued_bytes(0), max_queued_bytes(max_queued_bytes), source_done(false), merged(false)
+{
+    if (_nthreads == -1) {
+        nthreads = min(PThreadMisc::getNCpus(), MAX_THREADS/2);
+    } else {
+        SINVARIANT(_nthreads > 0);
+        nthreads = static_cast<unsigned>(_nthreads);
+    }
+    SINVARIANT(max_queued_bytes > 0);
+}
+
+ParallelRowAnalysisModule::~ParallelRowAnalysisModule() {
+    INVARIANT(workers.empty(), "deleting ParallelRowAnalysisModule while workers are running");
+    for (vector<Analysis *>::iterator i = analyses.begin(); i != analyses.end(); ++i) {
+        delete *i;
+    }
+}
+
+void ParallelRowAnalysisModule::startWorkers() {
+    SINVARIANT(analyses.empty() && workers.empty());
+    queues.resize(nthreads);
+    for (unsigned i = 0; i < nthreads; ++i) {
+        analyses.push_back(factory(source));
+        SINVARIANT(analyses.back() != NULL);
+        if (!where_expr_str.empty()) {
+            analyses.back()->setWhereExpr(where_expr_str);
+        }
+    }
+    prepared = true; // where_expr_str is now fixed
+    for (unsigned i = 0; i < nthreads; ++i) {
+        workers.push_back(new ParallelRowAnalysisModuleWorker(*this, i));
+        workers.back()->start();
+    }
+}
+
+Extent::Ptr ParallelRowAnalysisModule::getSharedExtent() {
+    if (merged) {
+        return Extent::Ptr();
+    }
+    if (workers.empty()) {
+        startWorkers();
+    }
+    Extent::Ptr e = source.getSharedExtent();
+    if (e == NULL) {
+        completeProcessing();
+        return e;
+    }
+
+    PThreadScopedLock lock(mutex);
+    while (queued_bytes > 0 && queued_bytes + e->size() > max_queued_bytes) {
+        space_cond.wait(mutex);
+    }
+    queues[next_queue].push_back(e);
+    next_queue = (next_queue + 1) % nthreads;
+    queued_bytes += e->size();
+    // the owner of the queue may be busy, let anyone that is idle steal it.
+    work_cond.broadcast();
+    return e;
+}
+
+void ParallelRowAnalysisModule::workerThread(unsigned thread_num) {
+    Analysis &analysis(*analyses[thread_num]);
+    PThreadScopedLock lock(mutex);
+    while (true) {
+        Extent::Ptr e;
+        if (!queues[thread_num].empty()) {
+            e = queues[thread_num].front();
+            queues[thread_num].pop_front();
+        } else {
+            // steal from the back so the owner keeps working from the front
+            for (unsigned i = 1; i < nthreads; ++i) {
+                deque<Extent::Ptr> &victim(queues[(thread_num + i) % nthreads]);
+                if (!victim.empty()) {
+                    e = victim.back();
+                    victim.pop_back();
+                    ++steals;
+                    break;
+                }
+            }
+        }
+        if (e == NULL) {
+            if (source_done) {
+                break;
+            }
+            work_cond.wait(mutex);
+            continue;
+        }
+        SINVARIANT(queued_bytes >= e->size());
+        queued_bytes -= e->size();
+        space_cond.signal();
+        {
+            PThreadScopedUnlock unlock(lock);
+            analysis.processExtent(e);
+        }
+    }
+}
+
+void ParallelRowAnalysisModule::processRow() {
+    FATAL_ERROR("ParallelRowAnalysisModule::processRow should never be called");
+}
+
+void ParallelRowAnalysisModule::BatchAnalysis::processRow() {
+    FATAL_ERROR("ParallelRowAnalysisModule::BatchAnalysis::processRow should never be called");
+}
+
+void ParallelRowAnalysisModule::completeProcessing() {
+    if (merged) {
+        return;
+    }
+    if (workers.empty()) {
+        startWorkers(); // no extents; still want a (empty) merged analysis
+    }
+    {
+        PThreadScopedLock lock(mutex);
+        source_done = true;
+        work_cond.broadcast();
+    }
+    for (vector<PThread *>::iterator i = workers.begin(); i != workers.end(); ++i) {
+        (**i).join();
+        delete *i;
+    }
+    workers.clear();
+    SINVARIANT(queued_bytes == 0);
+
+    Analysis &into(*analyses.front());
+    processed_rows = into.processed_rows;
+    ignored_rows = into.ignored_rows;
+    for (vector<Analysis *>::iterator i = analyses.begin() + 1; i != analyses.end(); ++i) {
+        into.merge(**i);
+        processed_rows += (**i).processed_rows;
+        ignored_rows += (**i).ignored_rows;
+    }
+    into.processed_rows = processed_rows;
+    into.ignored_rows = ignored_rows;
+    LintelLogDebug("ParallelRowAnalysisModule", format("merged %d analyses, %d steals")
+                   % analyses.size() % steals);
+    into.completeProcessing();
+    merged = true;
+}
+
+void ParallelRowAnalysisModule::printResult() {
+    INVARIANT(merged, "printResult called before processing completed");
+    analyses.front()->printResult();
+}
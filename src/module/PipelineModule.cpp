@@ -0,0 +1,113 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    implementation
+*/
+
+#include <boost/format.hpp>
+
+#include <Lintel/Clock.hpp>
+
+#include <DataSeries/PipelineModule.hpp>
+
+using namespace std;
+using boost::format;
+
+PipelineModule::PipelineModule(DataSeriesModule *head, unsigned max_queue_memory)
+    : SequenceModule(head), max_queue_memory(max_queue_memory), tail_time(0) { }
+
+PipelineModule::PipelineModule(DsmPtr head, unsigned max_queue_memory)
+    : SequenceModule(head), max_queue_memory(max_queue_memory), tail_time(0) { }
+
+PipelineModule::~PipelineModule() {
+    // a queue's thread may be reading from the queue before it, so stop the later ones first
+    for (vector<PrefetchBufferModule *>::reverse_iterator i = queues.rbegin();
+         i != queues.rend(); ++i) {
+        delete *i;
+    }
+}
+
+DataSeriesModule &PipelineModule::tail() {
+    queues.resize(size(), NULL);
+    if (queues.back() == NULL) {
+        queues.back() = new PrefetchBufferModule(SequenceModule::tail(), max_queue_memory);
+    }
+    return *queues.back();
+}
+
+Extent::Ptr PipelineModule::getSharedExtent() {
+    DataSeriesModule &from(lastStage());
+    Clock::Tdbl start = Clock::tod();
+    Extent::Ptr ret = from.getSharedExtent();
+    tail_time += Clock::tod() - start;
+    return ret;
+}
+
+Extent::Ptr PipelineModule::getSelectedExtent(const dataseries::RowSelection *&selection) {
+    DataSeriesModule &from(lastStage());
+    Clock::Tdbl start = Clock::tod();
+    Extent::Ptr ret = from.getSelectedExtent(selection);
+    tail_time += Clock::tod() - start;
+    return ret;
+}
+
+Extent *PipelineModule::getExtent() {
+    DataSeriesModule &from(lastStage());
+    Clock::Tdbl start = Clock::tod();
+    Extent *ret = from.getExtent();
+    tail_time += Clock::tod() - start;
+    return ret;
+}
+
+DataSeriesModule &PipelineModule::lastStage() {
+    queues.resize(size(), NULL);
+    // normally nothing reads a queue after the last module, so it runs on this thread
+    return queues.back() == NULL ? SequenceModule::tail() : *queues.back();
+}
+
+vector<PipelineModule::StageTimes> PipelineModule::getStageTimes() {
+    queues.resize(size(), NULL);
+    vector<PrefetchBufferModule::Times> times(queues.size());
+    for (size_t i = 0; i < queues.size(); ++i) {
+        if (queues[i] != NULL) {
+            times[i] = queues[i]->getTimes();
+        } else if (i + 1 == queues.size()) {
+            times[i].source = tail_time;
+        }
+    }
+
+    // A module's time getting extents includes its time waiting for them from the queue
+    // before it; a module with no queue after it runs as part of the next module's stage.
+    vector<StageTimes> ret(queues.size());
+    double input_wait = 0;
+    for (size_t i = 0; i < queues.size(); ++i) {
+        if (queues[i] == NULL && i + 1 < queues.size()) {
+            continue;
+        }
+        ret[i].busy = times[i].source - input_wait;
+        ret[i].idle = input_wait + times[i].full;
+        input_wait = times[i].empty;
+    }
+    return ret;
+}
+
+void PipelineModule::printStageTimes(ostream &to) {
+    vector<StageTimes> times(getStageTimes());
+    size_t slowest = 0;
+    for (size_t i = 1; i < times.size(); ++i) {
+        if (times[i].busy > times[slowest].busy) {
+            slowest = i;
+        }
+    }
+    for (size_t i = 0; i < times.size(); ++i) {
+        double total = times[i].busy + times[i].idle;
+        to << format("# pipeline stage %d: busy %.3fs, idle %.3fs, %.0f%% busy%s\n")
+            % i % times[i].busy % times[i].idle % (total > 0 ? 100 * times[i].busy / total : 0)
+            % (i == slowest ? " (slowest)" : "");
+    }
+}
@@ -9,6 +9,8 @@
     implementation
 */
 
+#include <Lintel/Clock.hpp>
+
 #include <DataSeries/PrefetchBufferModule.hpp>
 
 /** Note: we special case the code when we are compiling in profile mode because
@@ -69,7 +71,9 @@ Extent::Ptr PrefetchBufferModule::getSharedExtent() {
         } else {
             start_prefetching = true;
             cond.signal();
+            Clock::Tdbl wait_start = Clock::tod();
             cond.wait(mutex);
+            times.empty += Clock::tod() - wait_start;
         }
     }
     mutex.unlock();
@@ -101,8 +105,11 @@ void PrefetchBufferModule::prefetcherThread() {
     while (abort_prefetching == false) {
         if (cur_used_memory < max_used_memory) {
             mutex.unlock();
+            Clock::Tdbl get_start = Clock::tod();
             Extent::Ptr e = source.getSharedExtent();
+            Clock::Tdbl get_time = Clock::tod() - get_start;
             mutex.lock();
+            times.source += get_time;
             if (e == NULL) {
                 source_done = true;
                 cond.signal();
@@ -113,9 +120,16 @@ void PrefetchBufferModule::prefetcherThread() {
             cur_used_memory += e->size();
         } else {
             SINVARIANT(buffer.empty() == false);
+            Clock::Tdbl wait_start = Clock::tod();
             cond.wait(mutex);
+            times.full += Clock::tod() - wait_start;
         }
     }
     mutex.unlock();
 }
 
+PrefetchBufferModule::Times PrefetchBufferModule::getTimes() {
+    PThreadScopedLock lock(mutex);
+    return times;
+}
+
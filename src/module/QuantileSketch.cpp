@@ -0,0 +1,254 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    implementation
+*/
+
+#include <math.h>
+
+#include <algorithm>
+
+#include <boost/format.hpp>
+
+#include <Lintel/AssertBoost.hpp>
+#include <Lintel/StatsQuantile.hpp>
+
+#include <DataSeries/QuantileSketch.hpp>
+
+using namespace std;
+using boost::format;
+
+namespace dataseries {
+
+namespace {
+    // compactor i from the top holds k * (2/3)^i values, but at least min_capacity
+    const double capacity_decay = 2.0 / 3.0;
+    const uint32_t min_capacity = 8;
+    // rank error is about error_scale / k with high probability
+    const double error_scale = 1.7;
+    const uint32_t coin_seed = 0x9E3779B9;
+}
+
+QuantileSketch::QuantileSketch(double error)
+    : k(static_cast<uint32_t>(ceil(error_scale / error))), nitems(0), capacity(0),
+      coin(coin_seed)
+{
+    INVARIANT(error > 0 && error < 1, format("invalid quantile sketch error %g") % error);
+    k = std::max(k, min_capacity);
+    updateCapacity();
+}
+
+QuantileSketch::~QuantileSketch() { }
+
+void QuantileSketch::reset() {
+    Stats::reset();
+    levels.clear();
+    nitems = 0;
+    coin = coin_seed;
+    updateCapacity();
+}
+
+void QuantileSketch::add(const double value) {
+    Stats::add(value);
+    if (levels.empty()) {
+        levels.resize(1);
+        updateCapacity();
+    }
+    levels[0].push_back(value);
+    ++nitems;
+    if (nitems >= capacity) {
+        compress();
+    }
+}
+
+void QuantileSketch::add(const QuantileSketch &from) {
+    INVARIANT(k == from.k, format("can't merge quantile sketches with k %d and %d")
+              % k % from.k);
+    Stats::add(from);
+    if (levels.size() < from.levels.size()) {
+        levels.resize(from.levels.size());
+        updateCapacity();
+    }
+    for (size_t i = 0; i < from.levels.size(); ++i) {
+        levels[i].insert(levels[i].end(), from.levels[i].begin(), from.levels[i].end());
+    }
+    nitems += from.nitems;
+    compress();
+}
+
+uint32_t QuantileSketch::levelCapacity(size_t level) const {
+    return std::max(min_capacity, static_cast<uint32_t>
+                    (ceil(k * pow(capacity_decay, levels.size() - 1 - level))));
+}
+
+void QuantileSketch::updateCapacity() {
+    capacity = min_capacity;
+    if (!levels.empty()) {
+        capacity = 0;
+        for (size_t i = 0; i < levels.size(); ++i) {
+            capacity += levelCapacity(i);
+        }
+    }
+}
+
+void QuantileSketch::compress() {
+    while (nitems >= capacity) {
+        // compact the lowest full level; one must be full if the sketch is
+        size_t level = 0;
+        while (level < levels.size() && levels[level].size() < levelCapacity(level)) {
+            ++level;
+        }
+        SINVARIANT(level < levels.size());
+        if (level + 1 == levels.size()) {
+            levels.resize(levels.size() + 1);
+            updateCapacity();
+        }
+        vector<double> &from(levels[level]), &to(levels[level + 1]);
+        sort(from.begin(), from.end());
+
+        // an odd value out stays behind; of the rest, every other one moves up
+        size_t keep = from.size() % 2;
+        coin ^= coin << 13;
+        coin ^= coin >> 17;
+        coin ^= coin << 5;
+        for (size_t i = keep + (coin & 1); i < from.size(); i += 2) {
+            to.push_back(from[i]);
+        }
+        nitems -= (from.size() - keep) / 2;
+        from.resize(keep);
+    }
+}
+
+void QuantileSketch::weightedItems(Weighted &into) const {
+    into.clear();
+    into.reserve(nitems);
+    for (size_t i = 0; i < levels.size(); ++i) {
+        for (vector<double>::const_iterator j = levels[i].begin(); j != levels[i].end(); ++j) {
+            into.push_back(make_pair(*j, static_cast<uint64_t>(1) << i));
+        }
+    }
+    sort(into.begin(), into.end());
+}
+
+double QuantileSketch::quantileOf(const Weighted &items, uint64_t total, double quantile) {
+    double target = quantile * total;
+    uint64_t seen = 0;
+    for (Weighted::const_iterator i = items.begin(); i != items.end(); ++i) {
+        seen += i->second;
+        if (seen >= target) {
+            return i->first;
+        }
+    }
+    return items.back().first;
+}
+
+double QuantileSketch::getQuantile(double quantile) const {
+    INVARIANT(countll() > 0, "no values in quantile sketch");
+    INVARIANT(quantile >= 0 && quantile <= 1, format("invalid quantile %g") % quantile);
+    if (quantile == 0) {
+        return min();
+    } else if (quantile == 1) {
+        return max();
+    }
+    Weighted items;
+    weightedItems(items);
+    return quantileOf(items, countll(), quantile);
+}
+
+void QuantileSketch::printTextRanges(ostream &to, int nranges) const {
+    to << format("%d data points, mean %.6g +- %.6g [%.6g,%.6g]\n")
+        % countll() % mean() % stddev() % min() % max();
+    if (countll() == 0) {
+        return;
+    }
+    to << format("    quantiles every %.3g%%, rank error about %.2g%%:\n")
+        % (100.0 / nranges) % (100 * error());
+    Weighted items;
+    weightedItems(items);
+    for (int i = 1; i < nranges; ++i) {
+        if ((i - 1) % 10 == 0) {
+            to << format("    %.3g%%: ") % (100.0 * i / nranges);
+        } else {
+            to << ", ";
+        }
+        to << format("%.8g") % quantileOf(items, countll(), static_cast<double>(i) / nranges);
+        if ((i - 1) % 10 == 9 || i == nranges - 1) {
+            to << "\n";
+        }
+    }
+}
+
+void QuantileSketch::printText(ostream &to) const {
+    printTextRanges(to, 10);
+    if (countll() == 0) {
+        return;
+    }
+    static const double tails[] = { 0.95, 0.99, 0.995, 0.999 };
+    Weighted items;
+    weightedItems(items);
+    to << "  tails: ";
+    for (size_t i = 0; i < sizeof(tails) / sizeof(tails[0]); ++i) {
+        to << format("%s%.3g%%: %.8g") % (i == 0 ? "" : ", ") % (100 * tails[i])
+            % quantileOf(items, countll(), tails[i]);
+    }
+    to << "\n";
+}
+
+size_t QuantileSketch::memoryUsage() const {
+    size_t ret = sizeof(*this) + levels.capacity() * sizeof(vector<double>);
+    for (size_t i = 0; i < levels.size(); ++i) {
+        ret += levels[i].capacity() * sizeof(double);
+    }
+    return ret;
+}
+
+double QuantileSketch::error() const {
+    return error_scale / k;
+}
+
+Stats *newQuantileStats(double sketch_error, double error, int64_t nbound) {
+    if (sketch_error > 0) {
+        return new QuantileSketch(sketch_error);
+    } else {
+        return new StatsQuantile(error, nbound);
+    }
+}
+
+double getQuantile(Stats &stats, double quantile) {
+    if (QuantileSketch *sketch = dynamic_cast<QuantileSketch *>(&stats)) {
+        return sketch->getQuantile(quantile);
+    } else {
+        return dynamic_cast<StatsQuantile &>(stats).getQuantile(quantile);
+    }
+}
+
+void mergeQuantiles(Stats &into, Stats &from) {
+    if (QuantileSketch *sketch = dynamic_cast<QuantileSketch *>(&into)) {
+        sketch->add(dynamic_cast<QuantileSketch &>(from));
+    } else {
+        dynamic_cast<StatsQuantile &>(into).add(dynamic_cast<StatsQuantile &>(from));
+    }
+}
+
+void printQuantileRanges(Stats &stats, ostream &to, int nranges) {
+    if (QuantileSketch *sketch = dynamic_cast<QuantileSketch *>(&stats)) {
+        sketch->printTextRanges(to, nranges);
+    } else {
+        dynamic_cast<StatsQuantile &>(stats).printTextRanges(to, nranges);
+    }
+}
+
+size_t quantileMemoryUsage(Stats &stats) {
+    if (QuantileSketch *sketch = dynamic_cast<QuantileSketch *>(&stats)) {
+        return sketch->memoryUsage();
+    } else {
+        return dynamic_cast<StatsQuantile &>(stats).memoryUsage();
+    }
+}
+
+}
@@ -9,6 +9,9 @@
     implementation
 */
 
+#include <algorithm>
+#include <iterator>
+
 #include <DataSeries/DSExpr.hpp>
 #include <DataSeries/RowAnalysisModule.hpp>
 #include <DataSeries/SequenceModule.hpp>
@@ -16,7 +19,8 @@
 RowAnalysisModule::RowAnalysisModule(DataSeriesModule &_source,
                                      ExtentSeries::typeCompatibilityT _tc)
         : processed_rows(0), ignored_rows(0), 
-          series(_tc), source(_source), prepared(false), where_expr(NULL)
+          series(_tc), source(_source), prepared(false), where_expr(NULL),
+          pass_selection(NULL)
 {
     SINVARIANT(&source != NULL);
 }
@@ -33,11 +37,31 @@ void RowAnalysisModule::firstExtent(const Extent &e) { }
 void RowAnalysisModule::prepareForProcessing() { }
 
 Extent::Ptr RowAnalysisModule::getSharedExtent() {
-    Extent::Ptr e = source.getSharedExtent();
+    const dataseries::RowSelection *input_selection;
+    Extent::Ptr e = source.getSelectedExtent(input_selection);
     if (e == NULL) {
         completeProcessing();
         return e;
     }
+    processExtent(e, input_selection);
+    if (pass_selection != NULL) {
+        *pass_selection = input_selection;
+        return e;
+    }
+    return materializeSelection(e, input_selection);
+}
+
+Extent::Ptr RowAnalysisModule::getSelectedExtent(const dataseries::RowSelection *&selection) {
+    // go through getSharedExtent() in case a subclass has overridden it
+    selection = NULL;
+    pass_selection = &selection;
+    Extent::Ptr e = getSharedExtent();
+    pass_selection = NULL;
+    return e;
+}
+
+void RowAnalysisModule::processExtent(const Extent::Ptr &e,
+                                      const dataseries::RowSelection *input_selection) {
     if (!prepared) {
         firstExtent(*e);
     }
@@ -50,20 +74,58 @@ Extent::Ptr RowAnalysisModule::getSharedExtent() {
             where_expr = DSExpr::make(series, where_expr_str);
         }
     }
-    for (;series.morerecords();++series) {
-        if (!where_expr || where_expr->valBool()) {
-            ++processed_rows;
-            processRow();
+    uint32_t nrows = e->nRecords();
+    uint32_t ninput = input_selection == NULL ? nrows : input_selection->size();
+    const dataseries::RowSelection *rows = input_selection;
+    if (where_expr != NULL) {
+        if (input_selection == NULL) {
+            where_expr->selectRows(series, selection);
         } else {
-            ++ignored_rows;
+            where_expr->selectRows(series, where_selection);
+            selection.clear();
+            std::set_intersection(input_selection->begin(), input_selection->end(),
+                                  where_selection.begin(), where_selection.end(),
+                                  std::back_inserter(selection));
+        }
+        rows = &selection;
+    }
+    if (rows == NULL) {
+        processed_rows += nrows;
+        processBatch(nrows, NULL);
+    } else {
+        processed_rows += rows->size();
+        ignored_rows += ninput - rows->size();
+        if (nrows > 0) {
+            series.setCurPos(e->fixeddata.begin());
         }
+        processBatch(nrows, rows);
     }
     series.clearExtent();
-    return e;
+}
+
+void RowAnalysisModule::processBatch(uint32_t nrows, const dataseries::RowSelection *selection) {
+    if (selection == NULL) {
+        for (; series.morerecords(); ++series) {
+            processRow();
+        }
+    } else {
+        const uint8_t *row0 = series.getExtentRef().fixeddata.begin();
+        uint32_t stride = series.getTypePtr()->fixedrecordsize();
+        for (dataseries::RowSelection::const_iterator i = selection->begin(); 
+             i != selection->end(); ++i) {
+            DEBUG_SINVARIANT(*i < nrows);
+            series.setCurPos(row0 + *i * stride);
+            processRow();
+        }
+    }
 }
 
 void RowAnalysisModule::completeProcessing() { }
 
+void BatchAnalysisModule::processRow() {
+    FATAL_ERROR("BatchAnalysisModule::processRow should never be called");
+}
+
 void RowAnalysisModule::printResult() { }
 
 void RowAnalysisModule::setWhereExpr(const std::string &expr) {
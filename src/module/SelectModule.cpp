@@ -0,0 +1,96 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    implementation
+*/
+
+#include <algorithm>
+#include <iterator>
+
+#include <DataSeries/SelectModule.hpp>
+
+using namespace std;
+using dataseries::RowSelection;
+
+SelectModule::SelectModule(DataSeriesModule &source, const string &where_expr,
+                           uint32_t target_extent_size)
+    : input_rows(0), selected_rows(0), source(source), where_expr_str(where_expr),
+      target_extent_size(target_extent_size), copier(input_series, output_series)
+{ }
+
+SelectModule::~SelectModule() { }
+
+Extent::Ptr SelectModule::getSelectedExtent(const RowSelection *&rows) {
+    while (true) {
+        const RowSelection *input_selection;
+        Extent::Ptr e = source.getSelectedExtent(input_selection);
+        if (e == NULL) {
+            rows = NULL;
+            return e;
+        }
+        if (where_expr == NULL) {
+            input_series.setType(e->getTypePtr());
+            where_expr.reset(DSExpr::make(input_series, where_expr_str));
+        }
+        input_series.setExtent(e);
+        if (input_selection == NULL) {
+            input_rows += e->nRecords();
+            where_expr->selectRows(input_series, selection);
+        } else {
+            input_rows += input_selection->size();
+            where_expr->selectRows(input_series, where_selection);
+            selection.clear();
+            set_intersection(input_selection->begin(), input_selection->end(),
+                             where_selection.begin(), where_selection.end(),
+                             back_inserter(selection));
+        }
+        input_series.clearExtent();
+        if (selection.empty()) {
+            continue;
+        }
+        selected_rows += selection.size();
+        rows = selection.size() == e->nRecords() ? NULL : &selection;
+        return e;
+    }
+}
+
+Extent::Ptr SelectModule::getSharedExtent() {
+    while (true) {
+        const RowSelection *rows;
+        Extent::Ptr in = getSelectedExtent(rows);
+        if (in == NULL) {
+            break;
+        }
+        if (rows == NULL && !output_series.hasExtent()) {
+            return in; // nothing to copy
+        }
+        if (output_series.getTypePtr() == NULL) {
+            output_series.setType(in->getTypePtr());
+            copier.prep();
+        }
+        if (!output_series.hasExtent()) {
+            output_series.newExtent();
+        }
+        input_series.setExtent(in);
+        if (rows == NULL) {
+            copier.copyRecords(0, in->nRecords());
+        } else {
+            copier.copyRecords(*rows);
+        }
+        input_series.clearExtent();
+        if (output_series.getExtentRef().size() > target_extent_size) {
+            break;
+        }
+    }
+    Extent::Ptr ret;
+    if (output_series.hasExtent()) {
+        ret = output_series.getSharedExtent();
+        output_series.clearExtent();
+    }
+    return ret;
+}
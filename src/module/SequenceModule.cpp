@@ -50,3 +50,7 @@ Extent *SequenceModule::getExtent() {
 Extent::Ptr SequenceModule::getSharedExtent() {
     return tail().getSharedExtent();
 }
+
+Extent::Ptr SequenceModule::getSelectedExtent(const dataseries::RowSelection *&selection) {
+    return tail().getSelectedExtent(selection);
+}
@@ -0,0 +1,72 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    implementation
+*/
+
+#include <boost/format.hpp>
+
+#include <DataSeries/SharedScan.hpp>
+
+using namespace std;
+using boost::format;
+
+SharedScan::SharedScan(size_t max_buffer_memory)
+    : max_buffer_memory(max_buffer_memory), started(false) { }
+
+SharedScan::~SharedScan() {
+    // the consumers at the heads of the analyses go before their broadcasts
+    for (vector<Analysis>::iterator i = analyses.begin(); i != analyses.end(); ++i) {
+        delete i->sequence;
+    }
+    for (map<string, Scan>::iterator i = scans.begin(); i != scans.end(); ++i) {
+        delete i->second.broadcast;
+        delete i->second.source;
+    }
+}
+
+void SharedScan::addSource(const string &filename) {
+    INVARIANT(!started, "can't add sources to a SharedScan after it has run");
+    for (map<string, Scan>::iterator i = scans.begin(); i != scans.end(); ++i) {
+        i->second.source->addSource(filename);
+    }
+    filenames.push_back(filename);
+}
+
+SequenceModule &SharedScan::newAnalysis(const string &type_match) {
+    INVARIANT(!started, "can't add analyses to a SharedScan after it has run");
+    if (scans.find(type_match) == scans.end()) {
+        Scan &scan(scans[type_match]);
+        scan.source = new TypeIndexModule(type_match);
+        for (vector<string>::iterator i = filenames.begin(); i != filenames.end(); ++i) {
+            scan.source->addSource(*i);
+        }
+        scan.broadcast = new BroadcastBuffer(*scan.source, max_buffer_memory);
+    }
+    Analysis analysis;
+    analysis.type_match = type_match;
+    analysis.sequence = new SequenceModule(scans[type_match].broadcast->newConsumer());
+    analyses.push_back(analysis);
+    return *analysis.sequence;
+}
+
+void SharedScan::run() {
+    INVARIANT(!started, "a SharedScan can only run once");
+    started = true;
+    vector<DataSeriesModule *> tails;
+    for (vector<Analysis>::iterator i = analyses.begin(); i != analyses.end(); ++i) {
+        tails.push_back(i->sequence);
+    }
+    BroadcastBuffer::getAndDeleteSharedConcurrently(tails);
+}
+
+TypeIndexModule &SharedScan::scan(const string &type_match) {
+    map<string, Scan>::iterator i = scans.find(type_match);
+    INVARIANT(i != scans.end(), format("no analysis of type match '%s'") % type_match);
+    return *i->second.source;
+}
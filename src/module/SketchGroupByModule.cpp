@@ -0,0 +1,314 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    implementation
+*/
+
+#include <sstream>
+
+#include <boost/format.hpp>
+
+#include <Lintel/AssertBoost.hpp>
+#include <Lintel/StringUtil.hpp>
+
+#include <DataSeries/SketchGroupByModule.hpp>
+
+using namespace std;
+using boost::format;
+
+namespace {
+    const string str_distinct("distinct");
+    const string str_topk("topk");
+    const double default_distinct_error = 0.01;
+    const uint32_t default_k = 100;
+
+    /// parse distinct[=error]; false if stat_type isn't one
+    bool parseDistinct(const string &stat_type, double &error) {
+        error = default_distinct_error;
+        if (stat_type == str_distinct) {
+            return true;
+        } else if (prefixequal(stat_type, str_distinct + "=")) {
+            error = stringToDouble(stat_type.substr(str_distinct.size() + 1));
+            return error > 0 && error < 1;
+        } else {
+            return false;
+        }
+    }
+
+    /// parse topk[=k][:weight-expr]; false if stat_type isn't one
+    bool parseTopK(const string &stat_type, uint32_t &k, string &weight_expr) {
+        k = default_k;
+        weight_expr.clear();
+        if (!prefixequal(stat_type, str_topk)) {
+            return false;
+        }
+        string rest(stat_type.substr(str_topk.size()));
+        size_t colon = rest.find(':');
+        if (colon != string::npos) {
+            weight_expr = rest.substr(colon + 1);
+            rest.erase(colon);
+            if (weight_expr.empty()) {
+                return false;
+            }
+        }
+        if (rest.empty()) {
+            return true;
+        } else if (rest[0] == '=' && rest.size() > 1
+                   && rest.find_first_not_of("0123456789", 1) == string::npos) {
+            k = stringToInteger<int32_t>(rest.substr(1));
+            return k > 0;
+        } else {
+            return false;
+        }
+    }
+
+    vector<string> splitFields(const string &fields) {
+        vector<string> ret;
+        split(fields, ",", ret);
+        return ret;
+    }
+}
+
+SketchGroupByModule::SketchGroupByModule(DataSeriesModule &source, const string &name,
+                                         const vector<string> &value_fields,
+                                         const vector<string> &groupby,
+                                         const string &where_expr,
+                                         ExtentSeries::typeCompatibilityT tc)
+    : ParallelRowAnalysisModule::BatchAnalysis(source, tc), value_fields(value_fields),
+      groupby_names(groupby), name(name), keys_ready(false)
+{
+    INVARIANT(!value_fields.empty(), format("%s needs at least one value field") % name);
+    if (!where_expr.empty()) {
+        setWhereExpr(where_expr);
+    }
+}
+
+SketchGroupByModule::~SketchGroupByModule() { }
+
+void SketchGroupByModule::initKeys() {
+    if (!keys_ready) {
+        value_encoder.init(series, value_fields);
+        group_encoder.init(series, groupby_names);
+        keys_ready = true;
+    }
+}
+
+void SketchGroupByModule::prepareForProcessing() {
+    initKeys();
+}
+
+void SketchGroupByModule::processBatch(uint32_t nrows, const dataseries::RowSelection *selection) {
+    if (nrows == 0) {
+        return;
+    }
+    value_encoder.encodeRows(nrows, selection, value_keys, value_offsets);
+    group_encoder.encodeRows(nrows, selection, group_keys, group_offsets);
+    size_t nselected = group_offsets.size() - 1;
+    row_groups.resize(nselected);
+    const uint8_t *key_base = reinterpret_cast<const uint8_t *>(group_keys.data());
+    for (size_t i = 0; i < nselected; ++i) {
+        const uint8_t *key = key_base + group_offsets[i];
+        uint32_t key_size = group_offsets[i + 1] - group_offsets[i];
+        bool inserted;
+        dataseries::KeyTable<uint32_t>::Entry &group
+            (groups.lookup(dataseries::KeyEncoder::hash(key, key_size), key, key_size, inserted));
+        if (inserted) {
+            group.value = groups.size() - 1;
+            newGroup();
+        }
+        row_groups[i] = group.value;
+    }
+    addRows(nrows, selection, row_groups);
+}
+
+void SketchGroupByModule::merge(ParallelRowAnalysisModule::Analysis &_from) {
+    SketchGroupByModule &from(dynamic_cast<SketchGroupByModule &>(_from));
+    SINVARIANT(from.name == name && from.value_fields == value_fields
+               && from.groupby_names == groupby_names);
+    if (!keys_ready && from.keys_ready) {
+        // this analysis saw no extents; it needs the type to print the keys
+        series.setType(from.series.getTypePtr());
+        prepareForProcessing();
+    }
+    const vector<dataseries::KeyTable<uint32_t>::Entry> &entries(from.groups.entries());
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const uint8_t *key = from.groups.key(entries[i]);
+        bool inserted;
+        dataseries::KeyTable<uint32_t>::Entry &group
+            (groups.lookup(entries[i].hash, key, entries[i].key_size, inserted));
+        if (inserted) {
+            group.value = groups.size() - 1;
+            newGroup();
+        }
+        mergeGroup(group.value, from, entries[i].value);
+    }
+}
+
+void SketchGroupByModule::printResult() {
+    cout << format("# Begin %s\n") % name;
+    cout << format("# processed %d rows, where clause eliminated %d rows\n")
+        % processed_rows % ignored_rows;
+    printHeader(join(", ", groupby_names));
+
+    vector<uint32_t> order;
+    groups.sortedOrder(order);
+    vector<GeneralValue> key;
+    for (vector<uint32_t>::iterator i = order.begin(); i != order.end(); ++i) {
+        const dataseries::KeyTable<uint32_t>::Entry &group(groups.entries()[*i]);
+        group_encoder.decode(groups.key(group), key);
+        ostringstream prefix;
+        for (vector<GeneralValue>::iterator j = key.begin(); j != key.end(); ++j) {
+            prefix << *j << ", ";
+        }
+        printGroup(group.value, key, prefix.str());
+    }
+    cout << format("# End %s\n") % name;
+}
+
+bool SketchGroupByModule::validStatType(const string &stat_type) {
+    double error;
+    uint32_t k;
+    string weight_expr;
+    return parseDistinct(stat_type, error) || parseTopK(stat_type, k, weight_expr);
+}
+
+SketchGroupByModule *SketchGroupByModule::make(DataSeriesModule &source, const string &stat_type,
+                                               const string &value_fields,
+                                               const vector<string> &groupby,
+                                               const string &where_expr,
+                                               ExtentSeries::typeCompatibilityT tc) {
+    double error;
+    uint32_t k;
+    string weight_expr;
+    if (parseDistinct(stat_type, error)) {
+        return new DistinctCountModule(source, splitFields(value_fields), groupby, error,
+                                       where_expr, tc);
+    } else if (parseTopK(stat_type, k, weight_expr)) {
+        return new TopKModule(source, splitFields(value_fields), groupby, k, weight_expr,
+                              where_expr, tc);
+    } else {
+        FATAL_ERROR(format("invalid sketch stat type %s") % stat_type);
+    }
+}
+
+DistinctCountModule::DistinctCountModule(DataSeriesModule &source,
+                                         const vector<string> &value_fields,
+                                         const vector<string> &groupby, double error,
+                                         const string &where_expr,
+                                         ExtentSeries::typeCompatibilityT tc)
+    : SketchGroupByModule(source, "DistinctCountModule", value_fields, groupby, where_expr, tc),
+      precision(dataseries::HyperLogLog::precisionForError(error))
+{ }
+
+DistinctCountModule::~DistinctCountModule() {
+    for (vector<dataseries::HyperLogLog *>::iterator i = sketches.begin();
+         i != sketches.end(); ++i) {
+        delete *i;
+    }
+}
+
+void DistinctCountModule::newGroup() {
+    sketches.push_back(new dataseries::HyperLogLog(precision));
+}
+
+void DistinctCountModule::addRows(uint32_t nrows, const dataseries::RowSelection *selection,
+                                  const vector<uint32_t> &row_groups) {
+    const uint8_t *key_base = reinterpret_cast<const uint8_t *>(value_keys.data());
+    for (size_t i = 0; i < row_groups.size(); ++i) {
+        sketches[row_groups[i]]->add(key_base + value_offsets[i],
+                                     value_offsets[i + 1] - value_offsets[i]);
+    }
+}
+
+void DistinctCountModule::mergeGroup(uint32_t group, SketchGroupByModule &from,
+                                     uint32_t from_group) {
+    sketches[group]->add(*dynamic_cast<DistinctCountModule &>(from).sketches[from_group]);
+}
+
+void DistinctCountModule::printHeader(const string &groupby_list) {
+    cout << format("# %s%sdistinct(%s), relative standard error %.2g%%\n")
+        % groupby_list % (groupby_list.empty() ? "" : ", ") % join(", ", value_fields)
+        % (100 * dataseries::HyperLogLog::errorForPrecision(precision));
+}
+
+void DistinctCountModule::printGroup(uint32_t group, const vector<GeneralValue> &key,
+                                     const string &prefix) {
+    cout << format("%s%.0f\n") % prefix % sketches[group]->estimate();
+}
+
+TopKModule::TopKModule(DataSeriesModule &source, const vector<string> &value_fields,
+                       const vector<string> &groupby, uint32_t k, const string &weight_expr,
+                       const string &where_expr, ExtentSeries::typeCompatibilityT tc)
+    : SketchGroupByModule(source, "TopKModule", value_fields, groupby, where_expr, tc),
+      k(k), weight_expr_str(weight_expr), weight_expr(NULL)
+{ }
+
+TopKModule::~TopKModule() {
+    delete weight_expr;
+    for (vector<dataseries::SpaceSaving *>::iterator i = sketches.begin();
+         i != sketches.end(); ++i) {
+        delete *i;
+    }
+}
+
+void TopKModule::prepareForProcessing() {
+    SketchGroupByModule::prepareForProcessing();
+    if (!weight_expr_str.empty() && weight_expr == NULL) {
+        weight_expr = DSExpr::make(series, weight_expr_str);
+    }
+}
+
+void TopKModule::newGroup() {
+    sketches.push_back(new dataseries::SpaceSaving(k));
+}
+
+void TopKModule::addRows(uint32_t nrows, const dataseries::RowSelection *selection,
+                         const vector<uint32_t> &row_groups) {
+    if (weight_expr != NULL) {
+        weight_expr->valDoubles(series, selection, weights);
+        SINVARIANT(weights.size() == row_groups.size());
+    }
+    const uint8_t *key_base = reinterpret_cast<const uint8_t *>(value_keys.data());
+    for (size_t i = 0; i < row_groups.size(); ++i) {
+        sketches[row_groups[i]]->add(key_base + value_offsets[i],
+                                     value_offsets[i + 1] - value_offsets[i],
+                                     weight_expr == NULL ? 1 : weights[i]);
+    }
+}
+
+void TopKModule::mergeGroup(uint32_t group, SketchGroupByModule &from, uint32_t from_group) {
+    TopKModule &them(dynamic_cast<TopKModule &>(from));
+    SINVARIANT(them.k == k && them.weight_expr_str == weight_expr_str);
+    sketches[group]->add(*them.sketches[from_group]);
+}
+
+void TopKModule::printHeader(const string &groupby_list) {
+    cout << format("# top %d (%s) by %s%s\n") % k % join(", ", value_fields)
+        % (weight_expr_str.empty() ? string("count(*)") : "sum(" + weight_expr_str + ")")
+        % (groupby_list.empty() ? "" : " group by " + groupby_list);
+    cout << format("# count, max overcount, %s\n") % join(", ", value_fields);
+}
+
+void TopKModule::printGroup(uint32_t group, const vector<GeneralValue> &key,
+                            const string &prefix) {
+    if (!key.empty()) {
+        cout << format("# group %s\n") % prefix.substr(0, prefix.size() - 2);
+    }
+    vector<dataseries::SpaceSaving::Entry> entries;
+    sketches[group]->top(entries);
+    vector<GeneralValue> value;
+    for (vector<dataseries::SpaceSaving::Entry>::iterator i = entries.begin();
+         i != entries.end(); ++i) {
+        decodeValue(i->key, value);
+        cout << format("%.6g, %.6g") % i->count % i->error;
+        for (vector<GeneralValue>::iterator j = value.begin(); j != value.end(); ++j) {
+            cout << ", " << *j;
+        }
+        cout << "\n";
+    }
+}
@@ -0,0 +1,134 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    implementation
+*/
+
+#include <algorithm>
+
+#include <Lintel/AssertBoost.hpp>
+
+#include <DataSeries/SpaceSaving.hpp>
+
+using namespace std;
+
+namespace dataseries {
+
+namespace {
+    struct ByCountDescending {
+        bool operator()(const SpaceSaving::Entry &a, const SpaceSaving::Entry &b) const {
+            return a.count > b.count || (a.count == b.count && a.key < b.key);
+        }
+    };
+}
+
+SpaceSaving::SpaceSaving(uint32_t capacity) : capacity_(capacity), total_weight(0) {
+    INVARIANT(capacity > 0, "SpaceSaving needs a capacity of at least 1");
+}
+
+void SpaceSaving::add(const void *key, uint32_t size, double weight) {
+    SINVARIANT(weight >= 0);
+    total_weight += weight;
+    string k(reinterpret_cast<const char *>(key), size);
+    size_t *pos = positions.lookup(k);
+    if (pos != NULL) {
+        heap[*pos].count += weight;
+        siftDown(*pos);
+    } else if (heap.size() < capacity_) {
+        // not full yet; add at the end and sift up
+        positions[k] = heap.size();
+        heap.push_back(Entry(k, weight, 0));
+        for (size_t i = heap.size() - 1; i > 0 && heap[i].count < heap[(i - 1) / 2].count;
+             i = (i - 1) / 2) {
+            swapEntries(i, (i - 1) / 2);
+        }
+    } else {
+        // replace the smallest
+        Entry &smallest(heap[0]);
+        positions.remove(smallest.key);
+        positions[k] = 0;
+        smallest.error = smallest.count;
+        smallest.count += weight;
+        smallest.key.swap(k);
+        siftDown(0);
+    }
+}
+
+void SpaceSaving::add(const SpaceSaving &from) {
+    // combine everything either summary counted, charging keys missing from a full summary
+    // with its smallest count, then keep the largest capacity of them
+    double our_min = minCount(), their_min = from.minCount();
+    vector<Entry> combined;
+    combined.reserve(heap.size() + from.heap.size());
+    for (vector<Entry>::const_iterator i = heap.begin(); i != heap.end(); ++i) {
+        const size_t *theirs = from.positions.lookup(i->key);
+        if (theirs == NULL) {
+            combined.push_back(Entry(i->key, i->count + their_min, i->error + their_min));
+        } else {
+            const Entry &other(from.heap[*theirs]);
+            combined.push_back(Entry(i->key, i->count + other.count, i->error + other.error));
+        }
+    }
+    for (vector<Entry>::const_iterator i = from.heap.begin(); i != from.heap.end(); ++i) {
+        if (!positions.exists(i->key)) {
+            combined.push_back(Entry(i->key, i->count + our_min, i->error + our_min));
+        }
+    }
+    if (combined.size() > capacity_) {
+        nth_element(combined.begin(), combined.begin() + capacity_, combined.end(),
+                    ByCountDescending());
+        combined.erase(combined.begin() + capacity_, combined.end());
+    }
+
+    heap.swap(combined);
+    positions.clear();
+    make_heap(heap.begin(), heap.end(), ByCountDescending()); // smallest count at the top
+    for (size_t i = 0; i < heap.size(); ++i) {
+        positions[heap[i].key] = i;
+    }
+    total_weight += from.total_weight;
+}
+
+void SpaceSaving::top(vector<Entry> &into) const {
+    into = heap;
+    sort(into.begin(), into.end(), ByCountDescending());
+}
+
+size_t SpaceSaving::memoryUsage() const {
+    size_t ret = sizeof(*this) + heap.capacity() * sizeof(Entry)
+        + positions.size() * (sizeof(string) + sizeof(size_t) + 2 * sizeof(void *));
+    for (vector<Entry>::const_iterator i = heap.begin(); i != heap.end(); ++i) {
+        ret += 2 * i->key.capacity(); // once in the heap, once in positions
+    }
+    return ret;
+}
+
+void SpaceSaving::siftDown(size_t pos) {
+    while (true) {
+        size_t smallest = pos, left = 2 * pos + 1, right = left + 1;
+        if (left < heap.size() && heap[left].count < heap[smallest].count) {
+            smallest = left;
+        }
+        if (right < heap.size() && heap[right].count < heap[smallest].count) {
+            smallest = right;
+        }
+        if (smallest == pos) {
+            return;
+        }
+        swapEntries(pos, smallest);
+        pos = smallest;
+    }
+}
+
+void SpaceSaving::swapEntries(size_t a, size_t b) {
+    swap(heap[a], heap[b]);
+    positions[heap[a].key] = a;
+    positions[heap[b].key] = b;
+}
+
+}
@@ -5,9 +5,12 @@
   See the file named COPYING for license details
 */
 
+#include <Lintel/LintelLog.hpp>
+
 #include <DataSeries/TypeIndexModule.hpp>
 
 using namespace std;
+using boost::format;
 
 TypeIndexModule::TypeIndexModule(const string &_type_match)
         : IndexSourceModule(), 
@@ -17,11 +20,13 @@ TypeIndexModule::TypeIndexModule(const string &_type_match)
           extentOffset(indexSeries,"offset"), 
           extentType(indexSeries,"extenttype"),
           cur_file(0), cur_source(NULL),
-          my_type()
+          my_type(), cur_type(), type_compatibility(ExtentSeries::typeExact),
+          zone_skipped_extents(0)
 { }
 
-TypeIndexModule::~TypeIndexModule()
-{ }
+TypeIndexModule::~TypeIndexModule() {
+    zone_expr.reset(); // fields first, then their series
+}
 
 void TypeIndexModule::setMatch(const string &_type_match) {
     INVARIANT(startedPrefetching() == false,
@@ -36,6 +41,30 @@ void TypeIndexModule::setSecondMatch(const std::string &_type_match) {
 }
 
 
+void TypeIndexModule::setTypeCompatibility(ExtentSeries::typeCompatibilityT tc) {
+    INVARIANT(startedPrefetching() == false,
+              "invalid to change type compatibility after we start prefetching");
+    type_compatibility = tc;
+}
+
+void TypeIndexModule::setZonePredicate(const string &expr) {
+    INVARIANT(startedPrefetching() == false,
+              "invalid to change the zone predicate after we start prefetching");
+    INVARIANT(!type_match.empty(), "a zone predicate needs a type match to parse it against");
+    zone_predicate = expr;
+}
+
+void TypeIndexModule::addZoneRange(const string &field, const GeneralValue &min,
+                                   const GeneralValue &max) {
+    INVARIANT(startedPrefetching() == false,
+              "invalid to add zone ranges after we start prefetching");
+    ZoneRange range;
+    range.field = field;
+    range.min = min;
+    range.max = max;
+    zone_ranges.push_back(range);
+}
+
 void TypeIndexModule::addSource(const std::string &filename) {
     INVARIANT(startedPrefetching() == false, 
               "can't add sources safely after starting prefetching -- could get confused about the end of the entries.");
@@ -59,25 +88,36 @@ TypeIndexModule::PrefetchExtent *TypeIndexModule::lockedGetCompressedExtent() {
                       "can't handle source with null index extent\n");
             if (type_match.empty()) {
                 // nothing to do
-            } else if (my_type == NULL) {
-                my_type = matchType();
             } else {
-                const ExtentType::Ptr tmp = matchType();
-                // TODO: figure out what we should allow, should the series typematching rules be imported here?
-                INVARIANT(my_type == tmp, 
-                          boost::format("two different types were matched; this is currently invalid\nFile with mismatch was %s\nType 1:\n%s\nType 2:\n%s\n")
-                          % inputFiles[cur_file]
-                          % my_type->getXmlDescriptionString()
-                          % tmp->getXmlDescriptionString()); 
+                // Resolved per file so that we never have to read ahead
+                // through the collection; consistency is checked as we go.
+                cur_type = matchType();
+                if (my_type == NULL) {
+                    my_type = cur_type;
+                } else if (cur_type != NULL && cur_type != my_type) {
+                    INVARIANT(type_compatibility == ExtentSeries::typeLoose, 
+                              boost::format("two different types were matched; this is only valid with typeLoose compatibility\nFile with mismatch was %s\nType 1:\n%s\nType 2:\n%s\n")
+                              % inputFiles[cur_file]
+                              % my_type->getXmlDescriptionString()
+                              % cur_type->getXmlDescriptionString()); 
+                }
             }
 
             indexSeries.setExtent(cur_source->index_extent);
+            lockedReadZones();
         }
         for (;indexSeries.morerecords();++indexSeries) {
             if (type_match.empty() ||
-                (my_type != NULL &&
-                 extentType.stringval() == my_type->getName())) {
+                (cur_type != NULL &&
+                 extentType.equal(cur_type->getName()))) {
                 off64_t v = extentOffset.val();
+                if (!zonesMayMatch(v)) {
+                    ++zone_skipped_extents;
+                    continue;
+                }
+                if (!lockedLookupMayMatch(cur_source, v)) {
+                    continue;
+                }
                 PrefetchExtent *ret 
                         = readCompressed(cur_source, v, extentType.stringval());
                 ++indexSeries;
@@ -85,9 +125,16 @@ TypeIndexModule::PrefetchExtent *TypeIndexModule::lockedGetCompressedExtent() {
             }
         }
         if (indexSeries.morerecords() == false) {
+            if (!file_zones.empty()) {
+                LintelLogDebug("TypeIndexModule", format("%s: %d extents skipped by zone maps"
+                                                         " so far") % inputFiles[cur_file]
+                               % zone_skipped_extents);
+            }
+            file_zones.clear();
             indexSeries.clearExtent();
             delete cur_source;
             cur_source = NULL;
+            cur_type.reset();
             ++cur_file;
         }
     }
@@ -106,3 +153,32 @@ const ExtentType::Ptr TypeIndexModule::matchType() {
               % t->getName() % u->getName());
     return t != NULL ? t : u;
 }
+
+void TypeIndexModule::lockedReadZones() {
+    file_zones.clear();
+    if ((zone_predicate.empty() && zone_ranges.empty())
+        || !dataseries::ZoneMap::read(*cur_source, file_zones)) {
+        return;
+    }
+    if (!zone_predicate.empty() && cur_type != NULL && cur_type != zone_expr_type) {
+        zone_expr.reset();
+        zone_expr_series.reset(new ExtentSeries(cur_type));
+        zone_expr.reset(DSExpr::make(*zone_expr_series, zone_predicate));
+        zone_expr_type = cur_type;
+    }
+}
+
+bool TypeIndexModule::zonesMayMatch(int64_t offset) {
+    map<int64_t, dataseries::ExtentZones>::iterator i = file_zones.find(offset);
+    if (i == file_zones.end()) {
+        return true;
+    }
+    for (vector<ZoneRange>::iterator j = zone_ranges.begin(); j != zone_ranges.end(); ++j) {
+        dataseries::ExtentZones::iterator zone = i->second.find(j->field);
+        if (zone != i->second.end()
+            && !dataseries::ZoneMap::mayOverlap(zone->second, j->min, j->max)) {
+            return false;
+        }
+    }
+    return zone_expr == NULL || zone_expr->mayMatch(i->second);
+}
@@ -0,0 +1,323 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    implementation
+*/
+
+#include <string.h>
+
+#include <boost/format.hpp>
+
+#include <DataSeries/DataSeriesSource.hpp>
+#include <DataSeries/ExtentField.hpp>
+#include <DataSeries/ZoneMap.hpp>
+
+using namespace std;
+using boost::format;
+using namespace dataseries;
+
+namespace {
+    const string zone_map_type_xml(
+        "<ExtentType name=\"DataSeries: ZoneMap\" namespace=\"ssd.hpl.hp.com\" version=\"1.0\""
+        " comment=\"min, max and null counts of fields for each extent in this file\" >\n"
+        "  <field type=\"int64\" name=\"offset\" comment=\"offset of the extent\" />\n"
+        "  <field type=\"variable32\" name=\"extenttype\" pack_unique=\"yes\" />\n"
+        "  <field type=\"variable32\" name=\"field\" pack_unique=\"yes\" />\n"
+        "  <field type=\"int32\" name=\"rows\" />\n"
+        "  <field type=\"int32\" name=\"nulls\" />\n"
+        "  <field type=\"int64\" name=\"min_int\" opt_nullable=\"yes\" />\n"
+        "  <field type=\"int64\" name=\"max_int\" opt_nullable=\"yes\" />\n"
+        "  <field type=\"double\" name=\"min_double\" opt_nullable=\"yes\" />\n"
+        "  <field type=\"double\" name=\"max_double\" opt_nullable=\"yes\" />\n"
+        "  <field type=\"variable32\" name=\"min_string\" opt_nullable=\"yes\" />\n"
+        "  <field type=\"variable32\" name=\"max_string\" opt_nullable=\"yes\" />\n"
+        "</ExtentType>\n");
+
+    template<typename T> bool isNaN(T) {
+        return false;
+    }
+
+    template<> bool isNaN<double>(double v) {
+        return v != v;
+    }
+
+    /// min/max of the non-null values of span; false if there were none, or there was a NaN
+    template<typename T>
+    bool spanRange(const ColumnSpan<T> &span, uint32_t &nulls, T &lo, T &hi) {
+        bool any = false, nan = false;
+        for (uint32_t i = 0; i < span.size(); ++i) {
+            if (span.isNull(i)) {
+                ++nulls;
+                continue;
+            }
+            T v = span.raw(i);
+            if (isNaN(v)) {
+                nan = true;
+            } else if (!any) {
+                lo = hi = v;
+                any = true;
+            } else if (v < lo) {
+                lo = v;
+            } else if (hi < v) {
+                hi = v;
+            }
+        }
+        return any && !nan;
+    }
+
+    bool lessThan(const Variable32Ref &a, const Variable32Ref &b) {
+        int ret = memcmp(a.data, b.data, a.size < b.size ? a.size : b.size);
+        return ret < 0 || (ret == 0 && a.size < b.size);
+    }
+
+    template<class FT, typename T>
+    void intZone(ExtentSeries &series, const string &name, FieldZone &zone) {
+        FT field(series, name, Field::flag_nullable);
+        T lo = 0, hi = 0;
+        if (spanRange(field.span(), zone.nulls, lo, hi)) {
+            zone.min.setInt64(lo);
+            zone.max.setInt64(hi);
+        }
+    }
+}
+
+const ExtentType::Ptr &ZoneMap::extentType() {
+    static const ExtentType::Ptr type(ExtentTypeLibrary::sharedExtentTypePtr(zone_map_type_xml));
+    return type;
+}
+
+void ZoneMap::compute(const Extent::Ptr &e, const vector<string> &fields, ExtentZones &into) {
+    into.clear();
+    ExtentSeries series(e);
+    const ExtentType &type(*e->getTypePtr());
+    for (vector<string>::const_iterator i = fields.begin(); i != fields.end(); ++i) {
+        FieldZone zone;
+        zone.rows = e->nRecords();
+        switch (type.getFieldType(*i))
+            {
+            case ExtentType::ft_bool: {
+                BoolField field(series, *i, Field::flag_nullable);
+                bool lo = false, hi = false;
+                if (spanRange(field.span(), zone.nulls, lo, hi)) {
+                    zone.min.setInt64(lo ? 1 : 0);
+                    zone.max.setInt64(hi ? 1 : 0);
+                }
+                break;
+            }
+            case ExtentType::ft_byte: intZone<ByteField, uint8_t>(series, *i, zone); break;
+            case ExtentType::ft_int32: intZone<Int32Field, int32_t>(series, *i, zone); break;
+            case ExtentType::ft_int64: intZone<Int64Field, int64_t>(series, *i, zone); break;
+            case ExtentType::ft_double: {
+                // same flags as the fields expressions use, so these are the values they see
+                DoubleField field(series, *i, Field::flag_nullable
+                                  | DoubleField::flag_allownonzerobase);
+                double lo = 0, hi = 0;
+                if (spanRange(field.span(), zone.nulls, lo, hi)) {
+                    zone.min.setDouble(lo);
+                    zone.max.setDouble(hi);
+                }
+                break;
+            }
+            case ExtentType::ft_variable32: {
+                Variable32Field field(series, *i, Field::flag_nullable);
+                Variable32Span span(field.span());
+                Variable32Ref lo, hi;
+                bool any = false;
+                for (uint32_t row = 0; row < span.size(); ++row) {
+                    if (span.isNull(row)) {
+                        ++zone.nulls;
+                        continue;
+                    }
+                    Variable32Ref v(span.raw(row));
+                    if (!any) {
+                        lo = hi = v;
+                        any = true;
+                    } else if (lessThan(v, lo)) {
+                        lo = v;
+                    } else if (lessThan(hi, v)) {
+                        hi = v;
+                    }
+                }
+                if (any) {
+                    zone.min.setVariable32(lo.str());
+                    zone.max.setVariable32(hi.str());
+                }
+                break;
+            }
+            default:
+                continue;
+            }
+        into[*i] = zone;
+    }
+}
+
+void ZoneMap::append(ExtentSeries &series, int64_t offset, const string &type_name,
+                     const ExtentZones &zones) {
+    if (!series.hasExtent()) {
+        series.newExtent();
+    }
+    Int64Field f_offset(series, "offset");
+    Variable32Field f_extenttype(series, "extenttype"), f_field(series, "field");
+    Int32Field f_rows(series, "rows"), f_nulls(series, "nulls");
+    Int64Field min_int(series, "min_int", Field::flag_nullable);
+    Int64Field max_int(series, "max_int", Field::flag_nullable);
+    DoubleField min_double(series, "min_double", Field::flag_nullable);
+    DoubleField max_double(series, "max_double", Field::flag_nullable);
+    Variable32Field min_string(series, "min_string", Field::flag_nullable);
+    Variable32Field max_string(series, "max_string", Field::flag_nullable);
+
+    for (ExtentZones::const_iterator i = zones.begin(); i != zones.end(); ++i) {
+        const FieldZone &zone(i->second);
+        series.newRecord();
+        f_offset.set(offset);
+        f_extenttype.set(type_name);
+        f_field.set(i->first);
+        f_rows.set(zone.rows);
+        f_nulls.set(zone.nulls);
+        min_int.setNull();
+        max_int.setNull();
+        min_double.setNull();
+        max_double.setNull();
+        min_string.setNull();
+        max_string.setNull();
+        switch (zone.min.getType())
+            {
+            case ExtentType::ft_unknown: break;
+            case ExtentType::ft_int64:
+                min_int.set(zone.min.valInt64());
+                max_int.set(zone.max.valInt64());
+                break;
+            case ExtentType::ft_double:
+                min_double.set(zone.min.valDouble());
+                max_double.set(zone.max.valDouble());
+                break;
+            case ExtentType::ft_variable32:
+                min_string.set(zone.min.valString());
+                max_string.set(zone.max.valString());
+                break;
+            default:
+                FATAL_ERROR(format("internal error, unexpected zone type %s")
+                            % ExtentType::fieldTypeToStr(zone.min.getType()));
+            }
+    }
+}
+
+bool ZoneMap::read(DataSeriesSource &source, map<int64_t, ExtentZones> &into) {
+    into.clear();
+    const string &zone_type_name(extentType()->getName());
+    if (source.getLibrary().getTypeByNamePtr(zone_type_name, true) == NULL) {
+        return false;
+    }
+
+    ExtentSeries index_series(source.index_extent);
+    Int64Field index_offset(index_series, "offset");
+    Variable32Field index_type(index_series, "extenttype");
+
+    // zones are only trusted for extents of the type they were computed for in this file; a
+    // zone map copied from another file by a tool that doesn't know about them would refer to
+    // the offsets in that file
+    map<int64_t, string> extent_types;
+    vector<int64_t> zone_offsets;
+    for (; index_series.more(); index_series.next()) {
+        if (index_type.equal(zone_type_name)) {
+            zone_offsets.push_back(index_offset.val());
+        } else {
+            extent_types[index_offset.val()] = index_type.stringval();
+        }
+    }
+
+    ExtentSeries series;
+    Int64Field f_offset(series, "offset");
+    Variable32Field f_extenttype(series, "extenttype"), f_field(series, "field");
+    Int32Field f_rows(series, "rows"), f_nulls(series, "nulls");
+    Int64Field min_int(series, "min_int", Field::flag_nullable);
+    Int64Field max_int(series, "max_int", Field::flag_nullable);
+    DoubleField min_double(series, "min_double", Field::flag_nullable);
+    DoubleField max_double(series, "max_double", Field::flag_nullable);
+    Variable32Field min_string(series, "min_string", Field::flag_nullable);
+    Variable32Field max_string(series, "max_string", Field::flag_nullable);
+
+    for (vector<int64_t>::iterator i = zone_offsets.begin(); i != zone_offsets.end(); ++i) {
+        off64_t offset = *i;
+        Extent::Ptr e(source.preadExtent(offset));
+        for (series.setExtent(e); series.more(); series.next()) {
+            map<int64_t, string>::iterator extent = extent_types.find(f_offset.val());
+            if (extent == extent_types.end() || !f_extenttype.equal(extent->second)) {
+                continue;
+            }
+            FieldZone &zone(into[f_offset.val()][f_field.stringval()]);
+            zone.rows = f_rows.val();
+            zone.nulls = f_nulls.val();
+            if (!min_int.isNull()) {
+                zone.min.setInt64(min_int.val());
+                zone.max.setInt64(max_int.val());
+            } else if (!min_double.isNull()) {
+                zone.min.setDouble(min_double.val());
+                zone.max.setDouble(max_double.val());
+            } else if (!min_string.isNull()) {
+                zone.min.setVariable32(min_string.stringval());
+                zone.max.setVariable32(max_string.stringval());
+            }
+        }
+        series.clearExtent();
+    }
+    return true;
+}
+
+bool ZoneMap::valueRange(const FieldZone &zone, double &lo, double &hi) {
+    if (zone.hasRange()) {
+        if (zone.min.getType() == ExtentType::ft_variable32) {
+            return false;
+        }
+        lo = zone.min.valDouble();
+        hi = zone.max.valDouble();
+        if (zone.nulls > 0) {
+            lo = min(lo, 0.0);
+            hi = max(hi, 0.0);
+        }
+        return true;
+    } else if (zone.rows > 0 && zone.nulls == zone.rows) {
+        lo = hi = 0;
+        return true;
+    } else {
+        return false;
+    }
+}
+
+bool ZoneMap::valueRange(const FieldZone &zone, string &lo, string &hi) {
+    if (zone.hasRange()) {
+        if (zone.min.getType() != ExtentType::ft_variable32) {
+            return false;
+        }
+        lo = zone.nulls > 0 ? string() : zone.min.valString();
+        hi = zone.max.valString();
+        return true;
+    } else if (zone.rows > 0 && zone.nulls == zone.rows) {
+        lo = hi = string();
+        return true;
+    } else {
+        return false;
+    }
+}
+
+bool ZoneMap::mayOverlap(const FieldZone &zone, const GeneralValue &min_value,
+                         const GeneralValue &max_value) {
+    if (min_value.getType() == ExtentType::ft_variable32) {
+        string lo, hi;
+        if (!valueRange(zone, lo, hi)) {
+            return true;
+        }
+        return !(hi < min_value.valString() || max_value.valString() < lo);
+    } else {
+        double lo, hi;
+        if (!valueRange(zone, lo, hi)) {
+            return true;
+        }
+        return !(hi < min_value.valDouble() || max_value.valDouble() < lo);
+    }
+}
@@ -119,6 +119,8 @@ void getPackingArgs(int *argc, char *argv[], commonPackingArgs *commonArgs) {
                       && commonArgs->compress_level < 10,
                       format("compression level %d (%s) invalid, should be 1..9")
                       % commonArgs->compress_level % argv[cur_arg]);
+        } else if (strcmp(argv[cur_arg],"--extent-size=auto") == 0) {
+            commonArgs->extent_size = 0; // OutputModule::auto_extent_size
         } else if (strncmp(argv[cur_arg],"--extent-size=",14) == 0) {
             commonArgs->extent_size = atoi(argv[cur_arg]+14);
             INVARIANT(commonArgs->extent_size >= 1024,
@@ -178,8 +180,9 @@ const std::string packingOptions() {
     returnStr += 
             "} (default enables all --- enable does little on its own)\n"
             "    --compress-level=[0-9] (default 9)\n"
-            "    --extent-size=[>=1024] (default 16*1024*1024 if bz2 is "
-            "enabled, 64*1024 otherwise)\n";
+            "    --extent-size=[>=1024|auto] (default 16*1024*1024 if bz2 is "
+            "enabled, 64*1024 otherwise;\n"
+            "        auto tunes it per extent type as the output is packed)\n";
 
     return returnStr;
 }
@@ -197,9 +197,10 @@ int main(int argc, char *argv[]) {
     DataSeriesSink outds(ds_output_filename, packing_args.compress_modes,
                          packing_args.compress_level);
 
-    outds.writeExtentLibrary(lib);
     ExtentSeries series(type);
+    // before the library, so an automatically chosen extent size is recorded
     OutputModule *outmodule = new OutputModule(outds, series, type, packing_args.extent_size);
+    outds.writeExtentLibrary(lib);
 
     vector<bool> is_nullable;
     vector<GeneralField *> fields;
@@ -151,12 +151,8 @@ class MinMaxOutput {
     void finish() {
         SINVARIANT(!is_finished);
         // write modify extents
-        ExtentSeries modifyseries(modifytype);
-        Variable32Field modifyfilename(modifyseries,"filename");
-        Int64Field modifytime(modifyseries,"modify-time");
-        OutputModule *modifymodule 
-                = new OutputModule(*output, modifyseries, modifyseries.getTypePtr(),
-                                   packing_args.extent_size);
+        Variable32Field modifyfilename(*modifyseries,"filename");
+        Int64Field modifytime(*modifyseries,"modify-time");
 
         // sort so we get consistent output for regression testing.
         typedef ModifyTimesT::HashTableT::hte_vectorT mt_vectorT;
@@ -170,6 +166,9 @@ class MinMaxOutput {
 
         modifymodule->flushExtent();
         delete modifymodule;
+        delete modifyseries;
+        delete infomodule;
+        delete infoseries;
 
         // clean up the fields
         GeneralField::deleteFields(mins);
@@ -341,15 +340,13 @@ class MinMaxOutput {
 
     void setFieldList(const string &fieldlist) {
         // write info extents -- one row
-        ExtentSeries infoseries(infotype);
-        Variable32Field info_type_prefix(infoseries, "type-prefix");
-        Variable32Field info_fields(infoseries, "fields");
-        OutputModule infomodule(*output, infoseries, infotype, packing_args.extent_size);
+        Variable32Field info_type_prefix(*infoseries, "type-prefix");
+        Variable32Field info_fields(*infoseries, "fields");
 
-        infomodule.newRecord();
+        infomodule->newRecord();
         info_type_prefix.set(type_prefix);
         info_fields.set(fieldlist);
-        infomodule.flushExtent();
+        infomodule->flushExtent();
 
         for (unsigned i = 0; i < fields.size(); ++i) {
             mins.push_back(GeneralField::create(NULL, *minmaxseries, str_min + fields[i]));
@@ -379,6 +376,14 @@ class MinMaxOutput {
         minmaxmodule = new OutputModule(*output, *minmaxseries, minmaxtype,
                                         packing_args.extent_size);
 
+        // all the output modules exist before the library is written, so that automatic
+        // extent sizes are recorded for each of them
+        infoseries = new ExtentSeries(infotype);
+        infomodule = new OutputModule(*output, *infoseries, infotype, packing_args.extent_size);
+        modifyseries = new ExtentSeries(modifytype);
+        modifymodule = new OutputModule(*output, *modifyseries, modifytype,
+                                        packing_args.extent_size);
+
         output->writeExtentLibrary(library);
 
         setFieldList(fieldlist);
@@ -402,6 +407,8 @@ class MinMaxOutput {
     Int32Field *rowcount;
 
     OutputModule *minmaxmodule;
+    ExtentSeries *infoseries, *modifyseries;
+    OutputModule *infomodule, *modifymodule;
     bool is_open;
     bool is_finished;
     string index_filename, old_index, type_prefix, fieldlist;
@@ -74,9 +74,6 @@
    =cut
 */
 
-// TODO: use GeneralField/ExtentRecordCopy, we aren't changing the type so
-// it should be much faster.
-
 #include <time.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -87,12 +84,12 @@
 #include <Lintel/AssertBoost.hpp>
 #include <Lintel/LintelLog.hpp>
 #include <Lintel/StringUtil.hpp>
-#include <Lintel/PointerUtil.hpp>
 
 #include <DataSeries/commonargs.hpp>
 #include <DataSeries/DataSeriesFile.hpp>
 #include <DataSeries/GeneralField.hpp>
 #include <DataSeries/DataSeriesModule.hpp>
+#include <DataSeries/ExtentSizeTuner.hpp>
 #include <DataSeries/TypeIndexModule.hpp>
 #include <DataSeries/PrefetchBufferModule.hpp>
 
@@ -101,7 +98,6 @@ static bool show_progress = false;
 static bool generate_info_extent = true;
 
 using namespace std;
-using lintel::safeDownCast;
 
 // TODO: figure out why when compressing from lzo to lzf, we can only
 // get up to ~200% cpu utilization rather than going to 400% on a 4way
@@ -116,49 +112,24 @@ using lintel::safeDownCast;
 struct PerTypeWork {
     OutputModule *output_module;
     ExtentSeries inputseries, outputseries;
-    // Splitting out the types here is ugly.  However, it's a huge
-    // performance improvement to not be going through the virtual
-    // function call.  In particular, repacking an BlockIO::SRT file
-    // from LZO to LZF took 285 CPU seconds originally, 244 CPU s
-    // after adding in the bool specific case, and 235 seconds after
-    // special casing for int32's.  That file has lots of booleans
-    // somewhat fewer int32s, and then some doubles.
-
-    // TODO: remove special case, use ExtentRecordCopy
-    vector<GeneralField *> infields, outfields, all_fields;
-    vector<GF_Bool *> in_boolfields, out_boolfields;
-    vector<GF_Int32 *> in_int32fields, out_int32fields;
-    vector<GF_Variable32 *> in_var32fields, out_var32fields;
+    // The types are the same, so the copy is a memcpy of each record plus
+    // the variable32 fields.  Originally this went field by field through
+    // GeneralField with special cases for bool and int32, which took 235 CPU
+    // seconds to repack a BlockIO::SRT file from LZO to LZF.
+    ExtentRecordCopy copier;
+    vector<Variable32Field *> in_var32fields; // for the size of the variable data
 
     double sum_unpacked_size, sum_packed_size;
     PerTypeWork(DataSeriesSink &output, unsigned extent_size, 
                 const ExtentType::Ptr t) 
-            : inputseries(t), outputseries(t), sum_unpacked_size(0), sum_packed_size(0) 
+            : inputseries(t), outputseries(t), copier(inputseries, outputseries),
+              sum_unpacked_size(0), sum_packed_size(0) 
     {
         for (unsigned i = 0; i < t->getNFields(); ++i) {
             const string &s = t->getFieldName(i);
-            GeneralField *in = GeneralField::create(NULL, inputseries, s);
-            GeneralField *out = GeneralField::create(NULL, outputseries, s);
-            all_fields.push_back(in);
-            all_fields.push_back(out);
-            switch(t->getFieldType(s)) 
-            {
-                case ExtentType::ft_bool: 
-                    in_boolfields.push_back(safeDownCast<GF_Bool>(in));
-                    out_boolfields.push_back(safeDownCast<GF_Bool>(out));
-                    break;
-                case ExtentType::ft_int32: 
-                    in_int32fields.push_back(safeDownCast<GF_Int32>(in));
-                    out_int32fields.push_back(safeDownCast<GF_Int32>(out));
-                    break;
-                case ExtentType::ft_variable32: 
-                    in_var32fields.push_back(safeDownCast<GF_Variable32>(in));
-                    out_var32fields.push_back(safeDownCast<GF_Variable32>(out));
-                    break;
-                default:
-                    infields.push_back(in);
-                    outfields.push_back(out);
-                    break;
+            if (t->getFieldType(s) == ExtentType::ft_variable32) {
+                in_var32fields.push_back(new Variable32Field(inputseries, s, 
+                                                             Field::flag_nullable));
             }
         }
         output_module = new OutputModule(output, outputseries, t, 
@@ -166,8 +137,8 @@ struct PerTypeWork {
     }
 
     ~PerTypeWork() {
-        for (vector<GeneralField *>::iterator i = all_fields.begin();
-            i != all_fields.end(); ++i) {
+        for (vector<Variable32Field *>::iterator i = in_var32fields.begin();
+            i != in_var32fields.end(); ++i) {
             delete *i;
         }
     }
@@ -182,8 +153,12 @@ struct PerTypeWork {
         sum_unpacked_size += stats.unpacked_size;
         sum_packed_size += stats.packed_size;
 
+        // an automatic size starts over in each file, since it depends on how much of the
+        // file there is to read in parallel
         output_module = new OutputModule(output, outputseries, old->getOutputType(),
-                                         old->getTargetExtentSize());
+                                         old->isAutoExtentSize()
+                                         ? OutputModule::auto_extent_size
+                                         : old->getTargetExtentSize());
         delete old;
     }
 
@@ -213,7 +188,7 @@ void checkFileMissing(const std::string &filename) {
 
 const string generate_dsrepack_info_type_xml() {
 
-    string ret = "<ExtentType namespace=\"ssd.hpl.hp.com\" name=\"Info::DSRepack\" version=\"1.0\" >\n";
+    string ret = "<ExtentType namespace=\"ssd.hpl.hp.com\" name=\"Info::DSRepack\" version=\"1.1\" >\n";
 
     // Skip i = 0, which is compress none
     for (int i = 1; i < Extent::num_comp_algs; ++i ) {
@@ -224,7 +199,8 @@ const string generate_dsrepack_info_type_xml() {
     }
     
     ret += "  <field type=\"int32\" name=\"compress_level\" />\n"
-           "  <field type=\"int32\" name=\"extent_size\" />\n"
+           "  <field type=\"int32\" name=\"extent_size\" opt_nullable=\"yes\""
+           " comment=\"null if chosen automatically, see DataSeries: ExtentSize\" />\n"
            "  <field type=\"int32\" name=\"part\" opt_nullable=\"yes\" />\n"
            "</ExtentType>\n";
 
@@ -240,7 +216,10 @@ void writeRepackInfo(DataSeriesSink &sink, const commonPackingArgs &cpa, int fil
         return;
     }
     ExtentSeries series(dsrepack_info_type);
-    OutputModule out_module(sink, series, dsrepack_info_type, cpa.extent_size);
+    // one record, written after the library, so never sized automatically
+    OutputModule out_module(sink, series, dsrepack_info_type,
+                            cpa.extent_size == static_cast<int>(OutputModule::auto_extent_size)
+                            ? dataseries::ExtentSizeTuner::min_extent_size : cpa.extent_size);
 
     /* Previously, this line occured between initializing all the fields and
        calling set() on them.  Having it here doesn't seem to cause any problems,
@@ -249,7 +228,7 @@ void writeRepackInfo(DataSeriesSink &sink, const commonPackingArgs &cpa, int fil
     out_module.newRecord();
 
     Int32Field compress_level(series, "compress_level");
-    Int32Field extent_size(series, "extent_size");
+    Int32Field extent_size(series, "extent_size", Field::flag_nullable);
     Int32Field part(series, "part", Field::flag_nullable);
     
     // Skip i = 0, which is compress none
@@ -262,7 +241,11 @@ void writeRepackInfo(DataSeriesSink &sink, const commonPackingArgs &cpa, int fil
     }
 
     compress_level.set(cpa.compress_level);
-    extent_size.set(cpa.extent_size);
+    if (cpa.extent_size == static_cast<int>(OutputModule::auto_extent_size)) {
+        extent_size.setNull();
+    } else {
+        extent_size.set(cpa.extent_size);
+    }
     if (file_count >= 0) {
         part.set(file_count);
     } else {
@@ -271,8 +254,7 @@ void writeRepackInfo(DataSeriesSink &sink, const commonPackingArgs &cpa, int fil
 }
 
 bool skipType(const ExtentType::Ptr type) {
-    return type->getName() == "DataSeries: ExtentIndex"
-            || type->getName() == "DataSeries: XmlType"
+    return DataSeriesSink::isMetadataType(type->getName())
             || (type->getName() == "Info::DSRepack"
                 && type->getNamespace() == "ssd.hpl.hp.com");
 }
@@ -401,7 +383,7 @@ int main(int argc, char *argv[]) {
         Variable32Field extenttype(s,"extenttype");
 
         for (; s.morerecords(); ++s) {
-            if (skipType(library.getTypeByNamePtr(extenttype.stringval()))) {
+            if (skipType(f.getLibrary().getTypeByNamePtr(extenttype.stringval()))) {
                 continue;
             }
             ++extent_count;
@@ -446,18 +428,9 @@ int main(int argc, char *argv[]) {
              ++ptw->inputseries) {
             ptw->output_module->newRecord();
             cur_file_bytes += ptw->outputseries.getTypePtr()->fixedrecordsize();
-            for (unsigned int i=0; i < ptw->in_boolfields.size(); ++i) {
-                ptw->out_boolfields[i]->set(ptw->in_boolfields[i]);
-            }
-            for (unsigned int i=0; i < ptw->in_int32fields.size(); ++i) {
-                ptw->out_int32fields[i]->set(ptw->in_int32fields[i]);
-            }
+            ptw->copier.copyRecord();
             for (unsigned int i=0; i < ptw->in_var32fields.size(); ++i) {
-                cur_file_bytes += ptw->in_var32fields[i]->myfield.size();
-                ptw->out_var32fields[i]->set(ptw->in_var32fields[i]);
-            }
-            for (unsigned int i=0; i<ptw->infields.size(); ++i) {
-                ptw->outfields[i]->set(ptw->infields[i]);
+                cur_file_bytes += ptw->in_var32fields[i]->size();
             }
             if (target_file_bytes > 0 && cur_file_bytes >= target_file_bytes) {
                 output->flushPending();
@@ -479,12 +452,11 @@ int main(int argc, char *argv[]) {
                             new DataSeriesSink(output_path, 
                                                packing_args.compress_modes,
                                                packing_args.compress_level);
-                    new_output->writeExtentLibrary(library);
-                   
                     for (map<string, PerTypeWork *>::iterator i = per_type_work.begin();
                          i != per_type_work.end(); ++i) {
                         i->second->rotateOutput(*new_output);
                     }
+                    new_output->writeExtentLibrary(library);
                     writeRepackInfo(*output, packing_args, output_file_count);
                     output->close();
                     all_stats += output->getStats();
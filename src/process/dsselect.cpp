@@ -44,9 +44,9 @@
 
 #include <DataSeries/commonargs.hpp>
 #include <DataSeries/DataSeriesFile.hpp>
-#include <DataSeries/DSExpr.hpp>
 #include <DataSeries/GeneralField.hpp>
 #include <DataSeries/DataSeriesModule.hpp>
+#include <DataSeries/SelectModule.hpp>
 #include <DataSeries/TypeIndexModule.hpp>
 
 static bool update_type = false;
@@ -54,6 +54,7 @@ static bool get_all_fields = false;
 
 using namespace std;
 using boost::format;
+using boost::scoped_ptr;
 
 lintel::ProgramOption<string> where_arg
 ("where", "expression controlling which lines to select, man DSExpr for details");
@@ -165,30 +166,36 @@ int main(int argc, char *argv[]) {
     
     ExtentTypeLibrary library;
     const ExtentType::Ptr outputtype(library.registerTypePtr(xmloutdesc));
-    output.writeExtentLibrary(library);
     outputseries.setType(outputtype);
     for (vector<string>::iterator i = fields.begin();
         i != fields.end();++i) {
         outfields.push_back(GeneralField::create(NULL,outputseries,*i));
     }
-    DSExpr *where = NULL;
+    // the select hands on whole input extents with the matching rows, so only the selected
+    // fields of the selected rows get copied
+    DataSeriesModule *rows_from = &source;
+    scoped_ptr<SelectModule> select;
     if (where_arg.used()) {
-        string tmp = where_arg.get();
-        where = DSExpr::make(inputseries, tmp);
+        select.reset(new SelectModule(source, where_arg.get()));
+        rows_from = select.get();
     }
 
     OutputModule outmodule(output,outputseries,outputtype,
                            packing_args.extent_size);
+    // after the output module, so an automatically chosen extent size is recorded
+    output.writeExtentLibrary(library);
     uint64_t input_row_count = 0, output_row_count = 0;
     while (true) {
-        Extent::Ptr inextent = source.getSharedExtent();
+        const dataseries::RowSelection *selection;
+        Extent::Ptr inextent = rows_from->getSelectedExtent(selection);
         if (inextent == NULL) 
             break;
-        for (inputseries.setExtent(inextent);inputseries.morerecords(); ++inputseries) {
-            ++input_row_count;
-            if (where && !where->valBool()) {
-                continue;
-            }
+        inputseries.setExtent(inextent);
+        const uint8_t *row0 = inextent->fixeddata.begin();
+        uint32_t stride = intype->fixedrecordsize();
+        uint32_t nrows = selection == NULL ? inextent->nRecords() : selection->size();
+        for (uint32_t row = 0; row < nrows; ++row) {
+            inputseries.setCurPos(row0 + (selection == NULL ? row : (*selection)[row]) * stride);
             ++output_row_count;
             outmodule.newRecord();
             for (unsigned int i=0;i<infields.size();++i) {
@@ -196,12 +203,13 @@ int main(int argc, char *argv[]) {
             }
         }
     }
+    // without a where clause every row is output
+    input_row_count = select ? select->input_rows : output_row_count;
     outmodule.flushExtent();
     outmodule.close();
     
     GeneralField::deleteFields(infields);
     GeneralField::deleteFields(outfields);
-    delete where;
 
     cout << format("%d input rows, %d output rows\n") % input_row_count % output_row_count;
     return 0;
@@ -0,0 +1,274 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/*
+  =pod
+
+  =head1 NAME
+
+  dssharedscan - run several analyses over the same files, reading each extent type only once
+
+  =head1 SYNOPSIS
+
+  % dssharedscan [--buffer-mb=I<n>] I<analysis>... from file...
+
+  =head1 DESCRIPTION
+
+  Running dsstatgroupby and ds2txt separately over the same files reads and decompresses the same
+  extents once for each run.  dssharedscan instead takes a list of analyses, reads the extents of
+  each extent type match once, and gives each extent to all the analyses of that type match, each
+  running on its own thread.  The analyses can get up to --buffer-mb (default 64) MB of extents
+  apart before the fastest waits for the slowest.  The results are printed per analysis in the
+  order the analyses were given, followed by the amount of data read for each type match.
+
+  =head1 ANALYSES
+
+  =over 4
+
+  =item stat I<extent-type-match> I<stat-type> I<expr> [where I<expr>]
+  [group by I<field>[,I<field>...]]
+
+  Calculate a statistic as dsstatgroupby does; any of its statistic types can be used.
+
+  =item text I<extent-type-match> I<output-file> [select I<field>[,I<field>...]] [where I<expr>]
+
+  Convert the extents to text in I<output-file> as ds2txt does, optionally only some of the
+  fields, and only the rows for which the where expression is true.
+
+  =back
+
+  =head1 EXAMPLE
+
+  % dssharedscan stat 'NFS trace: common' basic payload_length group by operation \
+      stat 'NFS trace: common' distinct source \
+      text 'NFS trace: common' big.txt where 'payload_length > 65536' from nfs-*.ds
+
+  reads and decompresses the common table once for all three analyses.
+
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <boost/format.hpp>
+
+#include <Lintel/StringUtil.hpp>
+
+#include <DataSeries/DataSeriesSource.hpp>
+#include <DataSeries/DSStatGroupByModule.hpp>
+#include <DataSeries/DStoTextModule.hpp>
+#include <DataSeries/SharedScan.hpp>
+#include <DataSeries/SketchGroupByModule.hpp>
+
+using namespace std;
+using boost::format;
+
+void
+usage(const string &program_name, const string &error)
+{
+    cerr << error << "\n"
+         << "Usage: " << program_name << " [--buffer-mb=n] <analysis>... from file...\n"
+         << "  analyses are:\n"
+         << "    stat <extent-type-match> <stat-type> <expr> [where <expr>]"
+         << " [group by <field>[,<field>...]]\n"
+         << "    text <extent-type-match> <output-file> [select <field>[,<field>...]]"
+         << " [where <expr>]\n"
+         << "  stat-types are those of dsstatgroupby\n";
+    exit(0);
+}
+
+struct AnalysisSpec {
+    string kind, type_match;
+    string stat_type, expr; // stat
+    string output, select; // text
+    string where_expr;
+    vector<string> group_by;
+
+    string describe() const {
+        string ret = str(format("%s '%s'") % kind % type_match);
+        if (kind == "stat") {
+            ret += str(format(" %s %s") % stat_type % expr);
+        } else {
+            ret += " " + output + (select.empty() ? "" : " select " + select);
+        }
+        if (!where_expr.empty()) {
+            ret += " where " + where_expr;
+        }
+        if (!group_by.empty()) {
+            ret += " group by " + join(",", group_by);
+        }
+        return ret;
+    }
+};
+
+/// parse one analysis starting at argv[argpos], leaving argpos after it
+AnalysisSpec parseAnalysis(const vector<string> &argv, uint32_t &argpos) {
+    AnalysisSpec spec;
+    spec.kind = argv[argpos];
+    if (spec.kind != "stat" && spec.kind != "text") {
+        usage(argv[0], str(format("expected stat or text, not '%s'") % spec.kind));
+    }
+    if (argpos + 3 > argv.size()) {
+        usage(argv[0], "missing arguments for " + spec.kind);
+    }
+    spec.type_match = argv[argpos + 1];
+    argpos += 2;
+    if (spec.kind == "stat") {
+        if (argpos + 2 > argv.size()) {
+            usage(argv[0], "stat needs a stat type and an expression");
+        }
+        spec.stat_type = argv[argpos];
+        spec.expr = argv[argpos + 1];
+        argpos += 2;
+        if (!DSStatGroupByModule::validStatType(spec.stat_type)
+            && !SketchGroupByModule::validStatType(spec.stat_type)) {
+            usage(argv[0], str(format("'%s' is an invalid stat type") % spec.stat_type));
+        }
+    } else {
+        spec.output = argv[argpos];
+        ++argpos;
+    }
+    while (argpos + 1 < argv.size()) {
+        if (argv[argpos] == "where") {
+            spec.where_expr = argv[argpos + 1];
+            argpos += 2;
+        } else if (argv[argpos] == "select" && spec.kind == "text") {
+            spec.select = argv[argpos + 1];
+            argpos += 2;
+        } else if (argv[argpos] == "group" && spec.kind == "stat" && argpos + 2 < argv.size()
+                   && argv[argpos + 1] == "by") {
+            split(argv[argpos + 2], ",", spec.group_by);
+            argpos += 3;
+        } else {
+            break;
+        }
+    }
+    return spec;
+}
+
+void addStat(SequenceModule &seq, const AnalysisSpec &spec) {
+    if (SketchGroupByModule::validStatType(spec.stat_type)) {
+        seq.addModule(SketchGroupByModule::make(seq.tail(), spec.stat_type, spec.expr,
+                                                spec.group_by, spec.where_expr));
+    } else {
+        seq.addModule(new DSStatGroupByModule(seq.tail(), vector<string>(1, spec.expr),
+                                              vector<string>(1, spec.stat_type),
+                                              spec.group_by, spec.where_expr));
+    }
+}
+
+void addText(SequenceModule &seq, const AnalysisSpec &spec, DataSeriesSource &first_source,
+             vector<FILE *> &outputs) {
+    FILE *output = fopen(spec.output.c_str(), "w");
+    INVARIANT(output != NULL, format("can't open %s for write: %s") % spec.output
+              % strerror(errno));
+    outputs.push_back(output);
+    DStoTextModule *text = new DStoTextModule(seq.tail(), output);
+    seq.addModule(text);
+    if (spec.select.empty() && spec.where_expr.empty()) {
+        return;
+    }
+    // the print specifications are by type name
+    const ExtentType::Ptr type
+        = first_source.getLibrary().getTypeMatchPtr(spec.type_match, false, true);
+    INVARIANT(type != NULL, format("no type matching '%s' in %s") % spec.type_match
+              % first_source.getFilename());
+    if (!spec.select.empty()) {
+        vector<string> fields;
+        split(spec.select, ",", fields);
+        for (vector<string>::iterator i = fields.begin(); i != fields.end(); ++i) {
+            text->addPrintField(type->getName(), *i);
+        }
+    }
+    if (!spec.where_expr.empty()) {
+        text->setWhereExpr(type->getName(), spec.where_expr);
+    }
+}
+
+int
+main(int argc, char *_argv[])
+{
+    vector<string> argv;
+    for (int i = 0; i < argc; ++i) {
+        argv.push_back(string(_argv[i]));
+    }
+    size_t buffer_mb = 64;
+    uint32_t argpos = 1;
+    if (argpos < argv.size() && prefixequal(argv[argpos], "--buffer-mb=")) {
+        int32_t mb = stringToInteger<int32_t>(argv[argpos].substr(12));
+        if (mb < 1) {
+            usage(argv[0], "--buffer-mb must be at least 1");
+        }
+        buffer_mb = mb;
+        ++argpos;
+    }
+
+    vector<AnalysisSpec> specs;
+    while (argpos < argv.size() && argv[argpos] != "from") {
+        specs.push_back(parseAnalysis(argv, argpos));
+    }
+    if (specs.empty()) {
+        usage(argv[0], "need at least one analysis");
+    }
+    if (argpos + 1 >= argv.size()) {
+        usage(argv[0], "missing from file... in arguments");
+    }
+    vector<string> files(argv.begin() + argpos + 1, argv.end());
+
+    SharedScan scan(buffer_mb * 1024 * 1024);
+    DataSeriesSource first_source(files[0]);
+    vector<FILE *> outputs;
+    for (vector<AnalysisSpec>::iterator i = specs.begin(); i != specs.end(); ++i) {
+        SequenceModule &seq(scan.newAnalysis(i->type_match));
+        if (i->kind == "stat") {
+            addStat(seq, *i);
+        } else {
+            addText(seq, *i, first_source, outputs);
+        }
+    }
+    // No-op unless DATASERIES_METADATA_CACHE is set; otherwise opens any
+    // uncached files in parallel so the scans only hit the cache.
+    DataSeriesSource::warmMetadataCache(files);
+    for (vector<string>::iterator i = files.begin(); i != files.end(); ++i) {
+        scan.addSource(*i);
+    }
+
+    scan.run();
+
+    for (vector<FILE *>::iterator i = outputs.begin(); i != outputs.end(); ++i) {
+        INVARIANT(fclose(*i) == 0, format("close failed: %s") % strerror(errno));
+    }
+    for (size_t i = 0; i < scan.analysisCount(); ++i) {
+        cout << format("%s# analysis %d: %s\n") % (i > 0 ? "\n" : "") % i % specs[i].describe();
+        if (specs[i].kind == "text") {
+            DStoTextModule &text(dynamic_cast<DStoTextModule &>(**(scan.analysis(i).begin() + 1)));
+            cout << format("# wrote %d rows, where clause eliminated %d rows\n")
+                % text.processed_rows % text.ignored_rows;
+        } else {
+            cout.flush();
+            RowAnalysisModule::printAllResults(scan.analysis(i), 1);
+        }
+    }
+
+    cout << "\n";
+    for (size_t i = 0; i < scan.analysisCount(); ++i) {
+        const string &type_match(scan.analysisTypeMatch(i));
+        bool first = true;
+        for (size_t j = 0; j < i; ++j) {
+            first = first && scan.analysisTypeMatch(j) != type_match;
+        }
+        if (first) {
+            TypeIndexModule &source(scan.scan(type_match));
+            cout << format("# scan of '%s': %.2f MB -> %.2f MB\n") % type_match
+                % (source.total_compressed_bytes / (1024.0 * 1024))
+                % (source.total_uncompressed_bytes / (1024.0 * 1024));
+        }
+    }
+    cout << format("# %d analyses over %d scans\n") % scan.analysisCount() % scan.scanCount();
+    return 0;
+}
@@ -14,30 +14,55 @@
 
   =head1 SYNOPSIS
 
-  % dsstatgroupby I<extent-type-match> I<statistic-description>... from file...
+  % dsstatgroupby [--threads=I<n>] [--pipeline] [--autotune] I<extent-type-match>
+      I<statistic-description>... from file...
 
   =head1 STATISTIC DESCRIPTION
 
   Each statistic is described by a minimum of two arguments -- the statistic type and the expression.
-  Two types of statistic types are currently implemented basic (mean, stddev, min, max), and quantile
-  (percentile/100).  The expression implements the standard + - * / () and constants.  Two optional
-  arguments can be added.  where I<expr> adds in a conditional expression so you could calculate 
-  separate statistics over large and small files.  group by <field> specifies a column that should be
-  used for grouping the statistics.
+  Three types of statistic types are currently implemented basic (mean, stddev, min, max), quantile
+  (percentile/100), and sketch[=I<error>], which calculates approximate quantiles with a rank error
+  of about I<error> (default 0.01) in a bounded amount of memory per group.  Use sketch rather than
+  quantile when there are many groups.  Two further statistic types take a comma separated list
+  of fields instead of an expression: distinct[=I<error>] estimates the number of distinct values
+  of the fields in each group with a relative standard error of about I<error> (default 0.01), and
+  topk[=I<k>][:I<weight-expr>] finds the approximately I<k> (default 100) most common values of the
+  fields in each group, by row count or by the sum of I<weight-expr>.  Both use a bounded amount
+  of memory per group.  The expression implements the standard + - * / () and constants.  Two
+  optional arguments can be added.  where I<expr> adds in a conditional expression so you could
+  calculate separate statistics over large and small files.  group by <field>[,<field>...]
+  specifies the columns that should be used for grouping the statistics.
 
   =head1 DESCRIPTION
 
   dsstatgroupby processes one or more input files calculating multiple statistics in a single pass
-  over that input file.
+  over that input file.  Consecutive statistics with the same where and group by clauses share a
+  single grouping table; distinct and topk statistics are each calculated separately.  With
+  --threads=I<n> for I<n> > 1, each group of statistics is calculated on I<n> threads and the
+  results are merged.  With --pipeline, each group of statistics runs on its own thread, reading
+  extents through a bounded queue from the one before, and the busy and idle time of each stage
+  is printed at the end.
+
+  With --autotune, the number of threads unpacking the input and the amount of input read ahead
+  are adjusted while the files are read, growing them while the statistics are waiting for input
+  and shrinking them when not.
 
 */
 
 #include <boost/format.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <Lintel/StringUtil.hpp>
 
+#include <DataSeries/DataSeriesSource.hpp>
 #include <DataSeries/DSStatGroupByModule.hpp>
+#include <DataSeries/ExtentCache.hpp>
+#include <DataSeries/ParallelRowAnalysisModule.hpp>
 #include <DataSeries/TypeIndexModule.hpp>
+#include <DataSeries/PipelineModule.hpp>
 #include <DataSeries/PrefetchBufferModule.hpp>
 #include <DataSeries/SequenceModule.hpp>
+#include <DataSeries/SketchGroupByModule.hpp>
 
 using namespace std;
 using boost::format;
@@ -48,15 +73,40 @@ usage(const std::string &program_name, const std::string &error)
     // TODO: should we make the usage ... from <prefix> in <file...>?
     cerr << error << "\n"
          << "Usage: " << program_name 
-         << " <extent-type-match> (<stat-type> <expr> [where <expr>] [group by <group-by>])+\n"
-         << "  from file...\n"
+         << " [--threads=n] [--pipeline] [--autotune] <extent-type-match>\n"
+         << "  (<stat-type> <expr> [where <expr>] [group by <field>[,<field>...]])+ from file...\n"
          << "\n"
          << "  stat-types include:\n\n"
-         << "    basic, quantile\n\n"
+         << "    basic, quantile, sketch[=error]\n"
+         << "    distinct[=error], topk[=k][:weight-expr]; their <expr> is <field>[,<field>...]\n\n"
          << DSExpr::usage();
     exit(0);
 }
 
+/// statistics that share a where clause and grouping, calculated by one module
+struct StatSpec {
+    vector<string> stat_types, exprs, group_by;
+    string where_expr;
+    bool sketch; // a single distinct or topk statistic
+};
+
+class StatFactory : public ParallelRowAnalysisModule::Factory {
+  public:
+    StatFactory(const StatSpec &spec) : spec(spec) { }
+
+    virtual ParallelRowAnalysisModule::Analysis *operator()(DataSeriesModule &source) {
+        if (spec.sketch) {
+            return SketchGroupByModule::make(source, spec.stat_types[0], spec.exprs[0],
+                                             spec.group_by, spec.where_expr);
+        } else {
+            return new DSStatGroupByModule(source, spec.exprs, spec.stat_types, spec.group_by,
+                                           spec.where_expr);
+        }
+    }
+
+    const StatSpec spec;
+};
+
 
 int 
 main(int argc, char *_argv[])
@@ -67,15 +117,41 @@ main(int argc, char *_argv[])
     for (int i=0; i<argc; ++i) {
         argv.push_back(string(_argv[i]));
     }
+    int nthreads = 1;
+    bool pipeline = false, autotune = false;
+    while (argc > 1 && prefixequal(argv[1], "--")) {
+        if (prefixequal(argv[1], "--threads=")) {
+            nthreads = stringToInteger<int32_t>(argv[1].substr(10));
+            if (nthreads < 1) {
+                usage(argv[0], "--threads must be at least 1");
+            }
+        } else if (argv[1] == "--pipeline") {
+            pipeline = true;
+        } else if (argv[1] == "--autotune") {
+            autotune = true;
+        } else {
+            usage(argv[0], str(format("unknown option %s") % argv[1]));
+        }
+        argv.erase(argv.begin() + 1);
+        --argc;
+    }
     if (argc <= 5) usage(argv[0], "insufficient arguments");
 
     string extent_type_match(argv[1]);
     
     TypeIndexModule source(extent_type_match);
+    if (autotune) {
+        source.enableAutoTune();
+    }
     PrefetchBufferModule *prefetch = new PrefetchBufferModule(source, 64*1024*1024);
 
-    SequenceModule seq(prefetch);
+    // used by the parallel analyses until seq is deleted
+    vector<StatFactory *> factories;
+    boost::scoped_ptr<SequenceModule> seq_ptr
+        (pipeline ? new PipelineModule(prefetch) : new SequenceModule(prefetch));
+    SequenceModule &seq(*seq_ptr);
 
+    vector<StatSpec> specs;
     uint32_t argpos;
     for (argpos = 2; argpos < argv.size();) {
         if (argv[argpos] == "from") 
@@ -85,7 +161,8 @@ main(int argc, char *_argv[])
         }
         string stat_type(argv[argpos]); 
         ++argpos;
-        if (!DSStatGroupByModule::validStatType(stat_type)) {
+        bool sketch = SketchGroupByModule::validStatType(stat_type);
+        if (!sketch && !DSStatGroupByModule::validStatType(stat_type)) {
             usage(argv[0], str(format("'%s' is an invalid stat type") % stat_type));
         }
 
@@ -99,28 +176,58 @@ main(int argc, char *_argv[])
             ++argpos;
         }
 
-        string group_by;
+        vector<string> group_by;
 
         if (argv[argpos] == "group" && argv[argpos+1] == "by" && argpos + 2 < argv.size()) {
-            group_by = argv[argpos + 2];
+            split(argv[argpos + 2], ",", group_by);
             argpos += 3;
         }
 
-        seq.addModule(new DSStatGroupByModule(seq.tail(), expr, group_by, 
-                                              stat_type, where_expr));
+        if (sketch || specs.empty() || specs.back().sketch
+            || specs.back().where_expr != where_expr || specs.back().group_by != group_by) {
+            specs.push_back(StatSpec());
+            specs.back().where_expr = where_expr;
+            specs.back().group_by = group_by;
+            specs.back().sketch = sketch;
+        }
+        specs.back().stat_types.push_back(stat_type);
+        specs.back().exprs.push_back(expr);
+    }
+
+    for (vector<StatSpec>::iterator i = specs.begin(); i != specs.end(); ++i) {
+        if (nthreads > 1) {
+            factories.push_back(new StatFactory(*i));
+            seq.addModule(new ParallelRowAnalysisModule(seq.tail(), *factories.back(),
+                                                        nthreads));
+        } else if (i->sketch) {
+            seq.addModule(SketchGroupByModule::make(seq.tail(), i->stat_types[0], i->exprs[0],
+                                                    i->group_by, i->where_expr));
+        } else {
+            seq.addModule(new DSStatGroupByModule(seq.tail(), i->exprs, i->stat_types,
+                                                  i->group_by, i->where_expr));
+        }
     }
 
     if (argpos >= argv.size() || argv[argpos] != "from") {
         usage(argv[0], "missing from in arguments");
     }
     ++argpos;
+    vector<string> files;
     for (;argpos<argv.size(); ++argpos) {
         source.addSource(argv[argpos]);
+        files.push_back(argv[argpos]);
     }
+    // No-op unless DATASERIES_METADATA_CACHE is set; otherwise opens any
+    // uncached files in parallel so the sequential scan only hits the cache.
+    DataSeriesSource::warmMetadataCache(files);
 
     seq.getAndDeleteShared();
     
     RowAnalysisModule::printAllResults(seq, 1);
+    if (pipeline) {
+        printf("\n");
+        dynamic_cast<PipelineModule &>(seq).printStageTimes();
+    }
 
     printf("\n");
     printf("# extents: %.2f MB -> %.2f MB\n",
@@ -133,7 +240,17 @@ main(int argc, char *_argv[])
            (double)source.total_uncompressed_bytes/(1024.0*1024));
     printf("# wait fraction :  %8.2f\n",
            source.waitFraction());
-    
+    ExtentCache::Stats cache_stats(ExtentCache::instance().getStats());
+    if (cache_stats.max_bytes > 0) {
+        cout << format("# extent cache hit rate: %.2f (%d hits, %d misses, %d evictions)\n")
+            % cache_stats.hitRate() % cache_stats.hits % cache_stats.misses
+            % cache_stats.evictions;
+    }
+
+    seq_ptr.reset();
+    for (vector<StatFactory *>::iterator i = factories.begin(); i != factories.end(); ++i) {
+        delete *i;
+    }
     return 0;
 }
 
@@ -99,8 +99,6 @@ main(int argc, char *argv[])
 
     ExtentSeries ip_hostname_series(ip_hostname_type);
 
-    ip_hostname_out.writeExtentLibrary(library);
-
     Variable32Field shortname_field(ip_hostname_series, "shortname", Field::flag_nullable);
     Variable32Field fullname_field(ip_hostname_series, "fullname", Field::flag_nullable);
     Variable32Field domainname_field(ip_hostname_series, "domainname", Field::flag_nullable);
@@ -111,6 +109,7 @@ main(int argc, char *argv[])
                                                ip_hostname_series,
                                                ip_hostname_type, 
                                                packing_args.extent_size);
+    ip_hostname_out.writeExtentLibrary(library);
 
     uint32_t linenum = 0;
     string mapping_time_line;
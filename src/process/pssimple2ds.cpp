@@ -109,6 +109,8 @@ main(int argc, char *argv[])
 {
     commonPackingArgs packing_args;
     getPackingArgs(&argc,argv,&packing_args);
+    INVARIANT(packing_args.extent_size > 0,
+              "pssimple2ds cuts its own extents, so needs a fixed --extent-size");
 
     double first_ps_record_time = -Double::Inf;
     if (argc == 4) {
@@ -106,11 +106,11 @@ class Indexer {
         output = new DataSeriesSink(index_filename, 
                                     packing_args.compress_modes,
                                     packing_args.compress_level);
-        output->writeExtentLibrary(library);
 
         word_series.setType(word_index_type);
         word_module = new OutputModule(*output, word_series, word_index_type,
                                        packing_args.extent_size);
+        output->writeExtentLibrary(library);
     }
 
     virtual ~Indexer() {
@@ -334,13 +334,12 @@ email_entries(vector<string> &args, commonPackingArgs &packing_args)
     DataSeriesSink output(entries_filename, packing_args.compress_modes,
                           packing_args.compress_level);
 
-    output.writeExtentLibrary(library);
-
     ExtentSeries entries_series(entries_type);
     Int32Field id(entries_series, "id");
     Variable32Field text(entries_series, "text");
     OutputModule entries_module(output, entries_series, entries_type,
                                 packing_args.extent_size);
+    output.writeExtentLibrary(library);
     int cur_id = 0;
     for (unsigned i=3;i<args.size();++i) {
         FILE *f = fopen(args[i].c_str(), "r");
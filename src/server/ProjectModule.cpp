@@ -1,71 +1,50 @@
 #include "DSSModule.hpp"
 
+// Passes on views of the input extents (see ExtentType::makeView), so nothing is copied unless
+// the projection is written out.
 class ProjectModule : public OutputSeriesModule {
   public:
     ProjectModule(DataSeriesModule &source, const vector<string> &keep_columns)
-            : source(source), keep_columns(keep_columns), copier(input_series, output_series)
+            : source(source), keep_columns(keep_columns)
     { }
 
     virtual ~ProjectModule() { }
 
     void firstExtent(Extent &in) {
         const ExtentType::Ptr t(in.getTypePtr());
-        input_series.setType(t);
-
-        string output_xml(str(format("<ExtentType name=\"project (%s)\" namespace=\"%s\""
-                                     " version=\"%d.%d\">\n") % t->getName() % t->getNamespace()
-                              % t->majorVersion() % t->minorVersion()));
-        HashUnique<string> kc;
+        vector<string> columns;
         BOOST_FOREACH(const string &c, keep_columns) {
-            kc.add(c);
-        }
-        for (uint32_t i = 0; i < t->getNFields(); ++i) {
-            const string &field_name(t->getFieldName(i));
-            if (kc.exists(field_name)) {
-                output_xml.append(t->xmlFieldDesc(field_name));
+            if (t->hasColumn(c)) {
+                columns.push_back(c);
             }
         }
-        output_xml.append("</ExtentType>\n");
-        ExtentTypeLibrary lib;
-        const ExtentType::Ptr output_type(lib.registerTypePtr(output_xml));
-            
-        output_series.setType(output_type);
-
-        copier.prep();
+        view_type = t->makeView(columns);
+        output_series.setType(view_type->getMaterializedTypePtr());
     }
 
     virtual Extent::Ptr getSharedExtent() {
-        while (true) {
-            Extent::Ptr in = source.getSharedExtent();
-            if (in == NULL) {
-                return returnOutputSeries();
-            }
-            if (input_series.getTypePtr() == NULL) {
-                firstExtent(*in);
-            }
+        const RowSelection *selection;
+        Extent::Ptr e = getSelectedExtent(selection);
+        return materializeSelection(e, selection);
+    }
 
-            if (!output_series.hasExtent()) {
-                output_series.newExtent();
-            }
-        
-            for (input_series.setExtent(in); input_series.more(); input_series.next()) {
-                output_series.newRecord();
-                copier.copyRecord();
-            }
-            if (output_series.getExtentRef().size() > 96*1024) {
-                return returnOutputSeries();
-            }
+    virtual Extent::Ptr getSelectedExtent(const RowSelection *&selection) {
+        Extent::Ptr in = source.getSelectedExtent(selection);
+        if (in == NULL) {
+            return in;
         }
+        if (view_type == NULL) {
+            firstExtent(*in);
+        }
+        return Extent::makeView(in, view_type);
     }
 
     DataSeriesModule &source;
-    ExtentSeries input_series;
     vector<string> keep_columns;
-    ExtentRecordCopy copier;
+    ExtentType::Ptr view_type;
 };
 
 OutputSeriesModule::OSMPtr 
 dataseries::makeProjectModule(DataSeriesModule &source, const vector<string> &keep_columns) {
     return OutputSeriesModule::OSMPtr(new ProjectModule(source, keep_columns));
 }
-
@@ -1,5 +1,9 @@
 #include "DSSModule.hpp"
 
+#include <sstream>
+
+#include <DataSeries/NativeCode.hpp>
+
 #include <new> // losertree.h needs this and forgot to include it.
 #include <parallel/losertree.h>
 
@@ -9,7 +13,9 @@
    complicated template, and does not support sorting based on multiple columns.  Since the intent
    in this code is to first make slow, generalfield implementations and then eventually dynamically
    generate C++ source code for specific operations, we don't need the complication of the
-   template, and so we create yet another module to be more in the style of the server */
+   template, and so we create yet another module to be more in the style of the server.  When
+   NativeCode is enabled, the comparison is generated as C++ for the sort columns and extent type;
+   the GeneralField comparison remains as the fallback. */
 
 #if 0
 #include <algorithm>
@@ -53,12 +59,28 @@ class SortModule : public OutputSeriesModule {
 
     virtual ~SortModule() { }
 
+    typedef bool (*LessFn)(const uint8_t *row_a, const uint8_t *var_a,
+                           const uint8_t *row_b, const uint8_t *var_b);
+
     struct ExtentRowCompareState {
-        ExtentRowCompareState() : extent(), columns() { }
+        ExtentRowCompareState() : extent(), columns(), native(), native_less(NULL) { }
         Extent::Ptr extent;
         vector<SortColumnImpl> columns;
+        NativeCode::Ptr native;
+        /// generated version of strictlyLessThan for columns, or NULL
+        LessFn native_less;
     };
 
+    static bool lessThan(const ExtentRowCompareState &state,
+                         const Extent::Ptr &ea, const SEP_RowOffset &oa,
+                         const Extent::Ptr &eb, const SEP_RowOffset &ob) {
+        if (state.native_less != NULL) {
+            return state.native_less(oa.rowPosition(*ea), ea->variabledata.begin(),
+                                     ob.rowPosition(*eb), eb->variabledata.begin());
+        }
+        return strictlyLessThan(ea, oa, eb, ob, state.columns);
+    }
+
     static bool strictlyLessThan(const Extent::Ptr &ea, const SEP_RowOffset &oa,
                                  const Extent::Ptr &eb, const SEP_RowOffset &ob,
                                  const vector<SortColumnImpl> &columns) {
@@ -89,6 +111,54 @@ class SortModule : public OutputSeriesModule {
         return false; // all == so not <
     }
 
+    /// C++ source for a LessFn doing the same comparison as strictlyLessThan, or "" if one
+    /// of the columns has a type without native support
+    static string nativeLessSource(const ExtentType &type, const vector<SortColumn> &sort_by) {
+        ostringstream source;
+        source << NativeCode::comment(type.getXmlDescriptionString())
+               << "extern \"C\" bool dataseries_less(const uint8_t *row_a, const uint8_t *var_a,"
+               << " const uint8_t *row_b, const uint8_t *var_b) {\n";
+        BOOST_FOREACH(const SortColumn &by, sort_by) {
+            string va(NativeCode::value(type, by.column, "row_a", "var_a"));
+            string vb(NativeCode::value(type, by.column, "row_b", "var_b"));
+            if (va.empty()) {
+                return string();
+            }
+            const char *less = by.sort_mode == SM_Ascending ? "true" : "false";
+            const char *greater = by.sort_mode == SM_Ascending ? "false" : "true";
+            source << NativeCode::comment(str(format("column %s %s, nulls %s") % by.column
+                                              % (by.sort_mode == SM_Ascending ? "ascending"
+                                                 : "descending")
+                                              % (by.null_mode == NM_First ? "first" : "last")))
+                   << "    {\n"
+                   << format("        bool a_null = %s, b_null = %s;\n")
+                      % NativeCode::isNull(type, by.column, "row_a")
+                      % NativeCode::isNull(type, by.column, "row_b")
+                   << "        if (a_null != b_null) {\n"
+                   << format("            return %s;\n")
+                      % (by.null_mode == NM_First ? "a_null" : "b_null")
+                   << "        }\n"
+                   << "        if (!a_null) {\n";
+            if (type.getFieldType(by.column) == ExtentType::ft_variable32) {
+                source << format("            int cmp = compare(%s, %s);\n") % va % vb
+                       << format("            if (cmp != 0) {\n"
+                                 "                return cmp < 0 ? %s : %s;\n"
+                                 "            }\n") % less % greater;
+            } else {
+                source << format("            if (%s < %s) {\n"
+                                 "                return %s;\n"
+                                 "            } else if (%s < %s) {\n"
+                                 "                return %s;\n"
+                                 "            }\n") % va % vb % less % vb % va % greater;
+            }
+            source << "        }\n"
+                   << "    }\n";
+        }
+        source << "    return false;\n"
+               << "}\n";
+        return source.str();
+    }
+
     class ExtentRowCompare {
       public:
         ExtentRowCompare(ExtentRowCompareState *state) : state(state) { }
@@ -99,7 +169,7 @@ class SortModule : public OutputSeriesModule {
         }
 
         bool operator ()(const SEP_RowOffset &a, const SEP_RowOffset &b) const {
-            return strictlyLessThan(state->extent, a, state->extent, b, state->columns);
+            return lessThan(*state, state->extent, a, state->extent, b);
         }
 
         const ExtentRowCompareState *state;
@@ -119,7 +189,7 @@ class SortModule : public OutputSeriesModule {
         bool operator()(uint32_t ia, uint32_t ib) const {
             const SortedExtent &sea(*sm->sorted_extents[ia]);
             const SortedExtent &seb(*sm->sorted_extents[ib]);
-            return strictlyLessThan(sea.e, *sea.pos, seb.e, *seb.pos, sm->ercs.columns);
+            return lessThan(sm->ercs, sea.e, *sea.pos, seb.e, *seb.pos);
         }
 
         const SortModule *sm;
@@ -141,9 +211,25 @@ class SortModule : public OutputSeriesModule {
                                                   by.sort_mode == SM_Ascending ? true : false,
                                                   by.null_mode));
         }
+
+        string source(nativeLessSource(*t, sort_by));
+        if (!source.empty()) {
+            ercs.native = NativeCode::compile(source);
+            if (ercs.native != NULL) {
+                ercs.native_less
+                    = reinterpret_cast<LessFn>(ercs.native->lookup("dataseries_less"));
+            }
+        }
     }
 
     void sortExtent(Extent::Ptr in) {
+        if (ercs.native_less != NULL && in->getTypePtr() != input_series.getTypePtr()
+            && in->getTypePtr()->getXmlDescriptionString()
+               != input_series.getTypePtr()->getXmlDescriptionString()) {
+            // the generated offsets are only right for the first type
+            LintelLogDebug("SortModule", "extent type changed, using the interpreted comparison");
+            ercs.native_less = NULL;
+        }
         ercs.extent = in;
         SortedExtent::Ptr se(new SortedExtent(in));
         se->offsets.reserve(in->nRecords());
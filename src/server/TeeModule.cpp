@@ -14,13 +14,15 @@ class TeeModule : public RowAnalysisModule {
     }
 
     virtual void firstExtent(const Extent &e) {
+        // views (e.g. from a project) get their visible columns copied into a type of their own
+        const ExtentType::Ptr output_type(e.getTypePtr()->getMaterializedTypePtr());
         series.setType(e.getTypePtr());
-        output_series.setType(e.getTypePtr());
+        output_series.setType(output_type);
         SINVARIANT(output_module == NULL);
-        output_module = new OutputModule(output, output_series, e.getTypePtr(), 96*1024);
+        output_module = new OutputModule(output, output_series, output_type, 96*1024);
         copier.prep();
         ExtentTypeLibrary library;
-        library.registerType(e.getTypePtr());
+        library.registerType(output_type);
         output.writeExtentLibrary(library);
         first_extent = true;
     }
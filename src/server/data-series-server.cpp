@@ -5,6 +5,7 @@
 #include <errno.h>
 #include <inttypes.h>
 #include <pwd.h>
+#include <stdlib.h>
 #include <unistd.h>
 
 #include <concurrency/ThreadManager.h>
@@ -24,8 +25,10 @@
 #include <Lintel/ProgramOptions.hpp>
 #include <Lintel/STLUtility.hpp>
 
+#include <DataSeries/ColumnBatch.hpp>
 #include <DataSeries/DSExpr.hpp>
 #include <DataSeries/GeneralField.hpp>
+#include <DataSeries/NativeCode.hpp>
 #include <DataSeries/RowAnalysisModule.hpp>
 #include <DataSeries/SequenceModule.hpp>
 #include <DataSeries/TFixedField.hpp>
@@ -197,18 +200,48 @@ class DataSeriesServerHandler : public DataSeriesServerIf, public ThrowError {
             fields.push_back(tmp);
         }
 
-        BOOST_FOREACH(const vector<NullableString> &row, data.rows) {
-            output_module.newRecord();
+        // Append the rows a column at a time; variable32 values are used where they are, the
+        // rest are converted from their text.
+        const size_t nrows = data.rows.size();
+        vector<vector<string> > text(fields.size());
+        vector<vector<Variable32Ref> > refs(fields.size());
+        vector<vector<uint8_t> > nulls(fields.size(), vector<uint8_t>(nrows, 0));
+        vector<bool> is_variable(fields.size());
+        for (uint32_t i = 0; i < fields.size(); ++i) {
+            is_variable[i] = fields[i]->getType() == ExtentType::ft_variable32;
+            if (is_variable[i]) {
+                refs[i].resize(nrows);
+            } else {
+                text[i].resize(nrows);
+            }
+        }
+        for (size_t j = 0; j < nrows; ++j) {
+            const vector<NullableString> &row(data.rows[j]);
             if (row.size() != fields.size()) {
                 requestError("incorrect number of fields");
             }
             for (uint32_t i = 0; i < row.size(); ++i) {
-                if (row[i].__isset.v) {
-                    fields[i]->set(row[i].v);
+                if (!row[i].__isset.v) {
+                    nulls[i][j] = 1;
+                } else if (is_variable[i]) {
+                    refs[i][j] = Variable32Ref(reinterpret_cast<const uint8_t *>(row[i].v.data()),
+                                               row[i].v.size());
+                } else {
+                    text[i][j] = row[i].v;
+                }
+            }
+        }
+        if (nrows > 0) {
+            ColumnBatch batch(nrows);
+            for (uint32_t i = 0; i < fields.size(); ++i) {
+                if (is_variable[i]) {
+                    batch.add(dynamic_cast<GF_Variable32 &>(*fields[i]).myfield, &refs[i][0],
+                              &nulls[i][0]);
                 } else {
-                    fields[i]->setNull();
+                    batch.add(*fields[i], &text[i][0], &nulls[i][0]);
                 }
             }
+            output_module.appendColumns(batch);
         }
 
         updateTableInfo(dest_table, type);
@@ -539,6 +572,10 @@ void setupWorkingDirectory() {
 
 int main(int argc, char *argv[]) {
     LintelLog::parseEnv();
+    // queries run the same where clauses and sorts over many extents of one type, so compiling
+    // them pays off; DATASERIES_NATIVE_CODE=0 turns it off.
+    const char *native_code = getenv("DATASERIES_NATIVE_CODE");
+    NativeCode::setEnabled(native_code == NULL || string(native_code) != "0");
     shared_ptr<TProtocolFactory> protocolFactory(new TBinaryProtocolFactory());
     shared_ptr<DataSeriesServerHandler> handler(new DataSeriesServerHandler());
     shared_ptr<TProcessor> processor(new DataSeriesServerProcessor(handler));
@@ -0,0 +1,186 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    Writing test files, and the analyses and data shared by several of the tests
+*/
+
+#ifndef DATASERIES_TESTS_TESTCOMMON_HPP
+#define DATASERIES_TESTS_TESTCOMMON_HPP
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <boost/format.hpp>
+#include <boost/utility.hpp>
+
+#include <Lintel/AssertBoost.hpp>
+
+#include <DataSeries/DataSeriesFile.hpp>
+#include <DataSeries/DataSeriesModule.hpp>
+#include <DataSeries/RowAnalysisModule.hpp>
+
+/** \brief A test file being written with lzf: its type library, sink, and an output module
+    and series for each of its types.
+
+    The library is written when the first record is added or output() is first called, so
+    sink options such as setZoneMapFields() go before that.  The outputs are closed and the
+    file written out when it is destroyed. */
+class TestFile : boost::noncopyable {
+  public:
+    TestFile(const std::string &filename, const std::string &type_xml,
+             uint32_t extent_size)
+        : sink(filename, Extent::compression_algs[Extent::compress_mode_lzf].compress_flag),
+          wrote_library(false)
+    {
+        addType(type_xml, extent_size);
+    }
+
+    ~TestFile() {
+        writeLibrary();
+        for (size_t i = 0; i < outputs.size(); ++i) {
+            delete outputs[i];
+            delete all_series[i];
+        }
+    }
+
+    /// another type written to the file, returning its index for series() and output()
+    size_t addType(const std::string &type_xml, uint32_t extent_size) {
+        SINVARIANT(!wrote_library);
+        const ExtentType::Ptr type(library.registerTypePtr(type_xml));
+        all_series.push_back(new ExtentSeries(type));
+        outputs.push_back(new OutputModule(sink, *all_series.back(), type, extent_size));
+        return outputs.size() - 1;
+    }
+
+    ExtentSeries &series(size_t type = 0) {
+        return *all_series.at(type);
+    }
+
+    OutputModule &output(size_t type = 0) {
+        writeLibrary();
+        return *outputs.at(type);
+    }
+
+    void newRecord(size_t type = 0) {
+        output(type).newRecord();
+    }
+
+    DataSeriesSink sink;
+
+  private:
+    void writeLibrary() {
+        if (!wrote_library) {
+            sink.writeExtentLibrary(library);
+            wrote_library = true;
+        }
+    }
+
+    ExtentTypeLibrary library;
+    bool wrote_library;
+    std::vector<ExtentSeries *> all_series;
+    std::vector<OutputModule *> outputs;
+};
+
+/** \brief Counts and sums the int32 field bytes, optionally spinning for each row to make a
+    slow analysis. */
+class SumBytes : public RowAnalysisModule {
+  public:
+    SumBytes(DataSeriesModule &source, int spin = 0)
+        : RowAnalysisModule(source), bytes(series, "bytes"), spin(spin), count(0), sum(0) { }
+
+    virtual void processRow() {
+        ++count;
+        sum += bytes.val();
+        volatile int32_t busy = 0;
+        for (int i = 0; i < spin; ++i) {
+            busy += i;
+        }
+    }
+
+    Int32Field bytes;
+    const int spin;
+    uint64_t count;
+    int64_t sum;
+};
+
+inline void checkSameSums(const SumBytes &a, const SumBytes &b, const std::string &what) {
+    INVARIANT(a.count == b.count && a.sum == b.sum, boost::format("%s: %d/%d != %d/%d")
+              % what % a.count % a.sum % b.count % b.sum);
+}
+
+/// what module.printResult() prints
+inline std::string captureResult(RowAnalysisModule &module) {
+    std::ostringstream out;
+    std::streambuf *was = std::cout.rdbuf(out.rdbuf());
+    module.printResult();
+    std::cout.rdbuf(was);
+    return out.str();
+}
+
+inline std::vector<std::string> strings(const std::string &a, const std::string &b = "") {
+    std::vector<std::string> ret;
+    ret.push_back(a);
+    if (!b.empty()) {
+        ret.push_back(b);
+    }
+    return ret;
+}
+
+/// records of (client, op, bytes) for the group by tests
+namespace client_ops {
+    const std::string type_xml(
+        "<ExtentType namespace=\"ssd.hpl.hp.com\" name=\"Test::ClientOps\" version=\"1.0\" >\n"
+        "  <field type=\"int32\" name=\"client\" />\n"
+        "  <field type=\"variable32\" name=\"op\" opt_nullable=\"yes\" />\n"
+        "  <field type=\"double\" name=\"bytes\" />\n"
+        "</ExtentType>\n");
+
+    inline int32_t clientOf(int32_t i, int32_t nclients) {
+        return (i * 7919) % nclients - nclients / 2;
+    }
+
+    /// null for an empty string; some ops have embedded nuls
+    inline std::string opOf(int32_t i) {
+        switch (i % 5)
+            {
+            case 0: return "";
+            case 1: return "read";
+            case 2: return "write";
+            case 3: return std::string("get\0attr", 8);
+            default: return "get";
+            }
+    }
+
+    /// multiples of 0.5 so the sums are exact in any order
+    inline double bytesOf(int32_t i) {
+        return (i % 97) * 0.5;
+    }
+
+    /// write nrows records with nclients clients to filename
+    inline void writeFile(const std::string &filename, int32_t nrows, int32_t nclients,
+                          uint32_t extent_size) {
+        TestFile file(filename, type_xml, extent_size);
+        Int32Field client(file.series(), "client");
+        Variable32Field op(file.series(), "op", Field::flag_nullable);
+        DoubleField bytes(file.series(), "bytes");
+        for (int32_t i = 0; i < nrows; ++i) {
+            file.newRecord();
+            client.set(clientOf(i, nclients));
+            if (opOf(i).empty()) {
+                op.setNull();
+            } else {
+                op.set(opOf(i));
+            }
+            bytes.set(bytesOf(i));
+        }
+    }
+}
+
+#endif
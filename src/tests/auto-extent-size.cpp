@@ -0,0 +1,195 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    check that ExtentSizeTuner grows extents while it pays, backs off when packing slows,
+    stays within what the readers can use in parallel, and that OutputModule records the
+    sizes it chose in the file
+*/
+
+#include <deque>
+#include <iostream>
+
+#include <boost/format.hpp>
+
+#include <Lintel/TestUtil.hpp>
+
+#include <DataSeries/DataSeriesFile.hpp>
+#include <DataSeries/ExtentSizeTuner.hpp>
+#include <DataSeries/TypeIndexModule.hpp>
+#include <DataSeries/commonargs.hpp>
+
+using namespace std;
+using boost::format;
+using dataseries::ExtentSizeTuner;
+using dataseries::IExtentSink;
+
+const uint32_t KiB = 1024, MiB = 1024 * 1024;
+
+/// packed/unpacked, improving with size with diminishing returns
+double diminishingRatio(uint32_t size) {
+    return 0.2 + 0.3 * (64.0 * KiB) / size;
+}
+
+double steadyRate(uint32_t) {
+    return 100.0 * MiB;
+}
+
+double slowAbove256KiB(uint32_t size) {
+    return size > 256 * KiB ? 10.0 * MiB : 100.0 * MiB;
+}
+
+/** Feed tuner total_bytes of extents that pack as ratio and rate say, with packing two
+    extents behind flushing as it is with a sink's compression threads.  Returns the largest
+    target used. */
+uint32_t simulate(ExtentSizeTuner &tuner, uint64_t total_bytes, double (*ratio)(uint32_t),
+                  double (*rate)(uint32_t)) {
+    IExtentSink::Stats packed;
+    deque<uint32_t> pending;
+    uint32_t max_target = 0;
+    for (uint64_t done = 0; done < total_bytes; ) {
+        uint32_t size = tuner.targetSize();
+        max_target = max(max_target, size);
+        done += size;
+        pending.push_back(size);
+        if (pending.size() > 2) {
+            uint32_t s = pending.front();
+            pending.pop_front();
+            ++packed.extents;
+            packed.unpacked_size += s;
+            packed.packed_size += static_cast<uint64_t>(s * ratio(s));
+            packed.pack_time += s / rate(s);
+        }
+        if (tuner.extentFlushed(size)) {
+            tuner.update(packed);
+        }
+    }
+    return max_target;
+}
+
+void checkTuning() {
+    // grows while doubling saves at least 3%, i.e. up to 4MiB, and then only tries the next
+    // size up now and then
+    {
+        ExtentSizeTuner tuner(1);
+        SINVARIANT(tuner.targetSize() == ExtentSizeTuner::min_extent_size);
+        uint32_t max_target = simulate(tuner, 4ULL * 1024 * MiB, diminishingRatio, steadyRate);
+        INVARIANT(tuner.targetSize() == 4 * MiB || tuner.targetSize() == 8 * MiB,
+                  format("settled at %d") % tuner.targetSize());
+        SINVARIANT(max_target <= 16 * MiB);
+    }
+
+    // backs off when packing slows down too much
+    {
+        ExtentSizeTuner tuner(1);
+        uint32_t max_target = simulate(tuner, 256 * MiB, diminishingRatio, slowAbove256KiB);
+        INVARIANT(tuner.targetSize() == 256 * KiB, format("settled at %d") % tuner.targetSize());
+        SINVARIANT(max_target == 512 * KiB);
+    }
+
+    // leaves enough extents for 8 readers of 4MiB: two each
+    {
+        ExtentSizeTuner tuner(8);
+        uint32_t max_target = simulate(tuner, 4 * MiB, diminishingRatio, steadyRate);
+        INVARIANT(max_target >= 128 * KiB && max_target <= 256 * KiB,
+                  format("grew to %d") % max_target);
+    }
+}
+
+const string type_string(
+    "<ExtentType namespace=\"ssd.hpl.hp.com\" name=\"Test::AutoExtentSize\" version=\"1.0\" >\n"
+    "  <field type=\"int64\" name=\"id\" />\n"
+    "  <field type=\"int32\" name=\"bytes\" />\n"
+    "  <field type=\"variable32\" name=\"name\" />\n"
+    "</ExtentType>\n");
+
+const int32_t nrows = 400 * 1000;
+
+void checkRecorded() {
+    uint32_t chosen;
+    {
+        ExtentTypeLibrary library;
+        const ExtentType::Ptr type(library.registerTypePtr(type_string));
+        DataSeriesSink sink("auto-extent-size.ds",
+                            Extent::compression_algs[Extent::compress_mode_lzf].compress_flag);
+        ExtentSeries series(type);
+        OutputModule output(sink, series, type, OutputModule::auto_extent_size);
+        SINVARIANT(output.isAutoExtentSize());
+        SINVARIANT(output.getTargetExtentSize() == ExtentSizeTuner::min_extent_size);
+        output.setConsumerThreads(1);
+        // as a copy of the sizes from another file would; not recorded
+        sink.noteAutoExtentSize(ExtentSizeTuner::extentType()->getName(), 1024 * 1024);
+        sink.writeExtentLibrary(library);
+
+        Int64Field id(series, "id");
+        Int32Field bytes(series, "bytes");
+        Variable32Field name(series, "name");
+        for (int32_t i = 0; i < nrows; ++i) {
+            output.newRecord();
+            id.set(i);
+            bytes.set(i % 1000);
+            name.set(str(format("name-%d") % (i % 5000)));
+        }
+        output.close();
+        chosen = output.getTargetExtentSize();
+        sink.close();
+    }
+
+    uint32_t max_extent = 0;
+    int32_t rows = 0;
+    {
+        TypeIndexModule source("Test::AutoExtentSize");
+        source.addSource("auto-extent-size.ds");
+        ExtentSeries series;
+        Int64Field id(series, "id");
+        for (Extent::Ptr e = source.getSharedExtent(); e != NULL; e = source.getSharedExtent()) {
+            max_extent = max(max_extent, static_cast<uint32_t>(e->size()));
+            for (series.setExtent(e); series.morerecords(); ++series, ++rows) {
+                SINVARIANT(id.val() == rows);
+            }
+        }
+    }
+    SINVARIANT(rows == nrows);
+
+    TypeIndexModule sizes(ExtentSizeTuner::extentType()->getName());
+    sizes.addSource("auto-extent-size.ds");
+    Extent::Ptr e = sizes.getSharedExtent();
+    SINVARIANT(e != NULL && sizes.getSharedExtent() == NULL && e->nRecords() == 1);
+    ExtentSeries series(e);
+    Variable32Field extenttype(series, "extenttype");
+    Int32Field target(series, "target_extent_size"), min_size(series, "min_extent_size"),
+        max_size(series, "max_extent_size"), changes(series, "changes");
+    SINVARIANT(extenttype.stringval() == "Test::AutoExtentSize");
+    INVARIANT(static_cast<uint32_t>(target.val()) == chosen,
+              format("recorded %d, chose %d") % target.val() % chosen);
+    SINVARIANT(static_cast<uint32_t>(min_size.val()) == ExtentSizeTuner::min_extent_size);
+    SINVARIANT(min_size.val() <= target.val() && target.val() <= max_size.val());
+    SINVARIANT((changes.val() == 0) == (max_size.val() == min_size.val()));
+    // extents overshoot their target by at most a record
+    SINVARIANT(max_extent < static_cast<uint32_t>(max_size.val()) + 1024);
+    cout << format("chose %d bytes after %d changes, largest %d\n") % target.val()
+        % changes.val() % max_size.val();
+}
+
+void checkArgs() {
+    char prog[] = "prog", size[] = "--extent-size=auto", file[] = "file";
+    char *argv[] = { prog, size, file };
+    int argc = 3;
+    commonPackingArgs args;
+    getPackingArgs(&argc, argv, &args);
+    SINVARIANT(args.extent_size == static_cast<int>(OutputModule::auto_extent_size));
+    SINVARIANT(argc == 2 && argv[1] == file);
+}
+
+int main() {
+    checkTuning();
+    checkRecorded();
+    checkArgs();
+
+    cout << "auto extent size checks passed\n";
+    return 0;
+}
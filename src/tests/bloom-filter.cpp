@@ -0,0 +1,208 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    check Bloom filters and the lookup mode of the index source modules
+*/
+
+#include <iostream>
+
+#include <boost/format.hpp>
+
+#include <DataSeries/BloomFilter.hpp>
+#include <DataSeries/GeneralField.hpp>
+#include <DataSeries/TypeIndexModule.hpp>
+
+#include "TestCommon.hpp"
+
+using namespace std;
+using boost::format;
+using dataseries::BloomFilter;
+
+const string type_string(
+    "<ExtentType namespace=\"ssd.hpl.hp.com\" name=\"Test::Bloom\" version=\"1.0\" >\n"
+    "  <field type=\"int64\" name=\"id\" />\n"
+    "  <field type=\"variable32\" name=\"host\" opt_nullable=\"yes\" />\n"
+    "</ExtentType>\n");
+
+const int32_t nrows = 40 * 1000;
+
+int64_t idOf(int32_t i) {
+    return (static_cast<int64_t>(i) * 2654435761LL) % (1LL << 40);
+}
+
+string hostOf(int32_t i) {
+    return (format("10.%d.%d.%d") % (i % 7) % ((i * 31) % 256) % ((i * 17) % 253)).str();
+}
+
+void checkFilter() {
+    BloomFilter filter(1000, 10);
+    GeneralValue v;
+    for (int32_t i = 0; i < 1000; ++i) {
+        v.setInt64(idOf(i));
+        filter.addKey(BloomFilter::key(v));
+    }
+    int32_t false_positives = 0;
+    for (int32_t i = 0; i < 1000; ++i) {
+        v.setInt64(idOf(i));
+        SINVARIANT(filter.mayContain(v));
+        v.setInt64(idOf(i + 1000));
+        if (filter.mayContain(v)) {
+            ++false_positives;
+        }
+    }
+    INVARIANT(false_positives < 30, format("%d false positives") % false_positives);
+
+    // numbers are found whatever type they are looked up as
+    GeneralValue d;
+    d.setDouble(static_cast<double>(idOf(17)));
+    SINVARIANT(filter.mayContain(d));
+    SINVARIANT(!filter.mayContain(GeneralValue()));
+
+    BloomFilter copy(filter.getBits(), filter.getNHashes());
+    v.setInt64(idOf(42));
+    SINVARIANT(copy.mayContain(v));
+}
+
+void writeFile(const string &filename) {
+    TestFile out(filename, type_string, 16 * 1024);
+    vector<string> fields;
+    fields.push_back("id");
+    fields.push_back("host");
+    out.sink.setBloomFilterFields("Test::Bloom", fields);
+
+    Int64Field id(out.series(), "id");
+    Variable32Field host(out.series(), "host", Field::flag_nullable);
+    for (int32_t i = 0; i < nrows; ++i) {
+        out.newRecord();
+        id.set(idOf(i));
+        if (i % 10 == 0) {
+            host.setNull();
+        } else {
+            host.set(hostOf(i));
+        }
+    }
+}
+
+/// rows with id (if not null) and host (if not empty) in the extents returned by a lookup
+int32_t lookup(const GeneralValue &id_value, const string &host_value,
+               IndexSourceModule::LookupStats &stats, int32_t &extents,
+               bool count_positives = true) {
+    TypeIndexModule source("Test::Bloom");
+    source.addSource("bloom-filter.ds");
+    source.setCountLookupPositives(count_positives);
+    if (id_value.getType() != ExtentType::ft_unknown) {
+        source.addLookup("id", id_value);
+    }
+    if (!host_value.empty()) {
+        GeneralValue v;
+        v.setVariable32(host_value);
+        source.addLookup("host", v);
+    }
+    ExtentSeries series;
+    Int64Field id(series, "id");
+    Variable32Field host(series, "host", Field::flag_nullable);
+    int32_t rows = 0;
+    extents = 0;
+    for (Extent::Ptr e(source.getSharedExtent()); e != NULL; e = source.getSharedExtent()) {
+        ++extents;
+        for (series.setExtent(e); series.more(); series.next()) {
+            if ((id_value.getType() == ExtentType::ft_unknown
+                 || id.val() == id_value.valInt64())
+                && (host_value.empty() || (!host.isNull() && host.stringval() == host_value))) {
+                ++rows;
+            }
+        }
+    }
+    stats = source.getLookupStats();
+    return rows;
+}
+
+void checkLookups() {
+    IndexSourceModule::LookupStats stats;
+    int32_t extents = 0;
+
+    GeneralValue id;
+    id.setInt64(idOf(12345));
+    SINVARIANT(lookup(id, "", stats, extents) == 1);
+    cout << format("id lookup: %d extents returned, %d of %d skipped,"
+                   " false positive rate %.3f\n")
+        % extents % stats.skipped % stats.checked % stats.falsePositiveRate();
+    SINVARIANT(stats.checked == stats.skipped + extents && stats.unfiltered == 0);
+    SINVARIANT(stats.passed == static_cast<uint64_t>(extents));
+    SINVARIANT(stats.true_positives == 1 && stats.true_positives + stats.false_positives
+               == stats.passed);
+    SINVARIANT(stats.skipped > stats.checked * 9 / 10);
+
+    // positives are only counted on request
+    SINVARIANT(lookup(id, "", stats, extents, false) == 1);
+    SINVARIANT(stats.passed == static_cast<uint64_t>(extents)
+               && stats.true_positives == 0 && stats.false_positives == 0);
+
+    id.setInt64(-1);
+    SINVARIANT(lookup(id, "", stats, extents) == 0 && stats.true_positives == 0);
+
+    GeneralValue id_double;
+    id_double.setDouble(static_cast<double>(idOf(999)));
+    SINVARIANT(lookup(id_double, "", stats, extents) == 1 && stats.true_positives == 1);
+
+    int32_t expect = 0;
+    for (int32_t i = 0; i < nrows; ++i) {
+        if (i % 10 != 0 && hostOf(i) == hostOf(1234)) {
+            ++expect;
+        }
+    }
+    int32_t rows = lookup(GeneralValue(), hostOf(1234), stats, extents);
+    INVARIANT(rows == expect, format("%d != %d") % rows % expect);
+    SINVARIANT(stats.true_positives > 0 && stats.skipped > 0);
+
+    // both fields have to match
+    id.setInt64(idOf(1234));
+    SINVARIANT(lookup(id, hostOf(1234), stats, extents) == 1 && stats.true_positives == 1);
+    id.setInt64(idOf(1235));
+    SINVARIANT(lookup(id, hostOf(1234), stats, extents) == 0 && stats.true_positives == 0);
+}
+
+/// as in the zone map test, filters copied with the extents repacked are ignored
+void checkCopiedFilters(const string &from, const string &to) {
+    {
+        TestFile out(to, type_string, 24 * 1024);
+        out.addType(BloomFilter::extentType()->getXmlDescriptionString(), 16 * 1024);
+
+        TypeIndexModule source("Test::Bloom");
+        source.addSource(from);
+        ExtentSeries series;
+        ExtentRecordCopy copy(series, out.series());
+        for (Extent::Ptr e = source.getSharedExtent(); e != NULL; e = source.getSharedExtent()) {
+            for (series.setExtent(e); series.more(); series.next()) {
+                out.newRecord();
+                copy.copyRecord();
+            }
+        }
+        series.clearExtent();
+
+        TypeIndexModule filters(BloomFilter::extentType()->getName());
+        filters.addSource(from);
+        for (Extent::Ptr e = filters.getSharedExtent(); e != NULL;
+             e = filters.getSharedExtent()) {
+            out.sink.writeExtent(*e, NULL);
+        }
+    }
+
+    DataSeriesSource source(to);
+    map<int64_t, BloomFilter::ByField> filters;
+    SINVARIANT(BloomFilter::read(source, filters) && filters.empty());
+}
+
+int main() {
+    checkFilter();
+    writeFile("bloom-filter.ds");
+    checkLookups();
+    checkCopiedFilters("bloom-filter.ds", "bloom-filter-copy.ds");
+    cout << "bloom filter checks passed\n";
+    return 0;
+}
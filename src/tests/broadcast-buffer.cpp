@@ -0,0 +1,108 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    check that every BroadcastBuffer consumer sees all the extents of one read of the source,
+    within the memory bound, including when one of them stops early
+*/
+
+#include <iostream>
+
+#include <boost/format.hpp>
+
+#include <DataSeries/BroadcastBuffer.hpp>
+#include <DataSeries/SequenceModule.hpp>
+#include <DataSeries/TypeIndexModule.hpp>
+
+#include "TestCommon.hpp"
+
+using namespace std;
+using boost::format;
+
+const string type_string(
+    "<ExtentType namespace=\"ssd.hpl.hp.com\" name=\"Test::Broadcast\" version=\"1.0\" >\n"
+    "  <field type=\"int32\" name=\"bytes\" />\n"
+    "</ExtentType>\n");
+
+const size_t extent_size = 16 * 1024;
+
+/// many small extents
+void writeFile(const string &filename) {
+    TestFile out(filename, type_string, extent_size);
+    Int32Field bytes(out.series(), "bytes");
+    for (int32_t i = 0; i < 200 * 1000; ++i) {
+        out.newRecord();
+        bytes.set(i % 8192);
+    }
+}
+
+/// counts extents, closing its source after max_extents of them
+class CloseEarly : public DataSeriesModule {
+  public:
+    CloseEarly(BroadcastBuffer::Consumer &source, unsigned max_extents)
+        : source(source), max_extents(max_extents), extents(0) { }
+
+    virtual Extent::Ptr getSharedExtent() {
+        if (extents == max_extents) {
+            source.close();
+        }
+        Extent::Ptr ret = source.getSharedExtent();
+        if (ret != NULL) {
+            ++extents;
+        }
+        return ret;
+    }
+
+    BroadcastBuffer::Consumer &source;
+    const unsigned max_extents;
+    unsigned extents;
+};
+
+int main() {
+    writeFile("broadcast-buffer.ds");
+    TypeIndexModule serial_source("Test::Broadcast");
+    serial_source.addSource("broadcast-buffer.ds");
+    SumBytes serial(serial_source);
+    serial.getAndDeleteShared();
+    SINVARIANT(serial.count > 0);
+
+    TypeIndexModule source("Test::Broadcast");
+    source.addSource("broadcast-buffer.ds");
+    const size_t max_memory = 128 * 1024;
+    BroadcastBuffer broadcast(source, max_memory);
+
+    // consumers of different speeds, so the fast ones have to wait for the slow one
+    const int spins[] = { 0, 500, 0 };
+    vector<SequenceModule *> sequences;
+    vector<DataSeriesModule *> tails;
+    for (int i = 0; i < 3; ++i) {
+        sequences.push_back(new SequenceModule(broadcast.newConsumer()));
+        sequences.back()->addModule(new SumBytes(sequences.back()->tail(), spins[i]));
+        tails.push_back(sequences.back());
+    }
+    BroadcastBuffer::Consumer *early_consumer = broadcast.newConsumer();
+    CloseEarly early(*early_consumer, 2);
+    tails.push_back(&early);
+
+    BroadcastBuffer::getAndDeleteSharedConcurrently(tails);
+
+    for (int i = 0; i < 3; ++i) {
+        checkSameSums(dynamic_cast<SumBytes &>(**(sequences[i]->begin() + 1)), serial,
+                      str(format("consumer %d") % i));
+        delete sequences[i];
+    }
+    SINVARIANT(early.extents == 2);
+    delete early_consumer;
+
+    // one read of the source, and at most one extent over the bound
+    SINVARIANT(source.total_uncompressed_bytes == serial_source.total_uncompressed_bytes);
+    INVARIANT(broadcast.maxUsedMemory() <= max_memory + 2 * extent_size,
+              format("used %d bytes") % broadcast.maxUsedMemory());
+    cout << format("broadcast buffer checks passed, %d rows, at most %d bytes buffered\n")
+        % serial.count % broadcast.maxUsedMemory();
+    return 0;
+}
@@ -0,0 +1,184 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    check that appending whole columns writes the same records, split into extents of about the
+    same size, as appending a record at a time
+*/
+
+#include <iostream>
+
+#include <boost/format.hpp>
+
+#include <Lintel/TestUtil.hpp>
+
+#include <DataSeries/ColumnBatch.hpp>
+#include <DataSeries/TypeIndexModule.hpp>
+
+#include "TestCommon.hpp"
+
+using namespace std;
+using boost::format;
+using dataseries::ColumnBatch;
+using dataseries::Variable32Ref;
+
+const string type_string(
+    "<ExtentType namespace=\"ssd.hpl.hp.com\" name=\"Test::ColumnBatch\" version=\"1.0\" >\n"
+    "  <field type=\"int64\" name=\"id\" />\n"
+    "  <field type=\"bool\" name=\"flag\" opt_nullable=\"yes\" />\n"
+    "  <field type=\"int32\" name=\"bytes\" opt_nullable=\"yes\" />\n"
+    "  <field type=\"variable32\" name=\"name\" opt_nullable=\"yes\" />\n"
+    "  <field type=\"variable32\" name=\"path\" />\n"
+    "  <field type=\"double\" name=\"when\" />\n"
+    "</ExtentType>\n");
+
+const uint32_t nrows = 20000;
+const uint32_t extent_size = 32 * 1024;
+
+struct Columns {
+    vector<int64_t> id;
+    bool flag[nrows];
+    vector<int32_t> bytes;
+    vector<string> name, path;
+    vector<Variable32Ref> path_refs;
+    vector<double> when;
+    vector<uint8_t> flag_nulls, bytes_nulls, name_nulls;
+
+    Columns() {
+        for (uint32_t i = 0; i < nrows; ++i) {
+            id.push_back(i * 3);
+            flag[i] = i % 2 == 0;
+            flag_nulls.push_back(i % 7 == 0);
+            bytes.push_back(i % 1000);
+            bytes_nulls.push_back(i % 3 == 0);
+            name.push_back(str(format("name-%d") % i));
+            name_nulls.push_back(i % 5 == 0);
+            path.push_back(string(i % 37, 'p'));
+            when.push_back(i / 8.0);
+        }
+        for (uint32_t i = 0; i < nrows; ++i) {
+            path_refs.push_back(Variable32Ref(reinterpret_cast<const uint8_t *>(path[i].data()),
+                                              path[i].size()));
+        }
+    }
+};
+
+struct Fields {
+    Fields(ExtentSeries &series)
+        : id(series, "id"), flag(series, "flag", Field::flag_nullable),
+          bytes(series, "bytes", Field::flag_nullable),
+          name(series, "name", Field::flag_nullable), path(series, "path"), when(series, "when")
+    { }
+
+    Int64Field id;
+    BoolField flag;
+    Int32Field bytes;
+    Variable32Field name, path;
+    DoubleField when;
+};
+
+void writeFile(const string &filename, bool by_column, const Columns &columns) {
+    TestFile out(filename, type_string, extent_size);
+    OutputModule &output(out.output());
+    Fields fields(out.series());
+
+    if (by_column) {
+        // batches of a third of the rows, and a last one with the remainder, so extents get
+        // records from more than one batch
+        const uint32_t first = nrows / 3;
+        for (uint32_t from = 0; from < nrows; from += first) {
+            uint32_t n = min(first, nrows - from);
+            ColumnBatch batch(n);
+            batch.add(fields.id, &columns.id[from]);
+            batch.add(fields.flag, &columns.flag[from], &columns.flag_nulls[from]);
+            batch.add(fields.bytes, &columns.bytes[from], &columns.bytes_nulls[from]);
+            batch.add(fields.name, &columns.name[from], &columns.name_nulls[from]);
+            batch.add(fields.path, &columns.path_refs[from]);
+            batch.add(fields.when, &columns.when[from]);
+            output.appendColumns(batch);
+            SINVARIANT(fields.id.val() == columns.id[from + n - 1]);
+        }
+    } else {
+        for (uint32_t i = 0; i < nrows; ++i) {
+            output.newRecord();
+            fields.id.set(columns.id[i]);
+            if (columns.flag_nulls[i]) {
+                fields.flag.setNull();
+            } else {
+                fields.flag.set(columns.flag[i]);
+            }
+            if (columns.bytes_nulls[i]) {
+                fields.bytes.setNull();
+            } else {
+                fields.bytes.set(columns.bytes[i]);
+            }
+            if (columns.name_nulls[i]) {
+                fields.name.setNull();
+            } else {
+                fields.name.set(columns.name[i]);
+            }
+            fields.path.set(columns.path[i]);
+            fields.when.set(columns.when[i]);
+        }
+    }
+}
+
+/// check the records in filename, returning the number of extents
+uint32_t checkFile(const string &filename, const Columns &columns) {
+    TypeIndexModule source("Test::ColumnBatch");
+    source.addSource(filename);
+    ExtentSeries series;
+    Fields fields(series);
+    uint32_t i = 0, extents = 0;
+    for (Extent::Ptr e = source.getSharedExtent(); e != NULL; e = source.getSharedExtent()) {
+        ++extents;
+        SINVARIANT(e->size() < 2 * extent_size);
+        for (series.setExtent(e); series.morerecords(); ++series, ++i) {
+            INVARIANT(fields.id.val() == columns.id[i], format("%s: record %d has id %d")
+                      % filename % i % fields.id.val());
+            SINVARIANT(fields.flag.isNull() == (columns.flag_nulls[i] != 0));
+            SINVARIANT(fields.flag.isNull() || fields.flag.val() == columns.flag[i]);
+            SINVARIANT(fields.bytes.isNull() == (columns.bytes_nulls[i] != 0));
+            SINVARIANT(fields.bytes.isNull() || fields.bytes.val() == columns.bytes[i]);
+            SINVARIANT(fields.name.isNull() == (columns.name_nulls[i] != 0));
+            SINVARIANT(fields.name.isNull() || fields.name.stringval() == columns.name[i]);
+            SINVARIANT(fields.path.stringval() == columns.path[i]);
+            SINVARIANT(fields.when.val() == columns.when[i]);
+        }
+    }
+    SINVARIANT(i == nrows);
+    return extents;
+}
+
+int main() {
+    Columns columns;
+    writeFile("column-batch-rows.ds", false, columns);
+    writeFile("column-batch-columns.ds", true, columns);
+
+    uint32_t row_extents = checkFile("column-batch-rows.ds", columns);
+    uint32_t column_extents = checkFile("column-batch-columns.ds", columns);
+    INVARIANT(column_extents + 1 >= row_extents && column_extents <= row_extents + 1,
+              format("%d extents by column, %d by row") % column_extents % row_extents);
+
+    // setColumn fills in records made by appendRecords
+    {
+        ExtentTypeLibrary library;
+        ExtentSeries series(library.registerTypePtr(type_string));
+        Fields fields(series);
+        series.newExtent();
+        series.newRecord();
+        SINVARIANT(series.appendRecords(10) == 1 && fields.id.val() == 0);
+        fields.id.setColumn(1, 10, &columns.id[5]);
+        fields.name.setColumn(1, 10, &columns.name[5], &columns.name_nulls[5]);
+        SINVARIANT(fields.id.val() == columns.id[5] && fields.name.isNull());
+        ++series;
+        SINVARIANT(fields.name.stringval() == columns.name[6]);
+    }
+
+    cout << format("column batch checks passed, %d extents\n") % column_extents;
+    return 0;
+}
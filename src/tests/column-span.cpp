@@ -0,0 +1,139 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    check that the column spans from the field accessors match the per-row values
+*/
+
+#include <algorithm>
+#include <iostream>
+
+#include <boost/format.hpp>
+#include <boost/scoped_array.hpp>
+
+#include <Lintel/MersenneTwisterRandom.hpp>
+
+#include <DataSeries/Extent.hpp>
+#include <DataSeries/ExtentField.hpp>
+
+using namespace std;
+using namespace dataseries;
+using boost::format;
+
+const string span_types_xml =
+        "<ExtentType namespace=\"ssd.hpl.hp.com\" name=\"span-types\" version=\"1.0\" >\n"
+        "  <field type=\"bool\" name=\"bool\" />\n"
+        "  <field type=\"int32\" name=\"int32\" />\n"
+        "  <field type=\"variable32\" name=\"variable32\" />\n"
+        "  <field type=\"bool\" name=\"n-bool\" opt_nullable=\"yes\" />\n"
+        "  <field type=\"int64\" name=\"n-int64\" opt_nullable=\"yes\" />\n"
+        "  <field type=\"double\" name=\"n-double\" opt_nullable=\"yes\" />\n"
+        "  <field type=\"variable32\" name=\"n-variable32\" opt_nullable=\"yes\" />\n"
+        "</ExtentType>\n";
+
+const uint32_t nrows = 1000;
+
+template<typename T, typename Span, typename FT>
+void checkSpan(ExtentSeries &s, FT &field, const Span &span, bool nullable) {
+    SINVARIANT(span.size() == nrows && span.nullable() == nullable);
+    SINVARIANT(span.end() - span.begin() == static_cast<int32_t>(nrows));
+
+    // not vector<T> so that bool gets an array of bools
+    boost::scoped_array<T> gathered(new T[nrows]);
+    span.gather(gathered.get());
+    vector<uint8_t> null_flags(nrows);
+    span.nulls().gather(&null_flags[0]);
+
+    typename Span::const_iterator it = span.begin();
+    uint32_t row = 0, nulls = 0;
+    for (s.setCurPos(s.getExtentRef().fixeddata.begin()); s.morerecords(); ++s, ++row, ++it) {
+        SINVARIANT(span.isNull(row) == field.isNull() && span.nulls()[row] == field.isNull());
+        SINVARIANT((null_flags[row] != 0) == field.isNull());
+        nulls += field.isNull() ? 1 : 0;
+        SINVARIANT(span[row] == field.val() && *it == field.val() && gathered[row] == field.val());
+        SINVARIANT(span.begin()[row] == field.val() && *(span.begin() + row) == field.val());
+    }
+    SINVARIANT(row == nrows && it == span.end() && nulls == span.nulls().countNulls());
+    SINVARIANT(nullable ? nulls > 0 : nulls == 0);
+
+    // spot check the algorithms that need random access
+    RowSelection selection;
+    for (uint32_t i = 0; i < nrows; i += 7) {
+        selection.push_back(i);
+    }
+    boost::scoped_array<T> selected(new T[selection.size()]);
+    span.gather(selection, selected.get());
+    for (size_t i = 0; i < selection.size(); ++i) {
+        SINVARIANT(selected[i] == span[selection[i]]);
+    }
+    SINVARIANT(count(span.begin(), span.end(), span[nrows/2])
+               == count(gathered.get(), gathered.get() + nrows, span[nrows/2]));
+}
+
+void checkVariable32Span(ExtentSeries &s, Variable32Field &field, bool nullable) {
+    Variable32Span span(field.span());
+    SINVARIANT(span.size() == nrows && span.nullable() == nullable);
+    vector<Variable32Ref> refs(nrows);
+    span.gather(&refs[0]);
+    vector<int32_t> sizes(nrows);
+    span.gatherSizes(&sizes[0]);
+
+    Variable32Span::const_iterator it = span.begin();
+    uint32_t row = 0;
+    for (s.setCurPos(s.getExtentRef().fixeddata.begin()); s.morerecords(); ++s, ++row, ++it) {
+        SINVARIANT(span.isNull(row) == field.isNull());
+        string v(field.stringval());
+        SINVARIANT(span[row].str() == v && (*it).equal(v) && refs[row].equal(v));
+        SINVARIANT(sizes[row] == field.size());
+    }
+    SINVARIANT(row == nrows && it == span.end());
+}
+
+int main() {
+    ExtentTypeLibrary lib;
+    const ExtentType::Ptr t(lib.registerTypePtr(span_types_xml));
+    ExtentSeries s;
+    Extent::Ptr e(new Extent(t));
+    s.setExtent(e);
+
+    BoolField f_bool(s, "bool"), f_n_bool(s, "n-bool", Field::flag_nullable, true);
+    Int32Field f_int32(s, "int32");
+    Int64Field f_n_int64(s, "n-int64", Field::flag_nullable, -1);
+    DoubleField f_n_double(s, "n-double", Field::flag_nullable, 0.5);
+    Variable32Field f_var32(s, "variable32"),
+        f_n_var32(s, "n-variable32", Field::flag_nullable, "null");
+
+    MersenneTwisterRandom rng;
+    for (uint32_t i = 0; i < nrows; ++i) {
+        s.newRecord();
+        f_bool.set(rng.randInt(2) == 0);
+        f_int32.set(rng.randInt());
+        f_var32.set(str(format("row-%d") % rng.randInt(100)));
+        if (rng.randInt(4) == 0) {
+            f_n_bool.setNull();
+            f_n_int64.setNull();
+            f_n_double.setNull();
+            f_n_var32.setNull();
+        } else {
+            f_n_bool.set(rng.randInt(2) == 0);
+            f_n_int64.set(rng.randLongLong());
+            f_n_double.set(rng.randDouble());
+            f_n_var32.set(string(rng.randInt(20), 'x'));
+        }
+    }
+
+    checkSpan<bool>(s, f_bool, f_bool.span(), false);
+    checkSpan<bool>(s, f_n_bool, f_n_bool.span(), true);
+    checkSpan<int32_t>(s, f_int32, f_int32.span(), false);
+    checkSpan<int64_t>(s, f_n_int64, f_n_int64.span(), true);
+    checkSpan<double>(s, f_n_double, f_n_double.span(*e), true);
+    checkVariable32Span(s, f_var32, false);
+    checkVariable32Span(s, f_n_var32, true);
+
+    cout << "column spans ok\n";
+    return 0;
+}
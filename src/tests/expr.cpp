@@ -3,6 +3,7 @@
 #include <boost/bind.hpp>
 #include <boost/format.hpp>
 
+#include <Lintel/Double.hpp>
 #include <Lintel/StringUtil.hpp>
 
 #include <DataSeries/commonargs.hpp>
@@ -155,9 +156,110 @@ void testNullExpr() {
     cout << "Null Expr passed.\n";
 }
 
+void checkSelectRows(ExtentSeries &series, DSExpr &expr) {
+    dataseries::RowSelection expected, selected;
+    uint32_t row = 0;
+    for (series.setCurPos(series.getExtentRef().fixeddata.begin()); series.morerecords();
+         ++series, ++row) {
+        if (expr.valBool()) {
+            expected.push_back(row);
+        }
+    }
+    expr.selectRows(series, selected);
+    SINVARIANT(selected == expected);
+}
+
+void checkValDoubles(ExtentSeries &series, DSExpr &expr) {
+    dataseries::RowSelection every_third;
+    vector<double> expected, values;
+    uint32_t row = 0;
+    for (series.setCurPos(series.getExtentRef().fixeddata.begin()); series.morerecords();
+         ++series, ++row) {
+        expected.push_back(expr.valDouble());
+        if (row % 3 == 0) {
+            every_third.push_back(row);
+        }
+    }
+    expr.valDoubles(series, NULL, values);
+    SINVARIANT(values.size() == expected.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+        SINVARIANT(Double::eq(values[i], expected[i]));
+    }
+    expr.valDoubles(series, &every_third, values);
+    SINVARIANT(values.size() == every_third.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+        SINVARIANT(Double::eq(values[i], expected[every_third[i]]));
+    }
+}
+
+void testTypedEval() {
+    static string extent_type_xml(
+        "<ExtentType name=\"Test1\" namespace=\"ssd.hpl.hp.com\" version=\"1.0\" >"
+        "  <field type=\"bool\" name=\"f\" />"
+        "  <field type=\"int32\" name=\"a\" />"
+        "  <field type=\"int64\" name=\"b\" opt_nullable=\"yes\" />"
+        "  <field type=\"double\" name=\"c\" />"
+        "  <field type=\"variable32\" name=\"s\" />"
+        "  <field type=\"variable32\" name=\"t\" opt_nullable=\"yes\" />"
+        "</ExtentType>");
+
+    ExtentTypeLibrary library;
+    const ExtentType::Ptr extent_type(library.registerTypePtr(extent_type_xml));
+
+    ExtentSeries series(extent_type);
+    series.newExtent();
+    BoolField f(series, "f");
+    Int32Field a(series, "a");
+    Int64Field b(series, "b", Field::flag_nullable);
+    DoubleField c(series, "c");
+    Variable32Field s(series, "s"), t(series, "t", Field::flag_nullable);
+
+    boost::scoped_ptr<DSExpr> int_expr(DSExpr::make(series, "a * 3 + b - 7"));
+    boost::scoped_ptr<DSExpr> double_expr(DSExpr::make(series, "c / 2 - a"));
+    boost::scoped_ptr<DSExpr> bool_expr(DSExpr::make(series, "s == \"x3\" || (f == 1 && a > b)"));
+    boost::scoped_ptr<DSExpr> string_expr(DSExpr::make(series, "s < t && !(f != 0)"));
+    boost::scoped_ptr<DSExpr> null_expr(DSExpr::make(series, "a + b"));
+
+    for (int32_t i = 0; i < 200; ++i) {
+        series.newRecord();
+        f.set(i % 3 == 0);
+        a.set(i - 100);
+        c.set(i * 0.25);
+        s.set((boost::format("x%d") % (i % 7)).str());
+        if (i % 5 == 0) {
+            b.setNull();
+            t.setNull();
+        } else {
+            b.set(static_cast<int64_t>(i) << 33);
+            t.set((boost::format("x%d") % (i % 11)).str());
+        }
+
+        SINVARIANT(int_expr->valInt64() == (i - 100) * 3 + b.val() - 7);
+        SINVARIANT(Double::eq(double_expr->valDouble(), i * 0.125 - (i - 100)));
+        SINVARIANT(bool_expr->valBool()
+                   == (s.stringval() == "x3" || (f.val() && a.val() > b.val())));
+        SINVARIANT(string_expr->valBool() == (s.stringval() < t.stringval() && !f.val()));
+        SINVARIANT(null_expr->isNull() == b.isNull() && int_expr->isNull() == b.isNull());
+        SINVARIANT(!double_expr->isNull() && string_expr->isNull() == t.isNull());
+    }
+
+    // extent at a time evaluation
+    checkSelectRows(series, *bool_expr);
+    checkSelectRows(series, *string_expr);
+    boost::scoped_ptr<DSExpr> arith_expr(DSExpr::make(series, "a * c > -b / 2 || c <= 3"));
+    checkSelectRows(series, *arith_expr);
+    // string concatenation is evaluated a row at a time
+    boost::scoped_ptr<DSExpr> concat_expr(DSExpr::make(series, "s + t == \"x1x1\""));
+    checkSelectRows(series, *concat_expr);
+    checkValDoubles(series, *int_expr);
+    checkValDoubles(series, *double_expr);
+    cout << "Typed Eval passed.\n";
+}
+
 int main(int argc, char **argv) {
     testSeriesSelect();
     testNullExpr();
+    testTypedEval();
     makeFile();
 
     return 0;
@@ -0,0 +1,156 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    check that the ExtentCache serves repeated reads, evicts the least recently used extents
+    to stay within its size, stops hitting when a file is rewritten, and works with the
+    deprecated getExtent()
+*/
+
+#include <sys/time.h>
+
+#include <iostream>
+
+#include <boost/format.hpp>
+
+#define DS_RAW_EXTENT_PTR_DEPRECATED /* allowed */
+#include <DataSeries/ExtentCache.hpp>
+#include <DataSeries/TypeIndexModule.hpp>
+
+#include "TestCommon.hpp"
+
+using namespace std;
+using boost::format;
+
+const string type_string(
+    "<ExtentType namespace=\"ssd.hpl.hp.com\" name=\"Test::ExtentCache\" version=\"1.0\" >\n"
+    "  <field type=\"int32\" name=\"bytes\" />\n"
+    "</ExtentType>\n");
+
+const int32_t nrows = 50 * 1000;
+
+void writeFile(const string &filename) {
+    TestFile out(filename, type_string, 16 * 1024);
+    Int32Field bytes(out.series(), "bytes");
+    for (int32_t i = 0; i < nrows; ++i) {
+        out.newRecord();
+        bytes.set(i % 1000);
+    }
+}
+
+Extent::Ptr makeExtent(size_t bytes) {
+    Extent::Ptr ret(new Extent(ExtentTypeLibrary::sharedExtentTypePtr(type_string)));
+    ret->fixeddata.resize(bytes - ret->variabledata.size());
+    return ret;
+}
+
+void checkLRU() {
+    ExtentCache &cache(ExtentCache::instance());
+    cache.clear();
+    cache.setMaxBytes(3000);
+    ExtentCache::Stats before(cache.getStats());
+
+    Extent::Ptr a(makeExtent(1000)), b(makeExtent(1000)), c(makeExtent(1000));
+    cache.insert("f", 1, 0, a);
+    cache.insert("f", 1, 1000, b);
+    cache.insert("f", 1, 2000, c);
+    SINVARIANT(cache.getStats().cur_bytes == 3000);
+
+    // touching a makes b the least recently used, so it goes first
+    SINVARIANT(cache.lookup("f", 1, 0) == a);
+    cache.insert("f", 1, 3000, makeExtent(1000));
+    SINVARIANT(cache.lookup("f", 1, 1000) == NULL);
+    SINVARIANT(cache.lookup("f", 1, 0) == a && cache.lookup("f", 1, 2000) == c);
+
+    // one large extent pushes out as many as it needs, too large ones aren't cached
+    cache.insert("f", 1, 4000, makeExtent(2500));
+    SINVARIANT(cache.getStats().cur_bytes <= 3000 && cache.lookup("f", 1, 4000) != NULL);
+    cache.insert("f", 1, 5000, makeExtent(4000));
+    SINVARIANT(cache.lookup("f", 1, 5000) == NULL);
+
+    // a different modify time is a different file
+    SINVARIANT(cache.lookup("f", 2, 4000) == NULL);
+
+    ExtentCache::Stats after(cache.getStats());
+    SINVARIANT(after.inserts - before.inserts == 5);
+    SINVARIANT(after.evictions - before.evictions == 4);
+    SINVARIANT(after.hits - before.hits == 4 && after.misses - before.misses == 3);
+    cache.clear();
+    SINVARIANT(cache.getStats().cur_bytes == 0);
+}
+
+/// sum of bytes over filename, reading through getSharedExtent() or getExtent()
+int64_t readFile(const string &filename, bool shared, int32_t &extents) {
+    TypeIndexModule source("Test::ExtentCache");
+    source.addSource(filename);
+    ExtentSeries series;
+    Int32Field bytes(series, "bytes");
+    int64_t sum = 0;
+    extents = 0;
+    while (true) {
+        Extent::Ptr e;
+        if (shared) {
+            e = source.getSharedExtent();
+        } else {
+            Extent *raw = source.getExtent();
+            e.reset(raw);
+        }
+        if (e == NULL) {
+            break;
+        }
+        ++extents;
+        for (series.setExtent(e); series.more(); series.next()) {
+            sum += bytes.val();
+        }
+    }
+    series.clearExtent();
+    return sum;
+}
+
+void checkReads() {
+    ExtentCache &cache(ExtentCache::instance());
+    cache.setMaxBytes(64 * 1024 * 1024);
+    writeFile("extent-cache.ds");
+    int32_t extents = 0;
+
+    ExtentCache::Stats before(cache.getStats());
+    int64_t sum = readFile("extent-cache.ds", true, extents);
+    ExtentCache::Stats after(cache.getStats());
+    SINVARIANT(extents > 1 && after.hits == before.hits
+               && after.inserts - before.inserts == static_cast<uint64_t>(extents));
+
+    // the second read comes from the cache, including through getExtent(), which copies
+    for (int i = 0; i < 2; ++i) {
+        before = cache.getStats();
+        SINVARIANT(readFile("extent-cache.ds", i == 0, extents) == sum);
+        after = cache.getStats();
+        INVARIANT(after.hits - before.hits == static_cast<uint64_t>(extents)
+                  && after.misses == before.misses,
+                  format("%d hits for %d extents") % (after.hits - before.hits) % extents);
+    }
+
+    // rewriting the file changes its modify time, so nothing hits
+    struct timeval times[2];
+    gettimeofday(&times[0], NULL);
+    times[0].tv_sec += 10;
+    times[1] = times[0];
+    SINVARIANT(utimes("extent-cache.ds", times) == 0);
+    before = cache.getStats();
+    SINVARIANT(readFile("extent-cache.ds", true, extents) == sum);
+    after = cache.getStats();
+    SINVARIANT(after.hits == before.hits
+               && after.misses - before.misses == static_cast<uint64_t>(extents));
+    cout << format("extent cache checks passed, %d extents, hit rate %.2f\n")
+        % extents % after.hitRate();
+    cache.setMaxBytes(0);
+}
+
+int main() {
+    checkLRU();
+    checkReads();
+    return 0;
+}
@@ -0,0 +1,170 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    check that views of an extent show just their columns without copying, and are written out
+    as a type with only those columns
+*/
+
+#include <iostream>
+
+#include <boost/format.hpp>
+
+#include <Lintel/TestUtil.hpp>
+
+#include <DataSeries/DataSeriesFile.hpp>
+#include <DataSeries/ExtentField.hpp>
+#include <DataSeries/GeneralField.hpp>
+#include <DataSeries/TypeIndexModule.hpp>
+
+using namespace std;
+using boost::format;
+
+const string type_string(
+    "<ExtentType namespace=\"ssd.hpl.hp.com\" name=\"Test::View\" version=\"1.0\" >\n"
+    "  <field type=\"int64\" name=\"id\" />\n"
+    "  <field type=\"variable32\" name=\"name\" />\n"
+    "  <field type=\"int32\" name=\"bytes\" opt_nullable=\"yes\" />\n"
+    "  <field type=\"variable32\" name=\"padding\" />\n"
+    "</ExtentType>\n");
+
+const int32_t nrows = 1000;
+
+Extent::Ptr makeExtent(const ExtentType::Ptr &type) {
+    ExtentSeries series(type);
+    series.newExtent();
+    Int64Field id(series, "id");
+    Variable32Field name(series, "name");
+    Int32Field bytes(series, "bytes", Field::flag_nullable);
+    Variable32Field padding(series, "padding");
+    for (int32_t i = 0; i < nrows; ++i) {
+        series.newRecord();
+        id.set(i);
+        name.set(str(format("name-%d") % i));
+        if (i % 3 == 0) {
+            bytes.setNull();
+        } else {
+            bytes.set(i * 2);
+        }
+        padding.set(string(i % 50, 'x'));
+    }
+    return series.getSharedExtent();
+}
+
+/// check the visible columns of e, which must include bytes and name
+void checkRows(const Extent::Ptr &e, const string &what) {
+    ExtentSeries series(e);
+    Variable32Field name(series, "name");
+    Int32Field bytes(series, "bytes", Field::flag_nullable);
+    int32_t i = 0;
+    for (; series.morerecords(); ++series, ++i) {
+        INVARIANT(name.stringval() == str(format("name-%d") % i), format("%s: row %d name %s")
+                  % what % i % name.stringval());
+        SINVARIANT(bytes.isNull() == (i % 3 == 0));
+        SINVARIANT(bytes.isNull() || bytes.val() == i * 2);
+    }
+    SINVARIANT(i == nrows);
+}
+
+int main() {
+    ExtentTypeLibrary library;
+    const ExtentType::Ptr type(library.registerTypePtr(type_string));
+
+    vector<string> columns;
+    columns.push_back("bytes");
+    columns.push_back("name");
+    const ExtentType::Ptr view(type->makeView(columns));
+
+    // views are shared, list their columns in the order of the base type, and hide the rest
+    SINVARIANT(type->makeView(columns) == view);
+    SINVARIANT(view->isView() && view->getViewBasePtr() == type && !type->isView());
+    SINVARIANT(view->getName() == "project (Test::View)");
+    SINVARIANT(view->getNFields() == 2);
+    SINVARIANT(view->getFieldName(0) == "name" && view->getFieldName(1) == "bytes");
+    SINVARIANT(view->hasColumn("bytes") && !view->hasColumn("id") && !view->hasColumn("padding"));
+    SINVARIANT(view->fixedrecordsize() == type->fixedrecordsize());
+
+    const ExtentType::Ptr materialized(view->getMaterializedTypePtr());
+    SINVARIANT(!materialized->isView() && materialized->getName() == view->getName());
+    SINVARIANT(materialized->getNFields() == 2 && materialized->hasColumn("bytes"));
+    SINVARIANT(materialized->fixedrecordsize() < type->fixedrecordsize());
+    SINVARIANT(type->getMaterializedTypePtr() == type);
+
+    // a view of a view is a view of the base type
+    const ExtentType::Ptr name_only(view->makeView(vector<string>(1, "name"), "names"));
+    SINVARIANT(name_only->getViewBasePtr() == type && name_only->getNFields() == 1);
+
+    // an unshared extent moves into the view
+    Extent::Ptr e = makeExtent(type);
+    const uint8_t *fixed = e->fixeddata.begin();
+    Extent::Ptr v = Extent::makeView(e, view);
+    SINVARIANT(v->fixeddata.begin() == fixed && e->nRecords() == 0);
+    SINVARIANT(v->nRecords() == static_cast<size_t>(nrows));
+    checkRows(v, "moved view");
+
+    // a shared one is left as it was, and the view refers to its data, as does a view of
+    // that view
+    Extent::Ptr names;
+    {
+        Extent::Ptr base = makeExtent(type), keep(base);
+        fixed = base->fixeddata.begin();
+        v = Extent::makeView(base, view);
+        SINVARIANT(v->fixeddata.begin() == fixed);
+        SINVARIANT(base->nRecords() == static_cast<size_t>(nrows));
+        checkRows(base, "base");
+        Extent::Ptr keep_view(v);
+        names = Extent::makeView(v, name_only);
+        SINVARIANT(names->fixeddata.begin() == fixed);
+    }
+    // the views keep the data alive
+    checkRows(v, "shared view");
+
+    // growing a view's data copies it first
+    names->fixeddata.resize(2 * names->fixeddata.size());
+    SINVARIANT(names->fixeddata.begin() != fixed && v->fixeddata.begin() == fixed);
+    names.reset();
+    checkRows(v, "shared view after copy");
+
+    // copying records within a view doesn't copy its hidden columns
+    {
+        ExtentSeries source(v), dest(view);
+        dest.newExtent();
+        ExtentRecordCopy copier(source, dest);
+        for (; source.morerecords(); ++source) {
+            dest.newRecord();
+            copier.copyRecord();
+        }
+        checkRows(dest.getSharedExtent(), "copied records");
+    }
+
+    // materializing copies just the visible columns
+    Extent::Ptr m = Extent::materialize(v);
+    SINVARIANT(m->getTypePtr() == materialized);
+    checkRows(m, "materialized");
+    SINVARIANT(Extent::materialize(e) == e);
+
+    // writing a view writes the materialized type
+    {
+        ExtentTypeLibrary out_library;
+        out_library.registerType(view);
+        DataSeriesSink sink("extent-view.ds",
+                            Extent::compression_algs[Extent::compress_mode_lzf].compress_flag);
+        sink.writeExtentLibrary(out_library);
+        sink.writeExtent(*v, NULL);
+        sink.close();
+    }
+    TypeIndexModule source(view->getName());
+    source.addSource("extent-view.ds");
+    Extent::Ptr read = source.getSharedExtent();
+    SINVARIANT(read != NULL && source.getSharedExtent() == NULL);
+    SINVARIANT(read->getTypePtr()->getXmlDescriptionString()
+               == materialized->getXmlDescriptionString());
+    checkRows(read, "written");
+
+    cout << "extent view checks passed\n";
+    return 0;
+}
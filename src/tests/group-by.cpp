@@ -0,0 +1,145 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    check GroupByModule against a std::map rollup, with threads and spilling
+*/
+
+#include <iostream>
+#include <map>
+
+#include <boost/format.hpp>
+
+#include <DataSeries/GroupByModule.hpp>
+#include <DataSeries/TypeIndexModule.hpp>
+
+#include "TestCommon.hpp"
+
+using namespace std;
+using namespace client_ops;
+using boost::format;
+
+const int32_t nrows = 100 * 1000, nclients = 301;
+
+struct Sum {
+    Sum() : count(0), total(0) { }
+    int64_t count;
+    double total;
+};
+
+typedef map<pair<int32_t, string>, Sum> Expected;
+
+void expectSums(Expected &expected) {
+    for (int32_t i = 0; i < nrows; ++i) {
+        if (bytesOf(i) > 10) {
+            Sum &sum(expected[make_pair(clientOf(i, nclients), opOf(i))]);
+            ++sum.count;
+            sum.total += bytesOf(i);
+        }
+    }
+}
+
+class SumAnalysis : public GroupByModule::Analysis {
+  public:
+    SumAnalysis(ExtentSeries &s) : Analysis(s), bytes(s, "bytes") { }
+
+    virtual void doGroupRow() {
+        ++sum.count;
+        sum.total += bytes.val();
+    }
+
+    virtual void printResults() {
+        cout << format("%d, %.1f\n") % sum.count % sum.total;
+    }
+
+    virtual void save(string &into) const {
+        into.append(reinterpret_cast<const char *>(&sum), sizeof(sum));
+    }
+
+    virtual void restore(const string &from) {
+        SINVARIANT(from.size() == sizeof(sum));
+        memcpy(&sum, from.data(), sizeof(sum));
+    }
+
+    virtual void merge(GroupByModule::Analysis &from) {
+        SumAnalysis &them(dynamic_cast<SumAnalysis &>(from));
+        sum.count += them.sum.count;
+        sum.total += them.sum.total;
+    }
+
+    DoubleField bytes;
+    Sum sum;
+};
+
+class SumFactory : public GroupByModule::Factory {
+  public:
+    virtual GroupByModule::Analysis *operator()(ExtentSeries &s) {
+        return new SumAnalysis(s);
+    }
+};
+
+class CheckVisitor : public GroupByModule::Visitor {
+  public:
+    CheckVisitor(const Expected &expected) : i(expected.begin()), end(expected.end()) { }
+
+    virtual void operator()(const vector<GeneralValue> &key, GroupByModule::Analysis &analysis) {
+        SINVARIANT(i != end && key.size() == 2);
+        SINVARIANT(key[0].valInt32() == i->first.first);
+        if (i->first.second.empty()) {
+            SINVARIANT(key[1].getType() == ExtentType::ft_unknown);
+        } else {
+            INVARIANT(key[1].valString() == i->first.second,
+                      format("%s != %s") % key[1].valString() % i->first.second);
+        }
+        const Sum &sum(dynamic_cast<SumAnalysis &>(analysis).sum);
+        INVARIANT(sum.count == i->second.count && sum.total == i->second.total,
+                  format("%d/%d, %.1f/%.1f") % sum.count % i->second.count % sum.total
+                  % i->second.total);
+        ++i;
+    }
+
+    Expected::const_iterator i, end;
+};
+
+void checkGroupBy(const Expected &expected, int nthreads, size_t memory_limit) {
+    TypeIndexModule source("Test::ClientOps");
+    source.addSource("group-by.ds");
+    vector<string> keys;
+    keys.push_back("client");
+    keys.push_back("op");
+    SumFactory factory;
+    GroupByModule group_by(source, keys, factory, nthreads);
+    group_by.setWhereExpr("bytes > 10");
+    if (memory_limit > 0) {
+        group_by.setMemoryLimit(memory_limit);
+    }
+    group_by.getAndDeleteShared();
+
+    for (int pass = 0; pass < 2; ++pass) { // visiting again re-reads the spilled groups
+        CheckVisitor visitor(expected);
+        SINVARIANT(group_by.visitGroups(visitor) == expected.size());
+        SINVARIANT(visitor.i == expected.end());
+    }
+    cout << format("%d threads, memory limit %d: %d groups, %d spills of %d groups\n")
+        % nthreads % memory_limit % expected.size() % group_by.spills % group_by.spilled_groups;
+    SINVARIANT((memory_limit > 0) == (group_by.spills > 0));
+    if (nthreads == 1 && memory_limit == 0) {
+        group_by.printResult();
+    }
+}
+
+int main() {
+    Expected expected;
+    writeFile("group-by.ds", nrows, nclients, 32 * 1024);
+    expectSums(expected);
+    checkGroupBy(expected, 1, 0);
+    checkGroupBy(expected, 4, 0);
+    checkGroupBy(expected, 1, 16 * 1024);
+    checkGroupBy(expected, 3, 16 * 1024);
+    cout << "group by checks passed\n";
+    return 0;
+}
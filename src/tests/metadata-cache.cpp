@@ -0,0 +1,122 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <time.h>
+#include <utime.h>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <iostream>
+
+#include <Lintel/TestUtil.hpp>
+
+#include <DataSeries/DataSeriesSource.hpp>
+
+using namespace std;
+
+static int countCacheEntries(const string &dir) {
+    DIR *d = opendir(dir.c_str());
+    SINVARIANT(d != NULL);
+    int ret = 0;
+    while (struct dirent *ent = readdir(d)) {
+        string name(ent->d_name);
+        if (name.size() > 7 && name.substr(name.size() - 7) == ".dsmeta") {
+            ++ret;
+        }
+    }
+    closedir(d);
+    return ret;
+}
+
+// compare against a freshly opened, uncached source
+static void checkSame(const string &file, DataSeriesSource &b) {
+    const char *cache_dir = getenv("DATASERIES_METADATA_CACHE");
+    SINVARIANT(cache_dir != NULL);
+    string save_dir(cache_dir);
+    unsetenv("DATASERIES_METADATA_CACHE");
+    DataSeriesSource a(file);
+    setenv("DATASERIES_METADATA_CACHE", save_dir.c_str(), 1);
+
+    SINVARIANT(a.needBitflip() == b.needBitflip());
+    SINVARIANT(a.index_extent->getTypePtr() == b.index_extent->getTypePtr());
+    SINVARIANT(a.index_extent->fixeddata.size() == b.index_extent->fixeddata.size());
+    SINVARIANT(memcmp(a.index_extent->fixeddata.begin(), b.index_extent->fixeddata.begin(),
+                      a.index_extent->fixeddata.size()) == 0);
+    SINVARIANT(a.index_extent->extent_source_offset == b.index_extent->extent_source_offset);
+
+    // the first data extent should be found at the same place.
+    Extent::Ptr ea(a.readExtent()), eb(b.readExtent());
+    SINVARIANT(ea != NULL && eb != NULL);
+    SINVARIANT(ea->extent_source_offset == eb->extent_source_offset);
+    SINVARIANT(ea->getTypePtr() == eb->getTypePtr());
+}
+
+void testMetadataCache(string file) {
+    string cmd = "/bin/rm -rf metadata-cache.dir && /bin/mkdir metadata-cache.dir && "
+        "/bin/cp " + file + " metadata-cache.ds";
+    int ret = system(cmd.c_str());
+    SINVARIANT(ret == 0);
+    file = "metadata-cache.ds";
+
+    unsetenv("DATASERIES_METADATA_CACHE");
+    {
+        DataSeriesSource uncached(file);
+        SINVARIANT(countCacheEntries("metadata-cache.dir") == 0);
+    }
+    SINVARIANT(DataSeriesSource::getMetadataCacheStats().misses == 0);
+
+    setenv("DATASERIES_METADATA_CACHE", "metadata-cache.dir", 1);
+    {
+        DataSeriesSource populate(file);
+        SINVARIANT(countCacheEntries("metadata-cache.dir") == 1);
+        DataSeriesSource::MetadataCacheStats stats(DataSeriesSource::getMetadataCacheStats());
+        SINVARIANT(stats.misses == 1 && stats.writes == 1 && stats.hits == 0);
+        checkSame(file, populate);
+    }
+    cout << "Populate passed.\n";
+
+    DataSeriesSource cached(file);
+    DataSeriesSource::MetadataCacheStats stats(DataSeriesSource::getMetadataCacheStats());
+    SINVARIANT(stats.hits == 1 && stats.misses == 1 && stats.writes == 1);
+    checkSame(file, cached);
+    cout << "Cached open passed.\n";
+
+    // a newer mtime invalidates the entry; it should be rewritten in place.
+    struct utimbuf file_time;
+    file_time.actime = time(NULL) + 10;
+    file_time.modtime = file_time.actime;
+    ret = utime(file.c_str(), &file_time);
+    SINVARIANT(ret == 0);
+    DataSeriesSource stale(file);
+    stats = DataSeriesSource::getMetadataCacheStats();
+    SINVARIANT(stats.hits == 1 && stats.stale == 1 && stats.writes == 2);
+    checkSame(file, stale);
+    SINVARIANT(countCacheEntries("metadata-cache.dir") == 1);
+    cout << "Stale entry passed.\n";
+
+    vector<string> files;
+    files.push_back(file);
+    files.push_back(file);
+    stats = DataSeriesSource::getMetadataCacheStats();
+    DataSeriesSource::warmMetadataCache(files, 2);
+    SINVARIANT(countCacheEntries("metadata-cache.dir") == 1);
+    SINVARIANT(DataSeriesSource::getMetadataCacheStats().hits == stats.hits + 2);
+    cout << "Warm passed.\n";
+
+    cmd = "/bin/rm -rf metadata-cache.dir metadata-cache.ds";
+    ret = system(cmd.c_str());
+    SINVARIANT(ret == 0);
+}
+
+int main(int argc, char *argv[]) {
+    SINVARIANT(argc == 2);
+    testMetadataCache(argv[1]);
+    return 0;
+}
@@ -0,0 +1,137 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    check that expressions compiled to native code match the interpreter
+*/
+
+#include <stdlib.h>
+
+#include <iostream>
+
+#include <boost/format.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <Lintel/Double.hpp>
+
+#include <DataSeries/DSExpr.hpp>
+#include <DataSeries/ExtentField.hpp>
+#include <DataSeries/NativeCode.hpp>
+
+using namespace std;
+
+void checkSelectRows(ExtentSeries &series, const string &expr_str) {
+    boost::scoped_ptr<DSExpr> expr(DSExpr::make(series, expr_str));
+    dataseries::RowSelection expected, selected;
+    uint32_t row = 0;
+    for (series.setCurPos(series.getExtentRef().fixeddata.begin()); series.morerecords();
+         ++series, ++row) {
+        if (expr->valBool()) {
+            expected.push_back(row);
+        }
+    }
+    expr->selectRows(series, selected);
+    INVARIANT(selected == expected, boost::format("mismatch on '%s'") % expr_str);
+}
+
+void checkValDoubles(ExtentSeries &series, const string &expr_str) {
+    boost::scoped_ptr<DSExpr> expr(DSExpr::make(series, expr_str));
+    dataseries::RowSelection odd;
+    vector<double> expected, values;
+    uint32_t row = 0;
+    for (series.setCurPos(series.getExtentRef().fixeddata.begin()); series.morerecords();
+         ++series, ++row) {
+        expected.push_back(expr->valDouble());
+        if (row % 2 == 1) {
+            odd.push_back(row);
+        }
+    }
+    expr->valDoubles(series, NULL, values);
+    SINVARIANT(values.size() == expected.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+        INVARIANT(Double::eq(values[i], expected[i]), boost::format("mismatch on '%s' row %d")
+                  % expr_str % i);
+    }
+    expr->valDoubles(series, &odd, values);
+    SINVARIANT(values.size() == odd.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+        SINVARIANT(Double::eq(values[i], expected[odd[i]]));
+    }
+}
+
+int main() {
+    setenv("DATASERIES_NATIVE_CACHE", "native-code.cache", 1);
+    NativeCode::setEnabled(true);
+
+    // the compiler might not be available where the tests run; everything below still has to
+    // work through the interpreter then.
+    string source("extern \"C\" int32_t f() { return compare(" + NativeCode::literal("ab\"\\")
+                  + ", makeStr(\"ab\\\"\\\\\", 4)) + 17; }\n");
+    NativeCode::Ptr code(NativeCode::compile(source));
+    if (code == NULL) {
+        cout << "no native code compiler, checking the fallbacks\n";
+    } else {
+        int32_t (*f)() = reinterpret_cast<int32_t (*)()>(code->lookup("f"));
+        SINVARIANT(f != NULL && f() == 17 && code->lookup("g") == NULL);
+        NativeCode::Ptr again(NativeCode::compile(source));
+        SINVARIANT(again != NULL && again->getPath() == code->getPath());
+    }
+
+    ExtentTypeLibrary library;
+    const ExtentType::Ptr extent_type(library.registerTypePtr(
+        "<ExtentType name=\"Test::Native\" namespace=\"ssd.hpl.hp.com\" version=\"1.0\" >"
+        "  <field type=\"bool\" name=\"f\" opt_nullable=\"yes\" />"
+        "  <field type=\"byte\" name=\"y\" />"
+        "  <field type=\"int32\" name=\"a\" />"
+        "  <field type=\"int64\" name=\"b\" opt_nullable=\"yes\" />"
+        "  <field type=\"double\" name=\"c\" />"
+        "  <field type=\"variable32\" name=\"s\" />"
+        "  <field type=\"variable32\" name=\"t\" opt_nullable=\"yes\" />"
+        "</ExtentType>"));
+
+    ExtentSeries series(extent_type);
+    series.newExtent();
+    BoolField f(series, "f", Field::flag_nullable);
+    ByteField y(series, "y");
+    Int32Field a(series, "a");
+    Int64Field b(series, "b", Field::flag_nullable);
+    DoubleField c(series, "c");
+    Variable32Field s(series, "s"), t(series, "t", Field::flag_nullable);
+
+    for (int32_t i = 0; i < 500; ++i) {
+        series.newRecord();
+        if (i % 7 == 0) {
+            f.setNull();
+        } else {
+            f.set(i % 3 == 0);
+        }
+        y.set(i % 256);
+        a.set(i - 250);
+        c.set(i * 0.5);
+        s.set((boost::format("x%d") % (i % 13)).str());
+        if (i % 5 == 0) {
+            b.setNull();
+            t.setNull();
+        } else {
+            b.set(static_cast<int64_t>(i) << 33);
+            t.set((boost::format("x%d\"\n") % (i % 11)).str());
+        }
+    }
+
+    checkSelectRows(series, "s == \"x3\" || (f == 1 && a > b)");
+    checkSelectRows(series, "s < t && !(f != 0)");
+    checkSelectRows(series, "a * c > -b / 2 || c <= 3");
+    checkSelectRows(series, "y >= 128 && (s != \"x1\" || t > s)");
+    checkSelectRows(series, "b / 8589934592 == a + 250 || b - 1 > a * 2");
+    // no native form for concatenation or function calls
+    checkSelectRows(series, "s + t == \"x1x1\"");
+    checkValDoubles(series, "a * 3 + b - 7");
+    checkValDoubles(series, "c / 2 - a + y");
+    checkValDoubles(series, "fn.TfracToSeconds(b) + 1");
+    cout << "native code checks passed\n";
+    return 0;
+}
@@ -0,0 +1,94 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    check that ParallelRowAnalysisModule gets the same answer as a serial RowAnalysisModule
+*/
+
+#include <iostream>
+
+#include <Lintel/TestUtil.hpp>
+
+#include <DataSeries/ExtentField.hpp>
+#include <DataSeries/ParallelRowAnalysisModule.hpp>
+#include <DataSeries/TypeIndexModule.hpp>
+
+using namespace std;
+
+class SumBytes : public ParallelRowAnalysisModule::Analysis {
+  public:
+    SumBytes(DataSeriesModule &source)
+        : ParallelRowAnalysisModule::Analysis(source), bytes(series, "bytes"), 
+          count(0), sum(0), prepare_count(0), completed(false) { }
+
+    virtual void prepareForProcessing() {
+        ++prepare_count;
+    }
+
+    virtual void processRow() {
+        ++count;
+        sum += bytes.val();
+    }
+
+    virtual void merge(ParallelRowAnalysisModule::Analysis &from) {
+        SumBytes &f(dynamic_cast<SumBytes &>(from));
+        count += f.count;
+        sum += f.sum;
+        prepare_count += f.prepare_count;
+    }
+
+    virtual void completeProcessing() {
+        completed = true;
+    }
+
+    Int32Field bytes;
+    uint64_t count;
+    int64_t sum;
+    int prepare_count;
+    bool completed;
+};
+
+class SumBytesFactory : public ParallelRowAnalysisModule::Factory {
+  public:
+    virtual ParallelRowAnalysisModule::Analysis *operator()(DataSeriesModule &source) {
+        return new SumBytes(source);
+    }
+};
+
+void runTest(const string &file, int nthreads) {
+    TypeIndexModule serial_source("I/O trace: SRT-V7");
+    serial_source.addSource(file);
+    SumBytes serial(serial_source);
+    serial.setWhereExpr("is_read");
+    serial.getAndDeleteShared();
+    SINVARIANT(serial.count > 0 && serial.ignored_rows > 0);
+
+    TypeIndexModule parallel_source("I/O trace: SRT-V7");
+    parallel_source.addSource(file);
+    SumBytesFactory factory;
+    ParallelRowAnalysisModule parallel(parallel_source, factory, nthreads);
+    parallel.setWhereExpr("is_read");
+    parallel.getAndDeleteShared();
+
+    SumBytes *merged = dynamic_cast<SumBytes *>(parallel.getMergedAnalysis());
+    SINVARIANT(merged != NULL && merged->completed);
+    INVARIANT(merged->count == serial.count && merged->sum == serial.sum,
+              boost::format("%d threads: %d/%d != %d/%d") % nthreads % merged->count 
+              % merged->sum % serial.count % serial.sum);
+    SINVARIANT(parallel.processed_rows == serial.processed_rows);
+    SINVARIANT(parallel.ignored_rows == serial.ignored_rows);
+    SINVARIANT(merged->prepare_count >= 1 && merged->prepare_count <= nthreads);
+    cout << boost::format("%d threads: %d rows, %d bytes, %d steals\n") % nthreads 
+        % merged->count % merged->sum % parallel.steals;
+}
+
+int main(int argc, char *argv[]) {
+    SINVARIANT(argc == 2);
+    runTest(argv[1], 1);
+    runTest(argv[1], 4);
+    return 0;
+}
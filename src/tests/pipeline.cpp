@@ -0,0 +1,109 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    check that PipelineModule gets the same answers as SequenceModule, that its stage
+    times pick out the slow stage, and that its last module runs on the caller's thread
+*/
+
+#include <iostream>
+
+#include <boost/format.hpp>
+
+#include <DataSeries/PipelineModule.hpp>
+#include <DataSeries/TypeIndexModule.hpp>
+
+#include "TestCommon.hpp"
+
+using namespace std;
+using boost::format;
+
+/// a fast stage, a slow one and another fast one
+void run(SequenceModule &seq) {
+    const int spins[] = { 0, 10000, 0 };
+    for (int i = 0; i < 3; ++i) {
+        seq.addModule(new SumBytes(seq.tail(), spins[i]));
+    }
+    seq.getAndDeleteShared();
+}
+
+SumBytes &stage(SequenceModule &seq, int i) {
+    return dynamic_cast<SumBytes &>(**(seq.begin() + i));
+}
+
+/// passes extents through, noting the thread that asked for them
+class ThreadOf : public DataSeriesModule {
+  public:
+    ThreadOf(DataSeriesModule &source) : source(source), called(false) { }
+
+    virtual Extent::Ptr getSharedExtent() {
+        called = true;
+        thread = pthread_self();
+        return source.getSharedExtent();
+    }
+
+    DataSeriesModule &source;
+    bool called;
+    pthread_t thread;
+};
+
+/// the deprecated getExtent() reads the last module on this thread, as getSharedExtent() does
+void checkGetExtent(const string &filename) {
+    TypeIndexModule *source = new TypeIndexModule("I/O trace: SRT-V7");
+    source->addSource(filename);
+    PipelineModule pipeline(source, 1024 * 1024);
+    pipeline.addModule(new SumBytes(pipeline.tail()));
+    ThreadOf *last = new ThreadOf(pipeline.tail());
+    pipeline.addModule(last);
+
+    uint32_t extents = 0;
+    for (Extent *e = pipeline.getExtent(); e != NULL; e = pipeline.getExtent()) {
+        ++extents;
+        delete e;
+    }
+    SINVARIANT(extents > 0 && last->called && pthread_equal(last->thread, pthread_self()));
+    SINVARIANT(stage(pipeline, 1).count > 0);
+
+    vector<PipelineModule::StageTimes> times(pipeline.getStageTimes());
+    SINVARIANT(times.size() == 3 && times[2].busy + times[2].idle > 0);
+}
+
+int main(int argc, char *argv[]) {
+    SINVARIANT(argc == 2);
+    TypeIndexModule *serial_source = new TypeIndexModule("I/O trace: SRT-V7");
+    serial_source->addSource(argv[1]);
+    SequenceModule serial(serial_source);
+    run(serial);
+
+    TypeIndexModule *pipeline_source = new TypeIndexModule("I/O trace: SRT-V7");
+    pipeline_source->addSource(argv[1]);
+    PipelineModule pipeline(pipeline_source, 1024 * 1024);
+    run(pipeline);
+
+    SINVARIANT(pipeline.size() == 4 && RowAnalysisModule::printAllResults(pipeline, 1) == 1);
+    for (int i = 1; i <= 3; ++i) {
+        SINVARIANT(stage(serial, i).count > 0);
+        checkSameSums(stage(pipeline, i), stage(serial, i), str(format("stage %d") % i));
+    }
+
+    vector<PipelineModule::StageTimes> times(pipeline.getStageTimes());
+    SINVARIANT(times.size() == 4);
+    for (int i = 0; i < 4; ++i) {
+        SINVARIANT(times[i].busy >= 0 && times[i].idle >= 0);
+        if (i != 2) {
+            INVARIANT(times[i].busy < times[2].busy, format("stage %d busier than the slow one")
+                      % i);
+        }
+    }
+    // everything after the slow stage waits for it
+    SINVARIANT(times[3].idle > times[3].busy);
+    pipeline.printStageTimes();
+
+    checkGetExtent(argv[1]);
+    cout << format("pipeline checks passed, %d rows\n") % stage(pipeline, 1).count;
+    return 0;
+}
@@ -0,0 +1,145 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    check that IndexSourceModule autotuning grows whatever makes the consumer wait, gives
+    threads and memory back when it doesn't, and parks the unpack threads it isn't using
+*/
+
+#include <iostream>
+
+#include <boost/format.hpp>
+
+#include <DataSeries/TypeIndexModule.hpp>
+
+#include "TestCommon.hpp"
+
+using namespace std;
+using boost::format;
+
+typedef IndexSourceModule::WaitStats WaitStats;
+typedef IndexSourceModule::PrefetchLimits PrefetchLimits;
+
+const unsigned MiB = 1024 * 1024;
+
+/// stats after nextents more extents, with the waits given per extent
+WaitStats after(const WaitStats &base, uint64_t nextents, double consumer,
+                double no_upstream, double downstream_full) {
+    WaitStats ret(base);
+    ret.nextents += nextents;
+    ret.consumer += static_cast<uint64_t>(consumer * nextents);
+    ret.unpack_no_upstream += static_cast<uint64_t>(no_upstream * nextents);
+    ret.unpack_downstream_full += static_cast<uint64_t>(downstream_full * nextents);
+    return ret;
+}
+
+bool operator ==(const PrefetchLimits &a, const PrefetchLimits &b) {
+    return a.unpack_threads == b.unpack_threads && a.compressed == b.compressed
+        && a.unpacked == b.unpacked;
+}
+
+void check(const WaitStats &now, const WaitStats &base, const PrefetchLimits &from,
+           const PrefetchLimits &expect, const string &what, bool decided = true) {
+    const PrefetchLimits max(4, 16 * MiB, 64 * MiB);
+    PrefetchLimits limits(from);
+    SINVARIANT(IndexSourceModule::autoTune(now, base, limits, max) == decided);
+    INVARIANT(limits == expect, format("%s: got %d threads, %d/%d; expected %d, %d/%d")
+              % what % limits.unpack_threads % limits.compressed % limits.unpacked
+              % expect.unpack_threads % expect.compressed % expect.unpacked);
+}
+
+void checkDecisions() {
+    WaitStats base;
+    base.nextents = 100; // decisions only look at the change since base
+    const PrefetchLimits start(2, 4 * MiB, 16 * MiB);
+
+    check(after(base, 8, 1, 0, 4), base, start, start, "too few extents", false);
+
+    // the consumer waits; grow the one thing holding it up
+    check(after(base, 16, 0.5, 0, 2), base, start, PrefetchLimits(2, 4 * MiB, 32 * MiB),
+          "unpackers blocked");
+    check(after(base, 16, 0.5, 0, 2), base, PrefetchLimits(2, 4 * MiB, 48 * MiB),
+          PrefetchLimits(2, 4 * MiB, 64 * MiB), "unpacked at most max");
+    check(after(base, 16, 0.5, 2, 0), base, start, PrefetchLimits(2, 8 * MiB, 16 * MiB),
+          "unpackers starved");
+    check(after(base, 16, 0.5, 0.5, 0), base, start, PrefetchLimits(3, 4 * MiB, 16 * MiB),
+          "unpackers busy");
+    check(after(base, 16, 0.5, 0, 2), base, PrefetchLimits(4, 16 * MiB, 64 * MiB),
+          PrefetchLimits(4, 16 * MiB, 64 * MiB), "all at max");
+
+    // the consumer doesn't wait; give back idle threads first, then memory
+    check(after(base, 16, 0, 2, 0), base, start, PrefetchLimits(1, 4 * MiB, 16 * MiB),
+          "unpackers idle");
+    check(after(base, 16, 0, 2, 0), base, PrefetchLimits(1, 4 * MiB, 16 * MiB),
+          PrefetchLimits(1, 4 * MiB, 12 * MiB), "one thread left");
+    check(after(base, 16, 0, 0, 2), base, start, PrefetchLimits(2, 4 * MiB, 12 * MiB),
+          "unpacked shrinks");
+    check(after(base, 16, 0, 0, 2), base, PrefetchLimits(2, 4 * MiB, MiB),
+          PrefetchLimits(2, 3 * MiB, MiB), "compressed shrinks");
+    check(after(base, 16, 0, 0, 2), base, PrefetchLimits(2, MiB, MiB),
+          PrefetchLimits(2, MiB, MiB), "all at min");
+
+    // in between, leave things alone
+    check(after(base, 16, 1.0 / 16, 2, 2), base, start, start, "some waiting");
+
+    // a consumer that waits until everything is grown, and then stops waiting, ends up back at
+    // the minimum
+    PrefetchLimits limits(1, MiB, MiB);
+    const PrefetchLimits max(4, 16 * MiB, 64 * MiB);
+    WaitStats now;
+    for (int i = 0; i < 20; ++i) {
+        WaitStats prev(now);
+        now = after(prev, 16, 0.5, i % 2 == 0 ? 2 : 0.5, i % 2 == 0 ? 0 : 2);
+        SINVARIANT(IndexSourceModule::autoTune(now, prev, limits, max));
+    }
+    SINVARIANT(limits == max);
+    for (int i = 0; i < 40; ++i) {
+        WaitStats prev(now);
+        now = after(prev, 16, 0, 2, 0);
+        SINVARIANT(IndexSourceModule::autoTune(now, prev, limits, max));
+    }
+    SINVARIANT(limits == PrefetchLimits(1, MiB, MiB));
+}
+
+const string type_string(
+    "<ExtentType namespace=\"ssd.hpl.hp.com\" name=\"Test::AutoTune\" version=\"1.0\" >\n"
+    "  <field type=\"int32\" name=\"bytes\" />\n"
+    "</ExtentType>\n");
+
+const int32_t nrows = 200 * 1000;
+
+/// reading with more unpack threads than autotuning allows parks the extra ones
+void checkParking() {
+    {
+        TestFile out("prefetch-autotune.ds", type_string, 16 * 1024);
+        Int32Field bytes(out.series(), "bytes");
+        for (int32_t i = 0; i < nrows; ++i) {
+            out.newRecord();
+            bytes.set(i % 1000);
+        }
+    }
+
+    TypeIndexModule source("Test::AutoTune");
+    source.addSource("prefetch-autotune.ds");
+    source.enableAutoTune(8 * MiB, 32 * MiB, 2);
+    source.startPrefetching(MiB, 4 * MiB, 4);
+    SumBytes sum(source);
+    sum.getAndDeleteShared();
+    SINVARIANT(sum.count == static_cast<uint64_t>(nrows));
+
+    WaitStats stats;
+    SINVARIANT(source.getWaitStats(stats));
+    INVARIANT(stats.unpack_parked >= 2, format("parked %d times") % stats.unpack_parked);
+    cout << format("%d extents, %d parked\n") % stats.nextents % stats.unpack_parked;
+}
+
+int main() {
+    checkDecisions();
+    checkParking();
+    cout << "prefetch autotune checks passed\n";
+    return 0;
+}
@@ -0,0 +1,103 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    check QuantileSketch rank error, size bound and merging against exact quantiles
+*/
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include <boost/format.hpp>
+
+#include <Lintel/AssertBoost.hpp>
+
+#include <DataSeries/QuantileSketch.hpp>
+
+using namespace std;
+using boost::format;
+using dataseries::QuantileSketch;
+
+const double error = 0.01;
+
+/// fraction of values <= v
+double rankOf(const vector<double> &sorted, double v) {
+    return static_cast<double>(upper_bound(sorted.begin(), sorted.end(), v) - sorted.begin())
+        / sorted.size();
+}
+
+void checkQuantiles(const QuantileSketch &sketch, vector<double> values, const string &what) {
+    sort(values.begin(), values.end());
+    SINVARIANT(sketch.countll() == static_cast<int64_t>(values.size()));
+    SINVARIANT(sketch.min() == values.front() && sketch.max() == values.back());
+    double worst = 0;
+    for (double q = 0.01; q < 0.995; q += 0.01) {
+        double v = sketch.getQuantile(q);
+        // a run of equal values makes every rank in the run correct
+        double low = static_cast<double>(lower_bound(values.begin(), values.end(), v)
+                                         - values.begin()) / values.size();
+        double high = rankOf(values, v);
+        worst = max(worst, q < low ? low - q : (q > high ? q - high : 0));
+    }
+    INVARIANT(worst <= 2 * error, format("%s: rank error %.4f > %.4f") % what % worst
+              % (2 * error));
+    cout << format("%s: %d values in %d bytes, worst rank error %.4f\n")
+        % what % values.size() % sketch.memoryUsage() % worst;
+}
+
+uint32_t next(uint32_t &state) {
+    state = state * 1103515245 + 12345;
+    return state >> 8;
+}
+
+int main() {
+    // small: exact while nothing has been compacted
+    QuantileSketch small(error);
+    vector<double> small_values;
+    for (int i = 0; i < 50; ++i) {
+        small.add(i);
+        small_values.push_back(i);
+    }
+    SINVARIANT(small.getQuantile(0.5) == 24);
+    checkQuantiles(small, small_values, "small");
+
+    // large, skewed: bounded size
+    uint32_t state = 1;
+    QuantileSketch all(error), parts[4]; // default error is 0.01
+    vector<double> values;
+    for (int i = 0; i < 1000 * 1000; ++i) {
+        double v = next(state) % 1000;
+        v = v * v * (i % 7); // skewed, with many duplicates
+        values.push_back(v);
+        all.add(v);
+        parts[i % 4].add(v);
+    }
+    checkQuantiles(all, values, "sequential");
+    SINVARIANT(all.memoryUsage() < 64 * 1024);
+
+    // merging, including into an empty sketch
+    QuantileSketch merged(error);
+    for (int i = 0; i < 4; ++i) {
+        merged.add(parts[i]);
+    }
+    checkQuantiles(merged, values, "merged");
+    SINVARIANT(merged.memoryUsage() < 64 * 1024);
+    SINVARIANT(merged.mean() == all.mean());
+
+    // the helpers work on either kind of quantile stats
+    Stats *stats = dataseries::newQuantileStats(error);
+    for (vector<double>::iterator i = small_values.begin(); i != small_values.end(); ++i) {
+        stats->add(*i);
+    }
+    dataseries::mergeQuantiles(*stats, small);
+    SINVARIANT(stats->countll() == 100 && dataseries::getQuantile(*stats, 0.5) == 24);
+    delete stats;
+
+    cout << "quantile sketch checks passed\n";
+    return 0;
+}
@@ -0,0 +1,202 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    check that ExtentRecordCopy copies the same values whether the types are identical, laid
+    out differently, or need conversions, one record or a range at a time
+*/
+
+#include <iostream>
+
+#include <boost/format.hpp>
+
+#include <Lintel/TestUtil.hpp>
+
+#include <DataSeries/ExtentField.hpp>
+#include <DataSeries/GeneralField.hpp>
+
+using namespace std;
+using boost::format;
+
+const string source_type_string(
+    "<ExtentType namespace=\"ssd.hpl.hp.com\" name=\"Test::CopySource\" version=\"1.0\" >\n"
+    "  <field type=\"int64\" name=\"id\" />\n"
+    "  <field type=\"bool\" name=\"flag\" />\n"
+    "  <field type=\"int32\" name=\"bytes\" opt_nullable=\"yes\" />\n"
+    "  <field type=\"variable32\" name=\"name\" opt_nullable=\"yes\" />\n"
+    "  <field type=\"byte\" name=\"small\" />\n"
+    "  <field type=\"bool\" name=\"other\" opt_nullable=\"yes\" />\n"
+    "  <field type=\"double\" name=\"when\" opt_doublebase=\"1000\" />\n"
+    "  <field type=\"int32\" name=\"count\" />\n"
+    "</ExtentType>\n");
+
+// the same fields in another order, with count widened and a different base for when
+const string convert_type_string(
+    "<ExtentType namespace=\"ssd.hpl.hp.com\" name=\"Test::CopyConvert\" version=\"1.0\" >\n"
+    "  <field type=\"int64\" name=\"count\" />\n"
+    "  <field type=\"variable32\" name=\"name\" opt_nullable=\"yes\" />\n"
+    "  <field type=\"bool\" name=\"other\" opt_nullable=\"yes\" />\n"
+    "  <field type=\"bool\" name=\"flag\" />\n"
+    "  <field type=\"int64\" name=\"id\" />\n"
+    "  <field type=\"byte\" name=\"small\" />\n"
+    "  <field type=\"int32\" name=\"bytes\" opt_nullable=\"yes\" />\n"
+    "  <field type=\"double\" name=\"when\" />\n"
+    "</ExtentType>\n");
+
+// a subset of the fields, all with the same representation
+const string subset_type_string(
+    "<ExtentType namespace=\"ssd.hpl.hp.com\" name=\"Test::CopySubset\" version=\"1.0\" >\n"
+    "  <field type=\"variable32\" name=\"name\" opt_nullable=\"yes\" />\n"
+    "  <field type=\"bool\" name=\"other\" opt_nullable=\"yes\" />\n"
+    "  <field type=\"int64\" name=\"id\" />\n"
+    "  <field type=\"bool\" name=\"flag\" />\n"
+    "  <field type=\"int32\" name=\"bytes\" opt_nullable=\"yes\" />\n"
+    "</ExtentType>\n");
+
+const uint32_t nrows = 1000;
+
+Extent::Ptr makeSource(const ExtentType::Ptr &type) {
+    ExtentSeries series(type);
+    series.newExtent();
+    Int64Field id(series, "id");
+    BoolField flag(series, "flag");
+    Int32Field bytes(series, "bytes", Field::flag_nullable);
+    Variable32Field name(series, "name", Field::flag_nullable);
+    ByteField small(series, "small");
+    BoolField other(series, "other", Field::flag_nullable);
+    DoubleField when(series, "when", DoubleField::flag_allownonzerobase);
+    Int32Field count(series, "count");
+    for (uint32_t i = 0; i < nrows; ++i) {
+        series.newRecord();
+        id.set(i * 7);
+        flag.set(i % 2 == 1);
+        if (i % 3 == 0) {
+            bytes.setNull();
+        } else {
+            bytes.set(i);
+        }
+        if (i % 5 == 0) {
+            name.setNull();
+        } else {
+            name.set(str(format("name-%s") % string(i % 23, 'n')));
+        }
+        small.set(i % 256);
+        if (i % 4 == 0) {
+            other.setNull();
+        } else {
+            other.set(i % 3 == 0);
+        }
+        when.setabs(1000 + i / 4.0);
+        count.set(i * 11);
+    }
+    return series.getSharedExtent();
+}
+
+/// check that the records of e are copies of the source rows in rows
+void checkRows(const Extent::Ptr &e, const vector<uint32_t> &rows, const string &what) {
+    ExtentSeries series(e);
+    Int64Field id(series, "id");
+    BoolField flag(series, "flag");
+    Int32Field bytes(series, "bytes", Field::flag_nullable);
+    Variable32Field name(series, "name", Field::flag_nullable);
+    BoolField other(series, "other", Field::flag_nullable);
+    bool all_fields = e->getTypePtr()->hasColumn("count");
+    GeneralField *small = all_fields ? GeneralField::create(series, "small") : NULL;
+    DoubleField *when = all_fields 
+        ? new DoubleField(series, "when", DoubleField::flag_allownonzerobase) : NULL;
+    GeneralField *count = all_fields ? GeneralField::create(series, "count") : NULL;
+
+    SINVARIANT(e->nRecords() == rows.size());
+    for (uint32_t j = 0; series.morerecords(); ++series, ++j) {
+        uint32_t i = rows[j];
+        INVARIANT(id.val() == i * 7, format("%s: record %d has id %d, not %d")
+                  % what % j % id.val() % (i * 7));
+        SINVARIANT(flag.val() == (i % 2 == 1));
+        SINVARIANT(bytes.isNull() == (i % 3 == 0)
+                   && (bytes.isNull() || bytes.val() == static_cast<int32_t>(i)));
+        SINVARIANT(name.isNull() == (i % 5 == 0));
+        SINVARIANT(name.isNull() || name.stringval() == str(format("name-%s")
+                                                            % string(i % 23, 'n')));
+        SINVARIANT(other.isNull() == (i % 4 == 0));
+        SINVARIANT(other.isNull() || other.val() == (i % 3 == 0));
+        if (all_fields) {
+            SINVARIANT(small->valDouble() == i % 256);
+            INVARIANT(when->absval() == 1000 + i / 4.0, format("%s: when %.2f for %d")
+                      % what % when->absval() % i);
+            SINVARIANT(count->valDouble() == i * 11);
+        }
+    }
+    delete small;
+    delete when;
+    delete count;
+}
+
+vector<uint32_t> allRows() {
+    vector<uint32_t> ret;
+    for (uint32_t i = 0; i < nrows; ++i) {
+        ret.push_back(i);
+    }
+    return ret;
+}
+
+/// copy every row one at a time, the second half in one range, and some scattered rows
+void checkCopies(const Extent::Ptr &from, const ExtentType::Ptr &to_type, const string &what) {
+    ExtentSeries source(from), dest(to_type);
+    ExtentRecordCopy copier(source, dest);
+
+    dest.newExtent();
+    for (; source.morerecords(); ++source) {
+        dest.newRecord();
+        copier.copyRecord();
+    }
+    checkRows(dest.getSharedExtent(), allRows(), what + " by record");
+
+    dest.newExtent();
+    source.setExtent(from);
+    copier.copyRecords(0, nrows / 2);
+    SINVARIANT(dest.getExtentRef().nRecords() == nrows / 2 && dest.morerecords());
+    copier.copyRecords(nrows / 2, nrows - nrows / 2);
+    ++dest;
+    SINVARIANT(!dest.morerecords());
+    checkRows(dest.getSharedExtent(), allRows(), what + " by range");
+
+    vector<uint32_t> rows;
+    for (uint32_t i = 0; i < nrows; i += (i % 10 < 5 ? 1 : 3)) {
+        rows.push_back(i);
+    }
+    dest.newExtent();
+    copier.copyRecords(rows);
+    checkRows(dest.getSharedExtent(), rows, what + " by rows");
+}
+
+int main() {
+    ExtentTypeLibrary library;
+    const ExtentType::Ptr source_type(library.registerTypePtr(source_type_string));
+    const ExtentType::Ptr convert_type(library.registerTypePtr(convert_type_string));
+    const ExtentType::Ptr subset_type(library.registerTypePtr(subset_type_string));
+    Extent::Ptr from = makeSource(source_type);
+
+    checkCopies(from, source_type, "identical");
+    checkCopies(from, convert_type, "convert");
+    checkCopies(from, subset_type, "subset");
+
+    // copying by offset, including fields that need converting
+    const ExtentType::Ptr to_types[] = { source_type, convert_type, subset_type };
+    for (size_t i = 0; i < sizeof(to_types) / sizeof(to_types[0]); ++i) {
+        ExtentSeries source(source_type), dest(to_types[i]);
+        dest.newExtent();
+        ExtentRecordCopy copier(source, dest);
+        for (ExtentSeries scan(from); scan.morerecords(); ++scan) {
+            dest.newRecord();
+            copier.copyRecord(*from, scan.getRowOffset());
+        }
+        checkRows(dest.getSharedExtent(), allRows(), to_types[i]->getName() + " by offset");
+    }
+
+    cout << "record copy checks passed\n";
+    return 0;
+}
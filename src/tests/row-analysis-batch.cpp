@@ -0,0 +1,113 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    check that RowAnalysisModule::processBatch() over column spans matches processRow()
+*/
+
+#include <iostream>
+
+#include <Lintel/TestUtil.hpp>
+
+#include <DataSeries/ExtentField.hpp>
+#include <DataSeries/RowAnalysisModule.hpp>
+#include <DataSeries/TypeIndexModule.hpp>
+
+using namespace std;
+
+class RowSum : public RowAnalysisModule {
+  public:
+    RowSum(DataSeriesModule &source)
+        : RowAnalysisModule(source), bytes(series, "bytes"),
+          thread_id(series, "thread_id", Field::flag_nullable, -1),
+          count(0), bytes_sum(0), thread_id_sum(0), null_thread_ids(0) { }
+
+    virtual void processRow() {
+        ++count;
+        bytes_sum += bytes.val();
+        thread_id_sum += thread_id.val();
+        if (thread_id.isNull()) {
+            ++null_thread_ids;
+        }
+    }
+
+    Int32Field bytes, thread_id;
+    uint64_t count;
+    int64_t bytes_sum, thread_id_sum;
+    uint64_t null_thread_ids;
+};
+
+class BatchSum : public RowSum {
+  public:
+    BatchSum(DataSeriesModule &source) : RowSum(source), batches(0) { }
+
+    virtual void processRow() {
+        FATAL_ERROR("should only get batches");
+    }
+
+    virtual void processBatch(uint32_t nrows, const dataseries::RowSelection *selection) {
+        ++batches;
+        dataseries::ColumnSpan<int32_t> b(bytes.span()), t(thread_id.span());
+        SINVARIANT(b.size() == nrows && t.size() == nrows && t.nullable());
+        if (selection == NULL) {
+            for (uint32_t i = 0; i < nrows; ++i) {
+                add(b, t, i);
+            }
+        } else {
+            for (dataseries::RowSelection::const_iterator i = selection->begin();
+                 i != selection->end(); ++i) {
+                add(b, t, *i);
+            }
+        }
+    }
+
+    void add(const dataseries::ColumnSpan<int32_t> &b, const dataseries::ColumnSpan<int32_t> &t,
+             uint32_t row) {
+        ++count;
+        bytes_sum += b[row];
+        thread_id_sum += t[row];
+        if (t.isNull(row)) {
+            ++null_thread_ids;
+        }
+    }
+
+    uint32_t batches;
+};
+
+void runTest(const string &file, const string &where) {
+    TypeIndexModule row_source("I/O trace: SRT-V7");
+    row_source.addSource(file);
+    RowSum row(row_source);
+    row.setWhereExpr(where);
+    row.getAndDeleteShared();
+    SINVARIANT(row.count > 0 && row.count == row.processed_rows);
+
+    TypeIndexModule batch_source("I/O trace: SRT-V7");
+    batch_source.addSource(file);
+    BatchSum batch(batch_source);
+    batch.setWhereExpr(where);
+    batch.getAndDeleteShared();
+
+    SINVARIANT(batch.batches > 0);
+    INVARIANT(batch.count == row.count && batch.bytes_sum == row.bytes_sum
+              && batch.thread_id_sum == row.thread_id_sum
+              && batch.null_thread_ids == row.null_thread_ids,
+              boost::format("'%s': %d/%d/%d/%d != %d/%d/%d/%d") % where
+              % batch.count % batch.bytes_sum % batch.thread_id_sum % batch.null_thread_ids
+              % row.count % row.bytes_sum % row.thread_id_sum % row.null_thread_ids);
+    SINVARIANT(batch.processed_rows == row.processed_rows);
+    SINVARIANT(batch.ignored_rows == row.ignored_rows);
+    cout << boost::format("'%s': %d rows in %d batches, %d bytes, %d null thread ids\n")
+        % where % batch.count % batch.batches % batch.bytes_sum % batch.null_thread_ids;
+}
+
+int main(int argc, char *argv[]) {
+    SINVARIANT(argc == 2);
+    runTest(argv[1], "");
+    runTest(argv[1], "is_read");
+    return 0;
+}
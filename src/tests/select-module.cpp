@@ -0,0 +1,157 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    check that analyses after a SelectModule see exactly the selected rows, whether they take
+    the selection or a materialized copy
+*/
+
+#include <iostream>
+
+#include <boost/format.hpp>
+
+#include <boost/scoped_ptr.hpp>
+
+#include <Lintel/StringUtil.hpp>
+
+#include <DataSeries/SelectModule.hpp>
+#include <DataSeries/SequenceModule.hpp>
+#include <DataSeries/TypeIndexModule.hpp>
+
+#include "TestCommon.hpp"
+
+using namespace std;
+using boost::format;
+
+const string type_string(
+    "<ExtentType namespace=\"ssd.hpl.hp.com\" name=\"Test::Select\" version=\"1.0\" >\n"
+    "  <field type=\"int32\" name=\"bytes\" />\n"
+    "  <field type=\"variable32\" name=\"name\" />\n"
+    "</ExtentType>\n");
+
+void writeFile(const string &filename) {
+    TestFile out(filename, type_string, 16 * 1024);
+    Int32Field bytes(out.series(), "bytes");
+    Variable32Field name(out.series(), "name");
+    for (int32_t i = 0; i < 50 * 1000; ++i) {
+        out.newRecord();
+        bytes.set(i % 1000);
+        name.set(str(format("row-%d") % i));
+    }
+}
+
+/// sums bytes and checks that name matches the row it came from
+class CheckedSum : public SumBytes {
+  public:
+    CheckedSum(DataSeriesModule &source, const string &where = "")
+        : SumBytes(source), name(series, "name") {
+        if (!where.empty()) {
+            setWhereExpr(where);
+        }
+    }
+
+    virtual void processRow() {
+        int32_t row = stringToInteger<int32_t>(name.stringval().substr(4));
+        INVARIANT(row % 1000 == bytes.val(), format("%s has bytes %d") % name.stringval()
+                  % bytes.val());
+        SumBytes::processRow();
+    }
+
+    Variable32Field name;
+};
+
+/// gets extents through getSharedExtent(), checking that every row has bytes >= min_bytes
+class CheckRows : public DataSeriesModule {
+  public:
+    CheckRows(DataSeriesModule &source, int32_t min_bytes)
+        : source(source), min_bytes(min_bytes), bytes(series, "bytes"), extents(0), rows(0) { }
+
+    virtual Extent::Ptr getSharedExtent() {
+        Extent::Ptr e = source.getSharedExtent();
+        if (e != NULL) {
+            ++extents;
+            for (series.setExtent(e); series.morerecords(); ++series) {
+                SINVARIANT(bytes.val() >= min_bytes);
+                ++rows;
+            }
+            series.clearExtent();
+        }
+        return e;
+    }
+
+    DataSeriesModule &source;
+    const int32_t min_bytes;
+    ExtentSeries series;
+    Int32Field bytes;
+    uint64_t extents, rows;
+};
+
+/// the reference: one analysis with the combined where clause over the unfiltered source
+CheckedSum *direct(const string &where) {
+    TypeIndexModule *source = new TypeIndexModule("Test::Select");
+    source->addSource("select-module.ds");
+    CheckedSum *ret = new CheckedSum(*source, where);
+    ret->getAndDeleteShared();
+    delete source;
+    return ret;
+}
+
+int main() {
+    writeFile("select-module.ds");
+
+    // selection passed through a sequence of analyses, each with its own where clause
+    {
+        boost::scoped_ptr<CheckedSum> outer(direct("bytes < 100"));
+        boost::scoped_ptr<CheckedSum> inner(direct("bytes < 100 && bytes >= 50"));
+        SINVARIANT(outer->count > 0 && inner->count > 0 && inner->count < outer->count);
+
+        TypeIndexModule source("Test::Select");
+        source.addSource("select-module.ds");
+        SequenceModule seq(new SelectModule(source, "bytes < 100"));
+        CheckedSum *first = new CheckedSum(seq.tail());
+        seq.addModule(first);
+        CheckedSum *second = new CheckedSum(seq.tail(), "bytes >= 50");
+        seq.addModule(second);
+        seq.getAndDeleteShared();
+        checkSameSums(*first, *outer, "first");
+        checkSameSums(*second, *inner, "second");
+        SINVARIANT(second->ignored_rows == outer->count - inner->count);
+    }
+
+    // materialized extents hold just the selected rows, including their variable data
+    {
+        boost::scoped_ptr<CheckedSum> expected(direct("bytes >= 900"));
+        TypeIndexModule source("Test::Select");
+        source.addSource("select-module.ds");
+        CheckRows input(source, 0);
+        SelectModule select(input, "bytes >= 900", 16 * 1024);
+        CheckRows from_select(select, 900);
+        CheckedSum sum(from_select);
+        sum.getAndDeleteShared();
+        checkSameSums(sum, *expected, "from select");
+        SINVARIANT(from_select.rows == expected->count);
+        SINVARIANT(select.selected_rows == expected->count && select.input_rows == input.rows);
+        // the copied rows are packed into fewer, fuller extents
+        SINVARIANT(from_select.extents < input.extents);
+    }
+
+    // as do the extents an analysis passes on after a select
+    {
+        boost::scoped_ptr<CheckedSum> expected(direct("bytes < 10"));
+        TypeIndexModule source("Test::Select");
+        source.addSource("select-module.ds");
+        SelectModule select(source, "bytes < 10");
+        CheckedSum sum(select);
+        CheckRows from_analysis(sum, 0);
+        from_analysis.getAndDeleteShared();
+        checkSameSums(sum, *expected, "from analysis");
+        SINVARIANT(from_analysis.rows == expected->count);
+    }
+
+    cout << "select module checks passed\n";
+    return 0;
+}
@@ -0,0 +1,101 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    check that analyses run through a SharedScan get the same results as separate scans, while
+    each type is read only once
+*/
+
+#include <iostream>
+
+#include <boost/format.hpp>
+
+#include <DataSeries/SharedScan.hpp>
+#include <DataSeries/TypeIndexModule.hpp>
+
+#include "TestCommon.hpp"
+
+using namespace std;
+using boost::format;
+
+const string a_type_string(
+    "<ExtentType namespace=\"ssd.hpl.hp.com\" name=\"Test::SharedScanA\" version=\"1.0\" >\n"
+    "  <field type=\"int32\" name=\"bytes\" />\n"
+    "</ExtentType>\n");
+
+const string b_type_string(
+    "<ExtentType namespace=\"ssd.hpl.hp.com\" name=\"Test::SharedScanB\" version=\"1.0\" >\n"
+    "  <field type=\"int32\" name=\"bytes\" />\n"
+    "</ExtentType>\n");
+
+const size_t extent_size = 16 * 1024;
+
+/// many small extents of two types
+void writeFile(const string &filename) {
+    TestFile out(filename, a_type_string, extent_size);
+    size_t b = out.addType(b_type_string, extent_size);
+    Int32Field a_bytes(out.series(), "bytes"), b_bytes(out.series(b), "bytes");
+    for (int32_t i = 0; i < 100 * 1000; ++i) {
+        out.newRecord();
+        a_bytes.set(i % 4096);
+        if (i % 3 == 0) {
+            out.newRecord(b);
+            b_bytes.set(i % 1000);
+        }
+    }
+}
+
+SumBytes *sumAtLeast(DataSeriesModule &source, int32_t min_bytes) {
+    SumBytes *ret = new SumBytes(source);
+    if (min_bytes > 0) {
+        ret->setWhereExpr(str(format("bytes >= %d") % min_bytes));
+    }
+    return ret;
+}
+
+struct Check {
+    string type_match;
+    int32_t min_bytes;
+};
+
+int main() {
+    writeFile("shared-scan.ds");
+    const Check checks[] = {
+        { "Test::SharedScanA", 0 }, { "Test::SharedScanA", 2048 }, { "Test::SharedScanB", 0 },
+        { "Test::SharedScanA", 4000 }, { "Test::SharedScanB", 500 }
+    };
+    const size_t nchecks = sizeof(checks) / sizeof(checks[0]);
+
+    // a small buffer so the analyses have to keep pace with each other
+    SharedScan scan(64 * 1024);
+    for (size_t i = 0; i < nchecks; ++i) {
+        SequenceModule &seq(scan.newAnalysis(checks[i].type_match));
+        seq.addModule(sumAtLeast(seq.tail(), checks[i].min_bytes));
+    }
+    scan.addSource("shared-scan.ds");
+    scan.run();
+    SINVARIANT(scan.analysisCount() == nchecks && scan.scanCount() == 2);
+
+    for (size_t i = 0; i < nchecks; ++i) {
+        TypeIndexModule source(checks[i].type_match);
+        source.addSource("shared-scan.ds");
+        auto_ptr<SumBytes> separate(sumAtLeast(source, checks[i].min_bytes));
+        separate->getAndDeleteShared();
+        SINVARIANT(separate->count > 0);
+
+        checkSameSums(dynamic_cast<SumBytes &>(**(scan.analysis(i).begin() + 1)), *separate,
+                      str(format("analysis %d") % i));
+        SINVARIANT(scan.analysisTypeMatch(i) == checks[i].type_match);
+
+        // each type match was read once, however many analyses it has
+        SINVARIANT(scan.scan(checks[i].type_match).total_uncompressed_bytes
+                   == source.total_uncompressed_bytes);
+    }
+    cout << format("shared scan checks passed, %d analyses over %d scans\n")
+        % scan.analysisCount() % scan.scanCount();
+    return 0;
+}
@@ -0,0 +1,225 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    check HyperLogLog and SpaceSaving against exact answers, and the DistinctCountModule and
+    TopKModule built on them, both on one thread and merged from several
+*/
+
+#include <math.h>
+
+#include <iostream>
+#include <map>
+#include <set>
+
+#include <boost/format.hpp>
+
+#include <Lintel/AssertBoost.hpp>
+
+#include <DataSeries/SketchGroupByModule.hpp>
+#include <DataSeries/TypeIndexModule.hpp>
+
+#include "TestCommon.hpp"
+
+using namespace std;
+using boost::format;
+using dataseries::HyperLogLog;
+using dataseries::SpaceSaving;
+
+uint32_t next(uint32_t &state) {
+    state = state * 1103515245 + 12345;
+    return state >> 8;
+}
+
+void checkHyperLogLog() {
+    const uint32_t counts[] = { 100, 10 * 1000, 1000 * 1000 };
+    for (int c = 0; c < 3; ++c) {
+        HyperLogLog all, parts[4];
+        for (uint32_t i = 0; i < counts[c]; ++i) {
+            for (int repeat = 0; repeat < 2; ++repeat) { // duplicates don't count
+                all.add(&i, sizeof(i));
+                parts[(i + repeat) % 4].add(&i, sizeof(i));
+            }
+        }
+        double relative = fabs(all.estimate() - counts[c]) / counts[c];
+        if (counts[c] < 1000) {
+            SINVARIANT(all.estimate() == counts[c]); // still an exact list of hashes
+        }
+        INVARIANT(relative < 4 * all.error(), format("%d distinct estimated as %.0f")
+                  % counts[c] % all.estimate());
+        SINVARIANT(all.memoryUsage() < 32 * 1024);
+
+        HyperLogLog merged;
+        for (int i = 0; i < 4; ++i) {
+            merged.add(parts[i]);
+        }
+        SINVARIANT(merged.estimate() == all.estimate());
+        cout << format("hyperloglog: %d distinct estimated as %.0f in %d bytes\n")
+            % counts[c] % all.estimate() % all.memoryUsage();
+    }
+}
+
+/// every heavy hitter is present, and every count is an upper bound within its error
+void checkSpaceSaving(const SpaceSaving &sketch, const map<uint32_t, double> &exact,
+                      double total) {
+    vector<SpaceSaving::Entry> top;
+    sketch.top(top);
+    SINVARIANT(top.size() == sketch.capacity() && sketch.total() == total);
+    set<uint32_t> found;
+    for (vector<SpaceSaving::Entry>::iterator i = top.begin(); i != top.end(); ++i) {
+        SINVARIANT(i->key.size() == sizeof(uint32_t));
+        uint32_t key = *reinterpret_cast<const uint32_t *>(i->key.data());
+        double actual = exact.find(key)->second;
+        INVARIANT(i->count - i->error <= actual && actual <= i->count,
+                  format("key %d: count %g error %g actual %g") % key % i->count % i->error
+                  % actual);
+        found.insert(key);
+    }
+    for (map<uint32_t, double>::const_iterator i = exact.begin(); i != exact.end(); ++i) {
+        if (i->second > total / sketch.capacity()) {
+            INVARIANT(found.count(i->first) == 1, format("missed heavy hitter %d") % i->first);
+        }
+    }
+}
+
+void checkSpaceSaving() {
+    uint32_t state = 1;
+    SpaceSaving all(50), parts[3] = { SpaceSaving(50), SpaceSaving(50), SpaceSaving(50) };
+    map<uint32_t, double> exact;
+    double total = 0;
+    for (int i = 0; i < 200 * 1000; ++i) {
+        // skewed: small keys are much more common
+        uint32_t key = next(state) % 10000;
+        key = key * key / (10000 * 10);
+        double weight = 1 + i % 3;
+        all.add(&key, sizeof(key), weight);
+        parts[i % 3].add(&key, sizeof(key), weight);
+        exact[key] += weight;
+        total += weight;
+    }
+    checkSpaceSaving(all, exact, total);
+
+    SpaceSaving merged(50);
+    for (int i = 0; i < 3; ++i) {
+        merged.add(parts[i]);
+    }
+    checkSpaceSaving(merged, exact, total);
+    cout << format("space saving: %d distinct keys in %d bytes\n")
+        % exact.size() % merged.memoryUsage();
+}
+
+const string type_string(
+    "<ExtentType namespace=\"ssd.hpl.hp.com\" name=\"Test::SketchGroupBy\" version=\"1.0\" >\n"
+    "  <field type=\"int32\" name=\"client\" />\n"
+    "  <field type=\"variable32\" name=\"file\" />\n"
+    "  <field type=\"int64\" name=\"bytes\" />\n"
+    "</ExtentType>\n");
+
+const int32_t nrows = 100 * 1000;
+
+struct Expected {
+    map<int32_t, set<string> > files; // by client
+    map<int32_t, map<string, int64_t> > file_bytes; // by client
+};
+
+void writeFile(const string &filename, Expected &expected) {
+    TestFile out(filename, type_string, 16 * 1024);
+    Int32Field client(out.series(), "client");
+    Variable32Field file(out.series(), "file");
+    Int64Field bytes(out.series(), "bytes");
+    uint32_t state = 2;
+    for (int32_t i = 0; i < nrows; ++i) {
+        // client 0 sees many files, the rest only a few, so both sparse and dense sketches
+        int32_t c = i % 5;
+        string f = str(format("file-%d") % (next(state) % (c == 0 ? 50000 : 20 * c)));
+        out.newRecord();
+        client.set(c);
+        file.set(f);
+        bytes.set(i % 1000);
+        expected.files[c].insert(f);
+        expected.file_bytes[c][f] += i % 1000;
+    }
+}
+
+class SketchFactory : public ParallelRowAnalysisModule::Factory {
+  public:
+    SketchFactory(const string &stat_type, const string &where_expr)
+        : stat_type(stat_type), where_expr(where_expr) { }
+
+    virtual ParallelRowAnalysisModule::Analysis *operator()(DataSeriesModule &source) {
+        return SketchGroupByModule::make(source, stat_type, "file", strings("client"),
+                                         where_expr);
+    }
+
+    const string stat_type, where_expr;
+};
+
+/// run on one thread, check against expected, and return the printed result
+string checkDistinct(Expected &expected) {
+    TypeIndexModule source("Test::SketchGroupBy");
+    source.addSource("sketch-group-by.ds");
+    DistinctCountModule distinct(source, strings("file"), strings("client"));
+    distinct.getAndDeleteShared();
+    SINVARIANT(distinct.groupCount() == expected.files.size());
+    // groups are numbered in order of appearance, which is client order here
+    for (uint32_t c = 0; c < distinct.groupCount(); ++c) {
+        double actual = expected.files[c].size();
+        INVARIANT(fabs(distinct.estimate(c) - actual) <= 0.04 * actual,
+                  format("client %d: %.0f distinct files estimated as %.0f")
+                  % c % actual % distinct.estimate(c));
+    }
+    return captureResult(distinct);
+}
+
+string checkTopK(Expected &expected) {
+    TypeIndexModule source("Test::SketchGroupBy");
+    source.addSource("sketch-group-by.ds");
+    // without client 0, at most 80 files per client, so exact
+    TopKModule topk(source, strings("file"), strings("client"), 100, "bytes", "client != 0");
+    topk.getAndDeleteShared();
+    SINVARIANT(topk.groupCount() == expected.file_bytes.size() - 1);
+    vector<dataseries::SpaceSaving::Entry> top;
+    vector<GeneralValue> value;
+    for (uint32_t c = 1; c <= topk.groupCount(); ++c) {
+        topk.top(c - 1, top);
+        SINVARIANT(top.size() == expected.file_bytes[c].size());
+        for (vector<dataseries::SpaceSaving::Entry>::iterator i = top.begin();
+             i != top.end(); ++i) {
+            topk.decodeValue(i->key, value);
+            SINVARIANT(value.size() == 1 && i->error == 0
+                       && i->count == expected.file_bytes[c][value[0].valString()]);
+        }
+    }
+    return captureResult(topk);
+}
+
+void checkParallel(const string &stat_type, const string &where_expr,
+                   const string &expected) {
+    TypeIndexModule source("Test::SketchGroupBy");
+    source.addSource("sketch-group-by.ds");
+    SketchFactory factory(stat_type, where_expr);
+    ParallelRowAnalysisModule parallel(source, factory, 4);
+    parallel.getAndDeleteShared();
+    string got(captureResult(parallel));
+    INVARIANT(got == expected, format("%s got:\n%s\nexpected:\n%s") % stat_type % got
+              % expected);
+}
+
+int main() {
+    checkHyperLogLog();
+    checkSpaceSaving();
+
+    Expected expected;
+    writeFile("sketch-group-by.ds", expected);
+    // merging distinct count sketches is exact, as is top k with room for every value
+    checkParallel("distinct", "", checkDistinct(expected));
+    string topk(checkTopK(expected));
+    SINVARIANT(topk.find("# top 100 (file) by sum(bytes) group by client\n") != string::npos);
+    checkParallel("topk:bytes", "client != 0", topk);
+    cout << "sketch group by checks passed\n";
+    return 0;
+}
@@ -0,0 +1,175 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    check DSStatGroupByModule with several statistics and a multi-column key, both on one
+    thread and merged from several, and grouping by a double with a base
+*/
+
+#include <iostream>
+#include <map>
+
+#include <boost/format.hpp>
+
+#include <Lintel/Stats.hpp>
+
+#include <DataSeries/DSStatGroupByModule.hpp>
+#include <DataSeries/TypeIndexModule.hpp>
+
+#include "TestCommon.hpp"
+
+using namespace std;
+using namespace client_ops;
+using boost::format;
+
+const int32_t nrows = 50 * 1000, nclients = 41;
+
+struct Expected {
+    Stats all_bytes;
+    map<pair<int32_t, string>, pair<Stats, Stats> > groups; // bytes, bytes * 2
+};
+
+void expectStats(Expected &expected) {
+    for (int32_t i = 0; i < nrows; ++i) {
+        expected.all_bytes.add(bytesOf(i));
+        if (bytesOf(i) > 10) {
+            pair<Stats, Stats> &group(expected.groups[make_pair(clientOf(i, nclients), opOf(i))]);
+            group.first.add(bytesOf(i));
+            group.second.add(bytesOf(i) * 2);
+        }
+    }
+}
+
+string basicRow(Stats &stat) {
+    return str(format("%1%, %2$.6g, %3$.6g, %4$.6g, %5$.6g\n")
+               % stat.count() % stat.mean() % stat.stddev() % stat.min() % stat.max());
+}
+
+string expectedGrouped(Expected &expected) {
+    int64_t selected = 0;
+    string rows[2];
+    for (map<pair<int32_t, string>, pair<Stats, Stats> >::iterator i = expected.groups.begin();
+         i != expected.groups.end(); ++i) {
+        GeneralValue op; // printed as the module prints it: binary strings in hex
+        if (!i->first.second.empty()) {
+            op.setVariable32(i->first.second);
+        }
+        string key = str(format("%d, %s, ") % i->first.first % op);
+        rows[0] += key + basicRow(i->second.first);
+        rows[1] += key + basicRow(i->second.second);
+        selected += i->second.first.count();
+    }
+    string ret;
+    const char *exprs[] = { "bytes", "bytes * 2" };
+    for (int i = 0; i < 2; ++i) {
+        ret += str(format("%s# Begin DSStatGroupByModule\n"
+                          "# processed %d rows, where clause eliminated %d rows\n"
+                          "# client, op, count(*), mean(%s), stddev, min, max\n")
+                   % (i > 0 ? "\n" : "") % selected % (nrows - selected) % exprs[i]);
+        ret += rows[i] + "# End DSStatGroupByModule\n";
+    }
+    return ret;
+}
+
+void checkEqual(const string &got, const string &expected) {
+    INVARIANT(got == expected, format("got:\n%s\nexpected:\n%s") % got % expected);
+}
+
+class StatFactory : public ParallelRowAnalysisModule::Factory {
+  public:
+    virtual ParallelRowAnalysisModule::Analysis *operator()(DataSeriesModule &source) {
+        return new DSStatGroupByModule(source, strings("bytes", "bytes * 2"),
+                                       strings("basic", "basic"), strings("client", "op"),
+                                       "bytes > 10");
+    }
+};
+
+void checkUngrouped(Expected &expected) {
+    TypeIndexModule source("Test::ClientOps");
+    source.addSource("stat-group-by.ds");
+    DSStatGroupByModule stat(source, "bytes", "");
+    stat.getAndDeleteShared();
+    checkEqual(captureResult(stat),
+               str(format("# Begin DSStatGroupByModule\n"
+                          "# processed %d rows, where clause eliminated 0 rows\n"
+                          "# count(*), mean(bytes), stddev, min, max\n"
+                          "%s# End DSStatGroupByModule\n")
+                   % nrows % basicRow(expected.all_bytes)));
+}
+
+void checkGrouped(Expected &expected) {
+    TypeIndexModule source("Test::ClientOps");
+    source.addSource("stat-group-by.ds");
+    StatFactory factory;
+    auto_ptr<ParallelRowAnalysisModule::Analysis> stat(factory(source));
+    stat->getAndDeleteShared();
+    SINVARIANT(dynamic_cast<DSStatGroupByModule &>(*stat).groupCount()
+               == expected.groups.size());
+    checkEqual(captureResult(*stat), expectedGrouped(expected));
+}
+
+void checkParallel(Expected &expected, int nthreads) {
+    TypeIndexModule source("Test::ClientOps");
+    source.addSource("stat-group-by.ds");
+    StatFactory factory;
+    ParallelRowAnalysisModule parallel(source, factory, nthreads);
+    parallel.getAndDeleteShared();
+    checkEqual(captureResult(parallel), expectedGrouped(expected));
+}
+
+const string timed_type_xml(
+    "<ExtentType namespace=\"ssd.hpl.hp.com\" name=\"Test::Timed\" version=\"1.0\" >\n"
+    "  <field type=\"double\" name=\"when\" opt_doublebase=\"1000000\" />\n"
+    "  <field type=\"int32\" name=\"bytes\" />\n"
+    "</ExtentType>\n");
+
+/// groups of a double field with a base are keyed and printed by the absolute value
+void checkDoubleBase() {
+    const int32_t ntimed = 1000;
+    {
+        TestFile out("stat-group-by-base.ds", timed_type_xml, 4 * 1024);
+        DoubleField when(out.series(), "when", DoubleField::flag_allownonzerobase);
+        Int32Field bytes(out.series(), "bytes");
+        for (int32_t i = 0; i < ntimed; ++i) {
+            out.newRecord();
+            when.setabs(1000000 + (i % 4) * 0.5);
+            bytes.set(i % 10);
+        }
+    }
+    TypeIndexModule source("Test::Timed");
+    source.addSource("stat-group-by-base.ds");
+    DSStatGroupByModule stat(source, strings("bytes"), strings("basic"), strings("when"), "");
+    stat.getAndDeleteShared();
+
+    Stats groups[4];
+    for (int32_t i = 0; i < ntimed; ++i) {
+        groups[i % 4].add(i % 10);
+    }
+    string rows;
+    for (int i = 0; i < 4; ++i) {
+        GeneralValue when;
+        when.setDouble(1000000 + i * 0.5);
+        rows += str(format("%s, ") % when) + basicRow(groups[i]);
+    }
+    checkEqual(captureResult(stat),
+               str(format("# Begin DSStatGroupByModule\n"
+                          "# processed %d rows, where clause eliminated 0 rows\n"
+                          "# when, count(*), mean(bytes), stddev, min, max\n"
+                          "%s# End DSStatGroupByModule\n") % ntimed % rows));
+}
+
+int main() {
+    Expected expected;
+    writeFile("stat-group-by.ds", nrows, nclients, 16 * 1024);
+    expectStats(expected);
+    checkUngrouped(expected);
+    checkGrouped(expected);
+    checkParallel(expected, 4);
+    checkDoubleBase();
+    cout << format("stat group by checks passed, %d groups\n") % expected.groups.size();
+    return 0;
+}
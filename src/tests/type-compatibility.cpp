@@ -0,0 +1,145 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    check that TypeIndexModule skips files without the matched type, and with typeLoose
+    compatibility reads files holding different versions of it
+*/
+
+#include <algorithm>
+#include <iostream>
+#include <set>
+
+#include <boost/format.hpp>
+
+#include <DataSeries/TypeIndexModule.hpp>
+
+#include "TestCommon.hpp"
+
+using namespace std;
+using boost::format;
+
+const string v1_type_string(
+    "<ExtentType namespace=\"ssd.hpl.hp.com\" name=\"Test::TypeCompat\" version=\"1.0\" >\n"
+    "  <field type=\"int64\" name=\"id\" />\n"
+    "  <field type=\"int32\" name=\"bytes\" />\n"
+    "</ExtentType>\n");
+
+// reordered, with a new field
+const string v2_type_string(
+    "<ExtentType namespace=\"ssd.hpl.hp.com\" name=\"Test::TypeCompat\" version=\"1.1\" >\n"
+    "  <field type=\"variable32\" name=\"name\" />\n"
+    "  <field type=\"int32\" name=\"bytes\" />\n"
+    "  <field type=\"int64\" name=\"id\" />\n"
+    "</ExtentType>\n");
+
+const string other_type_string(
+    "<ExtentType namespace=\"ssd.hpl.hp.com\" name=\"Test::Other\" version=\"1.0\" >\n"
+    "  <field type=\"int64\" name=\"id\" />\n"
+    "  <field type=\"int32\" name=\"bytes\" />\n"
+    "</ExtentType>\n");
+
+const int32_t nrows = 20000;
+
+/// write rows with ids [first, first + nrows) and bytes id % 1000
+void writeFile(const string &filename, const string &type_string, int64_t first) {
+    TestFile out(filename, type_string, 16 * 1024);
+    Int64Field id(out.series(), "id");
+    Int32Field bytes(out.series(), "bytes");
+    for (int64_t i = first; i < first + nrows; ++i) {
+        out.newRecord();
+        id.set(i);
+        bytes.set(i % 1000);
+    }
+}
+
+struct Totals {
+    int64_t rows, id_sum, bytes_sum;
+    size_t types;
+};
+
+Totals readFiles(const vector<string> &files, ExtentSeries::typeCompatibilityT tc) {
+    TypeIndexModule source("Test::TypeCompat");
+    source.setTypeCompatibility(tc);
+    for (vector<string>::const_iterator i = files.begin(); i != files.end(); ++i) {
+        source.addSource(*i);
+    }
+    ExtentSeries series(tc);
+    Int64Field id(series, "id");
+    Int32Field bytes(series, "bytes");
+    Totals ret = { 0, 0, 0, 0 };
+    set<ExtentType::Ptr> types;
+    for (Extent::Ptr e = source.getSharedExtent(); e != NULL; e = source.getSharedExtent()) {
+        SINVARIANT(e->getTypePtr()->getName() == "Test::TypeCompat");
+        types.insert(e->getTypePtr());
+        for (series.setExtent(e); series.morerecords(); ++series) {
+            ++ret.rows;
+            ret.id_sum += id.val();
+            ret.bytes_sum += bytes.val();
+        }
+    }
+    series.clearExtent();
+    ret.types = types.size();
+    return ret;
+}
+
+/// the totals of ids [first, first + nrows)
+Totals expected(int64_t first) {
+    Totals ret = { nrows, 0, 0, 1 };
+    for (int64_t i = first; i < first + nrows; ++i) {
+        ret.id_sum += i;
+        ret.bytes_sum += i % 1000;
+    }
+    return ret;
+}
+
+void checkTotals(const Totals &got, const Totals &want, const string &what) {
+    INVARIANT(got.rows == want.rows && got.id_sum == want.id_sum
+              && got.bytes_sum == want.bytes_sum && got.types == want.types,
+              format("%s: %d rows of %d types, sums %d/%d; expected %d rows of %d types, %d/%d")
+              % what % got.rows % got.types % got.id_sum % got.bytes_sum % want.rows
+              % want.types % want.id_sum % want.bytes_sum);
+}
+
+int main() {
+    writeFile("type-compat-v1.ds", v1_type_string, 0);
+    writeFile("type-compat-v1b.ds", v1_type_string, nrows);
+    writeFile("type-compat-v2.ds", v2_type_string, 2 * nrows);
+    writeFile("type-compat-other.ds", other_type_string, 3 * nrows);
+
+    Totals first(expected(0)), second(expected(nrows)), third(expected(2 * nrows));
+    Totals both_v1(first), all(first);
+    both_v1.rows += second.rows;
+    both_v1.id_sum += second.id_sum;
+    both_v1.bytes_sum += second.bytes_sum;
+    all.rows += third.rows;
+    all.id_sum += third.id_sum;
+    all.bytes_sum += third.bytes_sum;
+    all.types = 2;
+
+    // files without the type are skipped, whatever the compatibility
+    vector<string> files;
+    files.push_back("type-compat-other.ds");
+    files.push_back("type-compat-v1.ds");
+    files.push_back("type-compat-other.ds");
+    files.push_back("type-compat-v1b.ds");
+    checkTotals(readFiles(files, ExtentSeries::typeExact), both_v1, "exact, same version");
+    checkTotals(readFiles(files, ExtentSeries::typeLoose), both_v1, "loose, same version");
+
+    files.clear();
+    files.push_back("type-compat-v1.ds");
+    files.push_back("type-compat-other.ds");
+    files.push_back("type-compat-v2.ds");
+    checkTotals(readFiles(files, ExtentSeries::typeLoose), all, "loose, two versions");
+
+    // the type is resolved per file, so the later version can come first
+    reverse(files.begin(), files.end());
+    checkTotals(readFiles(files, ExtentSeries::typeLoose), all, "loose, reversed");
+
+    cout << "type compatibility checks passed\n";
+    return 0;
+}
@@ -0,0 +1,91 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    check that prefetching with unordered set returns every extent of a file exactly once,
+    marked with where it came from
+*/
+
+#include <iostream>
+#include <map>
+
+#include <boost/format.hpp>
+
+#include <DataSeries/TypeIndexModule.hpp>
+
+#include "TestCommon.hpp"
+
+using namespace std;
+using boost::format;
+
+const string type_string(
+    "<ExtentType namespace=\"ssd.hpl.hp.com\" name=\"Test::Unordered\" version=\"1.0\" >\n"
+    "  <field type=\"int64\" name=\"id\" />\n"
+    "  <field type=\"variable32\" name=\"name\" />\n"
+    "</ExtentType>\n");
+
+const int64_t nrows = 200 * 1000;
+
+void writeFile(const string &filename) {
+    TestFile out(filename, type_string, 8 * 1024);
+    Int64Field id(out.series(), "id");
+    Variable32Field name(out.series(), "name");
+    for (int64_t i = 0; i < nrows; ++i) {
+        out.newRecord();
+        id.set(i);
+        // slower to unpack in some extents than others
+        name.set(str(format("name-%d") % (i % 3000 < 1000 ? i : i % 7)));
+    }
+}
+
+/// first id of each extent by its offset in the file
+typedef map<int64_t, int64_t> Extents;
+
+Extents readFile(const string &filename, bool unordered, uint32_t &out_of_order) {
+    TypeIndexModule source("Test::Unordered");
+    source.addSource(filename);
+    source.startPrefetching(1024 * 1024, 4 * 1024 * 1024, 4, unordered);
+    ExtentSeries series;
+    Int64Field id(series, "id");
+    Extents ret;
+    int64_t rows = 0, prev_offset = -1;
+    out_of_order = 0;
+    for (Extent::Ptr e = source.getSharedExtent(); e != NULL; e = source.getSharedExtent()) {
+        SINVARIANT(e->extent_source == filename && e->extent_source_offset > 0);
+        if (e->extent_source_offset < prev_offset) {
+            ++out_of_order;
+        }
+        prev_offset = e->extent_source_offset;
+        series.setExtent(e);
+        SINVARIANT(series.morerecords());
+        INVARIANT(ret.insert(make_pair(e->extent_source_offset, id.val())).second,
+                  format("extent at %d returned twice") % e->extent_source_offset);
+        int64_t first = id.val();
+        for (; series.morerecords(); ++series, ++rows) {
+            SINVARIANT(id.val() == first++);
+        }
+    }
+    series.clearExtent();
+    SINVARIANT(rows == nrows);
+    return ret;
+}
+
+int main() {
+    writeFile("unordered-prefetch.ds");
+    uint32_t out_of_order;
+    Extents ordered(readFile("unordered-prefetch.ds", false, out_of_order));
+    SINVARIANT(out_of_order == 0 && ordered.size() > 10);
+
+    for (int i = 0; i < 5; ++i) {
+        Extents unordered(readFile("unordered-prefetch.ds", true, out_of_order));
+        INVARIANT(unordered == ordered, format("unordered read got %d extents, not %d")
+                  % unordered.size() % ordered.size());
+        cout << format("%d extents, %d out of order\n") % unordered.size() % out_of_order;
+    }
+    cout << "unordered prefetch checks passed\n";
+    return 0;
+}
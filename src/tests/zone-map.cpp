@@ -0,0 +1,218 @@
+// -*-C++-*-
+/*
+  (c) Copyright 2013, Hewlett-Packard Development Company, LP
+
+  See the file named COPYING for license details
+*/
+
+/** @file
+    check that zone maps are written and that TypeIndexModule skips only extents that can't
+    match
+*/
+
+#include <iostream>
+
+#include <boost/format.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include <DataSeries/DSExpr.hpp>
+#include <DataSeries/GeneralField.hpp>
+#include <DataSeries/TypeIndexModule.hpp>
+#include <DataSeries/ZoneMap.hpp>
+
+#include "TestCommon.hpp"
+
+using namespace std;
+using boost::format;
+using dataseries::ExtentZones;
+using dataseries::FieldZone;
+using dataseries::ZoneMap;
+
+const string type_string(
+    "<ExtentType namespace=\"ssd.hpl.hp.com\" name=\"Test::ZoneMap\" version=\"1.0\" >\n"
+    "  <field type=\"int64\" name=\"t\" />\n"
+    "  <field type=\"double\" name=\"d\" opt_nullable=\"yes\" />\n"
+    "  <field type=\"variable32\" name=\"s\" />\n"
+    "</ExtentType>\n");
+
+const int32_t nrows = 50 * 1000;
+
+void writeFile(const string &filename, bool zones) {
+    TestFile out(filename, type_string, 16 * 1024);
+    if (zones) {
+        vector<string> fields;
+        fields.push_back("t");
+        fields.push_back("d");
+        fields.push_back("s");
+        out.sink.setZoneMapFields("Test::ZoneMap", fields);
+    }
+
+    Int64Field t(out.series(), "t");
+    DoubleField d(out.series(), "d", Field::flag_nullable);
+    Variable32Field s(out.series(), "s");
+    for (int32_t i = 0; i < nrows; ++i) {
+        out.newRecord();
+        t.set(i);
+        if (i < 20000) {
+            d.setNull();
+        } else {
+            d.set(i * 0.25);
+        }
+        s.set((format("k%05d") % (i / 100)).str());
+    }
+}
+
+/// rows of filename matching expr, and how many extents were skipped
+int32_t countRows(const string &filename, const string &expr, bool use_zones,
+                  uint64_t &skipped, int32_t &extents) {
+    TypeIndexModule source("Test::ZoneMap");
+    source.addSource(filename);
+    if (use_zones) {
+        source.setZonePredicate(expr);
+    }
+    ExtentSeries series;
+    int32_t ret = 0;
+    extents = 0;
+    boost::scoped_ptr<DSExpr> filter;
+    while (true) {
+        Extent::Ptr e(source.getSharedExtent());
+        if (e == NULL) {
+            break;
+        }
+        ++extents;
+        series.setExtent(e);
+        if (filter == NULL) {
+            filter.reset(DSExpr::make(series, expr));
+        }
+        for (; series.more(); series.next()) {
+            if (filter->valBool()) {
+                ++ret;
+            }
+        }
+    }
+    filter.reset();
+    skipped = source.getZoneSkippedExtents();
+    return ret;
+}
+
+void checkPredicate(const string &expr, bool expect_skips) {
+    uint64_t skipped = 0, plain_skipped = 0;
+    int32_t extents = 0, plain_extents = 0;
+    int32_t rows = countRows("zone-map.ds", expr, true, skipped, extents);
+    int32_t plain_rows = countRows("zone-map.ds", expr, false, plain_skipped, plain_extents);
+    INVARIANT(rows == plain_rows, format("'%s': %d rows with zone maps, %d without")
+              % expr % rows % plain_rows);
+    SINVARIANT(plain_skipped == 0 && extents + skipped == static_cast<uint64_t>(plain_extents));
+    INVARIANT(expect_skips == (skipped > 0), format("'%s' skipped %d of %d extents")
+              % expr % skipped % plain_extents);
+    cout << format("'%s': %d rows, skipped %d of %d extents\n") % expr % rows % skipped
+        % plain_extents;
+
+    countRows("zone-map-none.ds", expr, true, skipped, extents);
+    SINVARIANT(skipped == 0);
+}
+
+void checkZones() {
+    DataSeriesSource source("zone-map.ds");
+    map<int64_t, ExtentZones> zones;
+    SINVARIANT(ZoneMap::read(source, zones));
+    SINVARIANT(zones.size() > 2);
+    uint32_t rows = 0, nulls = 0;
+    int64_t expect_min = 0;
+    for (map<int64_t, ExtentZones>::iterator i = zones.begin(); i != zones.end(); ++i) {
+        SINVARIANT(i->second.size() == 3);
+        const FieldZone &t(i->second["t"]);
+        SINVARIANT(t.nulls == 0 && t.min.valInt64() == expect_min
+                   && t.max.valInt64() == expect_min + t.rows - 1);
+        expect_min += t.rows;
+        rows += t.rows;
+        nulls += i->second["d"].nulls;
+        SINVARIANT(i->second["s"].min.getType() == ExtentType::ft_variable32);
+    }
+    SINVARIANT(rows == static_cast<uint32_t>(nrows) && nulls == 20000);
+
+    FieldZone &first(zones.begin()->second["d"]);
+    SINVARIANT(!first.hasRange() && first.nulls == first.rows);
+    GeneralValue zero, one;
+    zero.setDouble(0);
+    one.setDouble(1);
+    SINVARIANT(ZoneMap::mayOverlap(first, zero, zero) && !ZoneMap::mayOverlap(first, one, one));
+
+    DataSeriesSource plain("zone-map-none.ds");
+    SINVARIANT(!ZoneMap::read(plain, zones) && zones.empty());
+}
+
+void checkRanges() {
+    TypeIndexModule source("Test::ZoneMap");
+    source.addSource("zone-map.ds");
+    GeneralValue lo, hi;
+    lo.setVariable32("k00100");
+    hi.setVariable32("k00101");
+    source.addZoneRange("s", lo, hi);
+    int32_t extents = 0;
+    while (source.getSharedExtent() != NULL) {
+        ++extents;
+    }
+    SINVARIANT(extents >= 1 && extents <= 2 && source.getZoneSkippedExtents() > 0);
+}
+
+/** Copy from to to as a tool that doesn't know about zone maps would: repacking the rows into
+    extents of another size, after another type in the library, and copying the zone maps as
+    they are.  Readers must ignore the zones, which are for the offsets in from. */
+void checkCopiedZones(const string &from, const string &to) {
+    {
+        TestFile out(to, "<ExtentType namespace=\"ssd.hpl.hp.com\" name=\"Test::ZoneMapPad\""
+                     " version=\"1.0\" >\n  <field type=\"int32\" name=\"pad\" />\n"
+                     "</ExtentType>\n", 16 * 1024);
+        size_t rows = out.addType(type_string, 24 * 1024);
+        out.addType(ZoneMap::extentType()->getXmlDescriptionString(), 16 * 1024);
+
+        TypeIndexModule source("Test::ZoneMap");
+        source.addSource(from);
+        ExtentSeries series;
+        ExtentRecordCopy copy(series, out.series(rows));
+        for (Extent::Ptr e = source.getSharedExtent(); e != NULL; e = source.getSharedExtent()) {
+            for (series.setExtent(e); series.more(); series.next()) {
+                out.newRecord(rows);
+                copy.copyRecord();
+            }
+        }
+        series.clearExtent();
+
+        TypeIndexModule zones(ZoneMap::extentType()->getName());
+        zones.addSource(from);
+        for (Extent::Ptr e = zones.getSharedExtent(); e != NULL; e = zones.getSharedExtent()) {
+            out.sink.writeExtent(*e, NULL);
+        }
+    }
+
+    DataSeriesSource source(to);
+    map<int64_t, ExtentZones> zones;
+    SINVARIANT(ZoneMap::read(source, zones) && zones.empty());
+
+    uint64_t skipped = 0;
+    int32_t extents = 0;
+    const string expr("t >= 10000 && t < 12000");
+    int32_t rows = countRows(to, expr, true, skipped, extents);
+    SINVARIANT(rows == 2000 && skipped == 0);
+}
+
+int main() {
+    writeFile("zone-map.ds", true);
+    writeFile("zone-map-none.ds", false);
+
+    checkZones();
+    checkPredicate("t >= 10000 && t < 12000", true);
+    checkPredicate("!(t < 49000)", true);
+    checkPredicate("1000 > t || t == 30000", true);
+    checkPredicate("s == \"k00042\"", true);
+    checkPredicate("d > 11000", true);
+    checkPredicate("d == 0", true); // nulls read as 0
+    checkPredicate("t >= 0", false);
+    checkPredicate("t != 17", false);
+    checkPredicate("t * 2 < 100", false); // not a plain field comparison
+    checkRanges();
+    checkCopiedZones("zone-map.ds", "zone-map-copy.ds");
+    cout << "zone map checks passed\n";
+    return 0;
+}